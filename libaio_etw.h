@@ -0,0 +1,37 @@
+#pragma once
+
+/**
+ * @file libaio_etw.h
+ * @brief The ETW events libaio-win32 writes, for consumers such as aio-etw.
+ *
+ * The library is a TraceLogging provider named AIO_ETW_PROVIDER_NAME. Its GUID is the standard
+ * hash of that name, so tools that accept `*LibaioWin32` find it as well. Until a session enables
+ * the provider, each event costs one load and branch, and its fields are not evaluated.
+ *
+ * Events are told apart by their opcode. Each event's fields are fixed-size and are written in the
+ * order listed below, so a consumer can read the user data as a packed sequence of little-endian
+ * values without decoding the TraceLogging metadata. `ctx` and `iocb` are addresses widened to
+ * 64 bits. `opcode` is the iocb's IO_CMD_* value. Latencies are measured from the io_submit call
+ * that accepted the iocb.
+ */
+
+#include <stdint.h>
+
+#define AIO_ETW_PROVIDER_NAME "LibaioWin32"
+/// {5a17318e-1316-5b83-fb8e-4917289dceec}
+#define AIO_ETW_PROVIDER_GUID (0x5a17318e, 0x1316, 0x5b83, 0xfb, 0x8e, 0x49, 0x17, 0x28, 0x9d, 0xce, 0xec)
+
+/// Keywords; enable both to see every event.
+#define AIO_ETW_KEYWORD_SUBMIT   0x1ULL   ///< Setup, Submit and Issue.
+#define AIO_ETW_KEYWORD_COMPLETE 0x2ULL   ///< Complete, SegmentComplete, VectoredComplete and Reap.
+
+/// Event opcodes. Setup is written at the informational level, the rest at the verbose level.
+enum {
+    AIO_ETW_SETUP = 10,     ///< io_setup created a context: ctx, serial (u32), maxevents (i32).
+    AIO_ETW_SUBMIT = 11,    ///< io_submit accepted an iocb: ctx, iocb, fd (i32), opcode (u32), offset (i64), length (u64).
+    AIO_ETW_ISSUE = 12,     ///< The engine handed a request to the OS: ctx, iocb, backend (u32), offset (i64), length (u64), queued_ns (u64).
+    AIO_ETW_COMPLETE = 13,  ///< io_getevents dequeued a whole request: ctx, iocb, opcode (u32), bytes (u64), error (u32), latency_ns (u64).
+    AIO_ETW_SEGMENT_COMPLETE = 14, ///< io_getevents dequeued one segment of a vectored iocb; fields as for Complete.
+    AIO_ETW_VECTORED_COMPLETE = 15, ///< The last segment of a vectored iocb completed: ctx, iocb, opcode (u32), segments (u32), bytes (u64), error (u32), latency_ns (u64).
+    AIO_ETW_REAP = 16,      ///< io_getevents returned: ctx, min_nr (i64), nr (i64), events (i64), wait_ns (u64).
+};
@@ -0,0 +1,646 @@
+/**
+ * @file libaio_linux.cpp
+ * @brief libaio-linux: the libaio API on Linux, over kernel AIO for O_DIRECT files and a worker
+ * pool for everything else.
+ *
+ * Kernel AIO is only asynchronous for files opened with O_DIRECT. On a buffered file, io_submit
+ * performs the transfer before it returns, so a queue depth of 64 becomes 64 synchronous reads in
+ * the submitting thread. This library exports libaio's functions with libaio's ABI, so an
+ * application links it instead of libaio and keeps its source and its iocbs. Each read or write
+ * goes to the kernel when its descriptor has O_DIRECT set, which fcntl(F_GETFL) tells at submission,
+ * and to a process-wide pool of worker threads otherwise. Syncs always run on the pool, since
+ * IOCB_CMD_FSYNC needs Linux 4.18 and is synchronous on most file systems even there.
+ *
+ * Vectored requests need no emulation: the kernel takes IOCB_CMD_PREADV and IOCB_CMD_PWRITEV as
+ * they are, and the pool runs them with one preadv2 or pwritev2 call. Requests carry their
+ * `aio_rw_flags` to either engine.
+ *
+ * Both engines signal one eventfd per context. The kernel does so for each request submitted with
+ * IOCB_FLAG_RESFD; a worker after queuing its completion. io_getevents takes what the pool has
+ * finished, then polls the kernel's ring without blocking, and sleeps in ppoll on the eventfd
+ * until enough has arrived.
+ */
+
+#define LIBAIO_LINUX_ENGINE
+#include "libaio_win32.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#define LIO_API extern "C" __attribute__((visibility("default")))
+
+/// The kernel's aio_context_t: the address of its completion ring in this process.
+typedef unsigned long KernelContext;
+
+/// IOCB_FLAG_RESFD from linux/aio_abi.h, which cannot be included beside libaio.h.
+static const unsigned KERNEL_FLAG_RESFD = 1u << 0;
+
+/// Records allocated at once when a context's free list runs out.
+static const unsigned RECORD_CHUNK = 64;
+
+struct LinuxContext;
+
+/**
+ * @struct LinuxRequest
+ * @brief One submitted iocb, from io_submit until its event is reaped.
+ *
+ * `cb` is a copy of the caller's iocb, taken at submission. A request bound for the kernel is
+ * submitted as that copy, whose `data` points back here and which signals the context's eventfd;
+ * kernel events therefore name the copy, and io_getevents restores the caller's iocb and data from
+ * the record. A pool request runs from the copy, and from `vec`, a copy of its iovec array, so the
+ * caller may reuse both once io_submit returns, as kernel AIO allows.
+ */
+struct LinuxRequest {
+    struct iocb cb;
+    std::vector<struct iovec> vec;  ///< A vectored pool request's segments; keeps its capacity for reuse.
+    struct iocb* caller;
+    LinuxContext* ctx;
+    LinuxRequest* next;     ///< Next free record, or next request in the pool's queue.
+    bool kernel;            ///< Submitted to the kernel rather than queued for the pool.
+};
+
+/**
+ * @struct LinuxContext
+ * @brief What io_context_t points to: a kernel AIO context, an eventfd, and the pool's completions.
+ *
+ * `lock` guards everything below it. The pool's completions wait in `completed` in the order the
+ * workers finished them.
+ */
+struct LinuxContext {
+    KernelContext kernel = 0;           ///< 0 if the kernel had no AIO context to give; every request then runs on the pool.
+    int event_fd = -1;
+    int forced_backend = IO_BACKEND_AUTO;
+    unsigned destroy_timeout_ms = 10000;
+    std::atomic<long> kernel_inflight{0};
+
+    std::mutex lock;
+    std::condition_variable drained;    ///< Signalled by the last pool request io_destroy waits for.
+    std::deque<struct io_event> completed;
+    long pool_inflight = 0;             ///< Queued or running on the pool, reaped or not.
+    bool orphaned = false;              ///< io_destroy gave up on it; the last pool request frees it.
+    LinuxRequest* free_records = nullptr;
+    std::vector<LinuxRequest*> chunks;
+
+    ~LinuxContext() {
+        if (event_fd >= 0) close(event_fd);
+        for (LinuxRequest* chunk : chunks) delete[] chunk;
+    }
+};
+
+// --- Environment ---
+
+static unsigned env_unsigned(const char* name, unsigned fallback) {
+    const char* value = getenv(name);
+    if (!value || !*value) return fallback;
+    char* end = nullptr;
+    unsigned long parsed = strtoul(value, &end, 10);
+    return *end == '\0' ? (unsigned)parsed : fallback;
+}
+
+/// The engine LIBAIO_WIN32_BACKEND forces for a context set up now, or IO_BACKEND_AUTO.
+static int env_backend() {
+    const char* value = getenv("LIBAIO_WIN32_BACKEND");
+    if (!value) return IO_BACKEND_AUTO;
+    if (strcmp(value, "kernel") == 0) return IO_BACKEND_KERNEL;
+    if (strcmp(value, "threadpool") == 0) return IO_BACKEND_THREADPOOL;
+    return IO_BACKEND_AUTO;
+}
+
+// --- Records ---
+
+/// Takes `count` records off the context's free list, allocating chunks as needed. Caller holds `ctx->lock`.
+static bool take_records(LinuxContext* ctx, long count, LinuxRequest** records) {
+    for (long i = 0; i < count; ++i) {
+        if (!ctx->free_records) {
+            LinuxRequest* chunk = new (std::nothrow) LinuxRequest[RECORD_CHUNK];
+            if (!chunk) {
+                while (i > 0) {
+                    --i;
+                    records[i]->next = ctx->free_records;
+                    ctx->free_records = records[i];
+                }
+                return false;
+            }
+            ctx->chunks.push_back(chunk);
+            for (unsigned c = 0; c < RECORD_CHUNK; ++c) {
+                chunk[c].next = ctx->free_records;
+                ctx->free_records = &chunk[c];
+            }
+        }
+        records[i] = ctx->free_records;
+        ctx->free_records = records[i]->next;
+    }
+    return true;
+}
+
+/// Returns a record to its context's free list. Caller holds `ctx->lock`.
+static void release_record(LinuxContext* ctx, LinuxRequest* record) {
+    record->next = ctx->free_records;
+    ctx->free_records = record;
+}
+
+static void signal_context(LinuxContext* ctx) {
+    uint64_t one = 1;
+    ssize_t ignored = write(ctx->event_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// --- Worker Pool ---
+
+/**
+ * @struct WorkerPool
+ * @brief The process's worker threads, shared by every context, and their FIFO of requests.
+ *
+ * The pool starts with the first request that needs it and lives as long as the process. Its
+ * size comes from LIBAIO_WIN32_WORKERS, defaulting to the CPU count, capped at 256.
+ */
+struct WorkerPool {
+    std::mutex lock;
+    std::condition_variable work;
+    LinuxRequest* head = nullptr;
+    LinuxRequest* tail = nullptr;
+};
+
+static WorkerPool* g_pool = nullptr;
+static std::once_flag g_pool_once;
+
+/// Runs one request with blocking calls and returns libaio's result: bytes, or a negative errno value.
+static long run_request(const struct iocb* cb) {
+    struct iovec single;
+    const struct iovec* vec = &single;
+    int segments = 1;
+    long long offset = cb->u.c.offset;
+    switch (cb->aio_lio_opcode) {
+    case IO_CMD_PREAD:
+    case IO_CMD_PWRITE:
+        single.iov_base = cb->u.c.buf;
+        single.iov_len = cb->u.c.nbytes;
+        break;
+    case IO_CMD_PREADV:
+    case IO_CMD_PWRITEV:
+        vec = cb->u.v.vec;
+        segments = cb->u.v.nr;
+        offset = cb->u.v.offset;
+        break;
+    default:
+        break;
+    }
+
+    ssize_t result;
+    for (;;) {
+        switch (cb->aio_lio_opcode) {
+        case IO_CMD_PREAD:
+        case IO_CMD_PREADV:
+            result = preadv2(cb->aio_fildes, vec, segments, offset, (int)cb->aio_rw_flags);
+            break;
+        case IO_CMD_PWRITE:
+        case IO_CMD_PWRITEV:
+            result = pwritev2(cb->aio_fildes, vec, segments, offset, (int)cb->aio_rw_flags);
+            break;
+        case IO_CMD_FSYNC:
+            result = fsync(cb->aio_fildes);
+            break;
+        default: // IO_CMD_FDSYNC; io_submit refuses the rest.
+            result = fdatasync(cb->aio_fildes);
+            break;
+        }
+        if (result >= 0) break;
+        // Pipes and sockets have no offset: they are read and written at their current position.
+        if (errno == ESPIPE && offset != -1) offset = -1;
+        else if (errno != EINTR) break;
+    }
+    return result < 0 ? -(long)errno : (long)result;
+}
+
+/// Queues a finished pool request's event on its context, or frees the context io_destroy left behind.
+static void complete_pooled(LinuxRequest* request, long result) {
+    LinuxContext* ctx = request->ctx;
+    std::unique_lock<std::mutex> guard(ctx->lock);
+    long left = --ctx->pool_inflight;
+    if (ctx->orphaned) {
+        release_record(ctx, request);
+        guard.unlock();
+        if (left == 0) delete ctx;
+        return;
+    }
+    struct io_event event;
+    event.data = request->caller->data;
+    event.obj = request->caller;
+    event.res = (unsigned long)result;
+    event.res2 = 0;
+    ctx->completed.push_back(event);
+    release_record(ctx, request);
+    if (left == 0) ctx->drained.notify_all();
+    // Under the lock: once it is released, io_destroy may close the eventfd and free the context.
+    signal_context(ctx);
+}
+
+static void worker_main(WorkerPool* pool) {
+    for (;;) {
+        LinuxRequest* request;
+        {
+            std::unique_lock<std::mutex> guard(pool->lock);
+            pool->work.wait(guard, [pool] { return pool->head != nullptr; });
+            request = pool->head;
+            pool->head = request->next;
+            if (!pool->head) pool->tail = nullptr;
+        }
+        complete_pooled(request, run_request(&request->cb));
+    }
+}
+
+static WorkerPool* worker_pool() {
+    std::call_once(g_pool_once, [] {
+        WorkerPool* pool = new WorkerPool;
+        unsigned cpus = std::thread::hardware_concurrency();
+        unsigned workers = env_unsigned("LIBAIO_WIN32_WORKERS", cpus ? cpus : 4);
+        if (workers == 0) workers = 1;
+        if (workers > 256) workers = 256;
+        for (unsigned i = 0; i < workers; ++i) std::thread(worker_main, pool).detach();
+        g_pool = pool;
+    });
+    return g_pool;
+}
+
+/// Hands a chain of requests, linked through `next`, to the pool.
+static void enqueue_pooled(LinuxRequest* first, LinuxRequest* last, long count) {
+    WorkerPool* pool = worker_pool();
+    last->next = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        if (pool->tail) pool->tail->next = first;
+        else pool->head = first;
+        pool->tail = last;
+    }
+    if (count == 1) pool->work.notify_one();
+    else pool->work.notify_all();
+}
+
+/// Unlinks the context's requests that no worker has started yet. Returns how many there were.
+static long drop_queued(LinuxContext* ctx) {
+    if (!g_pool) return 0;
+    long dropped = 0;
+    std::lock_guard<std::mutex> guard(g_pool->lock);
+    LinuxRequest** link = &g_pool->head;
+    LinuxRequest* previous = nullptr;
+    while (*link) {
+        LinuxRequest* request = *link;
+        if (request->ctx == ctx) {
+            *link = request->next;
+            ++dropped;
+        }
+        else {
+            previous = request;
+            link = &request->next;
+        }
+    }
+    g_pool->tail = previous;
+    return dropped;
+}
+
+// --- Kernel AIO ---
+
+static long kernel_setup(unsigned nr_events, KernelContext* kernel) {
+    return syscall(SYS_io_setup, nr_events, kernel);
+}
+
+static long kernel_destroy(KernelContext kernel) {
+    return syscall(SYS_io_destroy, kernel);
+}
+
+static long kernel_submit(KernelContext kernel, long nr, struct iocb** iocbs) {
+    return syscall(SYS_io_submit, kernel, nr, iocbs);
+}
+
+static long kernel_getevents(KernelContext kernel, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+    return syscall(SYS_io_getevents, kernel, min_nr, nr, events, timeout);
+}
+
+/// The engine a request of `opcode` on a descriptor with file status `flags` runs on.
+static int route(const LinuxContext* ctx, short opcode, int flags) {
+    if (opcode == IO_CMD_FSYNC || opcode == IO_CMD_FDSYNC || !ctx->kernel) return IO_BACKEND_THREADPOOL;
+    if (ctx->forced_backend != IO_BACKEND_AUTO) return ctx->forced_backend;
+    return (flags & O_DIRECT) ? IO_BACKEND_KERNEL : IO_BACKEND_THREADPOOL;
+}
+
+/**
+ * @brief Submits a run of kernel-bound requests in one io_submit.
+ * @return How many the kernel took, or a negative errno value if it took none.
+ */
+static long submit_kernel_run(LinuxContext* ctx, std::vector<struct iocb*>& run) {
+    long nr = (long)run.size();
+    // Counted first, so that a reaper that sees the eventfd signalled also sees them in flight.
+    ctx->kernel_inflight.fetch_add(nr, std::memory_order_relaxed);
+    long taken = kernel_submit(ctx->kernel, nr, run.data());
+    if (taken < 0) taken = -(long)errno;
+    ctx->kernel_inflight.fetch_sub(nr - (taken > 0 ? taken : 0), std::memory_order_relaxed);
+    run.clear();
+    return taken;
+}
+
+/// Moves up to `nr` of the pool's finished requests into `events`.
+static long take_pooled(LinuxContext* ctx, long nr, struct io_event* events) {
+    std::lock_guard<std::mutex> guard(ctx->lock);
+    long count = std::min(nr, (long)ctx->completed.size());
+    for (long i = 0; i < count; ++i) {
+        events[i] = ctx->completed.front();
+        ctx->completed.pop_front();
+    }
+    return count;
+}
+
+/**
+ * @brief Reaps up to `nr` kernel completions without waiting, and gives their events the caller's
+ * iocb and data back.
+ * @return The number reaped, or a negative errno value.
+ */
+static long take_kernel(LinuxContext* ctx, long nr, struct io_event* events) {
+    if (!ctx->kernel || nr == 0 || ctx->kernel_inflight.load(std::memory_order_relaxed) == 0) return 0;
+    struct timespec now = { 0, 0 };
+    long got = kernel_getevents(ctx->kernel, 0, nr, events, &now);
+    if (got <= 0) return got < 0 ? -(long)errno : 0;
+    ctx->kernel_inflight.fetch_sub(got, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> guard(ctx->lock);
+    for (long i = 0; i < got; ++i) {
+        LinuxRequest* record = (LinuxRequest*)events[i].data;
+        events[i].data = record->caller->data;
+        events[i].obj = record->caller;
+        release_record(ctx, record);
+    }
+    return got;
+}
+
+// --- API ---
+
+LIO_API int io_setup(int maxevents, io_context_t* ctxp) {
+    if (maxevents <= 0 || !ctxp) return -EINVAL;
+    LinuxContext* ctx = new (std::nothrow) LinuxContext;
+    if (!ctx) return -ENOMEM;
+    ctx->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctx->event_fd < 0) {
+        int error = errno;
+        delete ctx;
+        return -error;
+    }
+    ctx->forced_backend = env_backend();
+    ctx->destroy_timeout_ms = env_unsigned("LIBAIO_WIN32_DESTROY_TIMEOUT_MS", 10000);
+    // The kernel's contexts come out of fs.aio-max-nr. Without one, the pool runs every request.
+    if (ctx->forced_backend != IO_BACKEND_THREADPOOL && kernel_setup((unsigned)maxevents, &ctx->kernel) < 0) {
+        int error = errno;
+        ctx->kernel = 0;
+        if (ctx->forced_backend == IO_BACKEND_KERNEL) {
+            delete ctx;
+            return -error;
+        }
+    }
+    *ctxp = (io_context_t)ctx;
+    return 0;
+}
+
+LIO_API int io_queue_init(int maxevents, io_context_t* ctxp) {
+    return io_setup(maxevents, ctxp);
+}
+
+
+LIO_API int io_submit(io_context_t handle, long nr, struct iocb* iocbs[]) {
+    LinuxContext* ctx = (LinuxContext*)handle;
+    if (!ctx || nr < 0) return -EINVAL;
+    if (nr == 0) return 0;
+    if (!iocbs) return -EFAULT;
+
+    std::vector<LinuxRequest*> records((size_t)nr);
+    {
+        std::lock_guard<std::mutex> guard(ctx->lock);
+        if (!take_records(ctx, nr, records.data())) return -EAGAIN;
+    }
+
+    // Route every iocb up to the first invalid one. Descriptors are looked up once per run of
+    // iocbs on the same one, as their O_DIRECT flag can change between calls.
+    int error = 0;
+    int last_fd = -1, last_flags = 0;
+    long valid = 0;
+    for (; valid < nr; ++valid) {
+        struct iocb* cb = iocbs[valid];
+        if (!cb) {
+            error = -EFAULT;
+            break;
+        }
+        short opcode = cb->aio_lio_opcode;
+        bool known = opcode == IO_CMD_PREAD || opcode == IO_CMD_PWRITE || opcode == IO_CMD_PREADV ||
+                     opcode == IO_CMD_PWRITEV || opcode == IO_CMD_FSYNC || opcode == IO_CMD_FDSYNC;
+        // The eventfd fields carry the context's own eventfd to the kernel.
+        if (!known || (cb->u.c.flags & KERNEL_FLAG_RESFD)) {
+            error = -EINVAL;
+            break;
+        }
+        if (cb->aio_fildes < 0 || cb->aio_fildes != last_fd) {
+            last_flags = fcntl(cb->aio_fildes, F_GETFL);
+            if (last_flags < 0) {
+                error = -EBADF;
+                break;
+            }
+            last_fd = cb->aio_fildes;
+        }
+        LinuxRequest* record = records[valid];
+        record->caller = cb;
+        record->ctx = ctx;
+        record->kernel = route(ctx, opcode, last_flags) == IO_BACKEND_KERNEL;
+        record->cb = *cb;
+        if (record->kernel) {
+            // The kernel copies the iovec array itself, inside io_submit.
+            record->cb.data = record;
+            record->cb.u.c.flags |= KERNEL_FLAG_RESFD;
+            record->cb.u.c.resfd = (unsigned)ctx->event_fd;
+        }
+        else if (opcode == IO_CMD_PREADV || opcode == IO_CMD_PWRITEV) {
+            if (cb->u.v.nr < 0) {
+                error = -EINVAL;
+                break;
+            }
+            try {
+                record->vec.assign(cb->u.v.vec, cb->u.v.vec + cb->u.v.nr);
+            }
+            catch (const std::bad_alloc&) {
+                error = -ENOMEM;
+                break;
+            }
+            record->cb.u.v.vec = record->vec.data();
+        }
+    }
+
+    // Consecutive kernel requests go to the kernel in one call. A run is sent before the pool
+    // request that ends it, so that a kernel refusal stops submission at the iocb it refused.
+    std::vector<struct iocb*> run;
+    LinuxRequest* pool_first = nullptr;
+    LinuxRequest* pool_last = nullptr;
+    long pool_count = 0;
+    long accepted = 0;
+    for (long i = 0; i <= valid; ++i) {
+        if (i < valid && records[i]->kernel) {
+            run.push_back(&records[i]->cb);
+            continue;
+        }
+        if (!run.empty()) {
+            long sent = (long)run.size();
+            long taken = submit_kernel_run(ctx, run);
+            if (taken > 0) accepted += taken;
+            if (taken != sent) {
+                if (accepted == 0) error = (int)taken;
+                break;
+            }
+        }
+        if (i == valid) break;
+        records[i]->next = nullptr;
+        if (pool_last) pool_last->next = records[i];
+        else pool_first = records[i];
+        pool_last = records[i];
+        ++pool_count;
+        ++accepted;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(ctx->lock);
+        for (long i = accepted; i < nr; ++i) release_record(ctx, records[i]);
+        ctx->pool_inflight += pool_count;
+    }
+    if (pool_count) enqueue_pooled(pool_first, pool_last, pool_count);
+    return accepted > 0 ? (int)accepted : error;
+}
+
+LIO_API int io_getevents(io_context_t handle, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+    LinuxContext* ctx = (LinuxContext*)handle;
+    if (!ctx || min_nr < 0 || nr < 0 || min_nr > nr) return -EINVAL;
+    if (nr == 0) return 0;
+    if (!events) return -EFAULT;
+
+    struct timespec deadline = { 0, 0 };
+    if (timeout) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout->tv_sec;
+        deadline.tv_nsec += timeout->tv_nsec;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    long got = 0;
+    for (;;) {
+        // Reset the eventfd before looking, so that anything finishing after the look signals it anew.
+        uint64_t count;
+        ssize_t ignored = read(ctx->event_fd, &count, sizeof(count));
+        (void)ignored;
+        got += take_pooled(ctx, nr - got, events + got);
+        long reaped = take_kernel(ctx, nr - got, events + got);
+        if (reaped < 0) return got > 0 ? (int)got : (int)reaped;
+        got += reaped;
+        if (got >= min_nr) {
+            // A full array may have left events behind, which another waiting thread must hear of.
+            if (got == nr) signal_context(ctx);
+            return (int)got;
+        }
+
+        struct timespec left;
+        if (timeout) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            left.tv_sec = deadline.tv_sec - now.tv_sec;
+            left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (left.tv_nsec < 0) {
+                left.tv_sec -= 1;
+                left.tv_nsec += 1000000000L;
+            }
+            if (left.tv_sec < 0) return (int)got;
+        }
+        struct pollfd wait = { ctx->event_fd, POLLIN, 0 };
+        if (ppoll(&wait, 1, timeout ? &left : nullptr, nullptr) < 0 && errno == EINTR) return got > 0 ? (int)got : -EINTR;
+    }
+}
+
+/**
+ * Linux's io_destroy cancels what it can and waits for the rest. The kernel does so for its own
+ * requests; requests queued for the pool are dropped, and those a worker is running are waited for
+ * up to LIBAIO_WIN32_DESTROY_TIMEOUT_MS. After a timeout the last of them frees the context.
+ */
+LIO_API int io_destroy(io_context_t handle) {
+    LinuxContext* ctx = (LinuxContext*)handle;
+    if (!ctx) return -EINVAL;
+    if (ctx->kernel) kernel_destroy(ctx->kernel);
+    long dropped = drop_queued(ctx);
+
+    std::unique_lock<std::mutex> guard(ctx->lock);
+    ctx->pool_inflight -= dropped;
+    bool drained = ctx->drained.wait_for(guard, std::chrono::milliseconds(ctx->destroy_timeout_ms),
+        [ctx] { return ctx->pool_inflight == 0; });
+    if (!drained) {
+        ctx->orphaned = true;
+        return -ETIMEDOUT;
+    }
+    guard.unlock();
+    delete ctx;
+    return 0;
+}
+
+LIO_API int io_queue_release(io_context_t ctx) {
+    return io_destroy(ctx);
+}
+
+/**
+ * The kernel cannot cancel reads and writes of files, and its io_cancel returns -EINVAL for them.
+ * A request still waiting for a worker can be: it is taken off the queue and `evt` receives its
+ * event with -ECANCELED, which io_getevents will not report again.
+ */
+LIO_API int io_cancel(io_context_t handle, struct iocb* iocb, struct io_event* evt) {
+    LinuxContext* ctx = (LinuxContext*)handle;
+    if (!ctx || !iocb || !evt) return -EINVAL;
+    if (!g_pool) return -EINVAL;
+    LinuxRequest* found = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(g_pool->lock);
+        LinuxRequest* previous = nullptr;
+        for (LinuxRequest* request = g_pool->head; request; previous = request, request = request->next) {
+            if (request->ctx != ctx || request->caller != iocb) continue;
+            if (previous) previous->next = request->next;
+            else g_pool->head = request->next;
+            if (g_pool->tail == request) g_pool->tail = previous;
+            found = request;
+            break;
+        }
+    }
+    if (!found) return -EINVAL;
+    evt->data = iocb->data;
+    evt->obj = iocb;
+    evt->res = (unsigned long)-(long)ECANCELED;
+    evt->res2 = 0;
+    std::lock_guard<std::mutex> guard(ctx->lock);
+    --ctx->pool_inflight;
+    release_record(ctx, found);
+    if (ctx->pool_inflight == 0) ctx->drained.notify_all();
+    return 0;
+}
+
+LIO_API int io_file_backend(io_context_t handle, int fd) {
+    LinuxContext* ctx = (LinuxContext*)handle;
+    if (!ctx) return -EINVAL;
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) return -EBADF;
+    return route(ctx, IO_CMD_PREAD, flags);
+}
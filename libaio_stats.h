@@ -0,0 +1,109 @@
+#pragma once
+
+/**
+ * @file libaio_stats.h
+ * @brief Layout of the shared-memory statistics segment published by libaio-win32.
+ *
+ * After io_stats_publish, a process exposes its counters in a named file mapping,
+ * AIO_STATS_NAME_PREFIX followed by its decimal process ID. Monitors such as aio-top
+ * open the mapping read-only; the process being watched needs no other cooperation.
+ *
+ * The segment is an aio_stats_header followed by `max_contexts` aio_stats_context slots and
+ * `max_files` aio_stats_file slots. The I/O path updates counters with atomic adds and takes no
+ * locks. A slot changes owner only inside its seqlock: `sequence` is odd while the slot is being
+ * reassigned and is incremented again once it is consistent. A reader copies a slot, then
+ * discards the copy if `sequence` was odd or changed meanwhile. Counters only grow while a slot
+ * keeps its owner, so rates are differences between two copies with the same `sequence`.
+ */
+
+#include <stdint.h>
+
+#define AIO_STATS_MAGIC         "AIOSTATS"
+#define AIO_STATS_VERSION       1
+#define AIO_STATS_NAME_PREFIX   "Local\\libaio-win32-stats-"
+
+#define AIO_STATS_MAX_CONTEXTS  64
+#define AIO_STATS_MAX_FILES     1024
+#define AIO_STATS_PATH_MAX      192
+
+/// Request classes that counters and latency histograms are kept for.
+enum {
+    AIO_STATS_READ = 0,     ///< IO_CMD_PREAD, IO_CMD_PREADV and IO_CMD_PREAD_SELECT.
+    AIO_STATS_WRITE = 1,    ///< IO_CMD_PWRITE and IO_CMD_PWRITEV.
+    AIO_STATS_SYNC = 2,     ///< IO_CMD_FSYNC and IO_CMD_FDSYNC.
+    AIO_STATS_CLASSES = 3,
+};
+
+/**
+ * Latency histograms have four buckets per power of two of nanoseconds, from 0 ns to about
+ * 18 minutes, so a percentile read from a bucket's lower bound is within 25% of the true value.
+ */
+#define AIO_STATS_LATENCY_BUCKETS 160
+
+/// Returns the histogram bucket of a latency in nanoseconds.
+static inline unsigned aio_stats_latency_bucket(uint64_t ns) {
+    if (ns < 4) return (unsigned)ns;
+    unsigned exponent = 63;
+    while (!(ns >> exponent)) --exponent;
+    unsigned bucket = 4 * (exponent - 1) + (unsigned)((ns >> (exponent - 2)) & 3);
+    return bucket < AIO_STATS_LATENCY_BUCKETS ? bucket : AIO_STATS_LATENCY_BUCKETS - 1;
+}
+
+/// Returns the smallest latency, in nanoseconds, that falls into a histogram bucket.
+static inline uint64_t aio_stats_bucket_floor(unsigned bucket) {
+    if (bucket < 4) return bucket;
+    return (uint64_t)(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+/**
+ * @struct aio_stats_header
+ * @brief Leads the segment. Everything but the counters is written once, and `magic` is written
+ * last, so a reader that finds the magic can trust the rest of the header.
+ */
+struct aio_stats_header {
+    char     magic[8];          ///< AIO_STATS_MAGIC, not NUL-terminated.
+    uint32_t version;           ///< AIO_STATS_VERSION.
+    uint32_t process_id;
+    uint32_t max_contexts;      ///< Number of aio_stats_context slots.
+    uint32_t max_files;         ///< Number of aio_stats_file slots.
+    uint32_t context_size;      ///< sizeof(struct aio_stats_context).
+    uint32_t file_size;         ///< sizeof(struct aio_stats_file).
+    uint64_t untracked_contexts; ///< Contexts created while every context slot was taken.
+    uint64_t untracked_files;   ///< Files first seen while every file slot was taken.
+};
+
+/**
+ * @struct aio_stats_context
+ * @brief Counters of one io_context_t.
+ *
+ * Completions are counted when io_getevents returns them; `bytes` is what was transferred.
+ * The number of requests in flight is `submitted` minus the sum of `completed`.
+ */
+struct aio_stats_context {
+    uint32_t sequence;          ///< Seqlock; odd while the slot changes owner.
+    uint32_t in_use;            ///< 1 while a context owns the slot.
+    uint32_t context;           ///< Serial number of the context, in order of creation, as in traces.
+    uint32_t reserved;
+    uint64_t submitted;         ///< iocbs accepted by io_submit.
+    uint64_t completed[AIO_STATS_CLASSES];
+    uint64_t bytes[AIO_STATS_CLASSES];
+    uint64_t errors;            ///< Completions that failed (a Windows error in res2).
+    uint64_t latency[AIO_STATS_CLASSES][AIO_STATS_LATENCY_BUCKETS]; ///< Submission-to-reap time.
+};
+
+/**
+ * @struct aio_stats_file
+ * @brief Counters of one file descriptor as seen by one context.
+ *
+ * Requests are counted when io_submit accepts them; `bytes` is what was requested. When the
+ * descriptor is closed and reused for another file, the slot changes owner.
+ */
+struct aio_stats_file {
+    uint32_t sequence;          ///< Seqlock; odd while the slot changes owner.
+    uint32_t in_use;            ///< 1 while a context owns the slot.
+    uint32_t context;           ///< Serial number of the owning context.
+    int32_t  fd;
+    uint64_t ops[AIO_STATS_CLASSES];
+    uint64_t bytes[AIO_STATS_CLASSES];
+    char     path[AIO_STATS_PATH_MAX]; ///< NUL-terminated; the end of the path is kept if it is too long.
+};
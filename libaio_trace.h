@@ -0,0 +1,77 @@
+#pragma once
+
+/**
+ * @file libaio_trace.h
+ * @brief On-disk format of the I/O traces recorded by libaio-win32.
+ *
+ * A trace starts with one aio_trace_header followed by a stream of fixed-size
+ * aio_trace_record entries. An AIO_TRACE_FILE record is followed by the file's
+ * path, NUL-padded up to a whole number of records. The format is little-endian
+ * and uses only fixed-width types, so traces recorded on Windows can be read on
+ * any platform.
+ */
+
+#include <stdint.h>
+
+#define AIO_TRACE_MAGIC   "AIOTRACE"
+#define AIO_TRACE_VERSION 1
+
+/// Record kinds.
+enum {
+    AIO_TRACE_SUBMIT = 1,   ///< An iocb was accepted by io_submit.
+    AIO_TRACE_COMPLETE = 2, ///< io_getevents returned the iocb's event.
+    AIO_TRACE_FILE = 3,     ///< A context saw a file descriptor for the first time; its path follows.
+    AIO_TRACE_END = 4,      ///< Last record of a trace; `length` holds the number of records dropped.
+};
+
+/**
+ * Opcodes. These follow the Linux kernel's IOCB_CMD_* numbering whichever platform recorded
+ * the trace; the Windows library renumbers its IO_CMD_FSYNC and IO_CMD_FDSYNC on the way in.
+ */
+enum {
+    AIO_TRACE_OP_PREAD = 0,
+    AIO_TRACE_OP_PWRITE = 1,
+    AIO_TRACE_OP_FSYNC = 2,
+    AIO_TRACE_OP_FDSYNC = 3,
+    AIO_TRACE_OP_PREADV = 7,
+    AIO_TRACE_OP_PWRITEV = 8,
+    AIO_TRACE_OP_PREAD_SELECT = 16, ///< libaio-win32's provided-buffer read.
+};
+
+/**
+ * @struct aio_trace_header
+ * @brief Leads every trace file.
+ */
+struct aio_trace_header {
+    char     magic[8];          ///< AIO_TRACE_MAGIC, not NUL-terminated.
+    uint32_t version;           ///< AIO_TRACE_VERSION.
+    uint32_t record_size;       ///< sizeof(struct aio_trace_record).
+    int64_t  ticks_per_second;  ///< Resolution of aio_trace_record::ticks.
+};
+
+/**
+ * @struct aio_trace_record
+ * @brief One traced event.
+ *
+ * For SUBMIT, `length` is the number of bytes requested (the sum of all segments for
+ * vectored opcodes). For COMPLETE, it is the number of bytes transferred, and `error` is 0
+ * on success or the recording platform's error code: a Win32 error on Windows, an errno on Linux.
+ * `id` is the iocb's address. The application may reuse an iocb once its completion has been
+ * reaped, so submits and completes pair up in order per `id`.
+ *
+ * Records are written roughly, not strictly, in time order. Readers should sort by `ticks`;
+ * a submission's timestamp is taken before the request is issued, so it always precedes its
+ * completion's, and an AIO_TRACE_FILE record precedes the first submission that uses the descriptor.
+ */
+struct aio_trace_record {
+    uint8_t  kind;      ///< AIO_TRACE_* kind.
+    uint8_t  opcode;    ///< AIO_TRACE_OP_* opcode.
+    uint16_t segments;  ///< Segment count of vectored opcodes, otherwise 0.
+    int32_t  fd;        ///< The iocb's aio_fildes.
+    uint32_t context;   ///< Serial number of the io_context_t, in order of creation.
+    uint32_t error;     ///< Error of a completion, 0 on success.
+    uint64_t id;        ///< Identifies the iocb.
+    int64_t  offset;    ///< File offset.
+    uint64_t length;    ///< Bytes requested or transferred; path length for AIO_TRACE_FILE.
+    int64_t  ticks;     ///< Time since tracing started, in ticks_per_second units.
+};
@@ -9,67 +9,469 @@
  */
 
 #include "libaio_win32.h"
+#include "libaio_trace.h"
+#include "libaio_stats.h"
+#include "libaio_etw.h"
 #include <windows.h>
+#include <psapi.h>      // Required for QueryWorkingSetEx
+#include <TraceLoggingProvider.h> // ETW events; see libaio_etw.h
 #include <io.h>         // Required for _get_osfhandle
+#include <stdio.h>      // Required for the watchdog's log lines
+#include <stdarg.h>     // Required for the profile report's formatter
+#include <intrin.h>     // Required for __rdtsc
 #include <new>          // Required for std::nothrow
 #include <atomic>       // Required for thread-safe atomic counters
+#include <algorithm>    // Required for std::partial_sort
+
+// Token privileges and ETW registration live in advapi32. Naming it here lets static and
+// header-only builds link without extra project settings.
+#if defined(_MSC_VER)
+#pragma comment(lib, "advapi32.lib")
+#endif
 
  // --- Internal Implementation Structures ---
 
+/**
+ * @struct FreeStack
+ * @brief A lock-free stack of indices threaded through a caller's link array, on its own cache line.
+ *
+ * The head packs an ABA tag in the upper 32 bits and `index + 1` in the lower 32 bits (0 means
+ * empty). Each link holds the index + 1 of the next free entry.
+ */
+struct alignas(64) FreeStack {
+    std::atomic<unsigned long long> head;
+
+    FreeStack() : head(0) {
+    }
+
+    bool empty() const {
+        return (head.load(std::memory_order_acquire) & 0xFFFFFFFF) == 0;
+    }
+
+    /// Pops an index, or returns false if the stack is empty.
+    bool pop(const std::atomic<unsigned>* links, unsigned* index) {
+        unsigned long long top_head = head.load(std::memory_order_acquire);
+        for (;;) {
+            unsigned top = (unsigned)(top_head & 0xFFFFFFFF);
+            if (top == 0) return false;
+            unsigned long long desired = (((top_head >> 32) + 1) << 32) | links[top - 1].load(std::memory_order_relaxed);
+            if (head.compare_exchange_weak(top_head, desired, std::memory_order_acq_rel)) {
+                *index = top - 1;
+                return true;
+            }
+        }
+    }
+
+    /// Pushes the entries `first` to `last`, already linked to each other in that order, in one step.
+    void push_chain(std::atomic<unsigned>* links, unsigned first, unsigned last) {
+        unsigned long long top_head = head.load(std::memory_order_relaxed);
+        for (;;) {
+            links[last].store((unsigned)(top_head & 0xFFFFFFFF), std::memory_order_relaxed);
+            unsigned long long desired = (((top_head >> 32) + 1) << 32) | ((unsigned long long)first + 1);
+            if (head.compare_exchange_weak(top_head, desired, std::memory_order_release, std::memory_order_relaxed)) return;
+        }
+    }
+
+    void push(std::atomic<unsigned>* links, unsigned index) {
+        push_chain(links, index, index);
+    }
+};
+
  /**
-  * @struct WinAioContext
-  * @brief Internal state for an io_context_t, holding the native IOCP handle.
+  * @struct BufferGroup
+  * @brief A pool of caller-provided buffers that IO_CMD_PREAD_SELECT reads draw from.
+  *
+  * Free buffers are kept on lock-free stacks threaded through `free_links`. With NUMA placement
+  * there is one stack per node, holding the buffers whose memory is on that node.
   */
-struct WinAioContext {
-    HANDLE ioCompletionPort;
+struct BufferGroup {
+    BufferGroup* next;
+    unsigned short group_id;
+    char* base;
+    size_t buffer_length;
+    unsigned buffer_count;
+    std::atomic<unsigned>* free_links;
+    std::atomic<unsigned>* held;    ///< One bit per buffer, set from its selection until it is recycled.
+    unsigned char* buffer_nodes;    ///< With more than one NUMA node, the node of each buffer, else nullptr.
+    FreeStack* free_lists;          ///< One per node with NUMA placement, else one.
+    unsigned lists;
+
+    BufferGroup(unsigned short bgid, void* region, size_t buf_len, unsigned nr)
+        : next(nullptr),
+        group_id(bgid),
+        base(static_cast<char*>(region)),
+        buffer_length(buf_len),
+        buffer_count(nr),
+        free_links(nullptr),
+        held(nullptr),
+        buffer_nodes(nullptr),
+        free_lists(nullptr),
+        lists(0) {
+    }
+
+    ~BufferGroup() {
+        delete[] free_links;
+        delete[] held;
+        delete[] buffer_nodes;
+        delete[] free_lists;
+    }
+
+    /// Pops a free buffer ID, one on `node` if it has any, or returns false if the group is exhausted.
+    bool acquire(unsigned node, unsigned short* bid) {
+        unsigned home = lists > 1 ? node : 0;
+        for (unsigned i = 0; i < lists; ++i) {
+            unsigned index;
+            if (free_lists[(home + i) % lists].pop(free_links, &index)) {
+                held[index / 32].fetch_or(1u << (index % 32), std::memory_order_relaxed);
+                *bid = (unsigned short)index;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Pushes a buffer ID back onto its node's free stack.
+    void release(unsigned short bid) {
+        held[bid / 32].fetch_and(~(1u << (bid % 32)), std::memory_order_relaxed);
+        free_lists[lists > 1 ? buffer_nodes[bid] : 0].push(free_links, bid);
+    }
+
+    /// Releases a buffer the application is done with. False if it is not held, so that recycling
+    /// a buffer twice cannot put it on a free stack twice.
+    bool recycle(unsigned short bid) {
+        unsigned bit = 1u << (bid % 32);
+        if (!(held[bid / 32].fetch_and(~bit, std::memory_order_relaxed) & bit)) return false;
+        free_lists[lists > 1 ? buffer_nodes[bid] : 0].push(free_links, bid);
+        return true;
+    }
 };
 
 // Forward-declare the main request structure
 struct WinAioRequest;
+struct HeapRequest;
+struct VectoredRequestGroup;
+
+/**
+ * @struct DeviceGate
+ * @brief Caps how many pool workers one volume may occupy at a time.
+ *
+ * Requests that arrive while the volume is at its limit wait on the gate's overflow list
+ * instead of in a worker, so a stalled volume ties up at most `limit` workers and requests
+ * for other volumes keep flowing.
+ */
+struct DeviceGate {
+    DeviceGate* next;
+    DWORD volume_serial;
+    long limit;
+    SRWLOCK lock;                   ///< Guards `active` and the overflow list.
+    long active;                    ///< Requests of this volume currently running on workers.
+    WinAioRequest* overflow_head;   ///< FIFO of admitted-later requests, linked through next_queued.
+    WinAioRequest* overflow_tail;
+    std::atomic<long> backlog;      ///< Length of the overflow list, readable without the lock.
+};
+
+/**
+ * @struct FileCounters
+ * @brief Exact counters of one descriptor on a context with per-file stats on.
+ *
+ * Allocated the first time the context resolves the descriptor and never moved, so FileEntry
+ * copies can keep pointing at it while the file table is reallocated. Indexed by request class.
+ */
+struct FileCounters {
+    std::atomic<unsigned long long> ops[AIO_STATS_CLASSES];
+    std::atomic<unsigned long long> bytes[AIO_STATS_CLASSES];
+    std::atomic<unsigned long long> completed;
+    std::atomic<unsigned long long> latency_ns;  ///< Sum of submission-to-reap times of `completed`.
+    std::atomic<unsigned long long> errors;
+};
+
+/**
+ * @struct HotFiles
+ * @brief Space-saving sketches (Metwally, Agrawal and El Abbadi, ICDT 2005) of the descriptors
+ * resolved after a context ran out of exact counters.
+ *
+ * Each sketch monitors at most CAPACITY descriptors, one weighted by requests and one by bytes.
+ * An unmonitored descriptor takes over the entry with the smallest count and inherits that count
+ * as its possible overcount, so any descriptor with more than 1/CAPACITY of the sketched weight
+ * is always monitored.
+ */
+struct HotFiles {
+    static const unsigned CAPACITY = 64;
+
+    struct Entry {
+        int fd;
+        unsigned long long overcount;   ///< Count inherited from the descriptor it displaced.
+        unsigned long long ops[AIO_STATS_CLASSES];   ///< Counted since the descriptor entered the sketch.
+        unsigned long long bytes[AIO_STATS_CLASSES];
+    };
+    struct Sketch {
+        unsigned used;
+        Entry entries[CAPACITY];
+    };
+
+    SRWLOCK lock;
+    Sketch by_ops;
+    Sketch by_bytes;
+};
+
+/**
+ * @struct InflightSlot
+ * @brief One entry of a context's in-flight index.
+ *
+ * A submitter claims a free slot by swapping `iocb` from nullptr to INFLIGHT_CLAIMED, fills in the
+ * fields and then publishes the iocb. Readers copy the fields and discard the copy if `iocb` or
+ * `generation` changed meanwhile; the fields are atomics only so that such racing copies are defined.
+ */
+struct InflightSlot {
+    std::atomic<struct iocb*> iocb;     ///< The indexed iocb, INFLIGHT_CLAIMED while being filled in, or nullptr.
+    std::atomic<unsigned> generation;   ///< Bumped by every claim, so readers can tell a reused slot.
+    std::atomic<unsigned> reported;     ///< Generation the watchdog last reported.
+    std::atomic<long long> submitted_at;    ///< QPC of the io_submit call.
+    std::atomic<long long> offset;
+    std::atomic<unsigned long long> length;
+    std::atomic<int> fd;
+    std::atomic<int> opcode;
+};
+
+/**
+ * @struct FileEntry
+ * @brief A context's cached view of one file descriptor: its OS handle and the engine driving it.
+ */
+struct FileEntry {
+    HANDLE handle;      ///< The handle the entry was resolved for; a mismatch means the fd was reused.
+    int backend;        ///< The engine chosen for the handle.
+    DeviceGate* device; ///< The volume the file lives on.
+    unsigned traced_session; ///< Trace session that has already recorded this file's path.
+    aio_stats_file* stats;  ///< The file's published counters, or nullptr.
+    FileCounters* counters; ///< The file's exact per-file counters, or nullptr.
+};
+
+// Forward-declare the thread-pool engine
+struct WorkerPool;
+struct WinAioContext;
+
+/**
+ * @struct RequestSlab
+ * @brief A context's WinAioRequests: address space for its io_setup depth is reserved up front and
+ * committed a chunk at a time, the first time the number of requests in flight reaches it.
+ *
+ * Records are named by index, and free ones are kept on FreeStacks threaded through `links`, so
+ * taking or returning one is a single CAS. With NUMA placement each chunk is placed on the node
+ * of the thread that needed it, and its records always return to that node's stack. Requests
+ * beyond the reserved depth come from the heap. A slab on large pages is committed whole by
+ * slab_init, on the node of the thread that called io_setup, and growing it only links records.
+ */
+struct RequestSlab {
+    WinAioRequest* records;         ///< `capacity` records, the first `committed` of them usable.
+    std::atomic<unsigned>* links;   ///< For each free record, the index + 1 of the next free one.
+    std::atomic<WinAioContext*>* owners; ///< Shared engine only: the thin context each record is taken by, or nullptr.
+    unsigned char* chunk_nodes;     ///< With more than one NUMA node, the node each committed chunk is on, else nullptr.
+    FreeStack* free_lists;          ///< One per node with NUMA placement, else one.
+    unsigned lists;
+    unsigned capacity;              ///< A multiple of SLAB_CHUNK.
+    unsigned committed;             ///< Guarded by grow_lock.
+    SRWLOCK grow_lock;
+    size_t large_bytes;             ///< Large-page memory the slab was committed on, or 0.
+    unsigned large_node;            ///< With `large_bytes`, the node that memory is on.
+};
+
+/**
+ * @struct CompletionList
+ * @brief The packets the shared engine has routed to one thin context, oldest first.
+ *
+ * A routed OVERLAPPED carries its packet in fields the reaper no longer reads: the byte count in
+ * Internal, the dequeue error in Offset, the completion key in OffsetHigh and the link in hEvent.
+ */
+struct CompletionList {
+    SRWLOCK lock;
+    CONDITION_VARIABLE ready;   ///< Signaled for each packet routed while `waiters` is nonzero.
+    OVERLAPPED* head;
+    OVERLAPPED* tail;
+    long waiters;               ///< Threads asleep on `ready`; guarded by lock.
+};
+
+/**
+ * @struct WinAioContext
+ * @brief Internal state for an io_context_t, holding the native IOCP handle.
+ *
+ * A thin context owns only its completions, in-flight index, buffer groups and counters. Its port,
+ * file table, worker pool and request slab are those of the process's shared engine.
+ */
+struct WinAioContext {
+    HANDLE ioCompletionPort;
+    bool port_bound;        ///< A file was associated with the port, so no later context may lease it.
+    WinAioContext* engine;  ///< Owner of the port, file table, worker pool and slab: this context, or the shared engine.
+    unsigned serial;        ///< Identifies the context in traces and the stats segment.
+    aio_stats_context* stats; ///< The context's published counters, or nullptr.
+    SRWLOCK buffer_groups_lock;
+    BufferGroup* buffer_groups;
+
+    SRWLOCK files_lock;     ///< Guards the file table below.
+    FileEntry* files;       ///< Indexed by file descriptor.
+    int file_capacity;
+    DeviceGate* devices;    ///< One gate per volume seen; also guarded by files_lock.
+    unsigned file_counter_budget; ///< Descriptors that may get exact counters; guarded by files_lock.
+    unsigned file_counters_used;
+    std::atomic<HotFiles*> hot_files; ///< Set once per-file stats are on, and kept until io_destroy.
+
+    InflightSlot* inflight; ///< Accepted, unreaped iocbs, open-addressed by address.
+    unsigned inflight_mask; ///< Slot count minus one; the count is a power of two.
+    size_t inflight_large_bytes; ///< Large-page memory the index is on, or 0 if it is on the heap.
+    std::atomic<long> inflight_untracked; ///< Accepted while the index was full and not reaped yet.
+    std::atomic<const void*> config; ///< ConfigIdentity of the configuration that submitted first; no other may use the context.
+    WinAioContext* next_context; ///< Link in the process's context list, or the parked list once destroyed.
+
+    /// Guards the two lists below: the requests io_destroy cannot find by walking the slab.
+    SRWLOCK unindexed_lock;
+    HeapRequest* heap_requests;         ///< Requests taken once the slab was in use.
+    VectoredRequestGroup* vectored_groups; ///< Vectored iocbs issued as overlapped segments.
+
+    INIT_ONCE pool_once;    ///< Starts the worker pool the first time a request needs it.
+    WorkerPool* pool;
+    RequestSlab slab;
+    CompletionList completions; ///< Thin contexts only.
+    /// Packets issued for the context that its reaper has not dequeued, or for a thin context,
+    /// that the engine has not routed. Added per io_submit and subtracted per io_getevents call.
+    std::atomic<long> owed;
+    std::atomic<bool> closing;  ///< Set by io_destroy: queued pooled requests complete as cancelled.
+};
+
+/**
+ * @enum RequestType
+ * @brief Distinguishes between a simple request and a segment of a vectored request.
+ */
+enum RequestType : unsigned char {
+    FREE_RECORD,        ///< A slab record not in use; freshly committed records read as this.
+    SINGLE_REQUEST,
+    VECTORED_SEGMENT
+};
+
+/// WinAioRequest::flags bits.
+enum {
+    REQUEST_BUFFER_SELECTED = 1,    ///< The read holds provided buffer `buffer_id` of the group its iocb's key names.
+};
+
+/**
+ * @struct RequestHeader
+ * @brief The part every OVERLAPPED handed to Windows is embedded in. It is self-describing
+ * via the 'type' field to allow for correct processing in io_getevents.
+ */
+struct RequestHeader {
+    OVERLAPPED overlapped;
+    RequestType type;
+    unsigned char flags;        ///< REQUEST_* bits of a SINGLE_REQUEST.
+    unsigned short buffer_id;   ///< SINGLE_REQUEST with REQUEST_BUFFER_SELECTED: the provided buffer it holds.
+    union {
+        unsigned submitted_at;  ///< SINGLE_REQUEST: low 32 bits of the QPC at submission, for latency stats.
+        unsigned segment_index; ///< VECTORED_SEGMENT: position in its group, which locates the group.
+    };
+};
+
+/**
+ * @struct WinAioRequest
+ * @brief The per-operation context of a whole iocb: one 64-byte slab record on x64.
+ *
+ * Requests run by the thread-pool engine are always SINGLE_REQUEST, including
+ * vectored iocbs, whose segments a worker transfers back to back. Their
+ * OVERLAPPED only serves as the token posted to the completion port.
+ */
+struct WinAioRequest : RequestHeader {
+    struct iocb* iocb_single;
+    WinAioRequest* next_queued; ///< Link in the worker pool's queue or a device's overflow list.
+    DeviceGate* device;         ///< Gate a pooled request must pass before it runs.
+};
+
+/// A request beyond its context's slab, linked on the context so io_destroy can cancel it.
+struct HeapRequest : WinAioRequest {
+    HeapRequest* prev;
+    HeapRequest* next;
+};
+
+/// One segment of a vectored iocb issued as overlapped I/O: only the OVERLAPPED and its place in the group.
+struct VectoredSegment : RequestHeader {
+};
 
 /**
  * @struct VectoredRequestGroup
  * @brief Aggregates multiple I/O segments from a single vectored iocb.
  * This is the key to a behaviorally correct implementation.
+ *
+ * The group and its segments are one allocation, with the segments' OVERLAPPEDs packed right
+ * after the group.
  */
 struct VectoredRequestGroup {
     struct iocb* original_iocb;
+    WinAioContext* context;     ///< The context the iocb was submitted on, which the shared engine routes by.
     std::atomic<long> completed_segments;
     long total_segments;
-    std::atomic<unsigned long> total_bytes_transferred;
+    std::atomic<unsigned long long> total_bytes_transferred;
     std::atomic<unsigned long> first_error;
+    unsigned submitted_at;      ///< As in RequestHeader, for every segment.
+    VectoredRequestGroup* prev; ///< Links in the context's vectored_groups, for io_destroy to cancel.
+    VectoredRequestGroup* next;
 
-    VectoredRequestGroup(struct iocb* iocb)
+    VectoredRequestGroup(WinAioContext* owner, struct iocb* iocb, unsigned stamp)
         : original_iocb(iocb),
+        context(owner),
         completed_segments(0),
         total_segments(iocb->u.v.nr_segs),
         total_bytes_transferred(0),
-        first_error(0) {
+        first_error(0),
+        submitted_at(stamp),
+        prev(nullptr),
+        next(nullptr) {
+    }
+
+    VectoredSegment* segments() { return reinterpret_cast<VectoredSegment*>(this + 1); }
+
+    static VectoredRequestGroup* of(VectoredSegment* segment) {
+        return reinterpret_cast<VectoredRequestGroup*>(segment - segment->segment_index) - 1;
     }
 };
 
+#if defined(_WIN64)
+static_assert(sizeof(WinAioRequest) == 64, "a request should fill one cache line");
+static_assert(sizeof(VectoredSegment) == 40, "a segment should add only its OVERLAPPED and tag");
+static_assert(sizeof(VectoredRequestGroup) == 56, "a vectored iocb costs 56 bytes plus 40 per segment");
+#endif
+static_assert(sizeof(VectoredRequestGroup) % alignof(VectoredSegment) == 0, "segments follow the group directly");
+
 /**
- * @enum RequestType
- * @brief Distinguishes between a simple request and a segment of a vectored request.
+ * @struct Completion
+ * @brief A finished iocb as the reaping loop sees it, before it is copied out as an
+ * io_event or io_event2 and counted by tracing, stats and ETW.
  */
-enum RequestType {
-    SINGLE_REQUEST,
-    VECTORED_SEGMENT
+struct Completion {
+    struct iocb* obj;
+    unsigned long long bytes;   ///< Bytes transferred, at full width.
+    DWORD error;                ///< Positive Windows error code, 0 on success.
+    int backend;                ///< The io_backend that ran the request.
+    unsigned long selected_buffer; ///< IO_EVENT_BUFFER_SELECTED | buffer ID for a read that holds one, else 0.
+    unsigned submitted_at;      ///< Low 32 bits of the submission QPC, as in WinAioRequest.
+    long long submitted_qpc;    ///< The full submission QPC, or 0 if the in-flight index did not hold it.
+};
+
+/// Most NUMA nodes the library tells apart; processors of higher-numbered nodes count as node 0's.
+static const unsigned NUMA_MAX_NODES = 64;
+
+/// Kinds of cross-node access counted for io_numa_read.
+enum NumaAccess {
+    NUMA_REMOTE_REQUEST,
+    NUMA_REMOTE_COMPLETION,
+    NUMA_REMOTE_BUFFER,
+    NUMA_ACCESS_KINDS
+};
+
+/// Cross-node accesses of the threads on one node, on its own cache line.
+struct alignas(64) NumaCounters {
+    std::atomic<unsigned long long> remote[NUMA_ACCESS_KINDS];
 };
 
 /**
- * @struct WinAioRequest
- * @brief The per-operation context passed to Windows. It is self-describing
- * via the 'type' field to allow for correct processing in io_getevents.
+ * Win32 has no dedicated "no buffer space" error; WSAENOBUFS is reported in
+ * res2 when a provided buffer group is empty at issue time.
  */
-struct WinAioRequest {
-    OVERLAPPED overlapped;
-    RequestType type;
-    union {
-        struct iocb* iocb_single;
-        VectoredRequestGroup* group_vectored;
-    };
-};
+static const DWORD ERROR_NO_PROVIDED_BUFFER = 10055; // WSAENOBUFS
 
 // --- Helper Functions ---
 
@@ -112,6 +514,7 @@ static int windows_error_to_errno(DWORD win_error) {
     case ERROR_ALREADY_EXISTS:      return -EEXIST;
     case ERROR_OPERATION_ABORTED:   return -ECANCELED;
     case WAIT_TIMEOUT:              return -ETIMEDOUT;
+    case ERROR_NO_PROVIDED_BUFFER:  return -ENOBUFS;
 
         // Best-effort mappings
     case ERROR_INVALID_FUNCTION:    return -EINVAL;
@@ -121,203 +524,4107 @@ static int windows_error_to_errno(DWORD win_error) {
     }
 }
 
-// --- API Function Implementations ---
+static long long qpc_now() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
 
-LIO_API int io_setup(int maxevents, io_context_t* ctxp) {
-    WinAioContext* context = new (std::nothrow) WinAioContext();
-    if (!context) {
-        return -ENOMEM;
+/// Returns the number of bytes an iocb asks to transfer; 0 for syncs.
+static unsigned long long request_length(const struct iocb* req) {
+    if (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV) {
+        unsigned long long length = 0;
+        for (int i = 0; i < req->u.v.nr_segs; ++i) length += req->u.v.vec[i].iov_len;
+        return length;
     }
-    context->ioCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
-    if (context->ioCompletionPort == NULL) {
-        DWORD last_error = GetLastError();
-        delete context;
-        return windows_error_to_errno(last_error);
+    if (req->aio_lio_opcode == IO_CMD_FSYNC || req->aio_lio_opcode == IO_CMD_FDSYNC) return 0;
+    return req->u.c.nbytes;
+}
+
+/// Whether every segment of a vectored iocb fits the DWORD that one ReadFile or WriteFile transfers.
+static bool segments_fit(const struct iocb* req) {
+    for (int i = 0; i < req->u.v.nr_segs; ++i) {
+        if (req->u.v.vec[i].iov_len > MAXDWORD) return false;
     }
-    *ctxp = context;
-    return 0;
+    return true;
 }
 
-LIO_API int io_submit(io_context_t ctx, long nr, struct iocb** iocbs) {
-    WinAioContext* context = static_cast<WinAioContext*>(ctx);
-    if (!context || !context->ioCompletionPort) return -EINVAL;
+/// Returns the file offset an iocb starts at.
+static long long request_offset(const struct iocb* req) {
+    bool is_vectored = (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV);
+    return is_vectored ? req->u.v.offset : req->u.c.offset;
+}
 
-    long iocbs_processed = 0;
-    for (long i = 0; i < nr; ++i) {
-        struct iocb* req = iocbs[i];
-        if (!req) continue;
+/**
+ * @brief Looks up the path of an open handle, without the "\\?\" prefix for plain drive paths.
+ * @param length Receives the path length, excluding the terminating NUL.
+ * @return A new[]-allocated path, or nullptr for pipes, devices and other handles without one.
+ */
+static char* query_file_path(HANDLE fileHandle, DWORD* length) {
+    *length = 0;
+    DWORD size = GetFinalPathNameByHandleA(fileHandle, NULL, 0, FILE_NAME_NORMALIZED);
+    char* path = size ? new (std::nothrow) char[size] : nullptr;
+    if (!path) return nullptr;
+    DWORD written = GetFinalPathNameByHandleA(fileHandle, path, size, FILE_NAME_NORMALIZED);
+    if (written == 0 || written >= size) {
+        delete[] path;
+        return nullptr;
+    }
+    if (written > 6 && memcmp(path, "\\\\?\\", 4) == 0 && path[5] == ':') {
+        memmove(path, path + 4, written - 3);
+        written -= 4;
+    }
+    *length = written;
+    return path;
+}
+
+/**
+ * @brief Finds a registered buffer group on a context.
+ * @return The group, or nullptr if `bgid` is not registered.
+ */
+static BufferGroup* find_buffer_group(WinAioContext* context, unsigned short bgid) {
+    AcquireSRWLockShared(&context->buffer_groups_lock);
+    BufferGroup* group = context->buffer_groups;
+    while (group && group->group_id != bgid) {
+        group = group->next;
+    }
+    ReleaseSRWLockShared(&context->buffer_groups_lock);
+    return group;
+}
 
-        HANDLE fileHandle = (HANDLE)_get_osfhandle(req->aio_fildes);
-        if (fileHandle == INVALID_HANDLE_VALUE) continue;
+static unsigned current_node();     // Defined under NUMA Placement.
+static void numa_count(unsigned node, NumaAccess access, unsigned long long count);
 
-        if (CreateIoCompletionPort(fileHandle, context->ioCompletionPort, 0, 0) == NULL) continue;
+/// True if an IO_CMD_PREAD_SELECT iocb names a group registered on the context whose buffers can hold its read.
+static bool provided_buffer_fits(WinAioContext* context, const struct iocb* req) {
+    BufferGroup* buffer_group = find_buffer_group(context, (unsigned short)(req->key & 0xFFFF));
+    return buffer_group && req->u.c.nbytes <= buffer_group->buffer_length;
+}
 
-        // --- Filesystem Synchronization Path ---
-        if (req->aio_lio_opcode == IO_CMD_FSYNC || req->aio_lio_opcode == IO_CMD_FDSYNC) {
-            if (!FlushFileBuffers(fileHandle)) {
-                // To report this failure, we could queue a no-op that will fail with the captured error.
-                // For simplicity here, we skip on immediate failure.
-                continue;
-            }
+/**
+ * @brief Takes a buffer from the group named by an IO_CMD_PREAD_SELECT iocb and points the iocb at it.
+ *
+ * The buffer is one on the calling thread's node if the group has any left.
+ * @param group Receives the group the buffer came from.
+ * @param bid Receives the buffer's ID, which the completion reports.
+ * @return ERROR_SUCCESS, or the Win32 error to complete the request with.
+ */
+static DWORD select_provided_buffer(WinAioContext* context, struct iocb* req, BufferGroup** group, unsigned short* bid) {
+    BufferGroup* buffer_group = find_buffer_group(context, (unsigned short)(req->key & 0xFFFF));
+    if (!buffer_group || req->u.c.nbytes > buffer_group->buffer_length) return ERROR_INVALID_PARAMETER;
 
-            // Queue a "no-op" async request to signal completion through the IOCP.
-            WinAioRequest* win_req = new (std::nothrow) WinAioRequest();
-            if (!win_req) break;
-            win_req->type = SINGLE_REQUEST;
-            win_req->iocb_single = req;
-            ZeroMemory(&win_req->overlapped, sizeof(OVERLAPPED));
-
-            DWORD dummy_bytes_read;
-            if (!ReadFile(fileHandle, NULL, 0, &dummy_bytes_read, &win_req->overlapped)) {
-                if (GetLastError() != ERROR_IO_PENDING) {
-                    delete win_req; // Unexpected failure.
-                    continue;
-                }
-            }
-            iocbs_processed++;
-            continue; // Move to the next iocb.
-        }
+    unsigned node = buffer_group->buffer_nodes ? current_node() : 0;
+    if (!buffer_group->acquire(node, bid)) return ERROR_NO_PROVIDED_BUFFER;
+    if (buffer_group->buffer_nodes && buffer_group->buffer_nodes[*bid] != node) numa_count(node, NUMA_REMOTE_BUFFER, 1);
+    req->u.c.buf = buffer_group->base + (size_t)*bid * buffer_group->buffer_length;
+    *group = buffer_group;
+    return ERROR_SUCCESS;
+}
 
-        // --- Read/Write Path ---
-        bool is_vectored = (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV);
+// --- Backend Probe ---
 
-        if (is_vectored) {
-            if (req->u.v.nr_segs == 0) {
-                iocbs_processed++;
-                continue;
-            }
-            VectoredRequestGroup* group = new (std::nothrow) VectoredRequestGroup(req);
-            if (!group) break;
-
-            long long current_offset = req->u.v.offset;
-            for (int seg = 0; seg < req->u.v.nr_segs; ++seg) {
-                WinAioRequest* win_req = new (std::nothrow) WinAioRequest();
-                if (!win_req) { delete group; goto cleanup_and_exit; }
-
-                win_req->type = VECTORED_SEGMENT;
-                win_req->group_vectored = group;
-                ZeroMemory(&win_req->overlapped, sizeof(OVERLAPPED));
-                win_req->overlapped.Offset = (DWORD)(current_offset & 0xFFFFFFFF);
-                win_req->overlapped.OffsetHigh = (DWORD)((current_offset >> 32) & 0xFFFFFFFF);
-
-                const struct iovec* iov = &req->u.v.vec[seg];
-                BOOL result = (req->aio_lio_opcode == IO_CMD_PREADV)
-                    ? ReadFile(fileHandle, iov->iov_base, (DWORD)iov->iov_len, NULL, &win_req->overlapped)
-                    : WriteFile(fileHandle, iov->iov_base, (DWORD)iov->iov_len, NULL, &win_req->overlapped);
-
-                if (!result && GetLastError() != ERROR_IO_PENDING) {
-                    delete win_req;
-                }
-                current_offset += iov->iov_len;
+/// FILE_MODE_INFORMATION flags, from the Windows DDK.
+static const ULONG FILE_NO_INTERMEDIATE_BUFFERING_MODE = 0x00000008;
+static const ULONG FILE_SYNCHRONOUS_IO_ALERT_MODE = 0x00000010;
+static const ULONG FILE_SYNCHRONOUS_IO_NONALERT_MODE = 0x00000020;
+static const int FILE_MODE_INFORMATION_CLASS = 16;
+
+struct IoStatusBlock {
+    union {
+        LONG Status;
+        PVOID Pointer;
+    };
+    ULONG_PTR Information;
+};
+
+typedef LONG(NTAPI* NtQueryInformationFileFn)(HANDLE, IoStatusBlock*, PVOID, ULONG, int);
+
+/// Processors per processor group, and the most processors the NUMA map covers.
+static const unsigned CPUS_PER_GROUP = sizeof(KAFFINITY) * 8;
+static const unsigned NUMA_MAX_CPUS = 2048;
+
+/**
+ * @struct BackendProbe
+ * @brief Process-wide, immutable once initialized: what the engine can do on this system.
+ */
+struct BackendProbe {
+    io_backend_caps caps;
+    NtQueryInformationFileFn query_information_file;
+    unsigned grow_after_us;     ///< Saturation that must persist before an elastic worker starts.
+    unsigned shrink_after_ms;   ///< Idle time after which an elastic worker retires.
+    unsigned file_stats_budget; ///< Exact per-file counters each new context gets (0 = per-file stats off).
+    unsigned sim_latency_us;    ///< Completion latency of the simulated device.
+    long long qpc_frequency;
+    bool numa_placement;        ///< Requests, provided buffers and pool workers are kept per node.
+    bool locked_pool_queue;     ///< Pool workers take from one locked FIFO, for comparison with the deques.
+    unsigned char node_of_cpu[NUMA_MAX_CPUS];    ///< Indexed by processor group * CPUS_PER_GROUP + number.
+    GROUP_AFFINITY node_affinity[NUMA_MAX_NODES]; ///< Each node's processors in its first group.
+};
+
+static INIT_ONCE g_probe_once = INIT_ONCE_STATIC_INIT;
+static BackendProbe g_probe;
+
+/// Most idle ports LIBAIO_WIN32_CONTEXT_POOL may ask for.
+static const unsigned CONTEXT_POOL_MAX = 1024;
+
+/**
+ * @brief Reads a small unsigned setting from the environment.
+ * @return The value, or `fallback` if the variable is unset or malformed.
+ */
+static unsigned env_unsigned(const char* name, unsigned fallback) {
+    char value[16];
+    DWORD length = GetEnvironmentVariableA(name, value, sizeof(value));
+    if (length == 0 || length >= sizeof(value)) return fallback;
+    unsigned result = 0;
+    for (DWORD i = 0; i < length; ++i) {
+        if (value[i] < '0' || value[i] > '9') return fallback;
+        result = result * 10 + (unsigned)(value[i] - '0');
+    }
+    return result;
+}
+
+/**
+ * @brief Maps each processor to its NUMA node, from the hardware or, with LIBAIO_WIN32_NUMA_NODES,
+ * by splitting the processors into that many equal ranges, so placement can be exercised on
+ * a single-node machine.
+ * @return The number of nodes, 1 on a single-node system.
+ */
+static unsigned probe_numa_topology(BackendProbe* probe) {
+    unsigned simulated = env_unsigned("LIBAIO_WIN32_NUMA_NODES", 0);
+    if (simulated > 1) {
+        unsigned nodes = simulated > NUMA_MAX_NODES ? NUMA_MAX_NODES : simulated;
+        unsigned long long total = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+        unsigned long long seen = 0;
+        WORD groups = GetActiveProcessorGroupCount();
+        for (WORD group = 0; group < groups; ++group) {
+            DWORD count = GetActiveProcessorCount(group);
+            for (DWORD number = 0; number < count && number < CPUS_PER_GROUP; ++number) {
+                unsigned cpu = group * CPUS_PER_GROUP + number;
+                if (cpu >= NUMA_MAX_CPUS || !total) break;
+                unsigned node = (unsigned)(seen++ * nodes / total);
+                probe->node_of_cpu[cpu] = (unsigned char)node;
+                GROUP_AFFINITY* affinity = &probe->node_affinity[node];
+                if (!affinity->Mask) affinity->Group = group;
+                if (affinity->Group == group) affinity->Mask |= (KAFFINITY)1 << number;
             }
         }
-        else { // Single I/O
-            WinAioRequest* win_req = new (std::nothrow) WinAioRequest();
-            if (!win_req) break;
-            win_req->type = SINGLE_REQUEST;
-            win_req->iocb_single = req;
+        probe->caps.features |= IO_CAP_NUMA_SIMULATED;
+        return nodes;
+    }
 
-            ZeroMemory(&win_req->overlapped, sizeof(OVERLAPPED));
-            win_req->overlapped.Offset = (DWORD)(req->u.c.offset & 0xFFFFFFFF);
-            win_req->overlapped.OffsetHigh = (DWORD)((req->u.c.offset >> 32) & 0xFFFFFFFF);
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest) || highest == 0) return 1;
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationNumaNode, nullptr, &length);
+    char* buffer = length ? new (std::nothrow) char[length] : nullptr;
+    if (!buffer || !GetLogicalProcessorInformationEx(RelationNumaNode, reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(buffer), &length)) {
+        delete[] buffer;
+        return 1;
+    }
+    unsigned nodes = 1;
+    for (DWORD offset = 0; offset < length;) {
+        const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info = reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer + offset);
+        DWORD node = info->NumaNode.NodeNumber;
+        const GROUP_AFFINITY& mask = info->NumaNode.GroupMask;
+        if (node < NUMA_MAX_NODES) {
+            if (!probe->node_affinity[node].Mask) probe->node_affinity[node] = mask;
+            for (unsigned number = 0; number < CPUS_PER_GROUP; ++number) {
+                unsigned cpu = mask.Group * CPUS_PER_GROUP + number;
+                if (((mask.Mask >> number) & 1) && cpu < NUMA_MAX_CPUS) probe->node_of_cpu[cpu] = (unsigned char)node;
+            }
+            if (node + 1 > nodes) nodes = node + 1;
+        }
+        offset += info->Size;
+    }
+    delete[] buffer;
+    return nodes;
+}
 
-            BOOL result = (req->aio_lio_opcode == IO_CMD_PREAD)
-                ? ReadFile(fileHandle, req->u.c.buf, (DWORD)req->u.c.nbytes, NULL, &win_req->overlapped)
-                : WriteFile(fileHandle, req->u.c.buf, (DWORD)req->u.c.nbytes, NULL, &win_req->overlapped);
+TRACELOGGING_DECLARE_PROVIDER(g_etw_provider);   // Defined under ETW Events; registered by the probe.
+static bool g_profile_report_at_exit = false;   ///< Set by the probe for LIBAIO_WIN32_PROFILE.
 
-            if (!result && GetLastError() != ERROR_IO_PENDING) {
-                delete win_req;
-                continue;
-            }
+/**
+ * @brief With LIBAIO_WIN32_LARGE_PAGES=1, checks that the account holds the "Lock pages in memory"
+ * privilege that large pages need. The probe only reads the token: the privilege is enabled by
+ * the first structure put on large pages (enable_lock_memory_privilege).
+ * @return The large page size, or 0 if large pages are off, unsupported or not permitted.
+ */
+static unsigned probe_large_pages() {
+    if (env_unsigned("LIBAIO_WIN32_LARGE_PAGES", 0) == 0) return 0;
+    SIZE_T size = GetLargePageMinimum();
+    if (size == 0 || size > 0x80000000u) return 0;
+    LUID lock_memory;
+    if (!LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &lock_memory)) return 0;
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) return 0;
+    DWORD length = 0;
+    GetTokenInformation(token, TokenPrivileges, nullptr, 0, &length);
+    char* buffer = length ? new (std::nothrow) char[length] : nullptr;
+    bool held = false;
+    if (buffer && GetTokenInformation(token, TokenPrivileges, buffer, length, &length)) {
+        const TOKEN_PRIVILEGES* privileges = reinterpret_cast<const TOKEN_PRIVILEGES*>(buffer);
+        for (DWORD i = 0; i < privileges->PrivilegeCount; ++i) {
+            const LUID& luid = privileges->Privileges[i].Luid;
+            if (luid.LowPart == lock_memory.LowPart && luid.HighPart == lock_memory.HighPart) held = true;
         }
-        iocbs_processed++;
     }
-cleanup_and_exit:
-    return iocbs_processed;
+    delete[] buffer;
+    CloseHandle(token);
+    return held ? (unsigned)size : 0;
 }
 
-LIO_API int io_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
-    WinAioContext* context = static_cast<WinAioContext*>(ctx);
-    if (!context || !context->ioCompletionPort || min_nr < 0 || min_nr > nr || !events) return -EINVAL;
-    if (min_nr == 0 && nr == 0) return 0;
+/**
+ * @brief Runs the one-time probe. It performs no I/O, only symbol, environment, NUMA topology and
+ * token lookups, and changes nothing in the process, so its cost is a few microseconds regardless of the system's storage.
+ */
+static BOOL CALLBACK run_backend_probe(PINIT_ONCE, PVOID, PVOID*) {
+    LARGE_INTEGER frequency, started, finished;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&started);
+    g_probe.qpc_frequency = frequency.QuadPart;
 
-    DWORD timeout_ms = timespec_to_ms(timeout);
-    long events_collected = 0;
+    g_probe.caps.backends = (1u << IO_BACKEND_IOCP) | (1u << IO_BACKEND_THREADPOOL)
+                          | (1u << IO_BACKEND_NULL) | (1u << IO_BACKEND_SIMULATED);
+    g_probe.caps.features = 0;
 
-    while (events_collected < nr) {
-        DWORD bytesTransferred = 0;
-        ULONG_PTR completionKey = 0;
-        LPOVERLAPPED overlapped_ptr = NULL;
-        DWORD current_timeout = (events_collected < min_nr) ? timeout_ms : 0;
+    HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+    g_probe.query_information_file = ntdll
+        ? reinterpret_cast<NtQueryInformationFileFn>(GetProcAddress(ntdll, "NtQueryInformationFile"))
+        : nullptr;
+    if (g_probe.query_information_file) {
+        g_probe.caps.features |= IO_CAP_FILE_MODE_QUERY;
+    }
 
-        BOOL status = GetQueuedCompletionStatus(context->ioCompletionPort, &bytesTransferred, &completionKey, &overlapped_ptr, current_timeout);
+    g_probe.caps.forced_backend = IO_BACKEND_AUTO;
+    char forced[16];
+    DWORD length = GetEnvironmentVariableA("LIBAIO_WIN32_BACKEND", forced, sizeof(forced));
+    if (length > 0 && length < sizeof(forced)) {
+        if (lstrcmpiA(forced, "iocp") == 0) g_probe.caps.forced_backend = IO_BACKEND_IOCP;
+        else if (lstrcmpiA(forced, "threadpool") == 0) g_probe.caps.forced_backend = IO_BACKEND_THREADPOOL;
+        else if (lstrcmpiA(forced, "null") == 0) g_probe.caps.forced_backend = IO_BACKEND_NULL;
+        else if (lstrcmpiA(forced, "simulated") == 0) g_probe.caps.forced_backend = IO_BACKEND_SIMULATED;
+    }
+    g_probe.sim_latency_us = env_unsigned("LIBAIO_WIN32_SIM_LATENCY_US", 100);
 
-        if (!overlapped_ptr) {
-            // GetQueuedCompletionStatus itself failed without dequeuing a packet.
-            DWORD last_error = GetLastError();
-            // Timeout is an expected way to stop waiting, not an error.
-            if (last_error != WAIT_TIMEOUT) {
-                return windows_error_to_errno(last_error);
-            }
-            break; // Break loop on timeout.
-        }
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    unsigned workers = env_unsigned("LIBAIO_WIN32_WORKERS", system_info.dwNumberOfProcessors);
+    g_probe.caps.worker_threads = workers < 1 ? 1 : (workers > 256 ? 256 : workers);
 
-        WinAioRequest* win_req = CONTAINING_RECORD(overlapped_ptr, WinAioRequest, overlapped);
-        bool is_group_complete = false;
+    // Elastic workers: up to 4x the core count, started after 2 ms of saturation, retired after 5 s idle.
+    unsigned max_workers = env_unsigned("LIBAIO_WIN32_MAX_WORKERS", g_probe.caps.worker_threads * 4);
+    g_probe.caps.max_worker_threads = max_workers < g_probe.caps.worker_threads
+        ? g_probe.caps.worker_threads : (max_workers > 256 ? 256 : max_workers);
+    g_probe.grow_after_us = env_unsigned("LIBAIO_WIN32_GROW_AFTER_US", 2000);
+    g_probe.shrink_after_ms = env_unsigned("LIBAIO_WIN32_SHRINK_AFTER_MS", 5000);
+    char pool_queue[16];
+    DWORD pool_queue_length = GetEnvironmentVariableA("LIBAIO_WIN32_POOL_QUEUE", pool_queue, sizeof(pool_queue));
+    g_probe.locked_pool_queue = pool_queue_length > 0 && pool_queue_length < sizeof(pool_queue) && lstrcmpiA(pool_queue, "locked") == 0;
+    if (g_probe.locked_pool_queue) g_probe.caps.features |= IO_CAP_LOCKED_POOL_QUEUE;
 
-        DWORD io_error = 0;
-        if (!status) {
-            io_error = GetLastError();
-        }
+    // By default one volume may use half the pool, so a stalled device always leaves workers for the rest.
+    unsigned device_workers = env_unsigned("LIBAIO_WIN32_DEVICE_WORKERS", (g_probe.caps.max_worker_threads + 1) / 2);
+    g_probe.caps.device_workers = device_workers < 1 ? 1
+        : (device_workers > g_probe.caps.max_worker_threads ? g_probe.caps.max_worker_threads : device_workers);
+    g_probe.caps.device_backlog = env_unsigned("LIBAIO_WIN32_DEVICE_BACKLOG", 0);
+    unsigned context_pool = env_unsigned("LIBAIO_WIN32_CONTEXT_POOL", 8);
+    g_probe.caps.context_pool = context_pool > CONTEXT_POOL_MAX ? CONTEXT_POOL_MAX : context_pool;
+    g_probe.file_stats_budget = env_unsigned("LIBAIO_WIN32_FILE_STATS", 0);
+    g_probe.caps.destroy_timeout_ms = env_unsigned("LIBAIO_WIN32_DESTROY_TIMEOUT_MS", 10000);
+    g_probe.caps.numa_nodes = probe_numa_topology(&g_probe);
+    g_probe.numa_placement = g_probe.caps.numa_nodes > 1 && env_unsigned("LIBAIO_WIN32_NUMA", 1) != 0;
+    if (g_probe.numa_placement) g_probe.caps.features |= IO_CAP_NUMA_PLACEMENT;
+    g_probe.caps.large_page_size = probe_large_pages();
+    if (g_probe.caps.large_page_size) g_probe.caps.features |= IO_CAP_LARGE_PAGES;
+    char contexts[16];
+    length = GetEnvironmentVariableA("LIBAIO_WIN32_CONTEXTS", contexts, sizeof(contexts));
+    if (length > 0 && length < sizeof(contexts) && lstrcmpiA(contexts, "shared") == 0) {
+        g_probe.caps.features |= IO_CAP_SHARED_CONTEXTS;
+    }
+    unsigned watchdog_ms = env_unsigned("LIBAIO_WIN32_WATCHDOG_MS", 0);
+    bool profile = env_unsigned("LIBAIO_WIN32_PROFILE", 0) != 0;
 
-        if (win_req->type == SINGLE_REQUEST) {
-            struct io_event* current_event = &events[events_collected];
-            current_event->data = win_req->iocb_single->data;
-            current_event->obj = win_req->iocb_single;
-            current_event->res = status ? bytesTransferred : 0;
-            current_event->res2 = io_error; // res2 stores the positive Windows error code.
-            events_collected++;
-        }
-        else { // VECTORED_SEGMENT
-            VectoredRequestGroup* group = win_req->group_vectored;
-            if (status) {
-                group->total_bytes_transferred.fetch_add(bytesTransferred);
-            }
-            else {
-                unsigned long expected = 0;
-                group->first_error.compare_exchange_strong(expected, io_error);
-            }
+    QueryPerformanceCounter(&finished);
+    g_probe.caps.probe_ns = (finished.QuadPart - started.QuadPart) * 1000000000LL / frequency.QuadPart;
 
-            if (group->completed_segments.fetch_add(1) + 1 == group->total_segments) {
-                is_group_complete = true;
-                struct io_event* current_event = &events[events_collected];
-                current_event->data = group->original_iocb->data;
-                current_event->obj = group->original_iocb;
-                current_event->res = group->total_bytes_transferred.load();
-                current_event->res2 = group->first_error.load(); // Store the positive error code.
-                events_collected++;
-            }
-        }
+    // Tracing and stats requested through the environment start with the first context, outside the timed probe.
+    char trace_path[MAX_PATH];
+    length = GetEnvironmentVariableA("LIBAIO_WIN32_TRACE", trace_path, sizeof(trace_path));
+    if (length > 0 && length < sizeof(trace_path)) {
+        io_trace_start(trace_path);
+    }
+    if (env_unsigned("LIBAIO_WIN32_STATS", 0)) {
+        io_stats_publish();
+    }
+    if (watchdog_ms) {
+        io_watchdog_start(watchdog_ms, nullptr, nullptr);
+    }
+    if (profile && io_profile_start() == 0) {
+        g_profile_report_at_exit = true;
+    }
+    TraceLoggingRegister(g_etw_provider);
+    return TRUE;
+}
 
-        delete win_req;
-        if (is_group_complete) {
-            delete win_req->group_vectored;
-        }
+static const BackendProbe& backend_probe() {
+    InitOnceExecuteOnce(&g_probe_once, run_backend_probe, NULL, NULL);
+    return g_probe;
+}
 
-        if (events_collected >= min_nr && current_timeout == 0) {
-            break;
-        }
+/**
+ * @brief Chooses the engine for a newly seen handle.
+ *
+ * Overlapped handles, including direct (unbuffered) ones, go to IOCP: the kernel queues the
+ * I/O and io_submit never blocks. Synchronous handles, which is what the CRT's _open returns,
+ * would make every ReadFile/WriteFile block inside io_submit, so they go to the worker pool.
+ */
+static int choose_backend(HANDLE fileHandle) {
+    const BackendProbe& probe = backend_probe();
+    if (probe.caps.forced_backend != IO_BACKEND_AUTO) return probe.caps.forced_backend;
+    if (!probe.query_information_file) return IO_BACKEND_IOCP;
+
+    IoStatusBlock status_block;
+    ULONG mode = 0;
+    if (probe.query_information_file(fileHandle, &status_block, &mode, sizeof(mode), FILE_MODE_INFORMATION_CLASS) < 0) {
+        return IO_BACKEND_IOCP;
     }
-    return events_collected;
+    if (mode & FILE_NO_INTERMEDIATE_BUFFERING_MODE) return IO_BACKEND_IOCP;
+    if (mode & (FILE_SYNCHRONOUS_IO_ALERT_MODE | FILE_SYNCHRONOUS_IO_NONALERT_MODE)) return IO_BACKEND_THREADPOOL;
+    return IO_BACKEND_IOCP;
 }
 
-LIO_API int io_destroy(io_context_t ctx) {
+// --- NUMA Placement ---
+// Windows puts a committed page on the node of the thread that first touches it. The library
+// keeps free requests and provided buffers on per-node stacks and hands out those of the
+// calling thread's node, and pins pool workers to nodes, so that on a multi-socket machine a
+// request's record, its buffer and the threads that run and reap it share a node wherever the
+// application lets them.
+
+/// Node the calling thread was bound to by io_numa_bind_thread or as a pool worker, or ~0u.
+static thread_local unsigned t_numa_node = ~0u;
+static NumaCounters g_numa_counters[NUMA_MAX_NODES];
+
+/// Free stacks a slab or buffer group keeps: one per node with NUMA placement, else one.
+static unsigned numa_lists() {
+    return g_probe.numa_placement ? g_probe.caps.numa_nodes : 1;
+}
+
+/// The node of the processor the calling thread runs on, or the node it is bound to.
+static unsigned current_node() {
+    if (t_numa_node != ~0u) return t_numa_node;
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+    unsigned cpu = processor.Group * CPUS_PER_GROUP + processor.Number;
+    return cpu < NUMA_MAX_CPUS ? g_probe.node_of_cpu[cpu] : 0;
+}
+
+static void numa_count(unsigned node, NumaAccess access, unsigned long long count) {
+    g_numa_counters[node].remote[access].fetch_add(count, std::memory_order_relaxed);
+}
+
+/// Pins the calling thread to a node's processors and treats it as running there from now on.
+static bool bind_to_node(unsigned node) {
+    if (!SetThreadGroupAffinity(GetCurrentThread(), &g_probe.node_affinity[node], NULL)) return false;
+    t_numa_node = node;
+    return true;
+}
+
+/**
+ * @brief Assigns each buffer of a new group to a node: the node its first page is resident on, or,
+ * for memory not touched yet, an equal share of the region per node, which that node's reads
+ * then fault in locally.
+ */
+static void numa_classify_buffers(BufferGroup* group) {
+    unsigned nodes = g_probe.caps.numa_nodes;
+    for (unsigned bid = 0; bid < group->buffer_count; ++bid) {
+        group->buffer_nodes[bid] = (unsigned char)((unsigned long long)bid * nodes / group->buffer_count);
+    }
+    if (g_probe.caps.features & IO_CAP_NUMA_SIMULATED) return; // Simulated nodes own no memory.
+
+    PSAPI_WORKING_SET_EX_INFORMATION* pages = new (std::nothrow) PSAPI_WORKING_SET_EX_INFORMATION[group->buffer_count];
+    if (!pages) return;
+    for (unsigned bid = 0; bid < group->buffer_count; ++bid) {
+        pages[bid].VirtualAddress = group->base + (size_t)bid * group->buffer_length;
+    }
+    if (QueryWorkingSetEx(GetCurrentProcess(), pages, (DWORD)(group->buffer_count * sizeof(*pages)))) {
+        for (unsigned bid = 0; bid < group->buffer_count; ++bid) {
+            if (pages[bid].VirtualAttributes.Valid && pages[bid].VirtualAttributes.Node < nodes) {
+                group->buffer_nodes[bid] = (unsigned char)pages[bid].VirtualAttributes.Node;
+            }
+        }
+    }
+    delete[] pages;
+}
+
+// --- Large Pages ---
+// At a depth of thousands, the request slab and the in-flight index span hundreds of 4 KiB
+// pages, touched in no particular order by every submission and completion, which is more than
+// the data TLB holds. On one or two large pages each, they cost a TLB entry or two.
+
+/// Smallest structure put on large pages. Below 64 small pages it fits the first-level data TLB
+/// of current x64 cores anyway, and a mostly empty 2 MiB page would only cost memory.
+static const size_t LARGE_PAGES_MIN_BYTES = 256 * 1024;
+
+static std::atomic<unsigned long long> g_large_page_regions(0);
+static std::atomic<unsigned long long> g_large_page_bytes(0);
+static std::atomic<unsigned long long> g_large_page_fallbacks(0);
+static INIT_ONCE g_lock_memory_once = INIT_ONCE_STATIC_INIT;
+static bool g_lock_memory_enabled = false;
+
+/**
+ * @brief Enables the "Lock pages in memory" privilege on the process token, once, for the first
+ * structure put on large pages. The probe found it held; enabling it only activates it, but it
+ * stays enabled for the rest of the process, which is why only LIBAIO_WIN32_LARGE_PAGES=1 and a
+ * structure that qualifies get this far.
+ */
+static BOOL CALLBACK enable_lock_memory_privilege(PINIT_ONCE, PVOID, PVOID*) {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return TRUE;
+    TOKEN_PRIVILEGES privileges = {};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    // AdjustTokenPrivileges succeeds with ERROR_NOT_ALL_ASSIGNED when the account lacks the privilege.
+    g_lock_memory_enabled = LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+        && AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL)
+        && GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return TRUE;
+}
+
+/**
+ * @brief Commits a structure on large pages, if they are on and it is big enough to gain from them.
+ * @param granted Receives the bytes committed, whole large pages, or 0.
+ * @return Zeroed memory, or nullptr if the caller should use small pages.
+ */
+static void* large_pages_alloc(size_t bytes, size_t* granted) {
+    *granted = 0;
+    size_t page = g_probe.caps.large_page_size;
+    if (!page || bytes < LARGE_PAGES_MIN_BYTES) return nullptr;
+    InitOnceExecuteOnce(&g_lock_memory_once, enable_lock_memory_privilege, NULL, NULL);
+    if (!g_lock_memory_enabled) {
+        g_large_page_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    size_t rounded = (bytes + page - 1) / page * page;
+    void* memory = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (!memory) {
+        // Physical memory is too fragmented for that many contiguous large pages.
+        g_large_page_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    g_large_page_regions.fetch_add(1, std::memory_order_relaxed);
+    g_large_page_bytes.fetch_add(rounded, std::memory_order_relaxed);
+    *granted = rounded;
+    return memory;
+}
+
+static void large_pages_free(void* memory, size_t granted) {
+    VirtualFree(memory, 0, MEM_RELEASE);
+    g_large_page_regions.fetch_sub(1, std::memory_order_relaxed);
+    g_large_page_bytes.fetch_sub(granted, std::memory_order_relaxed);
+}
+
+// --- Trace Recorder ---
+
+/// Records buffered between flushes. Writers drop records rather than wait when the ring is full.
+static const unsigned TRACE_RING_SIZE = 65536;
+static const unsigned TRACE_BATCH_SIZE = 1024;
+static const DWORD TRACE_FLUSH_INTERVAL_MS = 5;
+
+struct TraceSlot {
+    std::atomic<unsigned long long> sequence;
+    unsigned session;
+    aio_trace_record record;
+};
+
+/// A file path waiting to be written, queued when a context first submits to a descriptor.
+struct TracePath {
+    TracePath* next;
+    unsigned session;
+    aio_trace_record record;
+    char* path;
+};
+
+/**
+ * @struct TraceRecorder
+ * @brief Process-wide trace state.
+ *
+ * Submitting and reaping threads append fixed-size records to a bounded multi-producer ring
+ * (Vyukov's sequence-numbered slots); a single flusher thread drains it to the file every few
+ * milliseconds, so the I/O path never touches the trace file. Each start of a trace opens a new
+ * session. Session numbers are odd while recording, and the flusher discards records a writer
+ * stamped with an older session, so a writer racing io_trace_stop cannot leak into the next trace.
+ * The ring is allocated on the first start and kept for the life of the process for the same reason.
+ */
+struct TraceRecorder {
+    std::atomic<unsigned> session;
+    std::atomic<long long> start_ticks;
+    TraceSlot* slots;
+    alignas(64) std::atomic<unsigned long long> enqueue_position;
+    alignas(64) unsigned long long dequeue_position;    ///< Owned by the flusher.
+    std::atomic<unsigned long long> dropped;
+    TracePath* pending_paths;   ///< Guarded by g_trace_paths_lock; newest first.
+    HANDLE file;
+    HANDLE flusher;
+    HANDLE stop_event;
+    aio_trace_record batch[TRACE_BATCH_SIZE];   ///< The flusher's write buffer.
+};
+
+static TraceRecorder g_trace;
+static SRWLOCK g_trace_control_lock = SRWLOCK_INIT;    ///< Serializes io_trace_start and io_trace_stop.
+static SRWLOCK g_trace_paths_lock = SRWLOCK_INIT;
+
+/// Returns true, and the current session, if a trace is being recorded. Costs one load when it is not.
+static inline bool trace_active(unsigned* session) {
+    *session = g_trace.session.load(std::memory_order_acquire);
+    return (*session & 1) != 0;
+}
+
+static long long trace_ticks() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart - g_trace.start_ticks.load(std::memory_order_relaxed);
+}
+
+static void trace_fill(aio_trace_record* record, uint8_t kind, unsigned context_serial, const struct iocb* req) {
+    bool is_vectored = (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV);
+    record->kind = kind;
+    switch (req->aio_lio_opcode) {
+    case IO_CMD_FSYNC:  record->opcode = AIO_TRACE_OP_FSYNC; break;
+    case IO_CMD_FDSYNC: record->opcode = AIO_TRACE_OP_FDSYNC; break;
+    default:            record->opcode = (uint8_t)req->aio_lio_opcode; break; // The remaining opcodes share Linux's numbering.
+    }
+    record->segments = is_vectored ? (uint16_t)req->u.v.nr_segs : 0;
+    record->fd = req->aio_fildes;
+    record->context = context_serial;
+    record->error = 0;
+    record->id = (uint64_t)(uintptr_t)req;
+    record->offset = request_offset(req);
+    record->length = 0;
+}
+
+static void trace_push(unsigned session, const aio_trace_record& record) {
+    unsigned long long position = g_trace.enqueue_position.load(std::memory_order_relaxed);
+    TraceSlot* slot;
+    for (;;) {
+        slot = &g_trace.slots[position & (TRACE_RING_SIZE - 1)];
+        long long lag = (long long)(slot->sequence.load(std::memory_order_acquire) - position);
+        if (lag == 0) {
+            if (g_trace.enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        }
+        else if (lag < 0) {
+            g_trace.dropped.fetch_add(1, std::memory_order_relaxed); // The flusher has fallen a full ring behind.
+            return;
+        }
+        else {
+            position = g_trace.enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+    slot->session = session;
+    slot->record = record;
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+/// Records an accepted iocb. `submitted_at` is sampled before the request is issued, so it precedes its completion.
+static void trace_submit(WinAioContext* context, unsigned session, const struct iocb* req, long long submitted_at) {
+    aio_trace_record record;
+    trace_fill(&record, AIO_TRACE_SUBMIT, context->serial, req);
+    record.length = request_length(req);
+    record.ticks = submitted_at;
+    trace_push(session, record);
+}
+
+static void trace_complete(WinAioContext* context, unsigned session, const Completion& done) {
+    aio_trace_record record;
+    trace_fill(&record, AIO_TRACE_COMPLETE, context->serial, done.obj);
+    record.error = (uint32_t)done.error;
+    record.length = done.bytes;
+    record.ticks = trace_ticks();
+    trace_push(session, record);
+}
+
+/**
+ * @brief Queues the path behind a descriptor the first time a context submits to it in this session.
+ *
+ * The flusher writes queued paths before it drains the ring, and the timestamp is taken before
+ * the entry is marked, so a FILE record precedes every submission that refers to it.
+ */
+static void trace_file(WinAioContext* context, unsigned session, int fd) {
+    long long seen_at = trace_ticks();
+    AcquireSRWLockExclusive(&context->files_lock);
+    FileEntry* slot = &context->files[fd];
+    bool already_traced = slot->traced_session == session;
+    slot->traced_session = session;
+    HANDLE fileHandle = slot->handle;
+    ReleaseSRWLockExclusive(&context->files_lock);
+    if (already_traced) return;
+
+    TracePath* entry = new (std::nothrow) TracePath();
+    if (!entry) return;
+    // Pipes and devices have no path; replay needs an explicit mapping for them.
+    DWORD length;
+    entry->path = query_file_path(fileHandle, &length);
+
+    entry->session = session;
+    entry->record = aio_trace_record();
+    entry->record.kind = AIO_TRACE_FILE;
+    entry->record.fd = fd;
+    entry->record.context = context->serial;
+    entry->record.length = length;
+    entry->record.ticks = seen_at;
+
+    AcquireSRWLockExclusive(&g_trace_paths_lock);
+    entry->next = g_trace.pending_paths;
+    g_trace.pending_paths = entry;
+    ReleaseSRWLockExclusive(&g_trace_paths_lock);
+}
+
+static void trace_write(const void* data, DWORD length) {
+    DWORD written;
+    WriteFile(g_trace.file, data, length, &written, NULL);
+}
+
+/// Takes the queued paths, oldest first.
+static TracePath* trace_take_paths() {
+    AcquireSRWLockExclusive(&g_trace_paths_lock);
+    TracePath* newest = g_trace.pending_paths;
+    g_trace.pending_paths = nullptr;
+    ReleaseSRWLockExclusive(&g_trace_paths_lock);
+
+    TracePath* oldest = nullptr;
+    while (newest) {
+        TracePath* next = newest->next;
+        newest->next = oldest;
+        oldest = newest;
+        newest = next;
+    }
+    return oldest;
+}
+
+/// Writes queued paths and everything published in the ring so far. Runs on the flusher only.
+static void trace_flush(unsigned session) {
+    for (TracePath* entry = trace_take_paths(); entry;) {
+        TracePath* next = entry->next;
+        if (entry->session == session) {
+            // The path follows its record, NUL-padded to a whole number of records.
+            static const char padding[sizeof(aio_trace_record)] = {};
+            DWORD length = (DWORD)entry->record.length;
+            trace_write(&entry->record, sizeof(entry->record));
+            if (length) trace_write(entry->path, length);
+            trace_write(padding, (DWORD)((sizeof(aio_trace_record) - length % sizeof(aio_trace_record)) % sizeof(aio_trace_record)));
+        }
+        delete[] entry->path;
+        delete entry;
+        entry = next;
+    }
+
+    unsigned batched = 0;
+    for (;;) {
+        TraceSlot* slot = &g_trace.slots[g_trace.dequeue_position & (TRACE_RING_SIZE - 1)];
+        if (slot->sequence.load(std::memory_order_acquire) != g_trace.dequeue_position + 1) break;
+        if (slot->session == session) g_trace.batch[batched++] = slot->record;
+        slot->sequence.store(g_trace.dequeue_position + TRACE_RING_SIZE, std::memory_order_release);
+        g_trace.dequeue_position++;
+        if (batched == TRACE_BATCH_SIZE) {
+            trace_write(g_trace.batch, batched * sizeof(aio_trace_record));
+            batched = 0;
+        }
+    }
+    if (batched) trace_write(g_trace.batch, batched * sizeof(aio_trace_record));
+}
+
+static DWORD WINAPI trace_flusher_main(LPVOID) {
+    unsigned session = g_trace.session.load(std::memory_order_relaxed);
+    while (WaitForSingleObject(g_trace.stop_event, TRACE_FLUSH_INTERVAL_MS) == WAIT_TIMEOUT) {
+        trace_flush(session);
+    }
+    trace_flush(session);
+    return 0;
+}
+
+// --- Stats Segment ---
+
+/**
+ * @struct StatsSegment
+ * @brief The process's published counters, laid out as described in libaio_stats.h.
+ *
+ * The mapping is created by the first io_stats_publish and kept for the life of the process,
+ * because contexts and file entries point into it. Slots change owner under g_stats_lock;
+ * the I/O path only adds to counters, with interlocked instructions and no lock.
+ */
+struct StatsSegment {
+    HANDLE mapping;
+    aio_stats_header* header;
+    aio_stats_context* contexts;
+    aio_stats_file* files;
+};
+
+static StatsSegment g_stats;
+static SRWLOCK g_stats_lock = SRWLOCK_INIT;    ///< Guards publication and slot ownership.
+
+static inline void stats_add(uint64_t* counter, uint64_t value) {
+    InterlockedExchangeAdd64(reinterpret_cast<volatile LONG64*>(counter), (LONG64)value);
+}
+
+/// Bumps a slot's seqlock. Interlocked increments are full barriers, so the owner change lies between two bumps.
+static inline void stats_bump_sequence(uint32_t* sequence) {
+    InterlockedIncrement(reinterpret_cast<volatile LONG*>(sequence));
+}
+
+static unsigned stats_class(short opcode) {
+    if (opcode == IO_CMD_PWRITE || opcode == IO_CMD_PWRITEV) return AIO_STATS_WRITE;
+    if (opcode == IO_CMD_FSYNC || opcode == IO_CMD_FDSYNC) return AIO_STATS_SYNC;
+    return AIO_STATS_READ;
+}
+
+/**
+ * @brief Claims a context slot for a new context.
+ * @return The slot, or nullptr if nothing is published or every slot is taken.
+ */
+static aio_stats_context* stats_claim_context(unsigned serial) {
+    AcquireSRWLockExclusive(&g_stats_lock);
+    aio_stats_context* slot = nullptr;
+    for (unsigned i = 0; g_stats.header && i < AIO_STATS_MAX_CONTEXTS && !slot; ++i) {
+        if (!g_stats.contexts[i].in_use) slot = &g_stats.contexts[i];
+    }
+    if (slot) {
+        stats_bump_sequence(&slot->sequence);
+        ZeroMemory(&slot->in_use, sizeof(*slot) - offsetof(aio_stats_context, in_use));
+        slot->in_use = 1;
+        slot->context = serial;
+        stats_bump_sequence(&slot->sequence);
+    }
+    else if (g_stats.header) {
+        stats_add(&g_stats.header->untracked_contexts, 1);
+    }
+    ReleaseSRWLockExclusive(&g_stats_lock);
+    return slot;
+}
+
+/**
+ * @brief Claims a file slot for a descriptor a tracked context has just resolved.
+ * @return The slot, or nullptr if every slot is taken.
+ */
+static aio_stats_file* stats_claim_file(unsigned serial, int fd, HANDLE fileHandle) {
+    DWORD length;
+    char* path = query_file_path(fileHandle, &length);
+
+    AcquireSRWLockExclusive(&g_stats_lock);
+    aio_stats_file* slot = nullptr;
+    for (unsigned i = 0; i < AIO_STATS_MAX_FILES && !slot; ++i) {
+        if (!g_stats.files[i].in_use) slot = &g_stats.files[i];
+    }
+    if (slot) {
+        stats_bump_sequence(&slot->sequence);
+        ZeroMemory(&slot->in_use, sizeof(*slot) - offsetof(aio_stats_file, in_use));
+        slot->in_use = 1;
+        slot->context = serial;
+        slot->fd = fd;
+        // Keep the end of an overlong path; the file name says more than the volume.
+        DWORD skip = length >= AIO_STATS_PATH_MAX ? length - (AIO_STATS_PATH_MAX - 1) : 0;
+        if (path) memcpy(slot->path, path + skip, length - skip);
+        stats_bump_sequence(&slot->sequence);
+    }
+    else {
+        stats_add(&g_stats.header->untracked_files, 1);
+    }
+    ReleaseSRWLockExclusive(&g_stats_lock);
+    delete[] path;
+    return slot;
+}
+
+/// Returns a context or file slot to the free pool. `sequence` and `in_use` lead both slot types.
+template <typename Slot>
+static void stats_release(Slot* slot) {
+    AcquireSRWLockExclusive(&g_stats_lock);
+    stats_bump_sequence(&slot->sequence);
+    slot->in_use = 0;
+    stats_bump_sequence(&slot->sequence);
+    ReleaseSRWLockExclusive(&g_stats_lock);
+}
+
+static void stats_submit(aio_stats_context* stats, aio_stats_file* file_stats, const struct iocb* req) {
+    stats_add(&stats->submitted, 1);
+    if (file_stats) {
+        unsigned request_class = stats_class(req->aio_lio_opcode);
+        stats_add(&file_stats->ops[request_class], 1);
+        stats_add(&file_stats->bytes[request_class], request_length(req));
+    }
+}
+
+/// Returns the time since a request was stamped with the low half of the QPC.
+static unsigned long long elapsed_ns(unsigned submitted_at) {
+    unsigned long long ticks = (unsigned)((unsigned)qpc_now() - submitted_at);
+    return ticks * 1000000000ULL / (unsigned long long)g_probe.qpc_frequency;
+}
+
+/// Counts a reaped event.
+static void stats_complete(aio_stats_context* stats, const Completion& done) {
+    unsigned request_class = stats_class(done.obj->aio_lio_opcode);
+    unsigned long long ns = elapsed_ns(done.submitted_at);
+    stats_add(&stats->completed[request_class], 1);
+    stats_add(&stats->bytes[request_class], done.bytes);
+    if (done.error) stats_add(&stats->errors, 1);
+    stats_add(&stats->latency[request_class][aio_stats_latency_bucket(ns)], 1);
+}
+
+// --- Per-File Counters ---
+
+static void file_counters_reset(FileCounters* counters) {
+    for (unsigned c = 0; c < AIO_STATS_CLASSES; ++c) {
+        counters->ops[c].store(0, std::memory_order_relaxed);
+        counters->bytes[c].store(0, std::memory_order_relaxed);
+    }
+    counters->completed.store(0, std::memory_order_relaxed);
+    counters->latency_ns.store(0, std::memory_order_relaxed);
+    counters->errors.store(0, std::memory_order_relaxed);
+}
+
+static unsigned long long hot_files_count(const HotFiles::Entry& entry, int order) {
+    const unsigned long long* weights = order == IO_FILE_STATS_BY_BYTES ? entry.bytes : entry.ops;
+    return entry.overcount + weights[AIO_STATS_READ] + weights[AIO_STATS_WRITE] + weights[AIO_STATS_SYNC];
+}
+
+/// Adds a request to one sketch. Caller holds the sketches' lock exclusively.
+static void hot_files_add(HotFiles::Sketch* sketch, int order, int fd, unsigned request_class, unsigned long long bytes) {
+    HotFiles::Entry* target = nullptr;
+    HotFiles::Entry* smallest = nullptr;
+    unsigned long long smallest_count = ~0ULL;
+    for (unsigned i = 0; i < sketch->used && !target; ++i) {
+        HotFiles::Entry* entry = &sketch->entries[i];
+        if (entry->fd == fd) {
+            target = entry;
+        }
+        else {
+            unsigned long long count = hot_files_count(*entry, order);
+            if (count < smallest_count) { smallest = entry; smallest_count = count; }
+        }
+    }
+    if (!target) {
+        if (sketch->used < HotFiles::CAPACITY) {
+            target = &sketch->entries[sketch->used++];
+            target->overcount = 0;
+        }
+        else {
+            target = smallest;
+            target->overcount = smallest_count;
+        }
+        target->fd = fd;
+        ZeroMemory(target->ops, sizeof(target->ops));
+        ZeroMemory(target->bytes, sizeof(target->bytes));
+    }
+    target->ops[request_class]++;
+    target->bytes[request_class] += bytes;
+}
+
+/// Counts an accepted request against its file's exact counters, or the sketches if it has none.
+static void file_stats_submit(HotFiles* hot_files, const FileEntry& file, const struct iocb* req) {
+    unsigned request_class = stats_class(req->aio_lio_opcode);
+    unsigned long long bytes = request_length(req);
+    if (file.counters) {
+        file.counters->ops[request_class].fetch_add(1, std::memory_order_relaxed);
+        file.counters->bytes[request_class].fetch_add(bytes, std::memory_order_relaxed);
+        return;
+    }
+    AcquireSRWLockExclusive(&hot_files->lock);
+    hot_files_add(&hot_files->by_ops, IO_FILE_STATS_BY_OPS, req->aio_fildes, request_class, bytes);
+    // A zero-weight update would only evict a monitored file for nothing.
+    if (bytes) hot_files_add(&hot_files->by_bytes, IO_FILE_STATS_BY_BYTES, req->aio_fildes, request_class, bytes);
+    ReleaseSRWLockExclusive(&hot_files->lock);
+}
+
+/**
+ * @brief Adds a reaped event's latency and outcome to its file's exact counters.
+ *
+ * Sketched files have no latency or error counts. If the descriptor was reused while the request
+ * was in flight, the event is counted against the new file.
+ */
+static void file_stats_complete(WinAioContext* context, const Completion& done) {
+    int fd = done.obj->aio_fildes;
+    AcquireSRWLockShared(&context->files_lock);
+    FileCounters* counters = fd < context->file_capacity ? context->files[fd].counters : nullptr;
+    ReleaseSRWLockShared(&context->files_lock);
+    if (!counters) return;
+    counters->completed.fetch_add(1, std::memory_order_relaxed);
+    counters->latency_ns.fetch_add(elapsed_ns(done.submitted_at), std::memory_order_relaxed);
+    if (done.error) counters->errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// The figure io_file_stats_top ranks by; for sketched files, it includes the possible overcount.
+static unsigned long long file_stats_rank(const struct io_file_stats& stats, int order) {
+    unsigned long long weight = order == IO_FILE_STATS_BY_BYTES
+        ? stats.read_bytes + stats.write_bytes
+        : stats.reads + stats.writes + stats.syncs;
+    return weight + stats.overcount;
+}
+
+// --- ETW Events ---
+
+TRACELOGGING_DEFINE_PROVIDER(g_etw_provider, AIO_ETW_PROVIDER_NAME, AIO_ETW_PROVIDER_GUID);
+
+/// Unregisters the provider when the module unloads, so ETW never calls back into an unmapped image.
+static struct EtwRegistration {
+    ~EtwRegistration() { TraceLoggingUnregister(g_etw_provider); }
+} g_etw_registration;
+
+/// True while any session listens.
+static inline bool etw_enabled() {
+    return TraceLoggingProviderEnabled(g_etw_provider, 0, 0);
+}
+
+static void etw_setup(WinAioContext* context, int maxevents) {
+    TraceLoggingWrite(g_etw_provider, "Setup",
+        TraceLoggingLevel(WINEVENT_LEVEL_INFO), TraceLoggingOpcode(AIO_ETW_SETUP), TraceLoggingKeyword(AIO_ETW_KEYWORD_SUBMIT),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+        TraceLoggingUInt32(context->serial, "serial"),
+        TraceLoggingInt32(maxevents, "maxevents"));
+}
+
+static inline void etw_submit(WinAioContext* context, const struct iocb* req) {
+    TraceLoggingWrite(g_etw_provider, "Submit",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), TraceLoggingOpcode(AIO_ETW_SUBMIT), TraceLoggingKeyword(AIO_ETW_KEYWORD_SUBMIT),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)req, "iocb"),
+        TraceLoggingInt32(req->aio_fildes, "fd"),
+        TraceLoggingUInt32((uint32_t)req->aio_lio_opcode, "opcode"),
+        TraceLoggingInt64(request_offset(req), "offset"),
+        TraceLoggingUInt64(request_length(req), "length"));
+}
+
+static inline void etw_issue(WinAioContext* context, const struct iocb* req, int backend, long long offset, unsigned long long length, unsigned submitted_at) {
+    TraceLoggingWrite(g_etw_provider, "Issue",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), TraceLoggingOpcode(AIO_ETW_ISSUE), TraceLoggingKeyword(AIO_ETW_KEYWORD_SUBMIT),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)req, "iocb"),
+        TraceLoggingUInt32((uint32_t)backend, "backend"),
+        TraceLoggingInt64(offset, "offset"),
+        TraceLoggingUInt64(length, "length"),
+        TraceLoggingUInt64(elapsed_ns(submitted_at), "queued_ns"));
+}
+
+/// Writes Complete for a whole request, or SegmentComplete for one segment of a vectored iocb.
+static inline void etw_complete(WinAioContext* context, const struct iocb* req, bool segment, unsigned long long bytes, DWORD error, unsigned submitted_at) {
+    if (segment) {
+        TraceLoggingWrite(g_etw_provider, "SegmentComplete",
+            TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), TraceLoggingOpcode(AIO_ETW_SEGMENT_COMPLETE), TraceLoggingKeyword(AIO_ETW_KEYWORD_COMPLETE),
+            TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+            TraceLoggingUInt64((uint64_t)(uintptr_t)req, "iocb"),
+            TraceLoggingUInt32((uint32_t)req->aio_lio_opcode, "opcode"),
+            TraceLoggingUInt64(bytes, "bytes"),
+            TraceLoggingUInt32(error, "error"),
+            TraceLoggingUInt64(elapsed_ns(submitted_at), "latency_ns"));
+        return;
+    }
+    TraceLoggingWrite(g_etw_provider, "Complete",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), TraceLoggingOpcode(AIO_ETW_COMPLETE), TraceLoggingKeyword(AIO_ETW_KEYWORD_COMPLETE),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)req, "iocb"),
+        TraceLoggingUInt32((uint32_t)req->aio_lio_opcode, "opcode"),
+        TraceLoggingUInt64(bytes, "bytes"),
+        TraceLoggingUInt32(error, "error"),
+        TraceLoggingUInt64(elapsed_ns(submitted_at), "latency_ns"));
+}
+
+static inline void etw_vectored_complete(WinAioContext* context, const Completion& done, long segments) {
+    TraceLoggingWrite(g_etw_provider, "VectoredComplete",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), TraceLoggingOpcode(AIO_ETW_VECTORED_COMPLETE), TraceLoggingKeyword(AIO_ETW_KEYWORD_COMPLETE),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)done.obj, "iocb"),
+        TraceLoggingUInt32((uint32_t)done.obj->aio_lio_opcode, "opcode"),
+        TraceLoggingUInt32((uint32_t)segments, "segments"),
+        TraceLoggingUInt64(done.bytes, "bytes"),
+        TraceLoggingUInt32(done.error, "error"),
+        TraceLoggingUInt64(elapsed_ns(done.submitted_at), "latency_ns"));
+}
+
+static inline void etw_reap(WinAioContext* context, long min_nr, long nr, long events, long long entered_at) {
+    TraceLoggingWrite(g_etw_provider, "Reap",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), TraceLoggingOpcode(AIO_ETW_REAP), TraceLoggingKeyword(AIO_ETW_KEYWORD_COMPLETE),
+        TraceLoggingUInt64((uint64_t)(uintptr_t)context, "ctx"),
+        TraceLoggingInt64(min_nr, "min_nr"),
+        TraceLoggingInt64(nr, "nr"),
+        TraceLoggingInt64(events, "events"),
+        TraceLoggingUInt64(entered_at ? (unsigned long long)(qpc_now() - entered_at) * 1000000000ULL / (unsigned long long)g_probe.qpc_frequency : 0, "wait_ns"));
+}
+
+// --- In-Flight Index ---
+
+static struct iocb* const INFLIGHT_CLAIMED = reinterpret_cast<struct iocb*>(1);
+static const unsigned INFLIGHT_MIN_SLOTS = 256;
+/// A thin context's smallest index: tens of thousands of them must stay cheap.
+static const unsigned THIN_INFLIGHT_MIN_SLOTS = 16;
+static const unsigned INFLIGHT_MAX_SLOTS = 1u << 20;
+
+/// Every live context, for the watchdog.
+static SRWLOCK g_contexts_lock = SRWLOCK_INIT;
+static WinAioContext* g_contexts = nullptr;
+
+/// Twice the caller's expected depth, rounded up to a power of two, keeps probe sequences short.
+static unsigned inflight_capacity(int maxevents, unsigned min_slots) {
+    unsigned wanted = maxevents <= 0 ? 0
+        : (maxevents >= (int)(INFLIGHT_MAX_SLOTS / 2) ? INFLIGHT_MAX_SLOTS : (unsigned)maxevents * 2);
+    unsigned capacity = min_slots;
+    while (capacity < wanted) capacity <<= 1;
+    return capacity;
+}
+
+/// Allocates an index of `slots` slots, on large pages when it is big enough to gain from them.
+static InflightSlot* inflight_alloc(unsigned slots, size_t* large_bytes) {
+    void* memory = large_pages_alloc((size_t)slots * sizeof(InflightSlot), large_bytes);
+    if (!memory) return new (std::nothrow) InflightSlot[slots];
+    InflightSlot* inflight = static_cast<InflightSlot*>(memory);
+    for (unsigned i = 0; i < slots; ++i) new (&inflight[i]) InflightSlot();
+    return inflight;
+}
+
+static void inflight_free(InflightSlot* inflight, size_t large_bytes) {
+    if (large_bytes) large_pages_free(inflight, large_bytes);
+    else delete[] inflight;
+}
+
+static inline unsigned inflight_home(const struct iocb* req, unsigned mask) {
+    return (unsigned)(((unsigned long long)(uintptr_t)req * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+/// Converts a QPC interval to nanoseconds without overflowing for intervals of days.
+static unsigned long long ticks_to_ns(long long ticks) {
+    unsigned long long frequency = (unsigned long long)g_probe.qpc_frequency;
+    unsigned long long whole = (unsigned long long)ticks / frequency;
+    return whole * 1000000000ULL + ((unsigned long long)ticks - whole * frequency) * 1000000000ULL / frequency;
+}
+
+/**
+ * @brief Indexes an iocb before it is issued, so a completion can never overtake its entry.
+ *
+ * Claims the first free slot from the iocb's home slot on. Submitters on different threads
+ * only meet when they probe the same slot, and then one CAS decides.
+ */
+static void inflight_add(WinAioContext* context, struct iocb* req, long long submitted_at) {
+    unsigned mask = context->inflight_mask;
+    unsigned index = inflight_home(req, mask);
+    for (unsigned probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+        InflightSlot& slot = context->inflight[index];
+        struct iocb* expected = nullptr;
+        if (slot.iocb.load(std::memory_order_relaxed) != nullptr
+            || !slot.iocb.compare_exchange_strong(expected, INFLIGHT_CLAIMED, std::memory_order_relaxed)) {
+            continue;
+        }
+        // The claimer owns the slot now, so the bump needs no read-modify-write.
+        slot.generation.store(slot.generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.submitted_at.store(submitted_at, std::memory_order_relaxed);
+        slot.offset.store(request_offset(req), std::memory_order_relaxed);
+        slot.length.store(request_length(req), std::memory_order_relaxed);
+        slot.fd.store(req->aio_fildes, std::memory_order_relaxed);
+        slot.opcode.store(req->aio_lio_opcode, std::memory_order_relaxed);
+        slot.iocb.store(req, std::memory_order_release);
+        return;
+    }
+    context->inflight_untracked.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Drops an iocb from the index once its event is produced, or its issue failed.
+ *
+ * An indexed iocb is found within a few probes. Only an iocb accepted while the index was full
+ * costs a full scan, after which it is known to have been one of the untracked.
+ * @return The iocb's full submission QPC, or 0 if it was not indexed.
+ */
+static long long inflight_remove(WinAioContext* context, const struct iocb* req) {
+    unsigned mask = context->inflight_mask;
+    unsigned index = inflight_home(req, mask);
+    for (unsigned probe = 0; probe <= mask; ++probe, index = (index + 1) & mask) {
+        InflightSlot& slot = context->inflight[index];
+        if (slot.iocb.load(std::memory_order_relaxed) == req) {
+            long long submitted_at = slot.submitted_at.load(std::memory_order_relaxed);
+            slot.iocb.store(nullptr, std::memory_order_release);
+            return submitted_at;
+        }
+    }
+    context->inflight_untracked.fetch_sub(1, std::memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * @brief Takes a consistent copy of an occupied slot.
+ * @return False if the slot is free, being filled in, or was reused during the copy.
+ */
+static bool inflight_read(const InflightSlot& slot, long long now, struct io_inflight_req* out, unsigned* generation) {
+    struct iocb* req = slot.iocb.load(std::memory_order_acquire);
+    if (!req || req == INFLIGHT_CLAIMED) return false;
+    unsigned claimed = slot.generation.load(std::memory_order_relaxed);
+    long long submitted_at = slot.submitted_at.load(std::memory_order_relaxed);
+    out->offset = slot.offset.load(std::memory_order_relaxed);
+    out->length = slot.length.load(std::memory_order_relaxed);
+    out->fd = slot.fd.load(std::memory_order_relaxed);
+    out->opcode = slot.opcode.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.iocb.load(std::memory_order_relaxed) != req || slot.generation.load(std::memory_order_relaxed) != claimed) {
+        return false;
+    }
+    out->obj = req;
+    out->age_ns = now > submitted_at ? ticks_to_ns(now - submitted_at) : 0;
+    *generation = claimed;
+    return true;
+}
+
+// --- Watchdog ---
+
+/**
+ * @struct Watchdog
+ * @brief The optional thread that reports requests stuck in flight. Set up before the thread
+ * starts and read-only while it runs.
+ */
+struct Watchdog {
+    HANDLE thread;
+    HANDLE stop_event;
+    unsigned threshold_ms;
+    io_watchdog_callback callback;  ///< nullptr to log instead.
+    void* arg;
+};
+
+static Watchdog g_watchdog;
+static SRWLOCK g_watchdog_lock = SRWLOCK_INIT;  ///< Serializes io_watchdog_start and io_watchdog_stop.
+
+static const char* opcode_name(int opcode) {
+    switch (opcode) {
+    case IO_CMD_PREAD: return "pread";
+    case IO_CMD_PWRITE: return "pwrite";
+    case IO_CMD_FSYNC: return "fsync";
+    case IO_CMD_FDSYNC: return "fdsync";
+    case IO_CMD_PREADV: return "preadv";
+    case IO_CMD_PWRITEV: return "pwritev";
+    case IO_CMD_PREAD_SELECT: return "pread_select";
+    default: return "unknown";
+    }
+}
+
+static void watchdog_log(WinAioContext* context, const struct io_inflight_req& req) {
+    char line[256];
+    snprintf(line, sizeof(line),
+        "libaio-win32: %s in flight for %llu ms (context %u, fd %d, offset %lld, length %llu, iocb %p)\n",
+        opcode_name(req.opcode), req.age_ns / 1000000, context->serial, req.fd, req.offset, req.length, (void*)req.obj);
+    OutputDebugStringA(line);
+    fputs(line, stderr);
+}
+
+/// Scans every context a few times per threshold period, reporting each overdue request once.
+static DWORD WINAPI watchdog_main(LPVOID) {
+    backend_probe();    // Ages need the QPC frequency; waits here if the probe itself started the watchdog.
+    DWORD interval = g_watchdog.threshold_ms / 4;
+    if (interval < 10) interval = 10;
+    if (interval > 1000) interval = 1000;
+    unsigned long long threshold_ns = (unsigned long long)g_watchdog.threshold_ms * 1000000ULL;
+
+    while (WaitForSingleObject(g_watchdog.stop_event, interval) == WAIT_TIMEOUT) {
+        AcquireSRWLockShared(&g_contexts_lock);
+        long long now = qpc_now();
+        for (WinAioContext* context = g_contexts; context; context = context->next_context) {
+            for (unsigned i = 0; i <= context->inflight_mask; ++i) {
+                InflightSlot& slot = context->inflight[i];
+                struct io_inflight_req req;
+                unsigned generation;
+                if (!inflight_read(slot, now, &req, &generation) || req.age_ns < threshold_ns) continue;
+                if (slot.reported.load(std::memory_order_relaxed) == generation) continue;
+                slot.reported.store(generation, std::memory_order_relaxed);
+                if (g_watchdog.callback) g_watchdog.callback(context, &req, g_watchdog.arg);
+                else watchdog_log(context, req);
+            }
+        }
+        ReleaseSRWLockShared(&g_contexts_lock);
+    }
+    return 0;
+}
+
+// --- Self-Profiling ---
+
+static const char* const PROFILE_PHASE_NAMES[IO_PROFILE_PHASES] = {
+    "io_submit", "file lookup", "request alloc", "issue",
+    "io_getevents", "dequeue", "completion", "vectored", "request free",
+    "worker",
+};
+
+/// Extra counter slot that calibration times itself into; never reported.
+static const unsigned PROFILE_CALIBRATION = IO_PROFILE_PHASES;
+
+/**
+ * @struct ProfileThread
+ * @brief One thread's phase counters. Only the owning thread writes them, with plain loads and
+ * stores; they are atomics so that io_profile_read copying them from another thread is defined.
+ */
+struct ProfileThread {
+    ProfileThread* next;
+    DWORD thread_id;
+    std::atomic<unsigned long long> calls[IO_PROFILE_PHASES + 1];
+    std::atomic<unsigned long long> cycles[IO_PROFILE_PHASES + 1];
+};
+
+struct Profiler {
+    std::atomic<bool> enabled;
+    std::atomic<ProfileThread*> threads;    ///< Every thread that ever timed a phase; kept until exit.
+    bool started;                   ///< io_profile_start has run at least once.
+    unsigned long long pair_cycles; ///< Calibrated cost of one profile_begin/profile_end pair.
+    unsigned long long started_cycles;
+    unsigned long long stopped_cycles;
+    long long started_qpc;
+    long long stopped_qpc;
+};
+
+static Profiler g_profile;
+static SRWLOCK g_profile_lock = SRWLOCK_INIT;   ///< Serializes start, stop and reads.
+static thread_local ProfileThread* t_profile = nullptr;
+
+static inline unsigned long long profile_clock() {
+#if defined(_M_X64) || defined(_M_IX86)
+    return __rdtsc();
+#else
+    return (unsigned long long)qpc_now();
+#endif
+}
+
+/// Starts timing a phase. Returns 0 while the profiler is off, which profile_end ignores.
+static inline unsigned long long profile_begin() {
+    return g_profile.enabled.load(std::memory_order_relaxed) ? profile_clock() : 0;
+}
+
+static ProfileThread* profile_register() {
+    ProfileThread* thread = new (std::nothrow) ProfileThread();
+    if (!thread) return nullptr;
+    thread->thread_id = GetCurrentThreadId();
+    for (unsigned phase = 0; phase <= IO_PROFILE_PHASES; ++phase) {
+        thread->calls[phase].store(0, std::memory_order_relaxed);
+        thread->cycles[phase].store(0, std::memory_order_relaxed);
+    }
+    ProfileThread* head = g_profile.threads.load(std::memory_order_relaxed);
+    do {
+        thread->next = head;
+    } while (!g_profile.threads.compare_exchange_weak(head, thread, std::memory_order_release, std::memory_order_relaxed));
+    t_profile = thread;
+    return thread;
+}
+
+/// Adds the time since `started` to a phase of the calling thread.
+static inline void profile_end(unsigned phase, unsigned long long started) {
+    if (!started) return;
+    unsigned long long cycles = profile_clock() - started;
+    ProfileThread* thread = t_profile;
+    if (!thread && !(thread = profile_register())) return;
+    thread->calls[phase].store(thread->calls[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    thread->cycles[phase].store(thread->cycles[phase].load(std::memory_order_relaxed) + cycles, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Measures what timing one phase costs, as the fastest of several rounds so that an
+ * interrupt does not inflate it. Runs with the profiler enabled, so it takes the real path.
+ */
+static unsigned long long profile_calibrate() {
+    const unsigned pairs = 256;
+    unsigned long long best = ~0ULL;
+    for (unsigned round = 0; round < 8; ++round) {
+        unsigned long long round_started = profile_clock();
+        for (unsigned i = 0; i < pairs; ++i) {
+            profile_end(PROFILE_CALIBRATION, profile_begin());
+        }
+        unsigned long long per_pair = (profile_clock() - round_started) / pairs;
+        if (per_pair < best) best = per_pair;
+    }
+    return best;
+}
+
+/// Appends printf-style text at `*used`, counting the full length even once `buf` is full.
+static void text_append(char* buf, size_t len, size_t* used, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(*used < len ? buf + *used : nullptr, *used < len ? len - *used : 0, format, args);
+    va_end(args);
+    if (length > 0) *used += (size_t)length;
+}
+
+/// Prints the breakdown when LIBAIO_WIN32_PROFILE asked for it.
+static struct ProfileExitReport {
+    ~ProfileExitReport() {
+        if (!g_profile_report_at_exit) return;
+        io_profile_stop();
+        int length = io_profile_format(nullptr, 0);
+        char* text = length > 0 ? new (std::nothrow) char[length + 1] : nullptr;
+        if (!text) return;
+        io_profile_format(text, (size_t)length + 1);
+        fputs(text, stderr);
+        delete[] text;
+    }
+} g_profile_exit_report;
+
+// --- File Table ---
+
+/**
+ * @brief Finds or creates the gate for the volume a handle lives on. Caller holds files_lock exclusively.
+ *
+ * Volumes are told apart by their serial number; handles whose volume cannot be queried
+ * (pipes, some network redirectors) share the gate for serial 0.
+ * @return The gate, or nullptr if out of memory.
+ */
+static DeviceGate* find_device_gate(WinAioContext* context, HANDLE fileHandle) {
+    BY_HANDLE_FILE_INFORMATION info;
+    DWORD serial = GetFileInformationByHandle(fileHandle, &info) ? info.dwVolumeSerialNumber : 0;
+
+    for (DeviceGate* device = context->devices; device; device = device->next) {
+        if (device->volume_serial == serial) return device;
+    }
+    DeviceGate* device = new (std::nothrow) DeviceGate();
+    if (!device) return nullptr;
+    device->volume_serial = serial;
+    device->limit = (long)backend_probe().caps.device_workers;
+    InitializeSRWLock(&device->lock);
+    device->active = 0;
+    device->overflow_head = device->overflow_tail = nullptr;
+    device->backlog.store(0, std::memory_order_relaxed);
+    device->next = context->devices;
+    context->devices = device;
+    return device;
+}
+
+/**
+ * @brief Resolves a file descriptor to its cached entry, selecting an engine on first sight.
+ *
+ * Each handle is associated with the completion port once, here, rather than on every submission.
+ * If association fails (typically because another context already owns the handle), the file
+ * falls back to the thread-pool engine, which does not need the association.
+ * @return ERROR_SUCCESS, or the Win32 error that prevents I/O on the descriptor.
+ */
+static DWORD resolve_file(WinAioContext* context, int fd, FileEntry* entry) {
+    HANDLE fileHandle = (HANDLE)_get_osfhandle(fd);
+    if (fileHandle == INVALID_HANDLE_VALUE) return ERROR_INVALID_HANDLE;
+
+    AcquireSRWLockShared(&context->files_lock);
+    // An entry without counters is revisited while per-file stats still have counters to hand out.
+    bool cached = fd < context->file_capacity && context->files[fd].handle == fileHandle
+        && (context->files[fd].counters || context->file_counters_used >= context->file_counter_budget);
+    if (cached) *entry = context->files[fd];
+    ReleaseSRWLockShared(&context->files_lock);
+    if (cached) return ERROR_SUCCESS;
+
+    AcquireSRWLockExclusive(&context->files_lock);
+    if (fd >= context->file_capacity) {
+        int capacity = context->file_capacity ? context->file_capacity : 64;
+        while (capacity <= fd) capacity *= 2;
+        FileEntry* files = new (std::nothrow) FileEntry[capacity];
+        if (!files) {
+            ReleaseSRWLockExclusive(&context->files_lock);
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+        for (int i = 0; i < capacity; ++i) {
+            files[i] = i < context->file_capacity ? context->files[i] : FileEntry{ NULL, IO_BACKEND_AUTO, nullptr, 0, nullptr, nullptr };
+        }
+        delete[] context->files;
+        context->files = files;
+        context->file_capacity = capacity;
+    }
+
+    FileEntry* slot = &context->files[fd];
+    if (slot->handle != fileHandle) {
+        DeviceGate* device = find_device_gate(context, fileHandle);
+        if (!device) {
+            ReleaseSRWLockExclusive(&context->files_lock);
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+        int backend = choose_backend(fileHandle);
+        if (backend == IO_BACKEND_IOCP) {
+            if (CreateIoCompletionPort(fileHandle, context->ioCompletionPort, 0, 0) != NULL) context->port_bound = true;
+            else backend = IO_BACKEND_THREADPOOL;
+        }
+        slot->handle = fileHandle;
+        slot->backend = backend;
+        slot->device = device;
+        slot->traced_session = 0;
+        // A reused descriptor is a different file, so its counters start over in a fresh slot.
+        if (slot->stats) stats_release(slot->stats);
+        slot->stats = context->stats ? stats_claim_file(context->serial, fd, fileHandle) : nullptr;
+        if (slot->counters) file_counters_reset(slot->counters);
+    }
+    // The first descriptors seen get exact counters, up to the budget; later ones are sketched.
+    if (!slot->counters && context->file_counters_used < context->file_counter_budget) {
+        slot->counters = new (std::nothrow) FileCounters();
+        if (slot->counters) {
+            file_counters_reset(slot->counters);
+            context->file_counters_used++;
+        }
+    }
+    *entry = *slot;
+    ReleaseSRWLockExclusive(&context->files_lock);
+    return ERROR_SUCCESS;
+}
+
+// --- Request Slab ---
+
+/// Records committed at a time: 64 KiB of requests and one page of links on x64.
+static const unsigned SLAB_CHUNK = 1024;
+/// Largest reservation, so a huge io_setup depth cannot exhaust a 32-bit address space.
+static const unsigned SLAB_MAX_RECORDS = sizeof(void*) == 8 ? (1u << 24) : (1u << 16);
+
+/**
+ * @brief Reserves, without committing, room for `maxevents` requests, and for their owners if `shared`.
+ * A dedicated context's slab is instead committed whole on large pages when they are on. The shared
+ * engine's reservation is far too large to commit up front.
+ */
+static bool slab_init(RequestSlab* slab, int maxevents, bool shared) {
+    unsigned wanted = maxevents <= 0 ? 1 : (std::min)((unsigned)maxevents, SLAB_MAX_RECORDS);
+    slab->lists = numa_lists();
+    // Room for a chunk per node, so no node has to borrow another's records while it is under its depth.
+    slab->capacity = (std::max)((wanted + SLAB_CHUNK - 1) / SLAB_CHUNK, slab->lists) * SLAB_CHUNK;
+    slab->committed = 0;
+    InitializeSRWLock(&slab->grow_lock);
+    slab->free_lists = new (std::nothrow) FreeStack[slab->lists];
+    slab->chunk_nodes = g_probe.caps.numa_nodes > 1 ? new (std::nothrow) unsigned char[slab->capacity / SLAB_CHUNK] : nullptr;
+    size_t record_bytes = sizeof(WinAioRequest) + sizeof(std::atomic<unsigned>) + (shared ? sizeof(std::atomic<WinAioContext*>) : 0);
+    size_t bytes = (size_t)slab->capacity * record_bytes;
+    void* base = shared ? nullptr : large_pages_alloc(bytes, &slab->large_bytes);
+    if (base) slab->large_node = slab->chunk_nodes ? current_node() : 0;
+    else base = VirtualAlloc(NULL, bytes, MEM_RESERVE, PAGE_READWRITE);
+    slab->records = static_cast<WinAioRequest*>(base);
+    slab->links = reinterpret_cast<std::atomic<unsigned>*>(slab->records + slab->capacity);
+    // The links of a whole number of chunks end on a pointer boundary.
+    slab->owners = shared ? reinterpret_cast<std::atomic<WinAioContext*>*>(slab->links + slab->capacity) : nullptr;
+    return base != NULL && slab->free_lists && (slab->chunk_nodes || g_probe.caps.numa_nodes == 1);
+}
+
+/// The NUMA node a slab record's memory is on. Only for slabs with `chunk_nodes`.
+static inline unsigned record_node(const RequestSlab* slab, const WinAioRequest* win_req) {
+    return slab->chunk_nodes[(unsigned)(win_req - slab->records) / SLAB_CHUNK];
+}
+
+/// Commits the records, links and owners of the chunk starting at record `first`.
+static bool slab_commit_chunk(RequestSlab* slab, unsigned first) {
+    return VirtualAlloc(slab->records + first, SLAB_CHUNK * sizeof(WinAioRequest), MEM_COMMIT, PAGE_READWRITE)
+        && VirtualAlloc(slab->links + first, SLAB_CHUNK * sizeof(std::atomic<unsigned>), MEM_COMMIT, PAGE_READWRITE)
+        && (!slab->owners || VirtualAlloc(slab->owners + first, SLAB_CHUNK * sizeof(*slab->owners), MEM_COMMIT, PAGE_READWRITE));
+}
+
+/**
+ * @brief Commits the next chunk, placed on `node`, and pushes its records onto free stack `list`.
+ * A large-page slab is already committed, so its chunks only need linking.
+ * @return true if that stack has free records, including ones another thread added meanwhile.
+ */
+static bool slab_grow(RequestSlab* slab, unsigned list, unsigned node) {
+    AcquireSRWLockExclusive(&slab->grow_lock);
+    bool available = !slab->free_lists[list].empty();
+    unsigned first = slab->committed;
+    if (!available && first < slab->capacity && (slab->large_bytes || slab_commit_chunk(slab, first))) {
+        unsigned last = first + SLAB_CHUNK - 1;
+        for (unsigned i = first; i < last; ++i) new (&slab->links[i]) std::atomic<unsigned>(i + 2);
+        new (&slab->links[last]) std::atomic<unsigned>(0);
+        if (slab->chunk_nodes && !slab->large_bytes) {
+            // Touch every page now, from the node that asked for the chunk, so the records land there.
+            // Zero is what a fresh record holds anyway: FREE_RECORD.
+            for (char* page = reinterpret_cast<char*>(slab->records + first); page < reinterpret_cast<char*>(slab->records + last + 1); page += 4096) {
+                *reinterpret_cast<volatile char*>(page) = 0;
+            }
+        }
+        if (slab->chunk_nodes) slab->chunk_nodes[first / SLAB_CHUNK] = (unsigned char)node;
+        slab->committed = last + 1;
+        slab->free_lists[list].push_chain(slab->links, first, last);
+        available = true;
+    }
+    ReleaseSRWLockExclusive(&slab->grow_lock);
+    return available;
+}
+
+/**
+ * @brief Pops a free record, preferring `node`'s: its own stack, then a chunk committed for it, then,
+ * once the whole reservation is committed, another node's stack.
+ * @return The record, or nullptr once the reservation is in use.
+ */
+static WinAioRequest* slab_take(RequestSlab* slab, unsigned node) {
+    // Every record of a large-page slab is on one node, so there is no nearer stack to prefer.
+    if (slab->large_bytes) node = slab->large_node;
+    unsigned home = slab->lists > 1 ? node : 0;
+    unsigned index;
+    do {
+        if (slab->free_lists[home].pop(slab->links, &index)) return &slab->records[index];
+    } while (slab_grow(slab, home, node));
+    for (unsigned i = 1; i < slab->lists; ++i) {
+        if (slab->free_lists[(home + i) % slab->lists].pop(slab->links, &index)) return &slab->records[index];
+    }
+    return nullptr;
+}
+
+static inline bool slab_owns(const RequestSlab* slab, const WinAioRequest* win_req) {
+    return win_req >= slab->records && win_req < slab->records + slab->capacity;
+}
+
+/// Pushes a record back onto the stack of the node its chunk is on, whichever thread frees it.
+static void slab_return(RequestSlab* slab, WinAioRequest* win_req) {
+    unsigned index = (unsigned)(win_req - slab->records);
+    slab->free_lists[slab->lists > 1 ? slab->chunk_nodes[index / SLAB_CHUNK] : 0].push(slab->links, index);
+}
+
+/**
+ * @brief Releases the slab if every committed record is free. A record still in flight may yet be
+ * written by the kernel, so then the slab is left mapped, as heap requests were left allocated.
+ */
+static void slab_destroy(RequestSlab* slab) {
+    if (slab->records) {
+        unsigned free_records = 0;
+        for (unsigned list = 0; list < slab->lists; ++list) {
+            for (unsigned top = (unsigned)(slab->free_lists[list].head.load(std::memory_order_acquire) & 0xFFFFFFFF);
+                 top && free_records <= slab->committed; top = slab->links[top - 1].load(std::memory_order_relaxed)) {
+                free_records++;
+            }
+        }
+        if (free_records == slab->committed) {
+            if (slab->large_bytes) large_pages_free(slab->records, slab->large_bytes);
+            else VirtualFree(slab->records, 0, MEM_RELEASE);
+        }
+    }
+    delete[] slab->free_lists;
+    delete[] slab->chunk_nodes;
+    slab->records = nullptr;
+    slab->free_lists = nullptr;
+    slab->chunk_nodes = nullptr;
+}
+
+/**
+ * @brief Takes a record for one of `context`'s requests, from its engine's slab while it has room.
+ *
+ * The shared engine finds a request's thin context through the slab, so its requests never
+ * come from the heap.
+ * @return The record, or nullptr if out of memory.
+ */
+/// Allocates a record from the heap and lists it on its context, for io_destroy to cancel.
+static WinAioRequest* heap_new_record(WinAioContext* context) {
+    HeapRequest* heap_req = new (std::nothrow) HeapRequest();
+    if (!heap_req) return nullptr;
+    AcquireSRWLockExclusive(&context->unindexed_lock);
+    heap_req->prev = nullptr;
+    heap_req->next = context->heap_requests;
+    if (heap_req->next) heap_req->next->prev = heap_req;
+    context->heap_requests = heap_req;
+    ReleaseSRWLockExclusive(&context->unindexed_lock);
+    return heap_req;
+}
+
+static WinAioRequest* slab_new_record(WinAioContext* context) {
+    RequestSlab* slab = &context->engine->slab;
+    unsigned node = slab->chunk_nodes ? current_node() : 0;
+    WinAioRequest* win_req = slab_take(slab, node);
+    if (win_req && slab->chunk_nodes && record_node(slab, win_req) != node) numa_count(node, NUMA_REMOTE_REQUEST, 1);
+    if (win_req && slab->owners) slab->owners[win_req - slab->records].store(context, std::memory_order_relaxed);
+    if (!win_req && !slab->owners) win_req = heap_new_record(context);
+    return win_req;
+}
+
+static void free_single_request(WinAioContext* context, WinAioRequest* win_req) {
+    RequestSlab* slab = &context->engine->slab;
+    if (!slab_owns(slab, win_req)) {
+        // Only a context with its own slab falls back to the heap, so it is the request's context.
+        HeapRequest* heap_req = static_cast<HeapRequest*>(win_req);
+        AcquireSRWLockExclusive(&context->unindexed_lock);
+        if (heap_req->prev) heap_req->prev->next = heap_req->next;
+        else context->heap_requests = heap_req->next;
+        if (heap_req->next) heap_req->next->prev = heap_req->prev;
+        ReleaseSRWLockExclusive(&context->unindexed_lock);
+        delete heap_req;
+        return;
+    }
+    // io_destroy tells live records from free ones by these marks.
+    win_req->type = FREE_RECORD;
+    if (slab->owners) slab->owners[win_req - slab->records].store(nullptr, std::memory_order_relaxed);
+    slab_return(slab, win_req);
+}
+
+/// The context a request was submitted on, given the engine that runs it.
+static inline WinAioContext* request_owner(WinAioContext* engine, const WinAioRequest* win_req) {
+    const RequestSlab& slab = engine->slab;
+    return slab.owners ? slab.owners[win_req - slab.records].load(std::memory_order_relaxed) : engine;
+}
+
+/**
+ * @brief Allocates a vectored iocb's group and its segments' OVERLAPPEDs in one block.
+ * @return The group, or nullptr if out of memory.
+ */
+static VectoredRequestGroup* new_vectored_group(WinAioContext* context, struct iocb* req, unsigned submitted_at) {
+    size_t bytes = sizeof(VectoredRequestGroup) + (size_t)req->u.v.nr_segs * sizeof(VectoredSegment);
+    void* block = ::operator new(bytes, std::nothrow);
+    if (!block) return nullptr;
+    VectoredRequestGroup* group = new (block) VectoredRequestGroup(context, req, submitted_at);
+    VectoredSegment* segments = group->segments();
+    for (int seg = 0; seg < req->u.v.nr_segs; ++seg) {
+        VectoredSegment* segment = new (&segments[seg]) VectoredSegment();
+        segment->type = VECTORED_SEGMENT;
+        segment->segment_index = (unsigned)seg;
+    }
+    AcquireSRWLockExclusive(&context->unindexed_lock);
+    group->next = context->vectored_groups;
+    if (group->next) group->next->prev = group;
+    context->vectored_groups = group;
+    ReleaseSRWLockExclusive(&context->unindexed_lock);
+    return group;
+}
+
+static void free_vectored_group(VectoredRequestGroup* group) {
+    WinAioContext* context = group->context;
+    AcquireSRWLockExclusive(&context->unindexed_lock);
+    if (group->prev) group->prev->next = group->next;
+    else context->vectored_groups = group->next;
+    if (group->next) group->next->prev = group->prev;
+    ReleaseSRWLockExclusive(&context->unindexed_lock);
+    group->~VectoredRequestGroup();
+    ::operator delete(group);
+}
+
+// --- Thread-Pool Engine ---
+
+/**
+ * @struct WorkDeque
+ * @brief A bounded Chase-Lev work-stealing deque of queued requests.
+ *
+ * Only the owning worker pushes at the bottom; any worker may steal from the top. The owner takes
+ * from the top as well, so that requests run in the order they arrived; a deque whose owner
+ * popped at the bottom would run the newest request first. Follows the C11 formulation of Le,
+ * Pop, Cohen and Zappa Nardelli (PPoPP 2013).
+ */
+struct WorkDeque {
+    static const long long CAPACITY = 256;
+
+    std::atomic<long long> top;
+    std::atomic<long long> bottom;
+    std::atomic<WinAioRequest*> slots[CAPACITY];
+
+    WorkDeque() : top(0), bottom(0) {
+        for (long long i = 0; i < CAPACITY; ++i) slots[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    /// Owner only. Returns false if the deque is full.
+    bool push(WinAioRequest* win_req) {
+        long long b = bottom.load(std::memory_order_relaxed);
+        long long t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY) return false;
+        slots[b & (CAPACITY - 1)].store(win_req, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Any thread. Takes the oldest request, or returns nullptr if empty or the race was lost.
+    WinAioRequest* steal() {
+        long long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long long b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return nullptr;
+        WinAioRequest* win_req = slots[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return win_req;
+    }
+
+    /// Owner only. Takes the oldest request, retrying a race lost to a thief while any are left.
+    WinAioRequest* take() {
+        while (!empty()) {
+            WinAioRequest* win_req = steal();
+            if (win_req) return win_req;
+        }
+        return nullptr;
+    }
+
+    bool empty() const {
+        return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+    }
+};
+
+/**
+ * @struct PoolWorker
+ * @brief One worker thread of the thread-pool engine.
+ *
+ * Submitters cannot push into a Chase-Lev deque they do not own, so they push onto the
+ * worker's lock-free inbox instead. The worker moves the whole inbox into its deque in one
+ * exchange, which is where the batched dequeue happens.
+ */
+struct alignas(64) PoolWorker {
+    WorkerPool* pool;
+    HANDLE thread;
+    HANDLE wake_event;                      ///< Auto-reset; signaled when work arrives while parked.
+    std::atomic<WinAioRequest*> inbox;      ///< LIFO list linked through next_queued.
+    std::atomic<bool> parked;
+    std::atomic<bool> running;              ///< False for an elastic slot with no live thread.
+    unsigned node;                          ///< NUMA node the worker is pinned to, with NUMA placement.
+    WorkDeque deque;
+};
+
+/**
+ * @struct WorkerPool
+ * @brief Worker threads that perform blocking I/O and post the results to the context's port.
+ *
+ * The first `core_workers` slots run for the pool's whole life and are the only ones
+ * submitters address. The remaining slots are elastic: they are started when the pool has
+ * been saturated for a while and only ever steal, so their inboxes stay empty and a slot
+ * can retire as soon as its own deque is.
+ */
+struct WorkerPool {
+    WinAioContext* context;                 ///< The context that leases the pool; changed only while every worker is idle.
+    PoolWorker* workers;
+    unsigned core_workers;
+    unsigned worker_capacity;               ///< Hard upper bound on live workers.
+    std::atomic<unsigned> slots_in_use;     ///< High-water mark of slots ever started.
+    std::atomic<unsigned> live_workers;
+    std::atomic<long> busy_workers;         ///< Workers currently inside a blocking transfer.
+    std::atomic<long> queued;               ///< Requests waiting in inboxes and deques.
+    std::atomic<long long> saturated_since; ///< QPC tick since which every worker has been busy with work queued, or 0.
+    std::atomic<long long> last_resize;     ///< QPC tick of the last start or retirement.
+    SRWLOCK resize_lock;
+    std::atomic<bool> shutting_down;
+
+    // LIBAIO_WIN32_POOL_QUEUE=locked: one FIFO, linked through next_queued, in place of the inboxes and deques.
+    SRWLOCK queue_lock;
+    WinAioRequest* queue_head;
+    WinAioRequest* queue_tail;
+};
+
+/**
+ * @brief Transfers one buffer at an absolute offset and waits for it to finish.
+ *
+ * Works for both synchronous and overlapped handles. Setting the low bit of hEvent keeps a
+ * handle that is associated with a completion port from queuing a packet for this transfer.
+ * @return ERROR_SUCCESS, or the Win32 error of the transfer.
+ */
+static DWORD blocking_transfer(HANDLE fileHandle, bool is_write, void* buf, DWORD length, long long offset, HANDLE event, DWORD* bytes) {
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+    overlapped.Offset = (DWORD)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (DWORD)((offset >> 32) & 0xFFFFFFFF);
+    overlapped.hEvent = (HANDLE)((ULONG_PTR)event | 1);
+
+    BOOL result = is_write
+        ? WriteFile(fileHandle, buf, length, bytes, &overlapped)
+        : ReadFile(fileHandle, buf, length, bytes, &overlapped);
+    if (result) return ERROR_SUCCESS;
+
+    DWORD error = GetLastError();
+    if (error != ERROR_IO_PENDING) return error;
+    WaitForSingleObject(event, INFINITE);
+    return GetOverlappedResult(fileHandle, &overlapped, bytes, FALSE) ? ERROR_SUCCESS : GetLastError();
+}
+
+/**
+ * @brief Performs a queued request on the calling worker and posts its completion.
+ *
+ * Posted packets carry the Win32 error in the completion key, since GetQueuedCompletionStatus
+ * reports success for every posted packet.
+ */
+static void run_pooled_request(WinAioContext* context, WinAioRequest* win_req, HANDLE event) {
+    unsigned long long worker_started = profile_begin();
+    struct iocb* req = win_req->iocb_single;
+    HANDLE fileHandle = (HANDLE)_get_osfhandle(req->aio_fildes);
+    unsigned long long total_bytes = 0;
+    DWORD error = ERROR_SUCCESS;
+    WinAioContext* owner = request_owner(context, win_req);
+    etw_issue(owner, req, IO_BACKEND_THREADPOOL, request_offset(req), request_length(req), win_req->submitted_at);
+
+    if (owner->closing.load(std::memory_order_relaxed)) {
+        error = ERROR_OPERATION_ABORTED; // Its context is being destroyed; nobody will reap the result.
+    }
+    else if (fileHandle == INVALID_HANDLE_VALUE) {
+        error = ERROR_INVALID_HANDLE;
+    }
+    else if (req->aio_lio_opcode == IO_CMD_FSYNC || req->aio_lio_opcode == IO_CMD_FDSYNC) {
+        if (!FlushFileBuffers(fileHandle)) error = GetLastError();
+    }
+    else if (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV) {
+        bool is_write = (req->aio_lio_opcode == IO_CMD_PWRITEV);
+        long long current_offset = req->u.v.offset;
+        for (int seg = 0; seg < req->u.v.nr_segs && error == ERROR_SUCCESS; ++seg) {
+            const struct iovec* iov = &req->u.v.vec[seg];
+            DWORD bytes = 0;
+            error = blocking_transfer(fileHandle, is_write, iov->iov_base, (DWORD)iov->iov_len, current_offset, event, &bytes);
+            total_bytes += bytes;
+            current_offset += iov->iov_len;
+            if (bytes < iov->iov_len) break; // Short transfer: end of file.
+        }
+    }
+    else {
+        if (req->aio_lio_opcode == IO_CMD_PREAD_SELECT) {
+            BufferGroup* buffer_group = nullptr;
+            error = select_provided_buffer(owner, req, &buffer_group, &win_req->buffer_id);
+            if (buffer_group) win_req->flags |= REQUEST_BUFFER_SELECTED;
+        }
+        if (error == ERROR_SUCCESS) {
+            DWORD bytes = 0;
+            error = blocking_transfer(fileHandle, req->aio_lio_opcode == IO_CMD_PWRITE,
+                req->u.c.buf, (DWORD)req->u.c.nbytes, req->u.c.offset, event, &bytes);
+            total_bytes = bytes;
+        }
+    }
+
+    // The packet's byte count is a DWORD, so the full count of a large vectored transfer travels in
+    // the OVERLAPPED, which only serves as a token for posted packets and is never written by the kernel.
+    win_req->overlapped.InternalHigh = (ULONG_PTR)total_bytes;
+    PostQueuedCompletionStatus(context->ioCompletionPort, (DWORD)total_bytes, (ULONG_PTR)error, &win_req->overlapped);
+    profile_end(IO_PROFILE_WORKER, worker_started);
+}
+
+/**
+ * @brief Claims a worker slot on the request's volume, or parks the request on the volume's overflow list.
+ * @return true if the caller should run the request now.
+ */
+static bool enter_device(WinAioRequest* win_req) {
+    DeviceGate* device = win_req->device;
+    if (!device) return true;
+
+    AcquireSRWLockExclusive(&device->lock);
+    bool admitted = device->active < device->limit;
+    if (admitted) {
+        device->active++;
+    }
+    else {
+        win_req->next_queued = nullptr;
+        if (device->overflow_tail) device->overflow_tail->next_queued = win_req;
+        else device->overflow_head = win_req;
+        device->overflow_tail = win_req;
+        device->backlog.fetch_add(1, std::memory_order_relaxed);
+    }
+    ReleaseSRWLockExclusive(&device->lock);
+    return admitted;
+}
+
+/**
+ * @brief Releases a worker slot on a volume, handing it straight to the oldest parked request.
+ * @return The request that now owns the slot and should run next, or nullptr.
+ */
+static WinAioRequest* leave_device(DeviceGate* device) {
+    if (!device) return nullptr;
+
+    AcquireSRWLockExclusive(&device->lock);
+    WinAioRequest* next = device->overflow_head;
+    if (next) {
+        device->overflow_head = next->next_queued;
+        if (!device->overflow_head) device->overflow_tail = nullptr;
+        device->backlog.fetch_sub(1, std::memory_order_relaxed);
+    }
+    else {
+        device->active--;
+    }
+    ReleaseSRWLockExclusive(&device->lock);
+    return next;
+}
+
+/**
+ * @brief Moves everything in `source`'s inbox into `owner`'s deque, oldest on top.
+ *
+ * `owner` must be the calling worker. Taking another worker's inbox lets an idle worker
+ * pick up a batch whose addressee is blocked in I/O.
+ * @return true if any request was moved.
+ */
+static bool drain_inbox(PoolWorker* owner, PoolWorker* source) {
+    WinAioRequest* list = source->inbox.exchange(nullptr, std::memory_order_acquire);
+    if (!list) return false;
+
+    // The inbox is newest-first; reverse it so the batch is pushed, and thieves see it, in arrival order.
+    WinAioRequest* ordered = nullptr;
+    while (list) {
+        WinAioRequest* next = list->next_queued;
+        list->next_queued = ordered;
+        ordered = list;
+        list = next;
+    }
+    while (ordered) {
+        WinAioRequest* next = ordered->next_queued;
+        if (!owner->deque.push(ordered)) break;
+        ordered = next;
+    }
+    if (!ordered) return true;
+
+    // Deque full: hand the remainder back newest-first, as the inbox keeps it, behind whatever
+    // was submitted meanwhile, so that the next drain still takes it first.
+    WinAioRequest* chain = nullptr;
+    while (ordered) {
+        WinAioRequest* next = ordered->next_queued;
+        ordered->next_queued = chain;
+        chain = ordered;
+        ordered = next;
+    }
+    for (;;) {
+        WinAioRequest* empty = nullptr;
+        if (source->inbox.compare_exchange_strong(empty, chain, std::memory_order_release, std::memory_order_relaxed)) break;
+        WinAioRequest* newer = source->inbox.exchange(nullptr, std::memory_order_acquire);
+        if (!newer) continue;
+        WinAioRequest* last = newer;
+        while (last->next_queued) last = last->next_queued;
+        last->next_queued = chain;
+        chain = newer;
+    }
+    return true;
+}
+
+/// Wakes one parked worker other than `except`, so queued work does not wait behind a blocked owner.
+static void wake_idle_worker(WorkerPool* pool, PoolWorker* except) {
+    unsigned slots = pool->slots_in_use.load(std::memory_order_acquire);
+    for (unsigned i = 0; i < slots; ++i) {
+        PoolWorker* peer = &pool->workers[i];
+        if (peer != except && peer->parked.load(std::memory_order_seq_cst)) {
+            SetEvent(peer->wake_event);
+            return;
+        }
+    }
+}
+
+/// Takes the oldest request of the locked queue, or nullptr if it is empty.
+static WinAioRequest* take_locked(WorkerPool* pool) {
+    AcquireSRWLockExclusive(&pool->queue_lock);
+    WinAioRequest* win_req = pool->queue_head;
+    if (win_req) {
+        pool->queue_head = win_req->next_queued;
+        if (!pool->queue_head) pool->queue_tail = nullptr;
+    }
+    ReleaseSRWLockExclusive(&pool->queue_lock);
+    return win_req;
+}
+
+/**
+ * @brief Finds the next request for a worker: its own deque, then its inbox, then its peers.
+ * @return A request, or nullptr if the whole pool is idle.
+ */
+static WinAioRequest* take_work(WorkerPool* pool, PoolWorker* self) {
+    if (g_probe.locked_pool_queue) return take_locked(pool);
+    WinAioRequest* win_req = self->deque.take();
+    if (win_req) return win_req;
+
+    // FIFO across batches: a new batch is only taken once the previous one is done.
+    if (drain_inbox(self, self)) {
+        if (!self->deque.empty()) wake_idle_worker(pool, self);
+        win_req = self->deque.take();
+        if (win_req) return win_req;
+    }
+
+    unsigned start = (unsigned)(self - pool->workers);
+    unsigned slots = pool->slots_in_use.load(std::memory_order_acquire);
+    // With NUMA placement, peers on the worker's own node are robbed first.
+    for (int pass = g_probe.numa_placement ? 0 : 1; pass < 2; ++pass) {
+        for (unsigned i = 1; i < slots; ++i) {
+            PoolWorker* victim = &pool->workers[(start + i) % slots];
+            if (pass == 0 && victim->node != self->node) continue;
+            win_req = victim->deque.steal();
+            if (win_req) return win_req;
+            // A victim blocked in I/O cannot drain its own inbox; take the batch on its behalf.
+            if (drain_inbox(self, victim)) {
+                win_req = self->deque.take();
+                if (win_req) return win_req;
+            }
+        }
+    }
+    return nullptr;
+}
+
+static WinAioRequest* find_work(WorkerPool* pool, PoolWorker* self) {
+    WinAioRequest* win_req = take_work(pool, self);
+    if (win_req) pool->queued.fetch_sub(1, std::memory_order_relaxed);
+    return win_req;
+}
+
+static bool has_visible_work(WorkerPool* pool) {
+    if (g_probe.locked_pool_queue) {
+        // Taking the lock orders this read after the caller's `parked` store, as a submitter's append is.
+        AcquireSRWLockShared(&pool->queue_lock);
+        bool queued = pool->queue_head != nullptr;
+        ReleaseSRWLockShared(&pool->queue_lock);
+        return queued;
+    }
+    unsigned slots = pool->slots_in_use.load(std::memory_order_acquire);
+    for (unsigned i = 0; i < slots; ++i) {
+        PoolWorker* worker = &pool->workers[i];
+        if (worker->inbox.load(std::memory_order_seq_cst) || !worker->deque.empty()) return true;
+    }
+    return false;
+}
+
+static DWORD WINAPI worker_main(LPVOID param);
+
+/**
+ * @brief Starts one elastic worker if the pool has been saturated for longer than the grow delay.
+ *
+ * "Saturated" means requests are queued while every live worker is blocked in a transfer,
+ * so adding a thread adds a concurrent I/O. The delay plus a cooldown between resizes
+ * provide the hysteresis that keeps a short burst from growing the pool.
+ */
+static void maybe_grow(WorkerPool* pool) {
+    if (pool->worker_capacity == pool->core_workers) return;
+
+    bool saturated = pool->queued.load(std::memory_order_relaxed) > 0
+        && pool->busy_workers.load(std::memory_order_relaxed) >= (long)pool->live_workers.load(std::memory_order_relaxed);
+    if (!saturated) {
+        if (pool->saturated_since.load(std::memory_order_relaxed) != 0) {
+            pool->saturated_since.store(0, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    long long now = qpc_now();
+    long long since = pool->saturated_since.load(std::memory_order_relaxed);
+    if (since == 0) {
+        pool->saturated_since.compare_exchange_strong(since, now, std::memory_order_relaxed);
+        return;
+    }
+    long long grow_after = (long long)backend_probe().grow_after_us * backend_probe().qpc_frequency / 1000000;
+    if (now - since < grow_after || now - pool->last_resize.load(std::memory_order_relaxed) < grow_after) return;
+    if (pool->shutting_down.load(std::memory_order_acquire)) return;
+    if (!TryAcquireSRWLockExclusive(&pool->resize_lock)) return; // Someone else is resizing.
+
+    for (unsigned i = pool->core_workers; i < pool->worker_capacity; ++i) {
+        PoolWorker* worker = &pool->workers[i];
+        if (worker->running.load(std::memory_order_acquire)) continue;
+        if (worker->thread) {
+            // A retired thread may still be on its way out.
+            WaitForSingleObject(worker->thread, INFINITE);
+            CloseHandle(worker->thread);
+            worker->thread = NULL;
+        }
+        worker->running.store(true, std::memory_order_release);
+        worker->thread = CreateThread(NULL, 0, worker_main, worker, 0, NULL);
+        if (!worker->thread) {
+            worker->running.store(false, std::memory_order_release);
+            break;
+        }
+        pool->live_workers.fetch_add(1, std::memory_order_relaxed);
+        unsigned slots = pool->slots_in_use.load(std::memory_order_relaxed);
+        if (i + 1 > slots) pool->slots_in_use.store(i + 1, std::memory_order_release);
+        pool->last_resize.store(now, std::memory_order_relaxed);
+        pool->saturated_since.store(0, std::memory_order_relaxed);
+        break;
+    }
+    ReleaseSRWLockExclusive(&pool->resize_lock);
+}
+
+/**
+ * @brief Lets an idle elastic worker exit, unless the pool resized too recently.
+ * @return true if the caller should exit.
+ */
+static bool try_retire(WorkerPool* pool, PoolWorker* self) {
+    if (!TryAcquireSRWLockExclusive(&pool->resize_lock)) return false;
+    long long now = qpc_now();
+    long long shrink_after = (long long)backend_probe().shrink_after_ms * backend_probe().qpc_frequency / 1000;
+    bool retire = now - pool->last_resize.load(std::memory_order_relaxed) >= shrink_after && self->deque.empty();
+    if (retire) {
+        self->running.store(false, std::memory_order_release);
+        pool->live_workers.fetch_sub(1, std::memory_order_relaxed);
+        pool->last_resize.store(now, std::memory_order_relaxed);
+    }
+    ReleaseSRWLockExclusive(&pool->resize_lock);
+    return retire;
+}
+
+static DWORD WINAPI worker_main(LPVOID param) {
+    PoolWorker* self = static_cast<PoolWorker*>(param);
+    WorkerPool* pool = self->pool;
+    bool is_elastic = (unsigned)(self - pool->workers) >= pool->core_workers;
+    HANDLE event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (g_probe.numa_placement) bind_to_node(self->node);
+
+    for (;;) {
+        WinAioRequest* win_req = find_work(pool, self);
+        if (win_req) {
+            if (!enter_device(win_req)) continue; // Parked until its volume frees a slot.
+            // Keep the slot while the volume has parked requests; the request is gone once posted.
+            pool->busy_workers.fetch_add(1, std::memory_order_relaxed);
+            while (win_req) {
+                DeviceGate* device = win_req->device;
+                run_pooled_request(pool->context, win_req, event);
+                // Checked while still counted as busy: if work queued up during this
+                // transfer, the pool was saturated for its whole duration.
+                maybe_grow(pool);
+                win_req = leave_device(device);
+            }
+            // Releases the device gates to an io_destroy that returns the pool instead of joining it.
+            pool->busy_workers.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        // Park. Publishing `parked` before the final check pairs with the submitter, which
+        // publishes its request before reading `parked`, so one of the two always sees the other.
+        bool idle_timeout = false;
+        self->parked.store(true, std::memory_order_seq_cst);
+        if (!has_visible_work(pool) && !pool->shutting_down.load(std::memory_order_seq_cst)) {
+            idle_timeout = WaitForSingleObject(self->wake_event, is_elastic ? backend_probe().shrink_after_ms : INFINITE) == WAIT_TIMEOUT;
+        }
+        self->parked.store(false, std::memory_order_seq_cst);
+
+        if (pool->shutting_down.load(std::memory_order_acquire) && !has_visible_work(pool)) break;
+        if (idle_timeout && try_retire(pool, self)) break;
+    }
+
+    if (event) CloseHandle(event);
+    return 0;
+}
+
+static void destroy_worker_pool(WorkerPool* pool) {
+    pool->shutting_down.store(true, std::memory_order_seq_cst);
+    AcquireSRWLockExclusive(&pool->resize_lock); // No worker starts after this point.
+    ReleaseSRWLockExclusive(&pool->resize_lock);
+    for (unsigned i = 0; i < pool->worker_capacity; ++i) {
+        if (pool->workers[i].wake_event) SetEvent(pool->workers[i].wake_event);
+    }
+    for (unsigned i = 0; i < pool->worker_capacity; ++i) {
+        PoolWorker* worker = &pool->workers[i];
+        if (worker->thread) {
+            WaitForSingleObject(worker->thread, INFINITE);
+            CloseHandle(worker->thread);
+        }
+        if (worker->wake_event) CloseHandle(worker->wake_event);
+    }
+    delete[] pool->workers;
+    delete pool;
+}
+
+static BOOL CALLBACK start_worker_pool(PINIT_ONCE, PVOID param, PVOID*) {
+    WinAioContext* context = static_cast<WinAioContext*>(param);
+    if (context->pool) return TRUE; // Leased from the context pool along with the port.
+    WorkerPool* pool = new (std::nothrow) WorkerPool();
+    if (!pool) return FALSE;
+    unsigned capacity = backend_probe().caps.max_worker_threads;
+    pool->context = context;
+    pool->core_workers = 0;
+    pool->worker_capacity = capacity;
+    pool->slots_in_use.store(0, std::memory_order_relaxed);
+    pool->live_workers.store(0, std::memory_order_relaxed);
+    pool->busy_workers.store(0, std::memory_order_relaxed);
+    pool->queued.store(0, std::memory_order_relaxed);
+    pool->saturated_since.store(0, std::memory_order_relaxed);
+    pool->last_resize.store(0, std::memory_order_relaxed);
+    InitializeSRWLock(&pool->resize_lock);
+    pool->shutting_down.store(false, std::memory_order_relaxed);
+    InitializeSRWLock(&pool->queue_lock);
+    pool->queue_head = pool->queue_tail = nullptr;
+    pool->workers = new (std::nothrow) PoolWorker[capacity];
+    if (!pool->workers) {
+        delete pool;
+        return FALSE;
+    }
+
+    // Every slot must exist before any thread starts stealing from its peers.
+    for (unsigned i = 0; i < capacity; ++i) {
+        PoolWorker* worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->thread = NULL;
+        worker->inbox.store(nullptr, std::memory_order_relaxed);
+        worker->parked.store(false, std::memory_order_relaxed);
+        worker->running.store(false, std::memory_order_relaxed);
+        worker->node = g_probe.numa_placement ? i % g_probe.caps.numa_nodes : 0;
+        worker->wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+        if (!worker->wake_event) {
+            pool->worker_capacity = i;
+            break;
+        }
+    }
+    unsigned core = backend_probe().caps.worker_threads;
+    pool->core_workers = core < pool->worker_capacity ? core : pool->worker_capacity;
+    pool->slots_in_use.store(pool->core_workers, std::memory_order_relaxed);
+
+    unsigned started = 0;
+    for (unsigned i = 0; i < pool->core_workers; ++i) {
+        pool->workers[i].running.store(true, std::memory_order_relaxed);
+        pool->workers[i].thread = CreateThread(NULL, 0, worker_main, &pool->workers[i], 0, NULL);
+        if (pool->workers[i].thread) started++;
+    }
+    if (started == 0) {
+        destroy_worker_pool(pool);
+        return FALSE;
+    }
+    pool->live_workers.store(started, std::memory_order_relaxed);
+    context->pool = pool;
+    return TRUE;
+}
+
+static std::atomic<unsigned> g_next_submitter_slot(0);
+static thread_local unsigned t_submitter_slot = ~0u;
+
+/**
+ * @brief Hands a request to the context's worker pool, starting the pool on first use.
+ *
+ * Each submitting thread is pinned to one worker's inbox, so its requests stay on one
+ * worker and consecutive submissions from the same thread batch together. With NUMA placement,
+ * that worker is one pinned to the submitter's node, if the pool has any. With
+ * LIBAIO_WIN32_POOL_QUEUE=locked, every request goes to the pool's one FIFO instead.
+ * @return true if the request was queued.
+ */
+static bool enqueue_pooled(WinAioContext* context, WinAioRequest* win_req) {
+    if (!InitOnceExecuteOnce(&context->pool_once, start_worker_pool, context, NULL)) return false;
+    WorkerPool* pool = context->pool;
+
+    if (g_probe.locked_pool_queue) {
+        pool->queued.fetch_add(1, std::memory_order_relaxed);
+        win_req->next_queued = nullptr;
+        AcquireSRWLockExclusive(&pool->queue_lock);
+        if (pool->queue_tail) pool->queue_tail->next_queued = win_req;
+        else pool->queue_head = win_req;
+        pool->queue_tail = win_req;
+        ReleaseSRWLockExclusive(&pool->queue_lock);
+        wake_idle_worker(pool, nullptr);
+        maybe_grow(pool);
+        return true;
+    }
+
+    if (t_submitter_slot == ~0u) {
+        t_submitter_slot = g_next_submitter_slot.fetch_add(1, std::memory_order_relaxed);
+    }
+    unsigned index = t_submitter_slot % pool->core_workers;
+    if (g_probe.numa_placement) {
+        // Core worker i is pinned to node i % nodes.
+        unsigned nodes = g_probe.caps.numa_nodes;
+        unsigned node = current_node();
+        unsigned on_node = node < pool->core_workers ? (pool->core_workers - node + nodes - 1) / nodes : 0;
+        if (on_node) index = node + nodes * (t_submitter_slot % on_node);
+    }
+    PoolWorker* target = &pool->workers[index];
+
+    pool->queued.fetch_add(1, std::memory_order_relaxed);
+    WinAioRequest* head = target->inbox.load(std::memory_order_relaxed);
+    do {
+        win_req->next_queued = head;
+    } while (!target->inbox.compare_exchange_weak(head, win_req, std::memory_order_seq_cst, std::memory_order_relaxed));
+
+    if (target->parked.load(std::memory_order_seq_cst)) {
+        SetEvent(target->wake_event);
+    }
+    else {
+        wake_idle_worker(pool, target);
+        maybe_grow(pool);
+    }
+    return true;
+}
+
+// --- Simulated Devices ---
+
+/**
+ * Completion key of packets posted by the null and simulated engines. File handles are associated
+ * with key 0 and pooled packets carry a Win32 error code, so neither can be mistaken for it.
+ */
+static const ULONG_PTR SIMULATED_COMPLETION_KEY = ~(ULONG_PTR)0;
+
+/// A transfer the simulated device completes once the QPC passes `due`.
+struct SimulatedTransfer {
+    WinAioContext* context;     ///< Cleared if the context is destroyed first.
+    OVERLAPPED* overlapped;
+    DWORD bytes;
+    long long due;
+};
+
+/**
+ * @struct SimulatedDevice
+ * @brief One process-wide device with unlimited parallelism and a fixed latency.
+ *
+ * Every transfer takes the same time, so pending transfers complete in the order they were
+ * issued and a FIFO ring replaces a timer queue.
+ */
+struct SimulatedDevice {
+    SRWLOCK lock;               ///< Guards the ring; held while completions are posted, so io_destroy can purge safely.
+    SimulatedTransfer* ring;
+    unsigned capacity;          ///< A power of two, or 0 before the first transfer.
+    unsigned head;
+    unsigned count;
+    HANDLE wake_event;          ///< Auto-reset; signaled when a transfer arrives at an empty ring.
+    HANDLE thread;
+    long long latency_ticks;
+};
+
+static INIT_ONCE g_simulator_once = INIT_ONCE_STATIC_INIT;
+static SimulatedDevice g_simulator = { SRWLOCK_INIT, nullptr, 0, 0, 0, NULL, NULL, 0 };
+
+/// The engine that runs requests issued as overlapped I/O: IOCP, or a benchmarking engine forced in its place.
+static inline int overlapped_engine() {
+    int forced = g_probe.caps.forced_backend;
+    return (forced == IO_BACKEND_NULL || forced == IO_BACKEND_SIMULATED) ? forced : IO_BACKEND_IOCP;
+}
+
+static DWORD WINAPI simulator_main(LPVOID) {
+    for (;;) {
+        long long now = qpc_now();
+        long long next_due = 0;
+        AcquireSRWLockExclusive(&g_simulator.lock);
+        while (g_simulator.count) {
+            SimulatedTransfer& transfer = g_simulator.ring[g_simulator.head];
+            if (transfer.due > now) { next_due = transfer.due; break; }
+            if (transfer.context) {
+                PostQueuedCompletionStatus(transfer.context->ioCompletionPort, transfer.bytes, SIMULATED_COMPLETION_KEY, transfer.overlapped);
+            }
+            g_simulator.head = (g_simulator.head + 1) & (g_simulator.capacity - 1);
+            g_simulator.count--;
+        }
+        ReleaseSRWLockExclusive(&g_simulator.lock);
+
+        if (!next_due) {
+            WaitForSingleObject(g_simulator.wake_event, INFINITE);
+            continue;
+        }
+        // Sleep while the next completion is more than a scheduler tick away, then spin.
+        long long wait_ms = (next_due - now) * 1000 / g_probe.qpc_frequency;
+        if (wait_ms >= 2) WaitForSingleObject(g_simulator.wake_event, (DWORD)(wait_ms - 1));
+        else SwitchToThread();
+    }
+}
+
+static BOOL CALLBACK start_simulator(PINIT_ONCE, PVOID, PVOID*) {
+    g_simulator.latency_ticks = (long long)g_probe.sim_latency_us * g_probe.qpc_frequency / 1000000;
+    g_simulator.wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (g_simulator.wake_event) {
+        g_simulator.thread = CreateThread(NULL, 0, simulator_main, NULL, 0, NULL);
+    }
+    return TRUE;
+}
+
+/**
+ * @brief Completes a transfer on the forced null or simulated engine instead of issuing it.
+ * @return TRUE if the completion was posted or scheduled, as ReadFile reports a started transfer.
+ */
+static BOOL simulate_transfer(WinAioContext* context, int engine, DWORD length, OVERLAPPED* overlapped) {
+    if (engine == IO_BACKEND_NULL) {
+        return PostQueuedCompletionStatus(context->ioCompletionPort, length, SIMULATED_COMPLETION_KEY, overlapped);
+    }
+    InitOnceExecuteOnce(&g_simulator_once, start_simulator, NULL, NULL);
+    if (!g_simulator.thread) {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    SimulatedTransfer transfer = { context, overlapped, length, qpc_now() + g_simulator.latency_ticks };
+
+    AcquireSRWLockExclusive(&g_simulator.lock);
+    if (g_simulator.count == g_simulator.capacity) {
+        unsigned capacity = g_simulator.capacity ? g_simulator.capacity * 2 : 1024;
+        SimulatedTransfer* ring = new (std::nothrow) SimulatedTransfer[capacity];
+        if (!ring) {
+            ReleaseSRWLockExclusive(&g_simulator.lock);
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return FALSE;
+        }
+        for (unsigned i = 0; i < g_simulator.count; ++i) {
+            ring[i] = g_simulator.ring[(g_simulator.head + i) & (g_simulator.capacity - 1)];
+        }
+        delete[] g_simulator.ring;
+        g_simulator.ring = ring;
+        g_simulator.capacity = capacity;
+        g_simulator.head = 0;
+    }
+    bool was_empty = g_simulator.count == 0;
+    g_simulator.ring[(g_simulator.head + g_simulator.count) & (g_simulator.capacity - 1)] = transfer;
+    g_simulator.count++;
+    ReleaseSRWLockExclusive(&g_simulator.lock);
+    if (was_empty) SetEvent(g_simulator.wake_event);
+    return TRUE;
+}
+
+/// Drops a destroyed context's pending simulated transfers, so nothing is posted to its closed port.
+static void simulator_forget(WinAioContext* context) {
+    AcquireSRWLockExclusive(&g_simulator.lock);
+    for (unsigned i = 0; i < g_simulator.count; ++i) {
+        SimulatedTransfer& transfer = g_simulator.ring[(g_simulator.head + i) & (g_simulator.capacity - 1)];
+        if (transfer.context == context) transfer.context = nullptr;
+    }
+    ReleaseSRWLockExclusive(&g_simulator.lock);
+}
+
+/**
+ * @brief Starts one overlapped transfer on a port-associated handle, or hands it to the forced
+ * null or simulated engine.
+ * @return TRUE if the transfer completed or is pending, either way with a packet to come; FALSE
+ * with the Win32 error set otherwise.
+ */
+static BOOL start_transfer(WinAioContext* context, HANDLE fileHandle, bool is_write, void* buf, DWORD length, OVERLAPPED* overlapped) {
+    int engine = overlapped_engine();
+    if (engine != IO_BACKEND_IOCP) return simulate_transfer(context, engine, length, overlapped);
+    BOOL result = is_write
+        ? WriteFile(fileHandle, buf, length, NULL, overlapped)
+        : ReadFile(fileHandle, buf, length, NULL, overlapped);
+    if (result || GetLastError() == ERROR_IO_PENDING) return TRUE;
+    // A read at or past end of file may fail at once, and then queues no packet: post the empty
+    // completion it owes, as the port would for one that failed with ERROR_HANDLE_EOF later.
+    if (!is_write && GetLastError() == ERROR_HANDLE_EOF) {
+        return PostQueuedCompletionStatus(context->ioCompletionPort, 0, ERROR_SUCCESS, overlapped);
+    }
+    return FALSE;
+}
+
+// --- Engine Configurations ---
+//
+// io_submit and io_getevents are written once, as templates over a configuration that names five
+// policies. The C API runs DefaultConfig, which keeps every feature and switches each at run time.
+// A C++ program that compiles the library in (LIBAIO_WIN32_IMPLEMENTATION) can drive its contexts
+// through AioEngine<Config> with policies whose hooks are empty, and those features then cost it
+// no load, branch or call. A context is bound to the configuration of its first io_submit, since a
+// request must be reaped through the configuration that submitted it; the others get -EINVAL.
+
+/// Backend policy: the engine runs every request, handing syncs and non-overlapped files to workers.
+struct AutoBackend {
+    static const bool pooled = true;
+};
+
+/**
+ * Backend policy: overlapped I/O only. A request that would need a worker, a sync or an iocb on a
+ * file the probe gave the thread pool, is refused with -EINVAL, like an opcode Linux does not support.
+ */
+struct OverlappedBackend {
+    static const bool pooled = false;
+};
+
+/// Allocator policy: request records from the engine's slab, then the heap. io_destroy frees leftovers the same way.
+struct SlabAllocator {
+    static WinAioRequest* take(WinAioContext* context) { return slab_new_record(context); }
+    static void release(WinAioContext* context, WinAioRequest* win_req) { free_single_request(context, win_req); }
+};
+
+/**
+ * Allocator policy: every record from the heap, listed on its context like the slab's overflow, which
+ * is what the slab saves a request. A thin context takes its records from the shared slab regardless,
+ * since the slab's owner table is how the engine routes their completions.
+ */
+struct HeapAllocator {
+    static WinAioRequest* take(WinAioContext* context) {
+        return context->engine->slab.owners ? slab_new_record(context) : heap_new_record(context);
+    }
+    static void release(WinAioContext* context, WinAioRequest* win_req) { free_single_request(context, win_req); }
+};
+
+/// Stats policy: published and per-file counters, the self-profiler's phases and NUMA completion counts.
+struct FullStats {
+    /// What one io_submit or io_getevents call counts into, loaded once per call.
+    struct Batch {
+        aio_stats_context* stats;
+        HotFiles* hot_files;
+
+        explicit Batch(WinAioContext* context)
+            : stats(context->stats), hot_files(context->hot_files.load(std::memory_order_acquire)) {
+        }
+        void submit(const FileEntry& file, const struct iocb* req) const {
+            if (stats) stats_submit(stats, file.stats, req);
+            if (hot_files) file_stats_submit(hot_files, file, req);
+        }
+        void complete(WinAioContext* context, const Completion& done) const {
+            if (stats) stats_complete(stats, done);
+            if (hot_files) file_stats_complete(context, done);
+        }
+    };
+    static const bool numa = true;
+    static unsigned long long phase_begin() { return profile_begin(); }
+    static void phase_end(unsigned phase, unsigned long long started) { profile_end(phase, started); }
+};
+
+/// Stats policy: counts nothing.
+struct NoStats {
+    struct Batch {
+        explicit Batch(WinAioContext*) {
+        }
+        void submit(const FileEntry&, const struct iocb*) const {
+        }
+        void complete(WinAioContext*, const Completion&) const {
+        }
+    };
+    static const bool numa = false;
+    static unsigned long long phase_begin() { return 0; }
+    static void phase_end(unsigned, unsigned long long) {}
+};
+
+/// Tracing policy: the trace recorder, ETW events and the in-flight index behind io_list_inflight and the watchdog.
+struct FullTracing {
+    /// The trace session one io_submit call records into, read once per call.
+    struct Batch {
+        unsigned session;
+        bool recording;
+
+        Batch() {
+            recording = trace_active(&session);
+        }
+        /// Records the file's path once per session. Returns the submission time for the trace.
+        long long submitting(WinAioContext* engine, const FileEntry& file, int fd) const {
+            if (!recording) return 0;
+            if (file.traced_session != session) trace_file(engine, session, fd);
+            return trace_ticks();
+        }
+        void submitted(WinAioContext* context, const struct iocb* req, long long submitted_at) const {
+            if (recording) trace_submit(context, session, req, submitted_at);
+            etw_submit(context, req);
+        }
+    };
+    static void track(WinAioContext* context, struct iocb* req, long long submitted_at) { inflight_add(context, req, submitted_at); }
+    static long long untrack(WinAioContext* context, const struct iocb* req) { return inflight_remove(context, req); }
+    static void issue(WinAioContext* context, const struct iocb* req, long long offset, unsigned long long length, unsigned submitted_at) {
+        etw_issue(context, req, overlapped_engine(), offset, length, submitted_at);
+    }
+    static void complete(WinAioContext* context, const struct iocb* req, bool segment, unsigned long long bytes, DWORD error, unsigned submitted_at) {
+        etw_complete(context, req, segment, bytes, error, submitted_at);
+    }
+    static void deliver(WinAioContext* context, const Completion& done) {
+        unsigned trace_session;
+        if (trace_active(&trace_session)) trace_complete(context, trace_session, done);
+    }
+    static void vectored_complete(WinAioContext* context, const Completion& done, long segments) { etw_vectored_complete(context, done, segments); }
+    /// The time io_getevents was entered, for the Reap event, or 0 while no session listens.
+    static long long reap_begin() { return etw_enabled() ? qpc_now() : 0; }
+    static void reap_end(WinAioContext* context, long min_nr, long nr, long events, long long entered_at) {
+        etw_reap(context, min_nr, nr, events, entered_at);
+    }
+};
+
+/**
+ * Tracing policy: records nothing. io_getevents2 then recovers submission times from their low
+ * halves, as it does for iocbs a full in-flight index could not hold.
+ */
+struct NoTracing {
+    struct Batch {
+        long long submitting(WinAioContext*, const FileEntry&, int) const { return 0; }
+        void submitted(WinAioContext*, const struct iocb*, long long) const {
+        }
+    };
+    static void track(WinAioContext*, struct iocb*, long long) {}
+    static long long untrack(WinAioContext*, const struct iocb*) { return 0; }
+    static void issue(WinAioContext*, const struct iocb*, long long, unsigned long long, unsigned) {}
+    static void complete(WinAioContext*, const struct iocb*, bool, unsigned long long, DWORD, unsigned) {}
+    static void deliver(WinAioContext*, const Completion&) {}
+    static void vectored_complete(WinAioContext*, const Completion&, long) {}
+    static long long reap_begin() { return 0; }
+    static void reap_end(WinAioContext*, long, long, long, long long) {}
+};
+
+/// Scheduler policy: a volume whose workers already have caps.device_backlog requests queued pushes back with -EAGAIN.
+struct BacklogScheduler {
+    static bool admit(const FileEntry& file) {
+        unsigned backlog_limit = backend_probe().caps.device_backlog;
+        return !backlog_limit || file.device->backlog.load(std::memory_order_relaxed) < (long)backlog_limit;
+    }
+};
+
+/// Scheduler policy: admits every request.
+struct NoScheduler {
+    static bool admit(const FileEntry&) { return true; }
+};
+
+/// What the C API runs.
+struct DefaultConfig {
+    typedef AutoBackend Backend;
+    typedef SlabAllocator Allocator;
+    typedef FullStats Stats;
+    typedef FullTracing Tracing;
+    typedef BacklogScheduler Scheduler;
+};
+
+/**
+ * Overlapped I/O from the slab and nothing else: what a request costs with every optional feature
+ * compiled out. Without the thread pool, io_submit refuses IO_CMD_FSYNC and IO_CMD_FDSYNC with
+ * -EINVAL: flush with FlushFileBuffers, or submit syncs through the C API on a context of their own.
+ */
+struct MinimalConfig {
+    typedef OverlappedBackend Backend;
+    typedef SlabAllocator Allocator;
+    typedef NoStats Stats;
+    typedef NoTracing Tracing;
+    typedef NoScheduler Scheduler;
+};
+
+/// One object per configuration, whose address tells configurations apart on a context.
+template <class Config>
+struct ConfigIdentity {
+    static const char tag;
+};
+template <class Config>
+const char ConfigIdentity<Config>::tag = 0;
+
+/**
+ * @brief Binds a context to the configuration of its first io_submit.
+ * @return false if another configuration submitted on the context, whose requests this one could
+ * not reap: their records, tracking and counters follow that configuration's policies.
+ */
+template <class Config>
+static bool bind_config(WinAioContext* context) {
+    const void* mine = &ConfigIdentity<Config>::tag;
+    const void* bound = context->config.load(std::memory_order_relaxed);
+    if (bound == mine) return true;
+    return bound == nullptr && (context->config.compare_exchange_strong(bound, mine, std::memory_order_relaxed) || bound == mine);
+}
+
+/// Whether a configuration may reap a context: no other configuration has submitted on it.
+template <class Config>
+static bool reaps_config(const WinAioContext* context) {
+    const void* bound = context->config.load(std::memory_order_relaxed);
+    return bound == nullptr || bound == &ConfigIdentity<Config>::tag;
+}
+
+/// Allocates a SINGLE_REQUEST for an iocb. Returns nullptr if out of memory.
+template <class Config>
+static WinAioRequest* new_single_request(WinAioContext* context, struct iocb* req, unsigned submitted_at) {
+    unsigned long long alloc_started = Config::Stats::phase_begin();
+    WinAioRequest* win_req = Config::Allocator::take(context);
+    Config::Stats::phase_end(IO_PROFILE_REQUEST_ALLOC, alloc_started);
+    if (!win_req) return nullptr;
+    ZeroMemory(&win_req->overlapped, sizeof(OVERLAPPED));
+    win_req->type = SINGLE_REQUEST;
+    win_req->flags = 0;
+    win_req->submitted_at = submitted_at;
+    win_req->iocb_single = req;
+    win_req->next_queued = nullptr;
+    win_req->device = nullptr;
+    return win_req;
+}
+
+// --- IOCP Engine ---
+
+/// Outcome of issuing one iocb, besides a negative errno that stops the submission batch.
+enum IssueResult {
+    ISSUE_SUBMITTED = 0,
+};
+
+/**
+ * @brief Issues a read/write iocb as overlapped I/O on a port-associated handle.
+ * @return An IssueResult, or a negative errno value that ends the submission batch.
+ */
+template <class Config>
+static int issue_iocp(WinAioContext* context, HANDLE fileHandle, struct iocb* req, unsigned submitted_at) {
+    bool is_vectored = (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV);
+
+    if (is_vectored) {
+        if (req->u.v.nr_segs == 0) {
+            // Nothing to transfer, but the iocb still owes the caller exactly one event.
+            WinAioRequest* win_req = new_single_request<Config>(context, req, submitted_at);
+            if (!win_req) return -ENOMEM;
+            unsigned long long post_started = Config::Stats::phase_begin();
+            PostQueuedCompletionStatus(context->ioCompletionPort, 0, ERROR_SUCCESS, &win_req->overlapped);
+            Config::Stats::phase_end(IO_PROFILE_ISSUE, post_started);
+            return ISSUE_SUBMITTED;
+        }
+        unsigned long long alloc_started = Config::Stats::phase_begin();
+        VectoredRequestGroup* group = new_vectored_group(context, req, submitted_at);
+        Config::Stats::phase_end(IO_PROFILE_REQUEST_ALLOC, alloc_started);
+        if (!group) return -ENOMEM;
+
+        long long current_offset = req->u.v.offset;
+        VectoredSegment* segments = group->segments();
+        for (int seg = 0; seg < req->u.v.nr_segs; ++seg) {
+            VectoredSegment* segment = &segments[seg];
+            segment->overlapped.Offset = (DWORD)(current_offset & 0xFFFFFFFF);
+            segment->overlapped.OffsetHigh = (DWORD)((current_offset >> 32) & 0xFFFFFFFF);
+
+            const struct iovec* iov = &req->u.v.vec[seg];
+            Config::Tracing::issue(context, req, current_offset, iov->iov_len, submitted_at);
+            unsigned long long issue_started = Config::Stats::phase_begin();
+            BOOL started = start_transfer(context, fileHandle, req->aio_lio_opcode == IO_CMD_PWRITEV,
+                iov->iov_base, (DWORD)iov->iov_len, &segment->overlapped);
+            if (!started) {
+                // The segment shares its group's allocation, so it completes with its error like
+                // any other; the group then reports the first failure.
+                PostQueuedCompletionStatus(context->ioCompletionPort, 0, (ULONG_PTR)GetLastError(), &segment->overlapped);
+            }
+            Config::Stats::phase_end(IO_PROFILE_ISSUE, issue_started);
+            current_offset += iov->iov_len;
+        }
+        return ISSUE_SUBMITTED;
+    }
+
+    // --- Provided-Buffer Selection ---
+    // IOCP needs the buffer when the read is issued, so the buffer is chosen here rather
+    // than at submission by the caller. It is pinned only while the OS owns it.
+    BufferGroup* buffer_group = nullptr;
+    unsigned short bid = 0;
+    DWORD select_error = ERROR_SUCCESS;
+    if (req->aio_lio_opcode == IO_CMD_PREAD_SELECT) {
+        select_error = select_provided_buffer(context, req, &buffer_group, &bid);
+        if (select_error == ERROR_INVALID_PARAMETER) return -EINVAL; // io_submit checked the group already.
+    }
+
+    WinAioRequest* win_req = new_single_request<Config>(context, req, submitted_at);
+    if (!win_req) {
+        if (buffer_group) buffer_group->release(bid);
+        return -ENOMEM;
+    }
+    if (select_error != ERROR_SUCCESS) {
+        // An exhausted group fails the read with an event, as on the thread-pool engine, where
+        // the buffer is only chosen once a worker runs the request.
+        PostQueuedCompletionStatus(context->ioCompletionPort, 0, (ULONG_PTR)select_error, &win_req->overlapped);
+        return ISSUE_SUBMITTED;
+    }
+    if (buffer_group) {
+        win_req->flags |= REQUEST_BUFFER_SELECTED;
+        win_req->buffer_id = bid;
+    }
+    win_req->overlapped.Offset = (DWORD)(req->u.c.offset & 0xFFFFFFFF);
+    win_req->overlapped.OffsetHigh = (DWORD)((req->u.c.offset >> 32) & 0xFFFFFFFF);
+
+    // Syncs only reach this path on the benchmarking engines, which complete them without I/O.
+    bool is_sync = (req->aio_lio_opcode == IO_CMD_FSYNC || req->aio_lio_opcode == IO_CMD_FDSYNC);
+    DWORD length = is_sync ? 0 : (DWORD)req->u.c.nbytes;
+    Config::Tracing::issue(context, req, req->u.c.offset, length, submitted_at);
+    unsigned long long issue_started = Config::Stats::phase_begin();
+    BOOL started = start_transfer(context, fileHandle, req->aio_lio_opcode == IO_CMD_PWRITE, req->u.c.buf, length, &win_req->overlapped);
+    Config::Stats::phase_end(IO_PROFILE_ISSUE, issue_started);
+
+    if (!started) {
+        // Refused outright, so it owes no event: the batch stops before it, as with a bad descriptor.
+        int error = windows_error_to_errno(GetLastError());
+        if (buffer_group) buffer_group->release(bid);
+        Config::Allocator::release(context, win_req);
+        return error < 0 ? error : -EIO;
+    }
+    return ISSUE_SUBMITTED;
+}
+
+// --- Shared Engine ---
+
+/**
+ * @brief Puts a new context in its empty state: its own engine, no files, no requests.
+ * The caller sets up the port, in-flight index and slab.
+ */
+static void init_context(WinAioContext* context) {
+    context->ioCompletionPort = NULL;
+    context->port_bound = false;
+    context->engine = context;
+    context->stats = nullptr;
+    InitializeSRWLock(&context->buffer_groups_lock);
+    context->buffer_groups = nullptr;
+    InitializeSRWLock(&context->files_lock);
+    context->files = nullptr;
+    context->file_capacity = 0;
+    context->devices = nullptr;
+    context->file_counter_budget = 0;
+    context->file_counters_used = 0;
+    context->hot_files.store(nullptr, std::memory_order_relaxed);
+    context->inflight = nullptr;
+    context->inflight_mask = 0;
+    context->inflight_large_bytes = 0;
+    context->inflight_untracked.store(0, std::memory_order_relaxed);
+    context->config.store(nullptr, std::memory_order_relaxed);
+    context->next_context = nullptr;
+    InitializeSRWLock(&context->unindexed_lock);
+    context->heap_requests = nullptr;
+    context->vectored_groups = nullptr;
+    InitOnceInitialize(&context->pool_once);
+    context->pool = nullptr;
+    context->slab.records = nullptr;
+    context->slab.free_lists = nullptr;
+    context->slab.chunk_nodes = nullptr;
+    context->slab.lists = 0;
+    context->slab.large_bytes = 0;
+    InitializeSRWLock(&context->completions.lock);
+    InitializeConditionVariable(&context->completions.ready);
+    context->completions.head = context->completions.tail = nullptr;
+    context->completions.waiters = 0;
+    context->owed.store(0, std::memory_order_relaxed);
+    context->closing.store(false, std::memory_order_relaxed);
+}
+
+static std::atomic<unsigned> g_next_context_serial(0);
+static INIT_ONCE g_shared_engine_once = INIT_ONCE_STATIC_INIT;
+static WinAioContext* g_shared_engine = nullptr;
+
+/// The thin context a packet on the shared port belongs to.
+static WinAioContext* packet_owner(WinAioContext* engine, OVERLAPPED* overlapped) {
+    RequestHeader* header = CONTAINING_RECORD(overlapped, RequestHeader, overlapped);
+    if (header->type == VECTORED_SEGMENT) return VectoredRequestGroup::of(static_cast<VectoredSegment*>(header))->context;
+    return request_owner(engine, static_cast<WinAioRequest*>(header));
+}
+
+/**
+ * @brief Moves every packet from the shared port to its thin context's completion list.
+ *
+ * One thread serves all thin contexts, so a thin context's completions cost one hand-off to
+ * its reaper, and an idle thin context costs no thread and no wait on the port.
+ */
+static DWORD WINAPI dispatcher_main(LPVOID param) {
+    WinAioContext* engine = static_cast<WinAioContext*>(param);
+    for (;;) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = nullptr;
+        BOOL status = GetQueuedCompletionStatus(engine->ioCompletionPort, &bytes, &key, &overlapped, INFINITE);
+        if (!overlapped) continue;
+        overlapped->Internal = bytes;
+        overlapped->Offset = status ? ERROR_SUCCESS : GetLastError();
+        overlapped->OffsetHigh = key == SIMULATED_COMPLETION_KEY ? MAXDWORD : (DWORD)key;
+        overlapped->hEvent = NULL;
+
+        // Woken under the lock: once `owed` reaches zero, io_destroy may free the context.
+        WinAioContext* owner = packet_owner(engine, overlapped);
+        CompletionList* list = &owner->completions;
+        AcquireSRWLockExclusive(&list->lock);
+        if (list->tail) list->tail->hEvent = (HANDLE)overlapped;
+        else list->head = overlapped;
+        list->tail = overlapped;
+        owner->owed.fetch_sub(1, std::memory_order_relaxed);
+        if (list->waiters) WakeConditionVariable(&list->ready);
+        ReleaseSRWLockExclusive(&list->lock);
+    }
+}
+
+/**
+ * @brief Creates the process's shared engine on the first thin io_setup. It lives until the
+ * process exits, like the worker pools' threads it may start.
+ */
+static BOOL CALLBACK start_shared_engine(PINIT_ONCE, PVOID, PVOID*) {
+    WinAioContext* engine = new (std::nothrow) WinAioContext();
+    if (!engine) return FALSE;
+    init_context(engine);
+    engine->serial = g_next_context_serial.fetch_add(1, std::memory_order_relaxed);
+    if (slab_init(&engine->slab, (int)SLAB_MAX_RECORDS, true)) {
+        engine->ioCompletionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    }
+    HANDLE thread = engine->ioCompletionPort ? CreateThread(NULL, 0, dispatcher_main, engine, 0, NULL) : NULL;
+    if (!thread) {
+        if (engine->ioCompletionPort) CloseHandle(engine->ioCompletionPort);
+        slab_destroy(&engine->slab);
+        delete engine;
+        return FALSE;
+    }
+    CloseHandle(thread);
+    g_shared_engine = engine;
+    return TRUE;
+}
+
+
+/**
+ * @brief Takes the oldest packet routed to a thin context, waiting up to `timeout_ms` for one.
+ * @return As GetQueuedCompletionStatus would for the packet.
+ */
+static BOOL thin_dequeue(WinAioContext* context, DWORD* bytes, ULONG_PTR* key, OVERLAPPED** overlapped, DWORD timeout_ms) {
+    CompletionList* list = &context->completions;
+    ULONGLONG deadline = timeout_ms == INFINITE ? 0 : GetTickCount64() + timeout_ms;
+    AcquireSRWLockExclusive(&list->lock);
+    while (!list->head) {
+        DWORD wait_ms = INFINITE;
+        if (timeout_ms != INFINITE) {
+            ULONGLONG now = GetTickCount64();
+            wait_ms = now >= deadline ? 0 : (DWORD)(deadline - now);
+        }
+        if (wait_ms == 0) {
+            ReleaseSRWLockExclusive(&list->lock);
+            *overlapped = NULL;
+            SetLastError(WAIT_TIMEOUT);
+            return FALSE;
+        }
+        list->waiters++;
+        SleepConditionVariableSRW(&list->ready, &list->lock, wait_ms, 0);
+        list->waiters--;
+    }
+    OVERLAPPED* packet = list->head;
+    list->head = static_cast<OVERLAPPED*>(packet->hEvent);
+    if (!list->head) list->tail = nullptr;
+    ReleaseSRWLockExclusive(&list->lock);
+
+    *overlapped = packet;
+    *bytes = (DWORD)packet->Internal;
+    *key = packet->OffsetHigh == MAXDWORD ? SIMULATED_COMPLETION_KEY : (ULONG_PTR)packet->OffsetHigh;
+    if (packet->Offset == ERROR_SUCCESS) return TRUE;
+    SetLastError(packet->Offset);
+    return FALSE;
+}
+
+// --- Submission ---
+
+/// The body of io_submit, for one configuration.
+template <class Config>
+static int submit_requests(WinAioContext* context, long nr, struct iocb** iocbs) {
+    if (!context || !context->ioCompletionPort || !bind_config<Config>(context)) return -EINVAL;
+
+    unsigned long long submit_started = Config::Stats::phase_begin();
+    long iocbs_processed = 0;
+    int submit_error = 0;
+    typename Config::Tracing::Batch tracing;
+    typename Config::Stats::Batch stats(context);
+    // One timestamp serves the whole batch; ages and latencies count from the io_submit call.
+    WinAioContext* engine = context->engine;
+    long packets_issued = 0;
+    long long batch_time = qpc_now();
+    unsigned batch_stamp = (unsigned)batch_time;
+    for (long i = 0; i < nr; ++i) {
+        // Submission stops at the first iocb refused, so the count returned is exactly the
+        // iocbs accepted and a caller can resubmit from iocbs + count, as on Linux.
+        struct iocb* req = iocbs[i];
+        if (!req) { submit_error = -EFAULT; break; }
+        if (req->aio_lio_opcode == IO_CMD_PREAD_SELECT && !provided_buffer_fits(context, req)) {
+            submit_error = -EINVAL;
+            break;
+        }
+        // Each segment is one transfer; a longer one would be silently cut to its low 32 bits.
+        if ((req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV) && !segments_fit(req)) {
+            submit_error = -EINVAL;
+            break;
+        }
+
+        FileEntry file;
+        unsigned long long lookup_started = Config::Stats::phase_begin();
+        DWORD resolve_error = resolve_file(engine, req->aio_fildes, &file);
+        Config::Stats::phase_end(IO_PROFILE_FILE_LOOKUP, lookup_started);
+        if (resolve_error == ERROR_NOT_ENOUGH_MEMORY) { submit_error = -ENOMEM; break; }
+        if (resolve_error != ERROR_SUCCESS) { submit_error = -EBADF; break; }
+
+        long long submitted_at = tracing.submitting(engine, file, req->aio_fildes);
+
+        // --- Filesystem Synchronization and Thread-Pool Path ---
+        // FlushFileBuffers always blocks, so syncs run on a worker whatever the file's engine,
+        // unless a benchmarking engine stands in for the device.
+        bool is_sync = (req->aio_lio_opcode == IO_CMD_FSYNC || req->aio_lio_opcode == IO_CMD_FDSYNC);
+        if ((is_sync && overlapped_engine() == IO_BACKEND_IOCP) || file.backend == IO_BACKEND_THREADPOOL) {
+            if (!Config::Backend::pooled) { submit_error = -EINVAL; break; }
+            // Overflow policy: with a bounded backlog, a saturated volume pushes back on the submitter.
+            if (!Config::Scheduler::admit(file)) {
+                submit_error = -EAGAIN;
+                break;
+            }
+            WinAioRequest* win_req = new_single_request<Config>(context, req, batch_stamp);
+            if (!win_req) { submit_error = -ENOMEM; break; }
+            win_req->device = file.device;
+            Config::Tracing::track(context, req, batch_time);
+            unsigned long long issue_started = Config::Stats::phase_begin();
+            bool enqueued = enqueue_pooled(engine, win_req);
+            Config::Stats::phase_end(IO_PROFILE_ISSUE, issue_started);
+            if (!enqueued) {
+                Config::Tracing::untrack(context, req);
+                Config::Allocator::release(context, win_req);
+                submit_error = -EAGAIN;
+                break;
+            }
+            tracing.submitted(context, req, submitted_at);
+            stats.submit(file, req);
+            packets_issued++;
+            iocbs_processed++;
+            continue;
+        }
+
+        // --- Read/Write Path ---
+        Config::Tracing::track(context, req, batch_time);
+        int result = issue_iocp<Config>(context, file.handle, req, batch_stamp);
+        if (result < 0) {
+            Config::Tracing::untrack(context, req);
+            submit_error = result;
+            break;
+        }
+        tracing.submitted(context, req, submitted_at);
+        stats.submit(file, req);
+        // An overlapped vectored iocb completes as one packet per segment.
+        bool segmented = (req->aio_lio_opcode == IO_CMD_PREADV || req->aio_lio_opcode == IO_CMD_PWRITEV) && req->u.v.nr_segs > 0;
+        packets_issued += segmented ? req->u.v.nr_segs : 1;
+        iocbs_processed++;
+    }
+    // Once per batch; the reaper may already have taken some of these packets, so `owed` can dip below zero meanwhile.
+    if (packets_issued) context->owed.fetch_add(packets_issued, std::memory_order_relaxed);
+    Config::Stats::phase_end(IO_PROFILE_SUBMIT, submit_started);
+    return (iocbs_processed == 0 && submit_error) ? submit_error : iocbs_processed;
+}
+
+// --- Event Reaping ---
+
+static inline bool event_has_timestamps(const struct io_event*) { return false; }
+static inline bool event_has_timestamps(const struct io_event2*) { return true; }
+
+static inline void store_event(struct io_event* out, const Completion& done, long long) {
+    out->data = done.obj->data;
+    out->obj = done.obj;
+    out->res = (unsigned long)done.bytes;
+    out->res2 = done.error ? done.error : done.selected_buffer; // res2 stores the positive Windows error code.
+}
+
+static inline void store_event(struct io_event2* out, const Completion& done, long long completed_at) {
+    out->data = done.obj->data;
+    out->obj = done.obj;
+    out->res = done.error ? windows_error_to_errno(done.error) : (long long)done.bytes;
+    out->os_error = done.error ? done.error : done.selected_buffer;
+    out->backend = done.backend;
+    // An iocb the full in-flight index could not hold has only the low half of its stamp;
+    // the high half is recovered from the completion time.
+    out->submitted_at = done.submitted_qpc
+        ? done.submitted_qpc
+        : completed_at - (long long)(unsigned)((unsigned)completed_at - done.submitted_at);
+    out->completed_at = completed_at;
+}
+
+/// Copies a finished iocb out and counts it.
+template <class Config, typename Event>
+static inline void deliver_event(WinAioContext* context, const typename Config::Stats::Batch& stats, const Completion& done, Event* out, long long completed_at) {
+    store_event(out, done, completed_at);
+    Config::Tracing::deliver(context, done);
+    stats.complete(context, done);
+}
+
+/**
+ * @brief The body of io_getevents and io_getevents2, which differ only in the event they fill.
+ *
+ * io_event2's completion time is read once per dequeue that may have waited, and the events
+ * dequeued without waiting after it share that time, so timestamps cost no clock read per event.
+ */
+template <class Config, typename Event>
+static int reap_events(WinAioContext* context, long min_nr, long nr, Event* events, struct timespec* timeout) {
+    if (!context || !context->ioCompletionPort || min_nr < 0 || min_nr > nr || !events || !reaps_config<Config>(context)) return -EINVAL;
+    if (min_nr == 0 && nr == 0) return 0;
+
+    DWORD timeout_ms = timespec_to_ms(timeout);
+    long events_collected = 0;
+    typename Config::Stats::Batch stats(context);
+    long long entered_at = Config::Tracing::reap_begin();
+    long long completed_at = 0;
+    unsigned long long getevents_started = Config::Stats::phase_begin();
+    bool own_port = context->engine == context;
+    long packets_taken = 0;
+    const RequestSlab* slab = &context->engine->slab;
+    unsigned reaper_node = Config::Stats::numa && slab->chunk_nodes ? current_node() : 0;
+    long remote_completions = 0;
+
+    while (events_collected < nr) {
+        DWORD bytesTransferred = 0;
+        ULONG_PTR completionKey = 0;
+        LPOVERLAPPED overlapped_ptr = NULL;
+        DWORD current_timeout = (events_collected < min_nr) ? timeout_ms : 0;
+
+        unsigned long long phase_started = Config::Stats::phase_begin();
+        BOOL status = own_port
+            ? GetQueuedCompletionStatus(context->ioCompletionPort, &bytesTransferred, &completionKey, &overlapped_ptr, current_timeout)
+            : thin_dequeue(context, &bytesTransferred, &completionKey, &overlapped_ptr, current_timeout);
+        Config::Stats::phase_end(IO_PROFILE_DEQUEUE, phase_started);
+
+        if (!overlapped_ptr) {
+            // GetQueuedCompletionStatus itself failed without dequeuing a packet.
+            DWORD last_error = GetLastError();
+            // Timeout is an expected way to stop waiting, not an error.
+            if (last_error != WAIT_TIMEOUT) {
+                if (own_port && packets_taken) context->owed.fetch_sub(packets_taken, std::memory_order_relaxed);
+                if (remote_completions) numa_count(reaper_node, NUMA_REMOTE_COMPLETION, remote_completions);
+                Config::Stats::phase_end(IO_PROFILE_GETEVENTS, getevents_started);
+                return windows_error_to_errno(last_error);
+            }
+            break; // Break loop on timeout.
+        }
+        packets_taken++;
+        if (event_has_timestamps(events) && (current_timeout || !completed_at)) {
+            completed_at = qpc_now();
+        }
+
+        RequestHeader* header = CONTAINING_RECORD(overlapped_ptr, RequestHeader, overlapped);
+
+        // Overlapped completions report errors through the status; packets posted by the
+        // worker pool carry them in the completion key. Simulated transfers always succeed.
+        bool simulated = completionKey == SIMULATED_COMPLETION_KEY;
+        DWORD io_error = simulated ? ERROR_SUCCESS : status ? (DWORD)completionKey : GetLastError();
+        int engine = simulated ? g_probe.caps.forced_backend : IO_BACKEND_IOCP;
+        if (io_error == ERROR_HANDLE_EOF) {
+            io_error = 0; // A read at or past end of file transfers 0 bytes, as on Linux.
+        }
+
+        phase_started = Config::Stats::phase_begin();
+        if (header->type == SINGLE_REQUEST) {
+            WinAioRequest* win_req = static_cast<WinAioRequest*>(header);
+            // Only pooled requests pass a device gate. Their full byte count is in the OVERLAPPED.
+            bool pooled = win_req->device != nullptr;
+            Completion done;
+            done.obj = win_req->iocb_single;
+            done.bytes = io_error ? 0 : (pooled ? (unsigned long long)win_req->overlapped.InternalHigh : bytesTransferred);
+            done.error = io_error;
+            done.backend = pooled ? IO_BACKEND_THREADPOOL : engine;
+            bool selected = (win_req->flags & REQUEST_BUFFER_SELECTED) != 0;
+            done.selected_buffer = selected && !io_error ? IO_EVENT_BUFFER_SELECTED | win_req->buffer_id : 0;
+            done.submitted_at = win_req->submitted_at;
+            Config::Tracing::complete(context, done.obj, false, done.bytes, io_error, win_req->submitted_at);
+            done.submitted_qpc = Config::Tracing::untrack(context, done.obj);
+            deliver_event<Config>(context, stats, done, &events[events_collected++], completed_at);
+
+            // A failed read never consumed its provided buffer, so hand it straight back.
+            // Groups live until io_destroy, so the iocb's key still names one.
+            if (io_error && selected) {
+                find_buffer_group(context, (unsigned short)(done.obj->key & 0xFFFF))->release(win_req->buffer_id);
+            }
+            Config::Stats::phase_end(IO_PROFILE_COMPLETION, phase_started);
+
+            if (Config::Stats::numa && slab->chunk_nodes && slab_owns(slab, win_req) && record_node(slab, win_req) != reaper_node) remote_completions++;
+            phase_started = Config::Stats::phase_begin();
+            Config::Allocator::release(context, win_req);
+            Config::Stats::phase_end(IO_PROFILE_REQUEST_FREE, phase_started);
+        }
+        else { // VECTORED_SEGMENT
+            VectoredRequestGroup* group = VectoredRequestGroup::of(static_cast<VectoredSegment*>(header));
+            bool group_done = false;
+            Config::Tracing::complete(context, group->original_iocb, true, io_error ? 0 : bytesTransferred, io_error, group->submitted_at);
+            if (!io_error) {
+                group->total_bytes_transferred.fetch_add(bytesTransferred);
+            }
+            else {
+                unsigned long expected = 0;
+                group->first_error.compare_exchange_strong(expected, io_error);
+            }
+
+            if (group->completed_segments.fetch_add(1) + 1 == group->total_segments) {
+                group_done = true;
+                Completion done;
+                done.obj = group->original_iocb;
+                done.bytes = group->total_bytes_transferred.load();
+                done.error = group->first_error.load();
+                done.backend = engine;
+                done.selected_buffer = 0;
+                done.submitted_at = group->submitted_at;
+                done.submitted_qpc = Config::Tracing::untrack(context, done.obj);
+                deliver_event<Config>(context, stats, done, &events[events_collected++], completed_at);
+                Config::Tracing::vectored_complete(context, done, group->total_segments);
+            }
+            Config::Stats::phase_end(IO_PROFILE_VECTORED, phase_started);
+
+            if (group_done) {
+                phase_started = Config::Stats::phase_begin();
+                free_vectored_group(group);
+                Config::Stats::phase_end(IO_PROFILE_REQUEST_FREE, phase_started);
+            }
+        }
+
+        if (events_collected >= min_nr && current_timeout == 0) {
+            break;
+        }
+    }
+    // A thin context's packets were counted off as the engine routed them.
+    if (own_port && packets_taken) context->owed.fetch_sub(packets_taken, std::memory_order_relaxed);
+    if (remote_completions) numa_count(reaper_node, NUMA_REMOTE_COMPLETION, remote_completions);
+    Config::Tracing::reap_end(context, min_nr, nr, events_collected, entered_at);
+    Config::Stats::phase_end(IO_PROFILE_GETEVENTS, getevents_started);
+    return events_collected;
+}
+
+/**
+ * @brief io_submit, io_getevents and io_getevents2 for one configuration, for C++ code that compiles
+ * the library in. Contexts still come from io_setup or io_setup_shared and go to io_destroy.
+ */
+template <class Config>
+struct AioEngine {
+    static int submit(io_context_t ctx, long nr, struct iocb** iocbs) {
+        return submit_requests<Config>(static_cast<WinAioContext*>(ctx), nr, iocbs);
+    }
+    static int getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+        return reap_events<Config>(static_cast<WinAioContext*>(ctx), min_nr, nr, events, timeout);
+    }
+    static int getevents2(io_context_t ctx, long min_nr, long nr, struct io_event2* events, struct timespec* timeout) {
+        return reap_events<Config>(static_cast<WinAioContext*>(ctx), min_nr, nr, events, timeout);
+    }
+};
+
+// --- Teardown ---
+
+/// Frees the request behind a packet that io_destroy took instead of a reaper.
+static void release_packet(WinAioContext* context, OVERLAPPED* overlapped) {
+    RequestHeader* header = CONTAINING_RECORD(overlapped, RequestHeader, overlapped);
+    if (header->type == SINGLE_REQUEST) {
+        free_single_request(context, static_cast<WinAioRequest*>(header));
+        return;
+    }
+    VectoredRequestGroup* group = VectoredRequestGroup::of(static_cast<VectoredSegment*>(header));
+    if (group->completed_segments.fetch_add(1) + 1 == group->total_segments) free_vectored_group(group);
+}
+
+/// The handle an overlapped request of `engine` was issued on, or nullptr if its file is not on IOCP.
+/// Caller holds the engine's files_lock.
+static HANDLE overlapped_handle(WinAioContext* engine, int fd) {
+    if (fd < 0 || fd >= engine->file_capacity || engine->files[fd].backend != IO_BACKEND_IOCP) return nullptr;
+    return engine->files[fd].handle;
+}
+
+/// Cancels a single request if it was issued as overlapped I/O. Caller holds the engine's files_lock.
+static void cancel_single(WinAioContext* engine, WinAioRequest* win_req) {
+    if (win_req->device) return; // Pooled: never in the device while queued, and see run_pooled_request.
+    HANDLE handle = overlapped_handle(engine, win_req->iocb_single->aio_fildes);
+    if (handle) CancelIoEx(handle, &win_req->overlapped);
+}
+
+/**
+ * @brief Asks Windows to abort the context's reads and writes that are still in the device.
+ *
+ * Each is cancelled by its own OVERLAPPED, so other contexts' and the application's I/O on the
+ * same handles is left alone. Slab records are found by walking the slab; requests from the heap
+ * and vectored groups, by the context's lists of them.
+ */
+static void cancel_overlapped(WinAioContext* context) {
+    if (overlapped_engine() != IO_BACKEND_IOCP) return;
+    WinAioContext* engine = context->engine;
+    RequestSlab* slab = &engine->slab;
+    unsigned committed = 0;
+    if (slab->records) {
+        AcquireSRWLockShared(&slab->grow_lock);
+        committed = slab->committed;
+        ReleaseSRWLockShared(&slab->grow_lock);
+    }
+
+    AcquireSRWLockShared(&engine->files_lock);
+    for (unsigned i = 0; i < committed; ++i) {
+        WinAioRequest* win_req = &slab->records[i];
+        // In the shared slab, only this context's records are stable while it is being destroyed.
+        if (slab->owners ? slab->owners[i].load(std::memory_order_relaxed) != context : win_req->type == FREE_RECORD) continue;
+        cancel_single(engine, win_req);
+    }
+    // A request completing meanwhile unlinks itself under this lock, so every one listed is still allocated.
+    AcquireSRWLockShared(&context->unindexed_lock);
+    for (HeapRequest* heap_req = context->heap_requests; heap_req; heap_req = heap_req->next) {
+        cancel_single(engine, heap_req);
+    }
+    for (VectoredRequestGroup* group = context->vectored_groups; group; group = group->next) {
+        HANDLE handle = overlapped_handle(engine, group->original_iocb->aio_fildes);
+        if (!handle) continue;
+        VectoredSegment* segments = group->segments();
+        for (long seg = 0; seg < group->total_segments; ++seg) CancelIoEx(handle, &segments[seg].overlapped);
+    }
+    ReleaseSRWLockShared(&context->unindexed_lock);
+    ReleaseSRWLockShared(&engine->files_lock);
+}
+
+/**
+ * @brief Takes and frees the packets still owed to a context with its own port, until none is
+ * left or the deadline passes.
+ * @return true if every packet was taken, so no request of the context remains.
+ */
+static bool drain_port(WinAioContext* context, ULONGLONG deadline) {
+    long owed = context->owed.load(std::memory_order_acquire);
+    while (owed > 0) {
+        ULONGLONG now = GetTickCount64();
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = nullptr;
+        GetQueuedCompletionStatus(context->ioCompletionPort, &bytes, &key, &overlapped, now >= deadline ? 0 : (DWORD)(deadline - now));
+        if (!overlapped) break;
+        release_packet(context, overlapped);
+        owed--;
+    }
+    context->owed.store(owed, std::memory_order_relaxed);
+    return owed <= 0;
+}
+
+/**
+ * @brief Waits until the engine has routed every packet it owes a thin context being destroyed,
+ * or the deadline passes, then frees the requests of those nobody reaped.
+ *
+ * The requests belong to the shared slab and the packets to the shared port, so unlike a
+ * context with its own port, a thin one cannot simply abandon them.
+ * @return false on timeout; the context must then stay allocated for the packets still owed to it.
+ */
+static bool thin_release(WinAioContext* context, ULONGLONG deadline) {
+    CompletionList* list = &context->completions;
+    AcquireSRWLockExclusive(&list->lock);
+    while (context->owed.load(std::memory_order_relaxed) > 0) {
+        ULONGLONG now = GetTickCount64();
+        if (now >= deadline) {
+            ReleaseSRWLockExclusive(&list->lock);
+            return false;
+        }
+        list->waiters++;
+        SleepConditionVariableSRW(&list->ready, &list->lock, (DWORD)(deadline - now), 0);
+        list->waiters--;
+    }
+    OVERLAPPED* packet = list->head;
+    list->head = list->tail = nullptr;
+    ReleaseSRWLockExclusive(&list->lock);
+
+    while (packet) {
+        OVERLAPPED* next = static_cast<OVERLAPPED*>(packet->hEvent);
+        release_packet(context, packet);
+        packet = next;
+    }
+    return true;
+}
+
+/// Stops a dedicated context's workers and closes its port, once nothing of it is in flight.
+static void close_engine(WinAioContext* context) {
+    // Workers finish whatever is queued before they exit, so stop them while the port is still open.
+    if (context->pool) {
+        destroy_worker_pool(context->pool);
+        context->pool = nullptr;
+    }
+    if (context->ioCompletionPort) {
+        simulator_forget(context);
+        CloseHandle(context->ioCompletionPort);
+        context->ioCompletionPort = NULL;
+    }
+}
+
+/// Frees a destroyed context and what it owns besides its port and workers.
+static void free_context(WinAioContext* context) {
+    while (context->buffer_groups) {
+        BufferGroup* group = context->buffer_groups;
+        context->buffer_groups = group->next;
+        delete group;
+    }
+    for (int fd = 0; fd < context->file_capacity; ++fd) {
+        if (context->files[fd].stats) stats_release(context->files[fd].stats);
+        delete context->files[fd].counters;
+    }
+    delete[] context->files;
+    delete context->hot_files.load(std::memory_order_relaxed);
+    inflight_free(context->inflight, context->inflight_large_bytes);
+    slab_destroy(&context->slab);
+    if (context->stats) {
+        stats_release(context->stats);
+    }
+    while (context->devices) {
+        DeviceGate* device = context->devices;
+        context->devices = device->next;
+        delete device;
+    }
+    delete context;
+}
+
+// --- Deferred Teardown ---
+// A context whose io_destroy timed out still has requests that the device or a worker may yet
+// complete. It is parked with its port, workers, records and buffers, and a reclaimer thread,
+// which runs only while some context is parked, finishes the teardown once the last packet
+// owed to it has come back. A request that never completes keeps its context parked.
+
+/// How often the reclaimer looks at the parked contexts.
+static const DWORD RECLAIM_INTERVAL_MS = 50;
+
+static SRWLOCK g_parked_lock = SRWLOCK_INIT;
+static WinAioContext* g_parked = nullptr;   ///< Linked through next_context.
+static bool g_reclaimer_running = false;    ///< Guarded by g_parked_lock.
+
+/// Finishes a parked context's teardown if nothing is owed to it any more.
+static bool try_reclaim(WinAioContext* context) {
+    if (context->engine != context) {
+        if (!thin_release(context, 0)) return false;
+    }
+    else {
+        if (!drain_port(context, 0)) return false;
+        close_engine(context);
+    }
+    free_context(context);
+    return true;
+}
+
+static DWORD WINAPI reclaimer_main(LPVOID) {
+    for (;;) {
+        Sleep(RECLAIM_INTERVAL_MS);
+        AcquireSRWLockExclusive(&g_parked_lock);
+        WinAioContext* parked = g_parked;
+        g_parked = nullptr;
+        ReleaseSRWLockExclusive(&g_parked_lock);
+
+        WinAioContext* pending = nullptr;
+        while (parked) {
+            WinAioContext* next = parked->next_context;
+            if (!try_reclaim(parked)) {
+                parked->next_context = pending;
+                pending = parked;
+            }
+            parked = next;
+        }
+
+        AcquireSRWLockExclusive(&g_parked_lock);
+        while (pending) {
+            WinAioContext* next = pending->next_context;
+            pending->next_context = g_parked;
+            g_parked = pending;
+            pending = next;
+        }
+        bool idle = g_parked == nullptr;
+        if (idle) g_reclaimer_running = false;
+        ReleaseSRWLockExclusive(&g_parked_lock);
+        if (idle) return 0;
+    }
+}
+
+/// Hands a context io_destroy gave up on to the reclaimer. If no reclaimer thread can be started,
+/// the context stays parked until the next one is.
+static void park_context(WinAioContext* context) {
+    AcquireSRWLockExclusive(&g_parked_lock);
+    context->next_context = g_parked;
+    g_parked = context;
+    if (!g_reclaimer_running) {
+        HANDLE thread = CreateThread(NULL, 0, reclaimer_main, NULL, 0, NULL);
+        if (thread) {
+            CloseHandle(thread);
+            g_reclaimer_running = true;
+        }
+    }
+    ReleaseSRWLockExclusive(&g_parked_lock);
+}
+
+// --- Context Pool ---
+
+/// A completion port and the worker pool bound to it, idle between two contexts.
+struct PooledEngine {
+    HANDLE port;                ///< An empty port no file is associated with, or NULL for the lessee to create one.
+    WorkerPool* pool;           ///< Parked workers that post to `port`, or nullptr if none were started.
+};
+
+/**
+ * @struct ContextPool
+ * @brief The ports and worker pools of destroyed contexts, which io_setup leases before creating new ones.
+ *
+ * Creating a port is a system call and starting a worker pool starts threads, which dominates
+ * io_setup for contexts that live for one short job. Only a context with nothing in flight gives
+ * its engine back, so a leased port holds no packets and its workers are parked. A port that had
+ * files associated is closed rather than pooled: a handle stays bound to its port for life, so the
+ * next context could not associate those files and would run them on the thread pool.
+ */
+struct ContextPool {
+    SRWLOCK lock;
+    PooledEngine* idle;         ///< caps.context_pool entries, allocated on first use.
+    unsigned count;
+};
+
+static ContextPool g_context_pool = { SRWLOCK_INIT, nullptr, 0 };
+
+/// Allocates the idle array. Caller holds the pool's lock exclusively.
+static bool context_pool_ready() {
+    if (!g_context_pool.idle && backend_probe().caps.context_pool) {
+        g_context_pool.idle = new (std::nothrow) PooledEngine[backend_probe().caps.context_pool];
+    }
+    return g_context_pool.idle != nullptr;
+}
+
+/// Takes the most recently returned engine, whose workers are likeliest to be warm.
+static PooledEngine context_pool_lease() {
+    PooledEngine engine = { NULL, nullptr };
+    AcquireSRWLockExclusive(&g_context_pool.lock);
+    if (g_context_pool.count) engine = g_context_pool.idle[--g_context_pool.count];
+    ReleaseSRWLockExclusive(&g_context_pool.lock);
+    return engine;
+}
+
+/**
+ * @brief Gives a drained context's port and worker pool to the pool, keeping only the workers
+ * if files were associated with the port.
+ *
+ * The context owes no completions, but a worker may still be leaving its last request's device
+ * gate, which belongs to the context. Such a pool is not waited for: it is not pooled, and the
+ * caller's destroy_worker_pool joins its workers.
+ * @return false if the pool is full, a worker is still busy or nothing is left to pool; the
+ * caller then releases the port and workers.
+ */
+static bool context_pool_return(WinAioContext* context) {
+    if (!backend_probe().caps.context_pool) return false;
+    WorkerPool* pool = context->pool;
+    if (pool && (pool->busy_workers.load(std::memory_order_acquire) != 0 || pool->queued.load(std::memory_order_acquire) != 0)) {
+        return false;
+    }
+    if (!pool && context->port_bound) return false;
+
+    AcquireSRWLockExclusive(&g_context_pool.lock);
+    bool kept = context_pool_ready() && g_context_pool.count < backend_probe().caps.context_pool;
+    if (kept) {
+        g_context_pool.idle[g_context_pool.count++] = { context->port_bound ? NULL : context->ioCompletionPort, pool };
+        if (pool) {
+            pool->saturated_since.store(0, std::memory_order_relaxed);
+            pool->context = nullptr;
+        }
+    }
+    ReleaseSRWLockExclusive(&g_context_pool.lock);
+    if (kept && context->port_bound) {
+        simulator_forget(context);
+        CloseHandle(context->ioCompletionPort);
+    }
+    return kept;
+}
+
+// --- API Function Implementations ---
+
+/**
+ * @brief Creates a context with its own engine, or, with `shared`, a thin one on the shared engine.
+ */
+static int setup_context(int maxevents, io_context_t* ctxp, bool shared) {
+    backend_probe();
+
+    WinAioContext* engine = nullptr;
+    if (shared && (!InitOnceExecuteOnce(&g_shared_engine_once, start_shared_engine, NULL, NULL) || !(engine = g_shared_engine))) {
+        return -ENOMEM;
+    }
+    WinAioContext* context = new (std::nothrow) WinAioContext();
+    if (!context) {
+        return -ENOMEM;
+    }
+    init_context(context);
+    context->inflight_mask = inflight_capacity(maxevents, shared ? THIN_INFLIGHT_MIN_SLOTS : INFLIGHT_MIN_SLOTS) - 1;
+    context->inflight = inflight_alloc(context->inflight_mask + 1, &context->inflight_large_bytes);
+    context->serial = g_next_context_serial.fetch_add(1, std::memory_order_relaxed);
+    context->stats = stats_claim_context(context->serial);
+    if (!context->inflight || (!shared && !slab_init(&context->slab, maxevents, false))) {
+        if (context->stats) stats_release(context->stats);
+        slab_destroy(&context->slab);
+        inflight_free(context->inflight, context->inflight_large_bytes);
+        delete context;
+        return -ENOMEM;
+    }
+    for (unsigned i = 0; i <= context->inflight_mask; ++i) {
+        context->inflight[i].iocb.store(nullptr, std::memory_order_relaxed);
+        context->inflight[i].generation.store(0, std::memory_order_relaxed);
+        context->inflight[i].reported.store(0, std::memory_order_relaxed);
+    }
+    if (shared) {
+        // Files, devices and workers are the engine's; the context keeps its requests' view.
+        context->engine = engine;
+        context->ioCompletionPort = engine->ioCompletionPort;
+    }
+    else {
+        PooledEngine leased = context_pool_lease();
+        context->ioCompletionPort = leased.port ? leased.port : CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+        if (leased.pool) {
+            leased.pool->context = context;
+            context->pool = leased.pool;
+        }
+    }
+    if (context->ioCompletionPort == NULL) {
+        DWORD last_error = GetLastError();
+        if (context->pool) destroy_worker_pool(context->pool);
+        if (context->stats) stats_release(context->stats);
+        slab_destroy(&context->slab);
+        inflight_free(context->inflight, context->inflight_large_bytes);
+        delete context;
+        return windows_error_to_errno(last_error);
+    }
+    if (g_probe.file_stats_budget && !shared) {
+        io_file_stats_enable(context, g_probe.file_stats_budget);
+    }
+    etw_setup(context, maxevents);
+    AcquireSRWLockExclusive(&g_contexts_lock);
+    context->next_context = g_contexts;
+    g_contexts = context;
+    ReleaseSRWLockExclusive(&g_contexts_lock);
+    *ctxp = context;
+    return 0;
+}
+
+LIO_API int io_setup(int maxevents, io_context_t* ctxp) {
+    return setup_context(maxevents, ctxp, (backend_probe().caps.features & IO_CAP_SHARED_CONTEXTS) != 0);
+}
+
+LIO_API int io_setup_shared(int maxevents, io_context_t* ctxp) {
+    return setup_context(maxevents, ctxp, true);
+}
+
+LIO_API int io_submit(io_context_t ctx, long nr, struct iocb** iocbs) {
+    return AioEngine<DefaultConfig>::submit(ctx, nr, iocbs);
+}
+
+LIO_API int io_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+    return AioEngine<DefaultConfig>::getevents(ctx, min_nr, nr, events, timeout);
+}
+
+LIO_API int io_getevents2(io_context_t ctx, long min_nr, long nr, struct io_event2* events, struct timespec* timeout) {
+    return AioEngine<DefaultConfig>::getevents2(ctx, min_nr, nr, events, timeout);
+}
+
+LIO_API int io_destroy(io_context_t ctx) {
     WinAioContext* context = static_cast<WinAioContext*>(ctx);
     if (context) {
-        if (context->ioCompletionPort) {
-            CloseHandle(context->ioCompletionPort);
+        AcquireSRWLockExclusive(&g_contexts_lock);
+        WinAioContext** link = &g_contexts;
+        while (*link && *link != context) link = &(*link)->next_context;
+        if (*link) *link = context->next_context;
+        ReleaseSRWLockExclusive(&g_contexts_lock);
+
+        // Like Linux, wait for what is still in flight, but cancel what can be cancelled first.
+        ULONGLONG deadline = GetTickCount64() + backend_probe().caps.destroy_timeout_ms;
+        bool drained = context->owed.load(std::memory_order_acquire) <= 0;
+        if (!drained) {
+            context->closing.store(true, std::memory_order_relaxed);
+            cancel_overlapped(context);
         }
-        delete context;
+        if (context->engine != context) {
+            // The port and workers are the shared engine's; only this context's packets are released.
+            drained = thin_release(context, deadline);
+        }
+        else {
+            if (!drained) drained = drain_port(context, deadline);
+            if (drained && !context_pool_return(context)) close_engine(context);
+        }
+        if (!drained) {
+            // Requests still in the device or on a worker would complete into freed memory.
+            park_context(context);
+            return -ETIMEDOUT;
+        }
+        free_context(context);
+    }
+    return 0;
+}
+
+LIO_API int io_reserve_contexts(unsigned count) {
+    unsigned wanted = count < backend_probe().caps.context_pool ? count : backend_probe().caps.context_pool;
+    AcquireSRWLockExclusive(&g_context_pool.lock);
+    int result = 0;
+    if (wanted && !context_pool_ready()) result = -ENOMEM;
+    while (result == 0 && g_context_pool.count < wanted) {
+        HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+        if (port == NULL) result = windows_error_to_errno(GetLastError());
+        else g_context_pool.idle[g_context_pool.count++] = { port, nullptr };
+    }
+    if (result == 0) result = (int)g_context_pool.count;
+    ReleaseSRWLockExclusive(&g_context_pool.lock);
+    return result;
+}
+
+LIO_API int io_provide_buffers(io_context_t ctx, unsigned short bgid, void* base, size_t buf_len, unsigned nr) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx);
+    if (!context || !base || buf_len == 0 || buf_len > MAXDWORD || nr == 0 || nr > 65536) return -EINVAL;
+
+    backend_probe();
+    BufferGroup* group = new (std::nothrow) BufferGroup(bgid, base, buf_len, nr);
+    if (!group) return -ENOMEM;
+    group->lists = numa_lists();
+    group->free_links = new (std::nothrow) std::atomic<unsigned>[nr];
+    group->held = new (std::nothrow) std::atomic<unsigned>[(nr + 31) / 32]();
+    group->free_lists = new (std::nothrow) FreeStack[group->lists];
+    if (g_probe.caps.numa_nodes > 1) group->buffer_nodes = new (std::nothrow) unsigned char[nr];
+    if (!group->free_links || !group->held || !group->free_lists || (g_probe.caps.numa_nodes > 1 && !group->buffer_nodes)) {
+        delete group;
+        return -ENOMEM;
+    }
+    if (group->buffer_nodes) numa_classify_buffers(group);
+    // Push in reverse so that each stack hands out its lowest buffer ID first.
+    for (unsigned bid = nr; bid-- > 0;) group->release((unsigned short)bid);
+
+    AcquireSRWLockExclusive(&context->buffer_groups_lock);
+    for (BufferGroup* existing = context->buffer_groups; existing; existing = existing->next) {
+        if (existing->group_id == bgid) {
+            ReleaseSRWLockExclusive(&context->buffer_groups_lock);
+            delete group;
+            return -EEXIST;
+        }
+    }
+    group->next = context->buffer_groups;
+    context->buffer_groups = group;
+    ReleaseSRWLockExclusive(&context->buffer_groups_lock);
+    return 0;
+}
+
+LIO_API int io_recycle_buffer(io_context_t ctx, unsigned short bgid, unsigned short bid) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx);
+    if (!context) return -EINVAL;
+    BufferGroup* group = find_buffer_group(context, bgid);
+    if (!group) return -ENOENT;
+    if (bid >= group->buffer_count || !group->recycle(bid)) return -EINVAL;
+    return 0;
+}
+
+LIO_API int io_query_backends(struct io_backend_caps* caps) {
+    if (!caps) return -EINVAL;
+    *caps = backend_probe().caps;
+    return 0;
+}
+
+LIO_API int io_numa_bind_thread(unsigned node) {
+    if (node >= backend_probe().caps.numa_nodes || node >= NUMA_MAX_NODES) return -EINVAL;
+    if (!bind_to_node(node)) return windows_error_to_errno(GetLastError());
+    return 0;
+}
+
+LIO_API int io_numa_read(struct io_numa_counters* counters) {
+    if (!counters) return -EINVAL;
+    unsigned long long totals[NUMA_ACCESS_KINDS] = {};
+    for (unsigned node = 0; node < NUMA_MAX_NODES; ++node) {
+        for (int access = 0; access < NUMA_ACCESS_KINDS; ++access) {
+            totals[access] += g_numa_counters[node].remote[access].load(std::memory_order_relaxed);
+        }
+    }
+    counters->remote_requests = totals[NUMA_REMOTE_REQUEST];
+    counters->remote_completions = totals[NUMA_REMOTE_COMPLETION];
+    counters->remote_buffers = totals[NUMA_REMOTE_BUFFER];
+    return 0;
+}
+
+LIO_API int io_large_pages_read(struct io_large_page_counters* counters) {
+    if (!counters) return -EINVAL;
+    counters->regions = g_large_page_regions.load(std::memory_order_relaxed);
+    counters->bytes = g_large_page_bytes.load(std::memory_order_relaxed);
+    counters->fallbacks = g_large_page_fallbacks.load(std::memory_order_relaxed);
+    return 0;
+}
+
+LIO_API int io_file_backend(io_context_t ctx, int fd) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx);
+    if (!context) return -EINVAL;
+    FileEntry file;
+    DWORD error = resolve_file(context->engine, fd, &file);
+    if (error != ERROR_SUCCESS) return windows_error_to_errno(error);
+    return file.backend;
+}
+
+LIO_API int io_file_stats_enable(io_context_t ctx, unsigned max_files) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx);
+    if (!context) return -EINVAL;
+
+    HotFiles* hot_files = nullptr;
+    if (!context->hot_files.load(std::memory_order_acquire)) {
+        hot_files = new (std::nothrow) HotFiles();
+        if (!hot_files) return -ENOMEM;
+        InitializeSRWLock(&hot_files->lock);
+        hot_files->by_ops.used = 0;
+        hot_files->by_bytes.used = 0;
+    }
+
+    AcquireSRWLockExclusive(&context->files_lock);
+    // Counters already handed out stay with their files, so the budget can grow but not shrink.
+    if (max_files > context->file_counter_budget) context->file_counter_budget = max_files;
+    if (hot_files && !context->hot_files.load(std::memory_order_relaxed)) {
+        context->hot_files.store(hot_files, std::memory_order_release);
+        hot_files = nullptr;
+    }
+    ReleaseSRWLockExclusive(&context->files_lock);
+    delete hot_files;
+    return 0;
+}
+
+LIO_API int io_file_stats_top(io_context_t ctx, int order, struct io_file_stats* stats, int nr) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx);
+    if (!context || (order != IO_FILE_STATS_BY_OPS && order != IO_FILE_STATS_BY_BYTES) || nr < 0 || (nr && !stats)) {
+        return -EINVAL;
+    }
+    HotFiles* hot_files = context->hot_files.load(std::memory_order_acquire);
+    if (!hot_files) return -ENOENT;
+
+    AcquireSRWLockShared(&context->files_lock);
+    struct io_file_stats* all = new (std::nothrow) io_file_stats[context->file_counters_used + HotFiles::CAPACITY];
+    if (!all) {
+        ReleaseSRWLockShared(&context->files_lock);
+        return -ENOMEM;
+    }
+    int count = 0;
+    for (int fd = 0; fd < context->file_capacity; ++fd) {
+        const FileCounters* counters = context->files[fd].counters;
+        if (!counters) continue;
+        struct io_file_stats* entry = &all[count++];
+        entry->fd = fd;
+        entry->estimated = 0;
+        entry->reads = counters->ops[AIO_STATS_READ].load(std::memory_order_relaxed);
+        entry->writes = counters->ops[AIO_STATS_WRITE].load(std::memory_order_relaxed);
+        entry->syncs = counters->ops[AIO_STATS_SYNC].load(std::memory_order_relaxed);
+        entry->read_bytes = counters->bytes[AIO_STATS_READ].load(std::memory_order_relaxed);
+        entry->write_bytes = counters->bytes[AIO_STATS_WRITE].load(std::memory_order_relaxed);
+        entry->completed = counters->completed.load(std::memory_order_relaxed);
+        entry->latency_ns = counters->latency_ns.load(std::memory_order_relaxed);
+        entry->errors = counters->errors.load(std::memory_order_relaxed);
+        entry->overcount = 0;
+    }
+    ReleaseSRWLockShared(&context->files_lock);
+
+    AcquireSRWLockShared(&hot_files->lock);
+    const HotFiles::Sketch& sketch = order == IO_FILE_STATS_BY_BYTES ? hot_files->by_bytes : hot_files->by_ops;
+    for (unsigned i = 0; i < sketch.used; ++i) {
+        const HotFiles::Entry& sketched = sketch.entries[i];
+        struct io_file_stats* entry = &all[count++];
+        entry->fd = sketched.fd;
+        entry->estimated = 1;
+        entry->reads = sketched.ops[AIO_STATS_READ];
+        entry->writes = sketched.ops[AIO_STATS_WRITE];
+        entry->syncs = sketched.ops[AIO_STATS_SYNC];
+        entry->read_bytes = sketched.bytes[AIO_STATS_READ];
+        entry->write_bytes = sketched.bytes[AIO_STATS_WRITE];
+        entry->completed = 0;
+        entry->latency_ns = 0;
+        entry->errors = 0;
+        entry->overcount = sketched.overcount;
+    }
+    ReleaseSRWLockShared(&hot_files->lock);
+
+    int wanted = nr < count ? nr : count;
+    std::partial_sort(all, all + wanted, all + count, [order](const io_file_stats& a, const io_file_stats& b) {
+        return file_stats_rank(a, order) > file_stats_rank(b, order);
+    });
+    for (int i = 0; i < wanted; ++i) stats[i] = all[i];
+    delete[] all;
+    return wanted;
+}
+
+LIO_API int io_list_inflight(io_context_t ctx, struct io_inflight_req* reqs, int nr) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx);
+    if (!context || nr < 0 || (nr && !reqs)) return -EINVAL;
+
+    struct io_inflight_req* all = new (std::nothrow) io_inflight_req[context->inflight_mask + 1];
+    if (!all) return -ENOMEM;
+    int count = 0;
+    long long now = qpc_now();
+    for (unsigned i = 0; i <= context->inflight_mask; ++i) {
+        unsigned generation;
+        if (inflight_read(context->inflight[i], now, &all[count], &generation)) count++;
+    }
+    int wanted = nr < count ? nr : count;
+    std::partial_sort(all, all + wanted, all + count, [](const io_inflight_req& a, const io_inflight_req& b) {
+        return a.age_ns > b.age_ns;
+    });
+    for (int i = 0; i < wanted; ++i) reqs[i] = all[i];
+    delete[] all;
+    return count;
+}
+
+LIO_API int io_watchdog_start(unsigned threshold_ms, io_watchdog_callback callback, void* arg) {
+    if (threshold_ms == 0) return -EINVAL;
+    AcquireSRWLockExclusive(&g_watchdog_lock);
+    if (g_watchdog.thread) {
+        ReleaseSRWLockExclusive(&g_watchdog_lock);
+        return -EBUSY;
+    }
+    g_watchdog.threshold_ms = threshold_ms;
+    g_watchdog.callback = callback;
+    g_watchdog.arg = arg;
+    g_watchdog.stop_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    g_watchdog.thread = g_watchdog.stop_event ? CreateThread(NULL, 0, watchdog_main, NULL, 0, NULL) : NULL;
+    if (!g_watchdog.thread) {
+        DWORD last_error = GetLastError();
+        if (g_watchdog.stop_event) CloseHandle(g_watchdog.stop_event);
+        g_watchdog.stop_event = NULL;
+        ReleaseSRWLockExclusive(&g_watchdog_lock);
+        return windows_error_to_errno(last_error);
+    }
+    ReleaseSRWLockExclusive(&g_watchdog_lock);
+    return 0;
+}
+
+LIO_API int io_watchdog_stop(void) {
+    AcquireSRWLockExclusive(&g_watchdog_lock);
+    if (g_watchdog.thread) {
+        SetEvent(g_watchdog.stop_event);
+        WaitForSingleObject(g_watchdog.thread, INFINITE);
+        CloseHandle(g_watchdog.thread);
+        CloseHandle(g_watchdog.stop_event);
+        g_watchdog.thread = NULL;
+        g_watchdog.stop_event = NULL;
+    }
+    ReleaseSRWLockExclusive(&g_watchdog_lock);
+    return 0;
+}
+
+LIO_API int io_profile_start(void) {
+    AcquireSRWLockExclusive(&g_profile_lock);
+    g_profile.enabled.store(false, std::memory_order_relaxed);
+    for (ProfileThread* thread = g_profile.threads.load(std::memory_order_acquire); thread; thread = thread->next) {
+        for (unsigned phase = 0; phase <= IO_PROFILE_PHASES; ++phase) {
+            thread->calls[phase].store(0, std::memory_order_relaxed);
+            thread->cycles[phase].store(0, std::memory_order_relaxed);
+        }
+    }
+    g_profile.started = true;
+    g_profile.started_qpc = qpc_now();
+    g_profile.started_cycles = profile_clock();
+    g_profile.enabled.store(true, std::memory_order_relaxed);
+    g_profile.pair_cycles = profile_calibrate();
+    ReleaseSRWLockExclusive(&g_profile_lock);
+    return 0;
+}
+
+LIO_API int io_profile_stop(void) {
+    AcquireSRWLockExclusive(&g_profile_lock);
+    if (g_profile.enabled.load(std::memory_order_relaxed)) {
+        g_profile.enabled.store(false, std::memory_order_relaxed);
+        g_profile.stopped_cycles = profile_clock();
+        g_profile.stopped_qpc = qpc_now();
+    }
+    ReleaseSRWLockExclusive(&g_profile_lock);
+    return 0;
+}
+
+LIO_API int io_profile_read(struct io_profile* profile) {
+    if (!profile) return -EINVAL;
+    AcquireSRWLockShared(&g_profile_lock);
+    if (!g_profile.started) {
+        ReleaseSRWLockShared(&g_profile_lock);
+        return -ENOENT;
+    }
+    bool running = g_profile.enabled.load(std::memory_order_relaxed);
+    unsigned long long cycles = (running ? profile_clock() : g_profile.stopped_cycles) - g_profile.started_cycles;
+    long long ticks = (running ? qpc_now() : g_profile.stopped_qpc) - g_profile.started_qpc;
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    profile->seconds = (double)ticks / (double)frequency.QuadPart;
+    profile->cycles_per_second = profile->seconds > 0 ? (double)cycles / profile->seconds : 0;
+    profile->threads = 0;
+    profile->pair_cycles = g_profile.pair_cycles;
+    for (unsigned phase = 0; phase < IO_PROFILE_PHASES; ++phase) {
+        profile->phases[phase].name = PROFILE_PHASE_NAMES[phase];
+        profile->phases[phase].calls = 0;
+        profile->phases[phase].cycles = 0;
+    }
+    unsigned long long pairs = 0;
+    for (ProfileThread* thread = g_profile.threads.load(std::memory_order_acquire); thread; thread = thread->next) {
+        unsigned long long thread_pairs = 0;
+        for (unsigned phase = 0; phase < IO_PROFILE_PHASES; ++phase) {
+            unsigned long long calls = thread->calls[phase].load(std::memory_order_relaxed);
+            profile->phases[phase].calls += calls;
+            profile->phases[phase].cycles += thread->cycles[phase].load(std::memory_order_relaxed);
+            thread_pairs += calls;
+        }
+        if (thread_pairs) profile->threads++;
+        pairs += thread_pairs;
+    }
+    profile->overhead_cycles = pairs * g_profile.pair_cycles;
+    ReleaseSRWLockShared(&g_profile_lock);
+    return 0;
+}
+
+LIO_API int io_profile_format(char* buf, size_t len) {
+    if (!buf && len) return -EINVAL;
+    struct io_profile profile;
+    int error = io_profile_read(&profile);
+    if (error) return error;
+
+    size_t used = 0;
+    if (len) buf[0] = '\0';
+    text_append(buf, len, &used, "libaio-win32 profile: %.3f s, %u threads, cycle counter at %.0f MHz\n",
+        profile.seconds, profile.threads, profile.cycles_per_second / 1e6);
+    text_append(buf, len, &used, "%-22s %12s %16s %12s %8s\n", "phase", "calls", "cycles", "cycles/call", "share");
+
+    // Top-level rows are shares of all timed cycles; nested rows are shares of the call they are part of.
+    unsigned long long timed = profile.phases[IO_PROFILE_SUBMIT].cycles + profile.phases[IO_PROFILE_GETEVENTS].cycles
+        + profile.phases[IO_PROFILE_WORKER].cycles;
+    static const unsigned groups[][2] = {
+        { IO_PROFILE_SUBMIT, IO_PROFILE_ISSUE },
+        { IO_PROFILE_GETEVENTS, IO_PROFILE_REQUEST_FREE },
+        { IO_PROFILE_WORKER, IO_PROFILE_WORKER },
+    };
+    for (const auto& group : groups) {
+        const auto& parent = profile.phases[group[0]];
+        unsigned long long nested = 0;
+        for (unsigned phase = group[0]; phase <= group[1]; ++phase) {
+            const auto& row = profile.phases[phase];
+            bool is_parent = phase == group[0];
+            unsigned long long whole = is_parent ? timed : parent.cycles;
+            text_append(buf, len, &used, "%s%-*s %12llu %16llu %12.1f %7.1f%%\n", is_parent ? "" : "  ", is_parent ? 22 : 20,
+                row.name, row.calls, row.cycles, row.calls ? (double)row.cycles / row.calls : 0.0,
+                whole ? 100.0 * row.cycles / whole : 0.0);
+            if (!is_parent) nested += row.cycles;
+        }
+        if (group[1] != group[0]) {
+            unsigned long long other = parent.cycles > nested ? parent.cycles - nested : 0;
+            text_append(buf, len, &used, "  %-20s %12s %16llu %12.1f %7.1f%%\n", "other", "",
+                other, parent.calls ? (double)other / parent.calls : 0.0, parent.cycles ? 100.0 * other / parent.cycles : 0.0);
+        }
+    }
+    // The cycles/call column holds the calibrated cost of timing one phase.
+    text_append(buf, len, &used, "%-22s %12s %16llu %12llu %7.1f%%  (included above)\n",
+        "profiler (estimated)", "", profile.overhead_cycles, profile.pair_cycles,
+        timed ? 100.0 * profile.overhead_cycles / timed : 0.0);
+
+    text_append(buf, len, &used, "\n%-12s %16s %16s %16s\n", "thread", "io_submit", "io_getevents", "worker");
+    AcquireSRWLockShared(&g_profile_lock);
+    for (ProfileThread* thread = g_profile.threads.load(std::memory_order_acquire); thread; thread = thread->next) {
+        unsigned long long submit = thread->cycles[IO_PROFILE_SUBMIT].load(std::memory_order_relaxed);
+        unsigned long long getevents = thread->cycles[IO_PROFILE_GETEVENTS].load(std::memory_order_relaxed);
+        unsigned long long worker = thread->cycles[IO_PROFILE_WORKER].load(std::memory_order_relaxed);
+        if (!submit && !getevents && !worker) continue;
+        text_append(buf, len, &used, "%-12lu %16llu %16llu %16llu\n", (unsigned long)thread->thread_id, submit, getevents, worker);
+    }
+    ReleaseSRWLockShared(&g_profile_lock);
+    return (int)used;
+}
+
+LIO_API int io_trace_start(const char* path) {
+    if (!path) return -EINVAL;
+    AcquireSRWLockExclusive(&g_trace_control_lock);
+    unsigned session = g_trace.session.load(std::memory_order_relaxed);
+    if (session & 1) {
+        ReleaseSRWLockExclusive(&g_trace_control_lock);
+        return -EBUSY;
+    }
+    if (!g_trace.slots) {
+        g_trace.slots = new (std::nothrow) TraceSlot[TRACE_RING_SIZE];
+        if (!g_trace.slots) {
+            ReleaseSRWLockExclusive(&g_trace_control_lock);
+            return -ENOMEM;
+        }
+        for (unsigned i = 0; i < TRACE_RING_SIZE; ++i) {
+            g_trace.slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    g_trace.file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (g_trace.file == INVALID_HANDLE_VALUE) {
+        DWORD last_error = GetLastError();
+        ReleaseSRWLockExclusive(&g_trace_control_lock);
+        return windows_error_to_errno(last_error);
+    }
+    LARGE_INTEGER frequency, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    aio_trace_header header = {};
+    memcpy(header.magic, AIO_TRACE_MAGIC, sizeof(header.magic));
+    header.version = AIO_TRACE_VERSION;
+    header.record_size = sizeof(aio_trace_record);
+    header.ticks_per_second = frequency.QuadPart;
+    trace_write(&header, sizeof(header));
+
+    g_trace.start_ticks.store(now.QuadPart, std::memory_order_relaxed);
+    g_trace.dropped.store(0, std::memory_order_relaxed);
+    g_trace.stop_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    g_trace.session.store(session + 1, std::memory_order_release);
+    g_trace.flusher = g_trace.stop_event ? CreateThread(NULL, 0, trace_flusher_main, NULL, 0, NULL) : NULL;
+    if (!g_trace.flusher) {
+        DWORD last_error = GetLastError();
+        g_trace.session.store(session + 2, std::memory_order_release);
+        if (g_trace.stop_event) CloseHandle(g_trace.stop_event);
+        CloseHandle(g_trace.file);
+        ReleaseSRWLockExclusive(&g_trace_control_lock);
+        return windows_error_to_errno(last_error);
+    }
+    ReleaseSRWLockExclusive(&g_trace_control_lock);
+    return 0;
+}
+
+LIO_API int io_trace_stop(void) {
+    AcquireSRWLockExclusive(&g_trace_control_lock);
+    unsigned session = g_trace.session.load(std::memory_order_relaxed);
+    if (!(session & 1)) {
+        ReleaseSRWLockExclusive(&g_trace_control_lock);
+        return 0;
     }
+    g_trace.session.store(session + 1, std::memory_order_release);
+    SetEvent(g_trace.stop_event);
+    WaitForSingleObject(g_trace.flusher, INFINITE);
+    CloseHandle(g_trace.flusher);
+    CloseHandle(g_trace.stop_event);
+
+    aio_trace_record end = {};
+    end.kind = AIO_TRACE_END;
+    end.length = g_trace.dropped.load(std::memory_order_relaxed);
+    end.ticks = trace_ticks();
+    trace_write(&end, sizeof(end));
+    CloseHandle(g_trace.file);
+
+    // Paths queued by submitters that raced the stop belong to the finished session.
+    for (TracePath* entry = trace_take_paths(); entry;) {
+        TracePath* next = entry->next;
+        delete[] entry->path;
+        delete entry;
+        entry = next;
+    }
+    ReleaseSRWLockExclusive(&g_trace_control_lock);
+    return 0;
+}
+
+LIO_API int io_stats_publish(void) {
+    AcquireSRWLockExclusive(&g_stats_lock);
+    if (g_stats.header) {
+        ReleaseSRWLockExclusive(&g_stats_lock);
+        return 0;
+    }
+
+    // The name is the prefix plus the decimal process ID.
+    char name[64] = AIO_STATS_NAME_PREFIX;
+    char digits[16];
+    int digit_count = 0;
+    for (DWORD pid = GetCurrentProcessId(); pid || digit_count == 0; pid /= 10) {
+        digits[digit_count++] = (char)('0' + pid % 10);
+    }
+    size_t name_length = sizeof(AIO_STATS_NAME_PREFIX) - 1;
+    while (digit_count) name[name_length++] = digits[--digit_count];
+    name[name_length] = '\0';
+
+    DWORD size = (DWORD)(sizeof(aio_stats_header) + AIO_STATS_MAX_CONTEXTS * sizeof(aio_stats_context)
+        + AIO_STATS_MAX_FILES * sizeof(aio_stats_file));
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+    DWORD last_error = GetLastError();
+    if (mapping && last_error == ERROR_ALREADY_EXISTS) {
+        // Another copy of the library in this process already publishes under the name.
+        CloseHandle(mapping);
+        ReleaseSRWLockExclusive(&g_stats_lock);
+        return -EEXIST;
+    }
+    void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size) : nullptr;
+    if (!view) {
+        last_error = GetLastError();
+        if (mapping) CloseHandle(mapping);
+        ReleaseSRWLockExclusive(&g_stats_lock);
+        return windows_error_to_errno(last_error);
+    }
+
+    // A new mapping is zero-filled, so every slot starts out free.
+    aio_stats_header* header = static_cast<aio_stats_header*>(view);
+    header->version = AIO_STATS_VERSION;
+    header->process_id = GetCurrentProcessId();
+    header->max_contexts = AIO_STATS_MAX_CONTEXTS;
+    header->max_files = AIO_STATS_MAX_FILES;
+    header->context_size = sizeof(aio_stats_context);
+    header->file_size = sizeof(aio_stats_file);
+    MemoryBarrier();
+    memcpy(header->magic, AIO_STATS_MAGIC, sizeof(header->magic));
+
+    g_stats.mapping = mapping;
+    g_stats.contexts = reinterpret_cast<aio_stats_context*>(header + 1);
+    g_stats.files = reinterpret_cast<aio_stats_file*>(g_stats.contexts + AIO_STATS_MAX_CONTEXTS);
+    g_stats.header = header;
+    ReleaseSRWLockExclusive(&g_stats_lock);
     return 0;
-}
\ No newline at end of file
+}
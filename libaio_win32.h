@@ -9,7 +9,170 @@
  * being ported from Linux to Windows. It aims to be behaviorally identical
  * for the core set of I/O operations, including positional, vectored, and
  * synchronization operations.
+ *
+ * On non-Windows platforms the header declares libaio's own API instead, from the system
+ * <libaio.h> where it is installed. The application then links either the native libaio or
+ * libaio-linux (libaio_linux.cpp), which runs O_DIRECT files on kernel AIO and buffered ones on a
+ * worker pool. Portable code should fill iocbs through the io_prep_* helpers, since field
+ * names such as `u.v.nr_segs` differ from the kernel layout. Extensions that
+ * exist only in this library are available when LIBAIO_WIN32_EXTENSIONS is defined.
+ *
+ * By default the functions are imported from aio.dll. Define LIBAIO_WIN32_STATIC to link the
+ * static library instead. Define LIBAIO_WIN32_IMPLEMENTATION in exactly one source file before
+ * including this header to compile the whole library into that file, so the compiler can inline
+ * it into the caller; other files then define LIBAIO_WIN32_STATIC. That file can also submit and
+ * reap through AioEngine<Config>, with the library's optional features compiled out by the
+ * configuration's policies (see "Engine Configurations" in libaio_win32.cpp).
+ */
+
+#if !defined(_WIN32)
+
+#if __has_include(<libaio.h>)
+#include <libaio.h>     // Native kernel AIO; iocbs are passed to the kernel untranslated
+#else
+// Without libaio's development files, the subset of <libaio.h> that libaio-linux implements, with
+// the same names and the kernel's layout, which libaio's is too.
+#include <string.h>     // For memset in the io_prep_* helpers
+#include <sys/uio.h>    // For struct iovec
+#include <time.h>       // For the timespec struct used in io_getevents
+
+#if !defined(__LP64__) || __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "libaio_win32.h declares libaio's iocb for 64-bit little-endian Linux only; install libaio's headers"
+#endif
+
+typedef struct io_context* io_context_t;
+
+typedef enum io_iocb_cmd {
+    IO_CMD_PREAD = 0,
+    IO_CMD_PWRITE = 1,
+    IO_CMD_FSYNC = 2,
+    IO_CMD_FDSYNC = 3,
+    IO_CMD_POLL = 5,
+    IO_CMD_NOOP = 6,
+    IO_CMD_PREADV = 7,
+    IO_CMD_PWRITEV = 8,
+} io_iocb_cmd_t;
+
+struct io_iocb_common {
+    void* buf;
+    unsigned long nbytes;
+    long long offset;
+    long long __pad3;
+    unsigned flags;     ///< IOCB_FLAG_RESFD to signal `resfd` on completion.
+    unsigned resfd;
+};
+
+struct io_iocb_vector {
+    const struct iovec* vec;
+    int nr;
+    long long offset;
+};
+
+struct iocb {
+    void* data;
+    unsigned key;
+    unsigned aio_rw_flags;  ///< RWF_* flags, as for preadv2 and pwritev2.
+    short aio_lio_opcode;
+    short aio_reqprio;
+    int aio_fildes;
+    union {
+        struct io_iocb_common c;
+        struct io_iocb_vector v;
+    } u;
+};
+
+struct io_event {
+    void* data;
+    struct iocb* obj;
+    unsigned long res;      ///< Bytes transferred, or a negative errno value.
+    unsigned long res2;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    int io_queue_init(int maxevents, io_context_t* ctxp);
+    int io_queue_release(io_context_t ctx);
+    int io_setup(int maxevents, io_context_t* ctxp);
+    int io_destroy(io_context_t ctx);
+    int io_submit(io_context_t ctx, long nr, struct iocb* iocbs[]);
+    int io_cancel(io_context_t ctx, struct iocb* iocb, struct io_event* evt);
+    int io_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout);
+#ifdef __cplusplus
+}
+#endif
+
+static inline void io_prep_pread(struct iocb* iocb, int fd, void* buf, size_t count, long long offset) {
+    memset(iocb, 0, sizeof(*iocb));
+    iocb->aio_fildes = fd;
+    iocb->aio_lio_opcode = IO_CMD_PREAD;
+    iocb->u.c.buf = buf;
+    iocb->u.c.nbytes = count;
+    iocb->u.c.offset = offset;
+}
+
+static inline void io_prep_pwrite(struct iocb* iocb, int fd, void* buf, size_t count, long long offset) {
+    io_prep_pread(iocb, fd, buf, count, offset);
+    iocb->aio_lio_opcode = IO_CMD_PWRITE;
+}
+
+static inline void io_prep_preadv(struct iocb* iocb, int fd, const struct iovec* iov, int iovcnt, long long offset) {
+    memset(iocb, 0, sizeof(*iocb));
+    iocb->aio_fildes = fd;
+    iocb->aio_lio_opcode = IO_CMD_PREADV;
+    iocb->u.v.vec = iov;
+    iocb->u.v.nr = iovcnt;
+    iocb->u.v.offset = offset;
+}
+
+static inline void io_prep_pwritev(struct iocb* iocb, int fd, const struct iovec* iov, int iovcnt, long long offset) {
+    io_prep_preadv(iocb, fd, iov, iovcnt, offset);
+    iocb->aio_lio_opcode = IO_CMD_PWRITEV;
+}
+
+static inline void io_prep_fsync(struct iocb* iocb, int fd) {
+    memset(iocb, 0, sizeof(*iocb));
+    iocb->aio_fildes = fd;
+    iocb->aio_lio_opcode = IO_CMD_FSYNC;
+}
+
+static inline void io_prep_fdsync(struct iocb* iocb, int fd) {
+    memset(iocb, 0, sizeof(*iocb));
+    iocb->aio_fildes = fd;
+    iocb->aio_lio_opcode = IO_CMD_FDSYNC;
+}
+#endif // __has_include(<libaio.h>)
+
+#if defined(LIBAIO_LINUX_ENGINE)
+/**
+ * @brief The engines libaio-linux runs a file's requests on, numbered as on Windows.
+ *
+ * LIBAIO_WIN32_BACKEND set to `kernel` or `threadpool` when a context is set up forces one engine
+ * for every file of that context; `auto` or unset selects per request, by the descriptor's O_DIRECT flag.
  */
+enum io_backend {
+    IO_BACKEND_AUTO = 0,        ///< Let the library choose per file.
+    IO_BACKEND_THREADPOOL = 2,  ///< Blocking preadv2/pwritev2/fsync on the process's worker threads.
+    IO_BACKEND_KERNEL = 5,      ///< Kernel AIO, which is only asynchronous for O_DIRECT files.
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+    /**
+     * @brief Reports the engine `ctx` would run a read or write of `fd` on now. Syncs always run
+     * on the worker pool.
+     * @return IO_BACKEND_KERNEL or IO_BACKEND_THREADPOOL, or a negative errno value on failure.
+     */
+    int io_file_backend(io_context_t ctx, int fd);
+#ifdef __cplusplus
+}
+#endif
+#endif // LIBAIO_LINUX_ENGINE
+
+#else
+
+#define LIBAIO_WIN32_EXTENSIONS 1
 
 #include <errno.h>      // For standard error codes like ENOMEM
 #include <time.h>       // For the timespec struct used in io_getevents
@@ -37,7 +200,7 @@ struct iovec {
  */
 struct iocb {
     void* data;           ///< User-defined data. Returned verbatim in the corresponding io_event.
-    unsigned        key;            ///< (Unused in this implementation)
+    unsigned        key;            ///< Buffer group for IO_CMD_PREAD_SELECT (low 16 bits). Never written by the engine.
     short           aio_lio_opcode; ///< The I/O command (e.g., IO_CMD_PREAD, IO_CMD_FSYNC).
     short           aio_reqprio;    ///< I/O request priority. (Unused in this implementation)
     int             aio_fildes;     ///< The file descriptor for the I/O operation.
@@ -69,7 +232,24 @@ struct io_event {
     void* data;   ///< The user-defined data from the source iocb.
     struct iocb* obj;    ///< A pointer to the source iocb.
     unsigned long   res;    ///< The result of the operation (e.g., total bytes transferred).
-    unsigned long   res2;   ///< The error code of the operation (0 on success).
+    unsigned long   res2;   ///< The Windows error code of the operation (0 on success), or for a successful IO_CMD_PREAD_SELECT, IO_EVENT_BUFFER_SELECTED | the buffer ID.
+};
+
+/**
+ * @struct io_event2
+ * @brief A completion as reported by io_getevents2: io_event with a 64-bit result, the engine
+ * that ran the request, and when it was submitted and reaped.
+ *
+ * Timestamps are QueryPerformanceCounter values; divide differences by QueryPerformanceFrequency.
+ */
+struct io_event2 {
+    void* data;             ///< The user-defined data from the source iocb.
+    struct iocb* obj;       ///< A pointer to the source iocb.
+    long long res;          ///< Bytes transferred, or a negative errno value if the operation failed.
+    unsigned long os_error; ///< The Windows error code behind a failure (0 on success), or the selected buffer, as in io_event's res2.
+    int backend;            ///< The io_backend that ran the request.
+    long long submitted_at; ///< Time of the io_submit call that accepted the iocb.
+    long long completed_at; ///< Time io_getevents2 dequeued the completion.
 };
 
 /// Defines the supported libaio command opcodes.
@@ -80,31 +260,301 @@ enum {
     IO_CMD_FDSYNC = 6,      ///< Asynchronous file data sync.
     IO_CMD_PREADV = 7,      ///< Vectored (scatter/gather) positional read operation.
     IO_CMD_PWRITEV = 8,     ///< Vectored (scatter/gather) positional write operation.
+    IO_CMD_PREAD_SELECT = 16, ///< Positional read into a buffer selected by the engine from a provided buffer group.
+};
+
+/**
+ * @brief The I/O engines a file can be driven by.
+ *
+ * The engine is chosen per file the first time a context sees it, and the choice is cached.
+ * Set the LIBAIO_WIN32_BACKEND environment variable to `iocp` or `threadpool` to force an
+ * engine for every file in the process. `auto` or unset means per-file selection.
+ *
+ * `null` and `simulated` force one of the benchmarking engines, which run requests through the
+ * IOCP engine's submission and completion paths but never touch the file: reads leave their
+ * buffers unchanged and every request succeeds with its full length. The simulated device
+ * completes each request LIBAIO_WIN32_SIM_LATENCY_US microseconds (default 100) after it was
+ * issued, from a thread that spins while completions are due within a millisecond.
+ */
+enum io_backend {
+    IO_BACKEND_AUTO = 0,        ///< Let the library choose per file.
+    IO_BACKEND_IOCP = 1,        ///< Overlapped I/O completed through the context's completion port.
+    IO_BACKEND_THREADPOOL = 2,  ///< Blocking I/O on engine worker threads, completed through the port.
+    IO_BACKEND_NULL = 3,        ///< No I/O; each request's completion is posted as it is issued.
+    IO_BACKEND_SIMULATED = 4,   ///< No I/O; completions are posted after a fixed simulated latency.
+};
+
+/// Capability bits reported in io_backend_caps::features.
+enum {
+    IO_CAP_FILE_MODE_QUERY = 1 << 0, ///< Per-file synchronous/direct-I/O flags can be queried.
+    IO_CAP_SHARED_CONTEXTS = 1 << 1, ///< io_setup makes thin contexts, as io_setup_shared does (LIBAIO_WIN32_CONTEXTS=shared).
+    IO_CAP_NUMA_PLACEMENT = 1 << 2,  ///< Requests, provided buffers and workers are kept per NUMA node (unless LIBAIO_WIN32_NUMA=0).
+    IO_CAP_NUMA_SIMULATED = 1 << 3,  ///< `numa_nodes` comes from LIBAIO_WIN32_NUMA_NODES rather than the hardware.
+    IO_CAP_LARGE_PAGES = 1 << 4,     ///< Request slabs and in-flight indexes may be placed on large pages (LIBAIO_WIN32_LARGE_PAGES=1, and the account holds "Lock pages in memory").
+    IO_CAP_LOCKED_POOL_QUEUE = 1 << 5, ///< Pool workers share one locked FIFO instead of stealing (LIBAIO_WIN32_POOL_QUEUE=locked).
+};
+
+/// Most the one-time probe may cost. It does no I/O, so it takes microseconds; the tests hold it to this.
+#define IO_PROBE_BUDGET_NS 1000000LL
+
+/**
+ * @struct io_backend_caps
+ * @brief The process-wide result of the backend probe performed on first use.
+ */
+struct io_backend_caps {
+    unsigned  backends;         ///< Bitmask of available engines, `1u << IO_BACKEND_*`.
+    unsigned  features;         ///< Bitmask of IO_CAP_* flags.
+    int       forced_backend;   ///< Engine forced through LIBAIO_WIN32_BACKEND, or IO_BACKEND_AUTO.
+    unsigned  worker_threads;   ///< Worker threads started per context for the thread-pool engine.
+    unsigned  max_worker_threads; ///< Upper bound the pool may grow to while blocked workers leave requests waiting.
+    unsigned  device_workers;   ///< Most workers that requests for one volume may occupy at once.
+    unsigned  device_backlog;   ///< Requests that may wait for a saturated volume before io_submit returns -EAGAIN (0 = unbounded).
+    unsigned  context_pool;     ///< Completion ports, with their worker pools, kept idle for io_setup to reuse (0 = none).
+    unsigned  destroy_timeout_ms; ///< Longest io_destroy waits for requests still in flight after cancelling them.
+    unsigned  numa_nodes;       ///< NUMA nodes the processors are split into; 1 on a single-node system.
+    unsigned  large_page_size;  ///< Bytes per large page with IO_CAP_LARGE_PAGES, else 0.
+    long long probe_ns;         ///< Wall-clock time the probe took, in nanoseconds; at most IO_PROBE_BUDGET_NS.
+};
+
+/// Orderings for io_file_stats_top.
+enum io_file_stats_order {
+    IO_FILE_STATS_BY_OPS = 0,   ///< Busiest by requests submitted.
+    IO_FILE_STATS_BY_BYTES = 1, ///< Busiest by bytes requested.
+};
+
+/**
+ * @struct io_file_stats
+ * @brief The counters of one file descriptor on one context, as reported by io_file_stats_top.
+ *
+ * Requests and bytes are counted when io_submit accepts them; `completed`, `latency_ns` and `errors`
+ * when io_getevents returns them. For an `estimated` entry, the file was first seen after the context
+ * ran out of exact counters: the request and byte figures cover only the time the file has been
+ * monitored by the sketch, the true total is at most `overcount` higher, and nothing is known about
+ * its completions.
+ */
+struct io_file_stats {
+    int       fd;
+    int       estimated;        ///< Nonzero if the figures come from the heavy-hitters sketch.
+    unsigned long long reads;
+    unsigned long long writes;
+    unsigned long long syncs;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long completed;   ///< Requests reaped.
+    unsigned long long latency_ns;  ///< Sum of submission-to-reap times of the completed requests.
+    unsigned long long errors;      ///< Completions that failed (a Windows error in res2).
+    unsigned long long overcount;   ///< For estimated entries, the most the ranked figure may be short by.
+};
+
+/**
+ * @struct io_inflight_req
+ * @brief One request a context has accepted but not yet returned from io_getevents, as reported
+ * by io_list_inflight and the watchdog.
+ */
+struct io_inflight_req {
+    struct iocb* obj;       ///< The submitted iocb; only compare it, it may complete at any moment.
+    int       fd;
+    int       opcode;       ///< The iocb's IO_CMD_* value.
+    long long offset;
+    unsigned long long length;  ///< Bytes requested, summed over the segments of a vectored iocb.
+    unsigned long long age_ns;  ///< Time since the io_submit call that accepted it.
+};
+
+/**
+ * @brief Called by the watchdog thread for each request that exceeds the age threshold, once per request.
+ *
+ * Runs while the watchdog holds the context list, so it must not call io_setup or io_destroy.
+ */
+typedef void (*io_watchdog_callback)(io_context_t ctx, const struct io_inflight_req* req, void* arg);
+
+/**
+ * @enum io_profile_phase_id
+ * @brief The parts of the engine the self-profiler times. Indented names are phases nested in the
+ * call above them; the remainder of that call is its own bookkeeping (stats, tracing, the in-flight index).
+ */
+enum io_profile_phase_id {
+    IO_PROFILE_SUBMIT = 0,      ///< Whole io_submit calls.
+    IO_PROFILE_FILE_LOOKUP,     ///<   Descriptor to handle, engine and counters.
+    IO_PROFILE_REQUEST_ALLOC,   ///<   Allocating requests and vectored groups.
+    IO_PROFILE_ISSUE,           ///<   ReadFile/WriteFile, or handing the request to the worker pool.
+    IO_PROFILE_GETEVENTS,       ///< Whole io_getevents calls.
+    IO_PROFILE_DEQUEUE,         ///<   GetQueuedCompletionStatus, including any time spent waiting.
+    IO_PROFILE_COMPLETION,      ///<   Turning a whole request's packet into an io_event.
+    IO_PROFILE_VECTORED,        ///<   Aggregating a segment of a vectored iocb, and its io_event if last.
+    IO_PROFILE_REQUEST_FREE,    ///<   Freeing requests and groups.
+    IO_PROFILE_WORKER,          ///< A pooled request on a worker thread: the blocking call and its completion packet.
+    IO_PROFILE_PHASES
+};
+
+/**
+ * @struct io_numa_counters
+ * @brief Process-wide counts of accesses that crossed NUMA nodes, as reported by io_numa_read.
+ *
+ * Kept only while io_backend_caps::numa_nodes is above 1. A request's node is the node of the
+ * memory its record lives on, and a provided buffer's the node of its first page.
+ */
+struct io_numa_counters {
+    unsigned long long remote_requests;    ///< Requests io_submit gave a record on another node than the submitting thread's.
+    unsigned long long remote_completions; ///< Requests io_getevents reaped on another node than their record's.
+    unsigned long long remote_buffers;     ///< Provided buffers a read was issued into from another node.
+};
+
+/**
+ * @struct io_large_page_counters
+ * @brief How the engine's structures are placed on large pages, as reported by io_large_pages_read.
+ */
+struct io_large_page_counters {
+    unsigned long long regions;     ///< Request slabs and in-flight indexes on large pages now.
+    unsigned long long bytes;       ///< Memory those take, in whole large pages.
+    unsigned long long fallbacks;   ///< Structures that were put on small pages because no large pages were free.
+};
+
+/**
+ * @struct io_profile
+ * @brief Self-profiler totals over every thread, as reported by io_profile_read.
+ */
+struct io_profile {
+    double    seconds;          ///< Time profiled.
+    double    cycles_per_second;    ///< Measured rate of the cycle counter.
+    unsigned  threads;          ///< Threads that recorded at least one phase.
+    unsigned long long pair_cycles;     ///< Calibrated cost of timing one phase.
+    unsigned long long overhead_cycles; ///< Estimated cycles spent timing, included in the phases' figures.
+    struct {
+        const char* name;
+        unsigned long long calls;
+        unsigned long long cycles;
+    } phases[IO_PROFILE_PHASES];
 };
 
+// --- iocb Preparation Helpers ---
+// These mirror the inline helpers of the Linux libaio.h with identical signatures.
+
+static inline void io_prep_pread(struct iocb* iocb, int fd, void* buf, size_t count, long long offset) {
+    iocb->data = 0;
+    iocb->key = 0;
+    iocb->aio_lio_opcode = IO_CMD_PREAD;
+    iocb->aio_reqprio = 0;
+    iocb->aio_fildes = fd;
+    iocb->u.c.buf = buf;
+    iocb->u.c.nbytes = (unsigned long)count;
+    iocb->u.c.offset = offset;
+}
+
+static inline void io_prep_pwrite(struct iocb* iocb, int fd, void* buf, size_t count, long long offset) {
+    io_prep_pread(iocb, fd, buf, count, offset);
+    iocb->aio_lio_opcode = IO_CMD_PWRITE;
+}
+
+static inline void io_prep_preadv(struct iocb* iocb, int fd, const struct iovec* iov, int iovcnt, long long offset) {
+    iocb->data = 0;
+    iocb->key = 0;
+    iocb->aio_lio_opcode = IO_CMD_PREADV;
+    iocb->aio_reqprio = 0;
+    iocb->aio_fildes = fd;
+    iocb->u.v.vec = iov;
+    iocb->u.v.nr_segs = iovcnt;
+    iocb->u.v.offset = offset;
+}
+
+static inline void io_prep_pwritev(struct iocb* iocb, int fd, const struct iovec* iov, int iovcnt, long long offset) {
+    io_prep_preadv(iocb, fd, iov, iovcnt, offset);
+    iocb->aio_lio_opcode = IO_CMD_PWRITEV;
+}
+
+static inline void io_prep_fsync(struct iocb* iocb, int fd) {
+    io_prep_pread(iocb, fd, 0, 0, 0);
+    iocb->aio_lio_opcode = IO_CMD_FSYNC;
+}
+
+static inline void io_prep_fdsync(struct iocb* iocb, int fd) {
+    io_prep_pread(iocb, fd, 0, 0, 0);
+    iocb->aio_lio_opcode = IO_CMD_FDSYNC;
+}
+
+/**
+ * @brief Prepares an iocb for a read whose buffer is picked by the engine from a provided buffer group.
+ *
+ * The iocb carries no buffer of its own. When the read is issued, the engine takes a free buffer from
+ * group `bgid` (see io_provide_buffers) and stores its address in `u.c.buf`; the completion reports
+ * the buffer's ID in `res2` (see io_event_buffer_id). `nbytes` must not exceed the group's buffer
+ * length, or io_submit fails the iocb with -EINVAL.
+ */
+static inline void io_prep_pread_select(struct iocb* iocb, int fd, unsigned long nbytes, long long offset, unsigned short bgid) {
+    iocb->data = 0;
+    iocb->key = bgid;
+    iocb->aio_lio_opcode = IO_CMD_PREAD_SELECT;
+    iocb->aio_reqprio = 0;
+    iocb->aio_fildes = fd;
+    iocb->u.c.buf = 0;
+    iocb->u.c.nbytes = nbytes;
+    iocb->u.c.offset = offset;
+}
+
+/// Set in a successful IO_CMD_PREAD_SELECT completion's res2 (or os_error), whose low 16 bits are then
+/// the buffer ID. Windows error codes never have this bit set.
+#define IO_EVENT_BUFFER_SELECTED 0x80000000UL
+
+/// Returns the ID of the provided buffer that an IO_CMD_PREAD_SELECT completion was read into, or -1 if
+/// it holds none because the read failed.
+static inline int io_event_buffer_id(const struct io_event* event) {
+    return (event->res2 & IO_EVENT_BUFFER_SELECTED) ? (int)(event->res2 & 0xFFFF) : -1;
+}
+
+/// io_event_buffer_id for an io_getevents2 completion.
+static inline int io_event2_buffer_id(const struct io_event2* event) {
+    return (event->os_error & IO_EVENT_BUFFER_SELECTED) ? (int)(event->os_error & 0xFFFF) : -1;
+}
+
 
 // C-style linkage is required for the DLL to be compatible with C and other languages.
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-    // LIO_API is used to mark functions for export from the DLL.
+    // LIO_API marks functions exported by the DLL; the DLL project defines LIBAIOWIN32_EXPORTS, its consumers import.
+    // Linked statically or compiled into the caller, they are plain functions.
+#if defined(LIBAIOWIN32_EXPORTS)
 #define LIO_API __declspec(dllexport)
+#elif defined(LIBAIO_WIN32_STATIC) || defined(LIBAIO_WIN32_IMPLEMENTATION)
+#define LIO_API
+#else
+#define LIO_API __declspec(dllimport)
+#endif
 
 /**
  * @brief Creates an asynchronous I/O context.
- * @param maxevents The maximum number of concurrent events the context can handle. (Unused in this IOCP-based implementation).
+ * @param maxevents The number of requests the caller expects to have in flight; sizes the in-flight index (see io_list_inflight).
  * @param ctxp A pointer that will receive the new io_context_t handle.
  * @return 0 on success, or a negative errno value on failure.
  */
     LIO_API int io_setup(int maxevents, io_context_t* ctxp);
 
+    /**
+     * @brief Creates a thin asynchronous I/O context on the process's shared engine.
+     *
+     * A thin context has its own completions, in-flight index, buffer groups and stats, but shares
+     * one completion port, file table and worker pool with every other thin context, so it costs
+     * no kernel object or thread of its own. One dispatcher thread hands each completion to its
+     * context, which adds a thread hop to every request. Per-file counters are not kept for thin
+     * contexts; io_file_stats_enable tracks their files with the sketch alone.
+     * @param maxevents The number of requests the caller expects to have in flight; sizes the in-flight index.
+     * @param ctxp A pointer that will receive the new io_context_t handle.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    LIO_API int io_setup_shared(int maxevents, io_context_t* ctxp);
+
     /**
      * @brief Submits one or more asynchronous I/O operations.
      * @param ctx The I/O context to which to submit the requests.
      * @param nr The number of requests (iocbs) to submit.
      * @param iocbs An array of pointers to iocb structures.
-     * @return The number of iocbs successfully submitted, or a negative errno value on failure.
+     * @return The number of iocbs successfully submitted, or a negative errno value on failure. Submission
+     * stops at the first iocb that fails, as on Linux: the count is exactly the iocbs accepted, the
+     * refused one and those after it produce no event, and the caller may resubmit from iocbs + count.
+     * If the first iocb fails, the result is its error: -EFAULT for a null pointer, -EBADF for a
+     * descriptor that does not resolve, -EINVAL for an IO_CMD_PREAD_SELECT naming an unregistered
+     * group or asking for more than the group's buffer length or for a vectored iocb with a segment
+     * of 4 GiB or more, or the Win32 error of a transfer the OS refuses outright, mapped to errno.
      */
     LIO_API int io_submit(io_context_t ctx, long nr, struct iocb** iocbs);
 
@@ -119,13 +569,253 @@ extern "C" {
      */
     LIO_API int io_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout);
 
+    /**
+     * @brief Reads completed I/O events exactly like io_getevents, into extended events.
+     *
+     * On Windows, io_event's `unsigned long` result is 32 bits wide, so a vectored transfer of 4 GiB or
+     * more does not fit; io_event2 reports it in full. The completion time is read once per dequeue that
+     * may wait, and events taken without waiting share it; that clock read is the only extra cost.
+     * @param ctx The I/O context to query.
+     * @param min_nr The minimum number of events to retrieve before returning.
+     * @param nr The maximum number of events to retrieve in this call.
+     * @param events A user-provided array to be filled with completed io_event2 structures.
+     * @param timeout The maximum time to wait for events. A null pointer means wait indefinitely.
+     * @return The number of events read (>= min_nr), or a negative errno value on failure.
+     */
+    LIO_API int io_getevents2(io_context_t ctx, long min_nr, long nr, struct io_event2* events, struct timespec* timeout);
+
     /**
      * @brief Destroys an asynchronous I/O context and releases its resources.
+     *
+     * Requests still in flight are cancelled where Windows allows it and waited for, as on Linux,
+     * for up to `destroy_timeout_ms`; their events are discarded and their memory freed. Once
+     * nothing is left, the context's worker pool goes back to the process's context pool for the
+     * next io_setup, up to `context_pool` of them, with its completion port if no file was ever
+     * associated with the port.
      * @param ctx The I/O context to destroy.
-     * @return 0 on success, or a negative errno value on failure.
+     * @return 0 on success, or -ETIMEDOUT if requests were still in flight at the timeout. The
+     * handle must not be used again either way. After a timeout the context keeps its port,
+     * workers, requests and buffers, and a library thread frees them once the last of those
+     * requests completes; a request that never completes keeps them allocated.
      */
     LIO_API int io_destroy(io_context_t ctx);
 
+    /**
+     * @brief Creates completion ports ahead of time, so that the next io_setup calls lease one instead.
+     *
+     * Fills the context pool up to `count` idle ports, capped at `context_pool`. Worker pools are not
+     * started here; they join the pool when a context that used one is destroyed.
+     * @param count The idle ports wanted.
+     * @return The number of idle ports now pooled, or a negative errno value on failure.
+     */
+    LIO_API int io_reserve_contexts(unsigned count);
+
+    /**
+     * @brief Registers a pool of equally-sized buffers as a buffer group for IO_CMD_PREAD_SELECT reads.
+     *
+     * The memory stays owned by the caller and must remain valid until the context is destroyed.
+     * Buffer `i` starts at `base + i * buf_len` and has buffer ID `i`. All buffers start out free.
+     * On a NUMA system each buffer belongs to the node its first page is resident on, or if it is
+     * not resident yet, to an equal share of the region per node, and reads prefer their own node's.
+     *
+     * A read that finds the group exhausted is still accepted by io_submit on every engine, and
+     * completes with res2 = 10055 (WSAENOBUFS), which io_getevents2 reports as -ENOBUFS.
+     * @param ctx The I/O context that owns the group.
+     * @param bgid The buffer group ID. Must not already be registered on this context.
+     * @param base Start of the contiguous buffer region.
+     * @param buf_len The length of each buffer in bytes.
+     * @param nr The number of buffers in the group (at most 65536).
+     * @return 0 on success, or a negative errno value on failure (-EEXIST if the group is already registered).
+     */
+    LIO_API int io_provide_buffers(io_context_t ctx, unsigned short bgid, void* base, size_t buf_len, unsigned nr);
+
+    /**
+     * @brief Returns a buffer consumed by a completed IO_CMD_PREAD_SELECT read to its group.
+     * @param ctx The I/O context that owns the group.
+     * @param bgid The buffer group ID.
+     * @param bid The buffer ID reported by io_event_buffer_id.
+     * @return 0 on success, -ENOENT if the group is not registered, or -EINVAL if `bid` is not held by
+     * a completed read, for instance because it was already recycled.
+     */
+    LIO_API int io_recycle_buffer(io_context_t ctx, unsigned short bgid, unsigned short bid);
+
+    /**
+     * @brief Reports which engines and capabilities the probe found.
+     *
+     * The probe runs once per process, on the first call to this function or io_setup. It does no I/O.
+     * @param caps Receives the probe result.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    LIO_API int io_query_backends(struct io_backend_caps* caps);
+
+    /**
+     * @brief Runs the calling thread on one NUMA node's processors from now on, so the requests and
+     * provided buffers it takes come from that node.
+     *
+     * With a simulated topology the node's processors are its share of LIBAIO_WIN32_NUMA_NODES.
+     * @param node The node, below io_backend_caps::numa_nodes.
+     * @return 0 on success, -EINVAL for an unknown node, or another negative errno value on failure.
+     */
+    LIO_API int io_numa_bind_thread(unsigned node);
+
+    /**
+     * @brief Reads the process's cross-node access counters.
+     * @param counters Receives the totals since the process started.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    LIO_API int io_numa_read(struct io_numa_counters* counters);
+
+    /**
+     * @brief Reports the engine structures placed on large pages.
+     *
+     * With LIBAIO_WIN32_LARGE_PAGES=1 and the "Lock pages in memory" privilege, io_setup commits a
+     * context's in-flight index, and a dedicated context's request slab, on large pages when each is
+     * at least 256 KiB, as both are at a depth of 4,096. They are committed whole and cannot be paged out.
+     *
+     * The first such structure enables SeLockMemoryPrivilege on the process token, which stays
+     * enabled for the life of the process and applies to the application's own allocations too.
+     * Without LIBAIO_WIN32_LARGE_PAGES=1, or until a context is deep enough, the library only reads
+     * the token, to report IO_CAP_LARGE_PAGES, and never changes it.
+     * @param counters Receives the current figures.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    LIO_API int io_large_pages_read(struct io_large_page_counters* counters);
+
+    /**
+     * @brief Reports the engine a context uses for a file descriptor.
+     *
+     * Selects and caches the engine if the context has not seen the file yet, exactly as io_submit would.
+     * @param ctx The I/O context.
+     * @param fd The file descriptor.
+     * @return IO_BACKEND_IOCP or IO_BACKEND_THREADPOOL, or a negative errno value on failure.
+     */
+    LIO_API int io_file_backend(io_context_t ctx, int fd);
+
+    /**
+     * @brief Starts recording every submission and completion in the process to a trace file.
+     *
+     * The trace uses the format described in libaio_trace.h and can be replayed with aio-replay.
+     * Records are buffered in memory and written by a background thread; if that thread falls
+     * behind, records are dropped and counted rather than slowing down I/O. Setting the
+     * LIBAIO_WIN32_TRACE environment variable to a path starts a trace when the first context is created.
+     * @param path The trace file to create. An existing file is overwritten.
+     * @return 0 on success, -EBUSY if a trace is already being recorded, or another negative errno value on failure.
+     */
+    LIO_API int io_trace_start(const char* path);
+
+    /**
+     * @brief Stops the current trace, writing out every buffered record and closing the file.
+     * @return 0 on success, including when no trace is being recorded.
+     */
+    LIO_API int io_trace_stop(void);
+
+    /**
+     * @brief Publishes the process's I/O counters in a named shared-memory segment for monitors such as aio-top.
+     *
+     * The segment layout is described in libaio_stats.h. Contexts created after this call, and the
+     * files they submit to, get counters, in-flight depth and latency histograms there; the I/O path
+     * updates them with atomic adds and takes no locks. Setting the LIBAIO_WIN32_STATS environment
+     * variable to 1 publishes when the first context is created. The segment lasts until the process exits.
+     * @return 0 on success, including when the segment is already published, or a negative errno value on failure.
+     */
+    LIO_API int io_stats_publish(void);
+
+    /**
+     * @brief Starts counting requests, bytes, latency and errors per file descriptor on a context.
+     *
+     * The first `max_files` descriptors the context resolves get exact counters. Later ones are
+     * tracked by a fixed-size heavy-hitters sketch that finds the busiest of them approximately.
+     * Setting the LIBAIO_WIN32_FILE_STATS environment variable to a file count enables this on
+     * every new context. Calling it again can raise the budget but not lower it.
+     * @param ctx The I/O context.
+     * @param max_files The number of descriptors that get exact counters.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    LIO_API int io_file_stats_enable(io_context_t ctx, unsigned max_files);
+
+    /**
+     * @brief Reports the busiest file descriptors of a context, busiest first.
+     * @param ctx The I/O context, with per-file stats enabled.
+     * @param order IO_FILE_STATS_BY_OPS or IO_FILE_STATS_BY_BYTES.
+     * @param stats Receives up to `nr` entries.
+     * @param nr The capacity of `stats`.
+     * @return The number of entries filled, -ENOENT if per-file stats are off, or another negative errno value on failure.
+     */
+    LIO_API int io_file_stats_top(io_context_t ctx, int order, struct io_file_stats* stats, int nr);
+
+    /**
+     * @brief Lists the requests a context has in flight, oldest first.
+     *
+     * Every context indexes the iocbs it accepts until io_getevents returns them, so a hung device
+     * shows up here as requests whose age keeps growing. The index is sized from io_setup's
+     * `maxevents`; requests accepted while it is full run normally but are not listed.
+     * @param ctx The I/O context.
+     * @param reqs Receives up to `nr` of the oldest requests.
+     * @param nr The capacity of `reqs`.
+     * @return The number of requests in flight, which may exceed `nr`, or a negative errno value on failure.
+     */
+    LIO_API int io_list_inflight(io_context_t ctx, struct io_inflight_req* reqs, int nr);
+
+    /**
+     * @brief Starts a background thread that reports requests in flight for longer than a threshold.
+     *
+     * The thread scans every context in the process a few times per threshold period and reports each
+     * overdue request once, to `callback` or, if it is null, to stderr and the debugger. Setting the
+     * LIBAIO_WIN32_WATCHDOG_MS environment variable starts a logging watchdog with the first context.
+     * @param threshold_ms The age, in milliseconds, past which a request is reported.
+     * @param callback Called for each overdue request, or null to log.
+     * @param arg Passed through to `callback`.
+     * @return 0 on success, -EBUSY if a watchdog is already running, or another negative errno value on failure.
+     */
+    LIO_API int io_watchdog_start(unsigned threshold_ms, io_watchdog_callback callback, void* arg);
+
+    /**
+     * @brief Stops the watchdog thread and waits for it to exit.
+     * @return 0 on success, including when no watchdog is running.
+     */
+    LIO_API int io_watchdog_stop(void);
+
+    /**
+     * @brief Resets the self-profiler and starts timing the engine's phases on every thread.
+     *
+     * Each phase is timed with the CPU's cycle counter and added to counters owned by the calling
+     * thread, so threads never contend. Setting the LIBAIO_WIN32_PROFILE environment variable to 1
+     * profiles from the first context on and prints the breakdown to stderr when the library unloads.
+     * While the profiler is off, each phase boundary costs one load and branch.
+     * @return 0 on success, or a negative errno value on failure.
+     */
+    LIO_API int io_profile_start(void);
+
+    /**
+     * @brief Stops timing. The counters keep their values until the next io_profile_start.
+     * @return 0 on success, including when the profiler is not running.
+     */
+    LIO_API int io_profile_stop(void);
+
+    /**
+     * @brief Sums the self-profiler's per-thread counters. For exact totals, call io_profile_stop first.
+     * @param profile Receives the totals.
+     * @return 0 on success, -ENOENT if the profiler was never started, or another negative errno value on failure.
+     */
+    LIO_API int io_profile_read(struct io_profile* profile);
+
+    /**
+     * @brief Formats the self-profiler's breakdown as a text table: cycles per phase and per call,
+     * each phase's share of its call, the profiler's own estimated overhead, and per-thread totals.
+     * @param buf Receives the NUL-terminated table, truncated to fit.
+     * @param len The size of `buf`.
+     * @return The length of the whole table, excluding the NUL, or a negative errno value on failure.
+     */
+    LIO_API int io_profile_format(char* buf, size_t len);
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
+
+// Header-only mode: the implementation follows the declarations, in the including file.
+#if defined(LIBAIO_WIN32_IMPLEMENTATION) && !defined(LIBAIO_WIN32_IMPLEMENTED)
+#define LIBAIO_WIN32_IMPLEMENTED
+#include "libaio_win32.cpp"
+#endif
+
+#endif // _WIN32
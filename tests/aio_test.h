@@ -0,0 +1,139 @@
+/**
+ * @file aio_test.h
+ * @brief The test harness of libaio-win32: test registration, checks, and helpers for files,
+ * heap and handle accounting.
+ *
+ * Every test runs in a process of its own, so that it can set the library's environment
+ * variables before the first call reads them and a hung or crashing test cannot take the others
+ * with it. The library is compiled into the test program (see test_hooks.cpp), which lets tests
+ * count its heap allocations and reach the few internals they check.
+ */
+#pragma once
+
+#include "libaio_win32.h"
+
+#include <stddef.h>
+#include <string>
+
+typedef void (*TestFunction)(void);
+
+/// A registered test, found by name from the command line.
+struct TestCase {
+    const char* name;
+    TestFunction run;
+    unsigned timeout_ms;    ///< The test fails if it has not finished by then.
+    TestCase* next;
+};
+
+/// Adds a test to the registry at static-initialization time.
+struct TestRegistration {
+    explicit TestRegistration(TestCase* test);
+};
+
+/// Default time a test may run before it is reported as hung.
+static const unsigned TEST_TIMEOUT_MS = 30000;
+
+/// Defines and registers a test with a time limit in milliseconds.
+#define AIO_TEST_TIMEOUT(name, timeout_ms) \
+    static void name(void); \
+    static TestCase name##_case = { #name, name, timeout_ms, nullptr }; \
+    static TestRegistration name##_registration(&name##_case); \
+    static void name(void)
+
+/// Defines and registers a test with the default time limit.
+#define AIO_TEST(name) AIO_TEST_TIMEOUT(name, TEST_TIMEOUT_MS)
+
+/// Records a failed check and carries on.
+void test_failed(const char* file, int line, const char* expression);
+/// Records a failed check of two values and carries on.
+void test_failed_values(const char* file, int line, const char* expression, long long actual, long long expected);
+/// Records a failed check and ends the test.
+[[noreturn]] void test_abort(const char* file, int line, const char* expression);
+
+#define CHECK(condition) \
+    do { if (!(condition)) test_failed(__FILE__, __LINE__, #condition); } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        long long check_actual = (long long)(actual), check_expected = (long long)(expected); \
+        if (check_actual != check_expected) test_failed_values(__FILE__, __LINE__, #actual " == " #expected, check_actual, check_expected); \
+    } while (0)
+
+#define REQUIRE(condition) \
+    do { if (!(condition)) test_abort(__FILE__, __LINE__, #condition); } while (0)
+
+/// Sets a library environment variable. Only effective before the variable is first read.
+void test_set_env(const char* name, const char* value);
+
+/// Length of the files test_open_file creates.
+static const size_t TEST_FILE_BYTES = 1 << 20;
+
+/// The byte test_open_file's files hold at `offset`.
+static inline unsigned char test_file_byte(long long offset) {
+    return (unsigned char)((offset * 7 + (offset >> 12)) & 0xFF);
+}
+
+/**
+ * @brief Creates a TEST_FILE_BYTES file of test_file_byte contents, deleted when closed, and opens it.
+ * @param overlapped Open it for overlapped I/O, which the library runs on IOCP; otherwise
+ * synchronously, which it runs on the thread pool.
+ * @return A CRT file descriptor. The test ends if the file cannot be created.
+ */
+int test_open_file(bool overlapped);
+
+/// Closes a descriptor from test_open_file, which deletes its file.
+void test_close_file(int fd);
+
+/**
+ * @brief A named pipe, for requests that stay in flight until the test writes to the pipe.
+ *
+ * Reads on the server end wait for data: an overlapped one in the OS, a synchronous one on the
+ * worker running it. Reads and pipes have no volume, so their requests share one device gate.
+ */
+struct TestPipe {
+    int fd;         ///< CRT descriptor of the server end, which the tests read.
+    void* client;   ///< Handle of the client end, which test_pipe_write writes to.
+};
+
+/// Creates a pipe whose server end is opened for overlapped I/O, or synchronously.
+TestPipe test_open_pipe(bool overlapped);
+
+/// Writes `bytes` bytes to the pipe, for its server end's reads.
+void test_pipe_write(const TestPipe& pipe, size_t bytes);
+
+/// Closes both ends of a pipe.
+void test_close_pipe(const TestPipe& pipe);
+
+/// Sleeps for about `ms` milliseconds.
+void test_sleep_ms(unsigned ms);
+
+/// Polls `done` every few milliseconds until it holds or `timeout_ms` passes. Returns its last value.
+template <class Predicate>
+bool test_wait_until(unsigned timeout_ms, Predicate done) {
+    for (unsigned waited = 0; !done(); waited += 5) {
+        if (waited >= timeout_ms) return false;
+        test_sleep_ms(5);
+    }
+    return true;
+}
+
+/// A unique name for a file or pipe of the running test, under the temporary directory.
+std::string test_temp_path(const char* suffix);
+
+/// Bytes and blocks currently allocated with operator new, by the library and the test alike.
+long long test_heap_bytes(void);
+long long test_heap_blocks(void);
+
+/// Kernel handles (here: emulated objects) the process holds.
+long long test_handle_count(void);
+
+/// AioEngine<MinimalConfig>'s submit and getevents (test_hooks.cpp).
+int test_minimal_submit(io_context_t ctx, long nr, struct iocb** iocbs);
+int test_minimal_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout);
+
+/// Submit and getevents of the C API's configuration with HeapAllocator (test_hooks.cpp).
+int test_heap_submit(io_context_t ctx, long nr, struct iocb** iocbs);
+int test_heap_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout);
+
+/// Worker threads of the context's thread-pool engine that are running now, core and elastic alike (test_hooks.cpp).
+long test_pool_live_workers(io_context_t ctx);
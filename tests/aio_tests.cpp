@@ -0,0 +1,306 @@
+/**
+ * @file aio_tests.cpp
+ * @brief aio-tests: runs libaio-win32's tests, each in a child process of its own.
+ *
+ *   aio-tests               runs every test
+ *   aio-tests NAME...       runs the named tests
+ *   aio-tests --list        lists the tests
+ *
+ * The exit status is the number of tests that failed, at most 100.
+ */
+#include "aio_test.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <io.h>
+#include <windows.h>
+
+#if defined(__linux__)
+// Under the Win32 emulation the runner is still a Linux process.
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+// --- Registry ---
+
+static TestCase* g_tests = nullptr;
+static TestCase** g_tests_tail = &g_tests;
+
+TestRegistration::TestRegistration(TestCase* test) {
+    *g_tests_tail = test;
+    g_tests_tail = &test->next;
+}
+
+static TestCase* find_test(const char* name) {
+    for (TestCase* test = g_tests; test; test = test->next) {
+        if (strcmp(test->name, name) == 0) return test;
+    }
+    return nullptr;
+}
+
+// --- Checks ---
+
+static std::atomic<unsigned> g_failures(0);
+
+void test_failed(const char* file, int line, const char* expression) {
+    fprintf(stderr, "  %s:%d: check failed: %s\n", file, line, expression);
+    g_failures.fetch_add(1);
+}
+
+void test_failed_values(const char* file, int line, const char* expression, long long actual, long long expected) {
+    fprintf(stderr, "  %s:%d: check failed: %s (%lld, expected %lld)\n", file, line, expression, actual, expected);
+    g_failures.fetch_add(1);
+}
+
+void test_abort(const char* file, int line, const char* expression) {
+    fprintf(stderr, "  %s:%d: required: %s\n", file, line, expression);
+    fflush(stderr);
+    std::_Exit(1);
+}
+
+void test_set_env(const char* name, const char* value) {
+    SetEnvironmentVariableA(name, value);
+}
+
+// --- Files ---
+
+std::string test_temp_path(const char* suffix) {
+    static std::atomic<unsigned> next_id(0);
+    char directory[MAX_PATH];
+    DWORD length = GetTempPathA(sizeof(directory), directory);
+    std::string path(directory, length && length < sizeof(directory) ? length : 0);
+    path += "libaio-test-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(next_id.fetch_add(1)) + "-" + suffix;
+    return path;
+}
+
+int test_open_file(bool overlapped) {
+    std::string path = test_temp_path("data");
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE | (overlapped ? FILE_FLAG_OVERLAPPED : 0), nullptr);
+    REQUIRE(handle != INVALID_HANDLE_VALUE);
+
+    std::vector<unsigned char> contents(TEST_FILE_BYTES);
+    for (size_t i = 0; i < contents.size(); ++i) contents[i] = test_file_byte((long long)i);
+    OVERLAPPED at_start = {};
+    HANDLE done = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    at_start.hEvent = (HANDLE)((ULONG_PTR)done | 1); // No completion packet: the file is not on a port yet anyway.
+    DWORD written = 0;
+    BOOL ok = WriteFile(handle, contents.data(), (DWORD)contents.size(), &written, overlapped ? &at_start : nullptr);
+    if (!ok && GetLastError() == ERROR_IO_PENDING) ok = GetOverlappedResult(handle, &at_start, &written, TRUE);
+    CloseHandle(done);
+    REQUIRE(ok && written == contents.size());
+
+    int fd = _open_osfhandle((intptr_t)handle, 0);
+    REQUIRE(fd >= 0);
+    return fd;
+}
+
+void test_close_file(int fd) {
+    _close(fd);
+}
+
+TestPipe test_open_pipe(bool overlapped) {
+    static std::atomic<unsigned> next_id(0);
+    std::string name = "\\\\.\\pipe\\libaio-test-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(next_id.fetch_add(1));
+    HANDLE server = CreateNamedPipeA(name.c_str(), PIPE_ACCESS_DUPLEX | (overlapped ? FILE_FLAG_OVERLAPPED : 0),
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, nullptr);
+    REQUIRE(server != INVALID_HANDLE_VALUE);
+    HANDLE client = CreateFileA(name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    REQUIRE(client != INVALID_HANDLE_VALUE);
+    TestPipe pipe;
+    pipe.fd = _open_osfhandle((intptr_t)server, 0);
+    pipe.client = client;
+    REQUIRE(pipe.fd >= 0);
+    return pipe;
+}
+
+void test_pipe_write(const TestPipe& pipe, size_t bytes) {
+    std::vector<char> data(bytes, 'p');
+    DWORD written = 0;
+    REQUIRE(WriteFile((HANDLE)pipe.client, data.data(), (DWORD)bytes, &written, nullptr) && written == bytes);
+}
+
+void test_close_pipe(const TestPipe& pipe) {
+    _close(pipe.fd);
+    CloseHandle((HANDLE)pipe.client);
+}
+
+void test_sleep_ms(unsigned ms) {
+    Sleep(ms);
+}
+
+// --- Heap Accounting ---
+// Every operator new of the program, the library's included, goes through counted_alloc, which
+// keeps the block's size in front of it.
+
+static std::atomic<long long> g_heap_bytes(0);
+static std::atomic<long long> g_heap_blocks(0);
+
+struct AllocationHeader {
+    void* raw;
+    size_t size;
+};
+
+static void* counted_alloc(size_t size, size_t alignment) {
+    if (alignment < alignof(std::max_align_t)) alignment = alignof(std::max_align_t);
+    char* raw = static_cast<char*>(malloc(size + alignment + sizeof(AllocationHeader)));
+    if (!raw) return nullptr;
+    uintptr_t block = ((uintptr_t)raw + sizeof(AllocationHeader) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(block) - 1;
+    header->raw = raw;
+    header->size = size;
+    g_heap_bytes.fetch_add((long long)size, std::memory_order_relaxed);
+    g_heap_blocks.fetch_add(1, std::memory_order_relaxed);
+    return reinterpret_cast<void*>(block);
+}
+
+static void counted_free(void* block) {
+    if (!block) return;
+    AllocationHeader* header = static_cast<AllocationHeader*>(block) - 1;
+    g_heap_bytes.fetch_sub((long long)header->size, std::memory_order_relaxed);
+    g_heap_blocks.fetch_sub(1, std::memory_order_relaxed);
+    free(header->raw);
+}
+
+static void* counted_alloc_or_throw(size_t size, size_t alignment) {
+    void* block = counted_alloc(size, alignment);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new(size_t size) { return counted_alloc_or_throw(size, 0); }
+void* operator new[](size_t size) { return counted_alloc_or_throw(size, 0); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_alloc_or_throw(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_alloc_or_throw(size, (size_t)alignment); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_alloc(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_alloc(size, (size_t)alignment); }
+void operator delete(void* block) noexcept { counted_free(block); }
+void operator delete[](void* block) noexcept { counted_free(block); }
+void operator delete(void* block, size_t) noexcept { counted_free(block); }
+void operator delete[](void* block, size_t) noexcept { counted_free(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { counted_free(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { counted_free(block); }
+void operator delete(void* block, std::align_val_t) noexcept { counted_free(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { counted_free(block); }
+void operator delete(void* block, size_t, std::align_val_t) noexcept { counted_free(block); }
+void operator delete[](void* block, size_t, std::align_val_t) noexcept { counted_free(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(block); }
+
+long long test_heap_bytes(void) {
+    return g_heap_bytes.load();
+}
+
+long long test_heap_blocks(void) {
+    return g_heap_blocks.load();
+}
+
+long long test_handle_count(void) {
+    DWORD count = 0;
+    GetProcessHandleCount(GetCurrentProcess(), &count);
+    return count;
+}
+
+// --- Runner ---
+
+/// Runs one test in this process and returns its exit status.
+static int run_child(TestCase* test) {
+    // A hung test must not hang the run; this thread ends the process when the test overruns.
+    unsigned timeout_ms = test->timeout_ms;
+    std::thread([timeout_ms] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        fprintf(stderr, "  timed out after %u ms\n", timeout_ms);
+        fflush(stderr);
+        std::_Exit(2);
+    }).detach();
+    test->run();
+    fflush(stdout);
+    fflush(stderr);
+    return g_failures.load() ? 1 : 0;
+}
+
+/// Runs one test in a child process of this program. Returns the child's exit status, or -1 if it could not start.
+static int spawn_child(const char* program, TestCase* test) {
+#if defined(__linux__)
+    char child_flag[] = "--child";
+    char* argv[] = { const_cast<char*>(program), child_flag, const_cast<char*>(test->name), nullptr };
+    pid_t pid;
+    if (posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, argv, environ) != 0) return -1;
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+#else
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, path, sizeof(path));
+    if (length == 0 || length >= sizeof(path)) return -1;
+    std::string command = std::string("\"") + path + "\" --child " + test->name;
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process = {};
+    if (!CreateProcessA(path, &command[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process)) return -1;
+    CloseHandle(process.hThread);
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD status = 0;
+    GetExitCodeProcess(process.hProcess, &status);
+    CloseHandle(process.hProcess);
+    (void)program;
+    return (int)status;
+#endif
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "--child") == 0) {
+        TestCase* test = find_test(argv[2]);
+        return test ? run_child(test) : 3;
+    }
+    if (argc == 2 && strcmp(argv[1], "--list") == 0) {
+        for (TestCase* test = g_tests; test; test = test->next) printf("%s\n", test->name);
+        return 0;
+    }
+
+    std::vector<TestCase*> selected;
+    for (int i = 1; i < argc; ++i) {
+        TestCase* test = find_test(argv[i]);
+        if (!test) {
+            fprintf(stderr, "aio-tests: no test named %s\n", argv[i]);
+            return 100;
+        }
+        selected.push_back(test);
+    }
+    if (selected.empty()) {
+        for (TestCase* test = g_tests; test; test = test->next) selected.push_back(test);
+    }
+
+    int failed = 0;
+    for (TestCase* test : selected) {
+        printf("%-56s ", test->name);
+        fflush(stdout);
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        int status = spawn_child(argv[0], test);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        if (status == 0) {
+            printf("ok      %6.2f s\n", seconds);
+        }
+        else {
+            printf("%s %6.2f s\n", status == 2 ? "HUNG   " : "FAILED ", seconds);
+            failed++;
+        }
+        fflush(stdout);
+    }
+    printf("%zu tests, %d failed\n", selected.size(), failed);
+    return failed > 100 ? 100 : failed;
+}
@@ -0,0 +1,345 @@
+/**
+ * @file linux_engine_tests.cpp
+ * @brief linux-engine-tests: libaio-linux's routing between kernel AIO and the worker pool.
+ *
+ *   linux-engine-tests          runs every test
+ *   linux-engine-tests NAME...  runs the named tests
+ *
+ * The engine is a plain Linux library, so these run in one process against real files, O_DIRECT
+ * ones on the kernel and buffered ones and pipes on the pool. The pool is the process's and is
+ * started once, with LIBAIO_WIN32_WORKERS workers as main sets it. The exit status is the number
+ * of tests that failed.
+ */
+#define LIBAIO_LINUX_ENGINE
+#include "libaio_win32.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const unsigned WORKERS = 2;
+static const size_t FILE_BYTES = 1 << 20;
+static const size_t BLOCK = 4096;
+
+static unsigned g_failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { fprintf(stderr, "  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); ++g_failures; } } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        long long check_actual = (long long)(actual), check_expected = (long long)(expected); \
+        if (check_actual != check_expected) { \
+            fprintf(stderr, "  %s:%d: check failed: %s == %s (%lld, expected %lld)\n", __FILE__, __LINE__, #actual, #expected, check_actual, check_expected); \
+            ++g_failures; \
+        } \
+    } while (0)
+
+static unsigned char file_byte(long long offset) {
+    return (unsigned char)((offset * 7 + (offset >> 12)) & 0xFF);
+}
+
+/// A FILE_BYTES file of file_byte contents, opened buffered and with O_DIRECT, and unlinked.
+struct TestFile {
+    int buffered = -1;
+    int direct = -1;
+
+    TestFile() {
+        char path[] = "/var/tmp/libaio-linux-test-XXXXXX";
+        buffered = mkstemp(path);
+        if (buffered < 0) return;
+        std::vector<unsigned char> contents(FILE_BYTES);
+        for (size_t i = 0; i < contents.size(); ++i) contents[i] = file_byte((long long)i);
+        if (pwrite(buffered, contents.data(), contents.size(), 0) != (ssize_t)contents.size()) buffered = -1;
+        direct = open(path, O_RDWR | O_DIRECT);
+        unlink(path);
+    }
+
+    ~TestFile() {
+        if (buffered >= 0) close(buffered);
+        if (direct >= 0) close(direct);
+    }
+};
+
+static void* aligned_buffer(size_t length) {
+    void* buffer = nullptr;
+    return posix_memalign(&buffer, BLOCK, length) == 0 ? buffer : nullptr;
+}
+
+/// Reaps `count` events, or as many as arrive within five seconds.
+static long reap(io_context_t ctx, long count, struct io_event* events) {
+    struct timespec wait = { 5, 0 };
+    long reaped = 0;
+    while (reaped < count) {
+        int got = io_getevents(ctx, 1, count - reaped, events + reaped, &wait);
+        if (got <= 0) break;
+        reaped += got;
+    }
+    return reaped;
+}
+
+// A descriptor with O_DIRECT runs on the kernel and one without on the pool, unless
+// LIBAIO_WIN32_BACKEND forced an engine when the context was set up; syncs always run on the pool.
+static void routes_by_o_direct() {
+    TestFile file;
+    CHECK(file.direct >= 0);
+    io_context_t ctx = 0;
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    CHECK_EQ(io_file_backend(ctx, file.direct), IO_BACKEND_KERNEL);
+    CHECK_EQ(io_file_backend(ctx, file.buffered), IO_BACKEND_THREADPOOL);
+    CHECK_EQ(io_file_backend(ctx, -1), -EBADF);
+    // The flag is read at each submission, so clearing it moves the descriptor to the pool.
+    CHECK_EQ(fcntl(file.direct, F_SETFL, fcntl(file.direct, F_GETFL) & ~O_DIRECT), 0);
+    CHECK_EQ(io_file_backend(ctx, file.direct), IO_BACKEND_THREADPOOL);
+    CHECK_EQ(io_destroy(ctx), 0);
+
+    setenv("LIBAIO_WIN32_BACKEND", "threadpool", 1);
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    unsetenv("LIBAIO_WIN32_BACKEND");
+    CHECK_EQ(fcntl(file.direct, F_SETFL, fcntl(file.direct, F_GETFL) | O_DIRECT), 0);
+    CHECK_EQ(io_file_backend(ctx, file.direct), IO_BACKEND_THREADPOOL);
+    CHECK_EQ(io_destroy(ctx), 0);
+}
+
+// One io_submit of reads, vectored reads and syncs on both descriptors: each iocb completes once,
+// with its own data pointer, its full length and the file's bytes.
+static void mixed_batch_completes_every_request() {
+    static const unsigned READS = 16, SEGMENTS = 4;
+    TestFile file;
+    io_context_t ctx = 0;
+    CHECK_EQ(io_setup(64, &ctx), 0);
+    std::vector<struct iocb> cbs(READS * 2 + 2);
+    std::vector<struct iocb*> list;
+    std::vector<void*> buffers;
+    std::vector<struct iovec> iov(READS * SEGMENTS);
+    for (unsigned i = 0; i < READS; ++i) {
+        int fd = i % 2 ? file.buffered : file.direct;
+        long long offset = (long long)i * BLOCK * 2;
+        void* single = aligned_buffer(BLOCK);
+        buffers.push_back(single);
+        io_prep_pread(&cbs[i], fd, single, BLOCK, offset);
+        for (unsigned s = 0; s < SEGMENTS; ++s) {
+            iov[i * SEGMENTS + s].iov_base = aligned_buffer(BLOCK);
+            iov[i * SEGMENTS + s].iov_len = BLOCK;
+            buffers.push_back(iov[i * SEGMENTS + s].iov_base);
+        }
+        io_prep_preadv(&cbs[READS + i], fd, &iov[i * SEGMENTS], SEGMENTS, offset + BLOCK);
+    }
+    io_prep_fsync(&cbs[READS * 2], file.direct);
+    io_prep_fdsync(&cbs[READS * 2 + 1], file.buffered);
+    for (size_t i = 0; i < cbs.size(); ++i) {
+        cbs[i].data = (void*)(i + 1);
+        list.push_back(&cbs[i]);
+    }
+
+    CHECK_EQ(io_submit(ctx, (long)list.size(), list.data()), (long)list.size());
+    std::vector<struct io_event> events(list.size() + 1);
+    CHECK_EQ(reap(ctx, (long)list.size(), events.data()), (long)list.size());
+    std::vector<int> seen(cbs.size());
+    for (size_t e = 0; e < list.size(); ++e) {
+        const struct io_event& event = events[e];
+        size_t index = (size_t)(event.obj - cbs.data());
+        CHECK(index < cbs.size());
+        if (index >= cbs.size()) continue;
+        seen[index]++;
+        CHECK(event.data == (void*)(index + 1));
+        long long expected = index < READS ? (long long)BLOCK : index < READS * 2 ? (long long)(BLOCK * SEGMENTS) : 0;
+        CHECK_EQ((long)event.res, expected);
+    }
+    for (int count : seen) CHECK_EQ(count, 1);
+    struct timespec now = { 0, 0 };
+    CHECK_EQ(io_getevents(ctx, 0, 1, events.data(), &now), 0);
+
+    for (unsigned i = 0; i < READS; ++i) {
+        long long offset = (long long)i * BLOCK * 2;
+        CHECK_EQ(((unsigned char*)cbs[i].u.c.buf)[BLOCK - 1], file_byte(offset + BLOCK - 1));
+        for (unsigned s = 0; s < SEGMENTS; ++s) {
+            long long at = offset + BLOCK + (long long)s * BLOCK;
+            CHECK_EQ(*(unsigned char*)iov[i * SEGMENTS + s].iov_base, file_byte(at));
+        }
+    }
+    CHECK_EQ(io_destroy(ctx), 0);
+    for (void* buffer : buffers) free(buffer);
+}
+
+// A read of an empty pipe would hold the submitting thread in the kernel's io_submit; on the pool
+// io_submit returns at once, and the read completes when the pipe has data.
+static void buffered_read_does_not_block_submission() {
+    int pipe_fds[2];
+    CHECK_EQ(pipe(pipe_fds), 0);
+    io_context_t ctx = 0;
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    char byte = 0;
+    struct iocb cb;
+    struct iocb* list[] = { &cb };
+    io_prep_pread(&cb, pipe_fds[0], &byte, 1, 0);
+    CHECK_EQ(io_submit(ctx, 1, list), 1);
+    struct io_event event;
+    struct timespec brief = { 0, 20 * 1000 * 1000 };
+    CHECK_EQ(io_getevents(ctx, 1, 1, &event, &brief), 0);
+    CHECK_EQ(write(pipe_fds[1], "p", 1), 1);
+    CHECK_EQ(reap(ctx, 1, &event), 1);
+    CHECK(event.obj == &cb);
+    CHECK_EQ((long)event.res, 1);
+    CHECK_EQ(byte, 'p');
+    CHECK_EQ(io_destroy(ctx), 0);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+// Submission stops at the first iocb it refuses: a null pointer, a closed descriptor, an opcode
+// the engine does not run, or a caller's eventfd, which the engine keeps for its own.
+static void submission_stops_at_a_bad_iocb() {
+    TestFile file;
+    io_context_t ctx = 0;
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    void* buffer = aligned_buffer(BLOCK);
+    struct iocb good, bad;
+    io_prep_pread(&good, file.direct, buffer, BLOCK, 0);
+    struct iocb* with_null[] = { nullptr, &good };
+    CHECK_EQ(io_submit(ctx, 2, with_null), -EFAULT);
+    struct iocb* good_then_null[] = { &good, nullptr };
+    CHECK_EQ(io_submit(ctx, 2, good_then_null), 1);
+    struct io_event event;
+    CHECK_EQ(reap(ctx, 1, &event), 1);
+
+    struct iocb* list[] = { &bad };
+    io_prep_pread(&bad, -1, buffer, BLOCK, 0);
+    CHECK_EQ(io_submit(ctx, 1, list), -EBADF);
+    io_prep_pread(&bad, file.buffered, buffer, BLOCK, 0);
+    bad.aio_lio_opcode = IO_CMD_NOOP;
+    CHECK_EQ(io_submit(ctx, 1, list), -EINVAL);
+    io_prep_pread(&bad, file.direct, buffer, BLOCK, 0);
+    bad.u.c.flags = 1; // IOCB_FLAG_RESFD
+    CHECK_EQ(io_submit(ctx, 1, list), -EINVAL);
+    struct timespec now = { 0, 0 };
+    CHECK_EQ(io_getevents(ctx, 0, 1, &event, &now), 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+    free(buffer);
+}
+
+// A pool request runs from copies taken in io_submit, as a kernel one does: the caller may reuse
+// its iocb and iovec array at once, although the request waits in the queue behind busy workers.
+static void pool_runs_from_copies_of_the_iocb_and_iovecs() {
+    static const unsigned SEGMENTS = 4;
+    TestFile file;
+    int pipe_fds[2];
+    CHECK_EQ(pipe(pipe_fds), 0);
+    io_context_t ctx = 0;
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    static char bytes[WORKERS];
+    static struct iocb holds[WORKERS];
+    for (unsigned i = 0; i < WORKERS; ++i) {
+        io_prep_pread(&holds[i], pipe_fds[0], &bytes[i], 1, 0);
+        struct iocb* list[] = { &holds[i] };
+        CHECK_EQ(io_submit(ctx, 1, list), 1);
+    }
+    usleep(20000); // Until both workers block in the pipe's reads.
+
+    std::vector<unsigned char> data(SEGMENTS * BLOCK), junk(BLOCK);
+    struct iocb cb;
+    struct iovec iov[SEGMENTS];
+    for (unsigned s = 0; s < SEGMENTS; ++s) {
+        iov[s].iov_base = &data[s * BLOCK];
+        iov[s].iov_len = BLOCK;
+    }
+    io_prep_preadv(&cb, file.buffered, iov, SEGMENTS, BLOCK);
+    struct iocb* list[] = { &cb };
+    CHECK_EQ(io_submit(ctx, 1, list), 1);
+    for (unsigned s = 0; s < SEGMENTS; ++s) {
+        iov[s].iov_base = junk.data();
+        iov[s].iov_len = 1;
+    }
+    io_prep_pread(&cb, -1, junk.data(), 1, 0);
+
+    CHECK_EQ(write(pipe_fds[1], "pp", WORKERS), (ssize_t)WORKERS);
+    struct io_event events[WORKERS + 1];
+    CHECK_EQ(reap(ctx, WORKERS + 1, events), WORKERS + 1);
+    for (const struct io_event& event : events) {
+        if (event.obj != &cb) continue;
+        CHECK_EQ((long)event.res, (long)(SEGMENTS * BLOCK));
+    }
+    for (unsigned i = 0; i < SEGMENTS * BLOCK; i += BLOCK / 2) CHECK_EQ(data[i], file_byte(BLOCK + i));
+    CHECK_EQ(junk[0], 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+// With every worker held by a pipe read, a further read waits in the queue: io_cancel takes it
+// back, and io_destroy gives up on the running reads after its timeout.
+static void destroy_cancels_queued_and_times_out_on_running() {
+    int pipe_fds[2];
+    CHECK_EQ(pipe(pipe_fds), 0);
+    setenv("LIBAIO_WIN32_DESTROY_TIMEOUT_MS", "50", 1);
+    io_context_t ctx = 0;
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    unsetenv("LIBAIO_WIN32_DESTROY_TIMEOUT_MS");
+    static char bytes[WORKERS + 2];
+    static struct iocb cbs[WORKERS + 2];
+    for (unsigned i = 0; i < WORKERS + 2; ++i) {
+        io_prep_pread(&cbs[i], pipe_fds[0], &bytes[i], 1, 0);
+        struct iocb* list[] = { &cbs[i] };
+        CHECK_EQ(io_submit(ctx, 1, list), 1);
+        usleep(20000); // Until a worker takes it, so the last two are the ones left queued.
+    }
+    struct io_event event;
+    CHECK_EQ(io_cancel(ctx, &cbs[WORKERS], &event), 0);
+    CHECK(event.obj == &cbs[WORKERS]);
+    CHECK_EQ((long)event.res, -ECANCELED);
+    CHECK_EQ(io_cancel(ctx, &cbs[0], &event), -EINVAL);
+    CHECK_EQ(io_destroy(ctx), -ETIMEDOUT);
+
+    // The workers' reads finish and free the context; the queued read was dropped and the next
+    // context's read gets the pipe's last byte.
+    CHECK_EQ(write(pipe_fds[1], "ppp", 3), 3);
+    CHECK_EQ(io_setup(8, &ctx), 0);
+    char byte = 0;
+    struct iocb cb;
+    struct iocb* list[] = { &cb };
+    io_prep_pread(&cb, pipe_fds[0], &byte, 1, 0);
+    CHECK_EQ(io_submit(ctx, 1, list), 1);
+    CHECK_EQ(reap(ctx, 1, &event), 1);
+    CHECK(event.obj == &cb);
+    CHECK_EQ(byte, 'p');
+    CHECK_EQ(io_destroy(ctx), 0);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+}
+
+struct Test {
+    const char* name;
+    void (*run)(void);
+};
+
+static const Test TESTS[] = {
+    { "routes_by_o_direct", routes_by_o_direct },
+    { "mixed_batch_completes_every_request", mixed_batch_completes_every_request },
+    { "buffered_read_does_not_block_submission", buffered_read_does_not_block_submission },
+    { "submission_stops_at_a_bad_iocb", submission_stops_at_a_bad_iocb },
+    { "pool_runs_from_copies_of_the_iocb_and_iovecs", pool_runs_from_copies_of_the_iocb_and_iovecs },
+    { "destroy_cancels_queued_and_times_out_on_running", destroy_cancels_queued_and_times_out_on_running },
+};
+
+int main(int argc, char** argv) {
+    setenv("LIBAIO_WIN32_WORKERS", std::to_string(WORKERS).c_str(), 1);
+    unsigned failed = 0, run = 0;
+    for (const Test& test : TESTS) {
+        bool named = argc < 2;
+        for (int i = 1; i < argc; ++i) named = named || strcmp(argv[i], test.name) == 0;
+        if (!named) continue;
+        unsigned before = g_failures;
+        test.run();
+        bool passed = g_failures == before;
+        printf("%-52s %s\n", test.name, passed ? "ok" : "FAILED");
+        ++run;
+        if (!passed) ++failed;
+    }
+    printf("%u tests, %u failed\n", run, failed);
+    return failed > 100 ? 100 : (int)failed;
+}
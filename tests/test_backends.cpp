@@ -0,0 +1,239 @@
+/**
+ * @file test_backends.cpp
+ * @brief The one-time backend probe, the results both engines give at the edges of a file and of
+ * the iocb's segment list, where io_submit stops on an iocb it refuses, and what io_getevents2
+ * reports for a plain read.
+ */
+#include "aio_test.h"
+
+#include <errno.h>
+#include <io.h>
+#include <windows.h>
+
+#include <vector>
+
+// The probe runs once per process, does no I/O, and stays within its budget.
+AIO_TEST(probe_runs_once_within_its_budget) {
+    struct io_backend_caps caps, again;
+    REQUIRE(io_query_backends(&caps) == 0);
+    CHECK(caps.probe_ns >= 0);
+    CHECK(caps.probe_ns <= IO_PROBE_BUDGET_NS);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    REQUIRE(io_query_backends(&again) == 0);
+    CHECK_EQ(again.probe_ns, caps.probe_ns);
+    CHECK_EQ(io_destroy(ctx), 0);
+}
+
+/// Reads `length` bytes at `offset` of `fd` and returns the event's result.
+static long long read_at(io_context_t ctx, int fd, void* buffer, unsigned length, long long offset) {
+    struct iocb cb;
+    io_prep_pread(&cb, fd, buffer, length, offset);
+    struct iocb* list[] = { &cb };
+    struct io_event event;
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    REQUIRE(io_getevents(ctx, 1, 1, &event, nullptr) == 1);
+    CHECK(event.obj == &cb);
+    return (long long)event.res;
+}
+
+// A read that starts at or past the end of the file completes with 0 bytes, as on Linux, rather
+// than with the -ENODATA that ERROR_HANDLE_EOF would map to; one that crosses it is short.
+AIO_TEST(reads_at_eof_complete_with_zero) {
+    char buffer[1024];
+    for (bool overlapped : { true, false }) {
+        int fd = test_open_file(overlapped);
+        io_context_t ctx = 0;
+        REQUIRE(io_setup(8, &ctx) == 0);
+        CHECK_EQ(io_file_backend(ctx, fd), overlapped ? IO_BACKEND_IOCP : IO_BACKEND_THREADPOOL);
+        CHECK_EQ(read_at(ctx, fd, buffer, sizeof(buffer), (long long)TEST_FILE_BYTES), 0);
+        CHECK_EQ(read_at(ctx, fd, buffer, sizeof(buffer), (long long)TEST_FILE_BYTES + 4096), 0);
+        CHECK_EQ(read_at(ctx, fd, buffer, sizeof(buffer), (long long)TEST_FILE_BYTES - 100), 100);
+        CHECK_EQ((unsigned char)buffer[99], test_file_byte(TEST_FILE_BYTES - 1));
+        CHECK_EQ(io_destroy(ctx), 0);
+        test_close_file(fd);
+    }
+}
+
+// A vectored iocb with no segments transfers nothing, but still owes exactly one event.
+AIO_TEST(zero_segment_vectored_iocb_completes) {
+    for (bool overlapped : { true, false }) {
+        int fd = test_open_file(overlapped);
+        io_context_t ctx = 0;
+        REQUIRE(io_setup(8, &ctx) == 0);
+        struct iovec iov = {};
+        struct iocb read_cb, write_cb;
+        io_prep_preadv(&read_cb, fd, &iov, 0, 0);
+        io_prep_pwritev(&write_cb, fd, &iov, 0, 4096);
+        struct iocb* list[] = { &read_cb, &write_cb };
+        REQUIRE(io_submit(ctx, 2, list) == 2);
+
+        struct io_event events[3];
+        long reaped = 0;
+        while (reaped < 2) {
+            int got = io_getevents(ctx, 1, 2 - reaped, &events[reaped], nullptr);
+            REQUIRE(got > 0);
+            reaped += got;
+        }
+        CHECK(events[0].obj != events[1].obj);
+        for (long i = 0; i < reaped; ++i) {
+            CHECK(events[i].obj == &read_cb || events[i].obj == &write_cb);
+            CHECK_EQ(events[i].res, 0);
+            CHECK_EQ(events[i].res2, 0);
+        }
+        struct timespec wait = { 0, 20 * 1000 * 1000 };
+        CHECK_EQ(io_getevents(ctx, 1, 1, &events[2], &wait), 0);
+        CHECK_EQ(io_destroy(ctx), 0);
+        test_close_file(fd);
+    }
+}
+
+// Each vectored iocb yields one event once its last segment completes, whose packet frees the
+// group: reaping one event per call, with other groups still in flight, touches no freed group.
+AIO_TEST(vectored_reads_complete_once_with_every_segment) {
+    static const unsigned READS = 32, SEGMENTS = 4, SEGMENT_BYTES = 256;
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(READS, &ctx) == 0);
+    std::vector<unsigned char> data((size_t)READS * SEGMENTS * SEGMENT_BYTES);
+    std::vector<struct iovec> iov(READS * SEGMENTS);
+    std::vector<struct iocb> cbs(READS);
+    std::vector<struct iocb*> list(READS);
+    for (unsigned i = 0; i < READS; ++i) {
+        for (unsigned s = 0; s < SEGMENTS; ++s) {
+            iov[i * SEGMENTS + s].iov_base = &data[((size_t)i * SEGMENTS + s) * SEGMENT_BYTES];
+            iov[i * SEGMENTS + s].iov_len = SEGMENT_BYTES;
+        }
+        io_prep_preadv(&cbs[i], fd, &iov[i * SEGMENTS], SEGMENTS, (long long)i * SEGMENTS * SEGMENT_BYTES);
+        list[i] = &cbs[i];
+    }
+    REQUIRE(io_submit(ctx, READS, list.data()) == (int)READS);
+
+    std::vector<bool> seen(READS);
+    for (unsigned n = 0; n < READS; ++n) {
+        struct io_event event;
+        REQUIRE(io_getevents(ctx, 1, 1, &event, nullptr) == 1);
+        size_t i = (size_t)(event.obj - cbs.data());
+        REQUIRE(i < READS);
+        CHECK(!seen[i]);
+        seen[i] = true;
+        CHECK_EQ(event.res, SEGMENTS * SEGMENT_BYTES);
+    }
+    struct io_event extra;
+    struct timespec wait = { 0, 20 * 1000 * 1000 };
+    CHECK_EQ(io_getevents(ctx, 1, 1, &extra, &wait), 0);
+    for (size_t b = 0; b < data.size(); b += SEGMENT_BYTES / 2) CHECK_EQ(data[b], test_file_byte((long long)b));
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
+
+// Submission stops at the first iocb refused, whatever the reason, and it produces no event: the
+// count returned is the iocbs accepted, or the refusal's error if that was the first one.
+AIO_TEST(submission_stops_at_a_bad_iocb) {
+    int fd = test_open_file(true);
+    std::string path = test_temp_path("read-only");
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, 0, nullptr, CREATE_NEW,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_OVERLAPPED, nullptr);
+    REQUIRE(handle != INVALID_HANDLE_VALUE);
+    int read_only = _open_osfhandle((intptr_t)handle, 0);
+    REQUIRE(read_only >= 0);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    char buffer[512];
+    struct iocb good, bad, last;
+    io_prep_pread(&good, fd, buffer, sizeof(buffer), 0);
+    io_prep_pread(&last, fd, buffer, sizeof(buffer), 512);
+    struct iocb* with_null[] = { nullptr, &good };
+    CHECK_EQ(io_submit(ctx, 2, with_null), -EFAULT);
+    struct iocb* good_then_null[] = { &good, nullptr, &last };
+    CHECK_EQ(io_submit(ctx, 3, good_then_null), 1);
+    struct io_event events[2];
+    REQUIRE(io_getevents(ctx, 1, 2, events, nullptr) == 1);
+    CHECK(events[0].obj == &good);
+
+    struct iocb* list[] = { &bad, &last };
+    io_prep_pread(&bad, -1, buffer, sizeof(buffer), 0);
+    CHECK_EQ(io_submit(ctx, 2, list), -EBADF);
+    struct iocb* good_then_bad[] = { &good, &bad, &last };
+    CHECK_EQ(io_submit(ctx, 3, good_then_bad), 1);
+    REQUIRE(io_getevents(ctx, 1, 2, events, nullptr) == 1);
+    CHECK(events[0].obj == &good);
+
+    // A write the handle was not opened for fails when it is issued, before any packet is owed.
+    io_prep_pwrite(&bad, read_only, buffer, sizeof(buffer), 0);
+    CHECK_EQ(io_submit(ctx, 2, list), -EACCES);
+    CHECK_EQ(io_submit(ctx, 3, good_then_bad), 1);
+    REQUIRE(io_getevents(ctx, 1, 2, events, nullptr) == 1);
+    CHECK(events[0].obj == &good);
+    struct timespec now = { 0, 0 };
+    CHECK_EQ(io_getevents(ctx, 0, 2, events, &now), 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+    _close(read_only);
+    test_close_file(fd);
+}
+
+// A segment is one ReadFile or WriteFile, whose length is a DWORD, so io_submit refuses a vectored
+// iocb with a segment of 4 GiB or more on either engine rather than transfer its low 32 bits.
+AIO_TEST(oversized_segment_is_refused) {
+    if (sizeof(size_t) == 4) return; // A 32-bit iov_len cannot exceed a DWORD.
+    for (bool overlapped : { true, false }) {
+        int fd = test_open_file(overlapped);
+        io_context_t ctx = 0;
+        REQUIRE(io_setup(8, &ctx) == 0);
+        char buffer[512];
+        struct iovec vectors[2] = { { buffer, sizeof(buffer) }, { buffer, (size_t)MAXDWORD + 1 } };
+        struct iocb good, oversized;
+        io_prep_pread(&good, fd, buffer, sizeof(buffer), 0);
+        io_prep_preadv(&oversized, fd, vectors, 2, 0);
+        struct iocb* first[] = { &oversized, &good };
+        CHECK_EQ(io_submit(ctx, 2, first), -EINVAL);
+        struct iocb* second[] = { &good, &oversized };
+        CHECK_EQ(io_submit(ctx, 2, second), 1);
+        struct io_event events[2];
+        REQUIRE(io_getevents(ctx, 1, 2, events, nullptr) == 1);
+        CHECK(events[0].obj == &good);
+        struct timespec now = { 0, 0 };
+        CHECK_EQ(io_getevents(ctx, 0, 2, events, &now), 0);
+        CHECK_EQ(io_destroy(ctx), 0);
+        test_close_file(fd);
+    }
+}
+
+// io_getevents2 reports a plain read's 64-bit result, the engine that ran it, and when it was
+// submitted and reaped, on both engines.
+AIO_TEST(getevents2_reports_plain_reads) {
+    for (bool overlapped : { true, false }) {
+        int fd = test_open_file(overlapped);
+        io_context_t ctx = 0;
+        REQUIRE(io_setup(8, &ctx) == 0);
+        char buffer[4096];
+        struct iocb cb;
+        struct iocb* list[] = { &cb };
+        io_prep_pread(&cb, fd, buffer, sizeof(buffer), 8192);
+        cb.data = &cb;
+        LARGE_INTEGER before, after;
+        QueryPerformanceCounter(&before);
+        REQUIRE(io_submit(ctx, 1, list) == 1);
+        struct io_event2 event;
+        REQUIRE(io_getevents2(ctx, 1, 1, &event, nullptr) == 1);
+        QueryPerformanceCounter(&after);
+        CHECK(event.obj == &cb);
+        CHECK(event.data == &cb);
+        CHECK_EQ(event.res, sizeof(buffer));
+        CHECK_EQ(event.os_error, 0);
+        CHECK_EQ(event.backend, overlapped ? IO_BACKEND_IOCP : IO_BACKEND_THREADPOOL);
+        CHECK(event.submitted_at >= before.QuadPart);
+        CHECK(event.completed_at >= event.submitted_at);
+        CHECK(event.completed_at <= after.QuadPart);
+        CHECK_EQ((unsigned char)buffer[0], test_file_byte(8192));
+
+        // At end of file: a result of 0, not an error.
+        io_prep_pread(&cb, fd, buffer, sizeof(buffer), TEST_FILE_BYTES);
+        REQUIRE(io_submit(ctx, 1, list) == 1);
+        REQUIRE(io_getevents2(ctx, 1, 1, &event, nullptr) == 1);
+        CHECK_EQ(event.res, 0);
+        CHECK_EQ(event.os_error, 0);
+        CHECK_EQ(io_destroy(ctx), 0);
+        test_close_file(fd);
+    }
+}
@@ -0,0 +1,98 @@
+/**
+ * @file test_configs.cpp
+ * @brief AioEngine configurations: HeapAllocator, MinimalConfig's refusals, and the binding of a
+ * context to the configuration that submitted on it first.
+ */
+#include "aio_test.h"
+
+#include <errno.h>
+#include <vector>
+
+static const unsigned READS = 64;
+static const unsigned READ_BYTES = 512;
+
+/// Reads `READS` blocks of the file, one per iocb.
+struct Reads {
+    std::vector<unsigned char> data;
+    std::vector<struct iocb> cbs;
+    std::vector<struct iocb*> list;
+
+    explicit Reads(int fd) : data(READS * READ_BYTES), cbs(READS), list(READS) {
+        for (unsigned i = 0; i < READS; ++i) {
+            io_prep_pread(&cbs[i], fd, &data[i * READ_BYTES], READ_BYTES, (long long)i * READ_BYTES);
+            list[i] = &cbs[i];
+        }
+    }
+
+    void check() const {
+        for (unsigned i = 0; i < READS * READ_BYTES; i += READ_BYTES / 2) CHECK_EQ(data[i], test_file_byte(i));
+    }
+};
+
+// Each record is a heap block of its own from submission until its event is reaped, and one left
+// unreaped is freed by io_destroy.
+AIO_TEST(heap_allocator_takes_and_frees_records) {
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(READS, &ctx) == 0);
+    Reads reads(fd);
+    std::vector<struct io_event> events(READS);
+    CHECK_EQ(io_file_backend(ctx, fd), IO_BACKEND_IOCP); // Its file table entry outlives the reads.
+    long long blocks = test_heap_blocks();
+
+    REQUIRE(test_heap_submit(ctx, READS, reads.list.data()) == (int)READS);
+    CHECK(test_heap_blocks() >= blocks + READS);
+    long reaped = 0;
+    while (reaped < (long)READS) {
+        int got = test_heap_getevents(ctx, 1, READS - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    for (const struct io_event& event : events) CHECK_EQ(event.res, READ_BYTES);
+    reads.check();
+    CHECK_EQ(test_heap_blocks(), blocks);
+
+    REQUIRE(test_heap_submit(ctx, READS, reads.list.data()) == (int)READS);
+    CHECK_EQ(io_destroy(ctx), 0);
+    CHECK(test_heap_blocks() < blocks);
+    test_close_file(fd);
+}
+
+// A context belongs to the configuration that submitted on it first; the C API may not reap
+// MinimalConfig's requests, or add its own, and the reverse.
+AIO_TEST(context_refuses_a_second_configuration) {
+    int fd = test_open_file(true);
+    Reads reads(fd);
+    std::vector<struct io_event> events(READS);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(READS, &ctx) == 0);
+    REQUIRE(test_minimal_submit(ctx, 1, reads.list.data()) == 1);
+    CHECK_EQ(io_getevents(ctx, 1, 1, events.data(), nullptr), -EINVAL);
+    CHECK_EQ(io_submit(ctx, 1, reads.list.data() + 1), -EINVAL);
+    CHECK_EQ(test_heap_submit(ctx, 1, reads.list.data() + 1), -EINVAL);
+    CHECK_EQ(test_minimal_getevents(ctx, 1, 1, events.data(), nullptr), 1);
+    CHECK(events[0].obj == reads.list[0]);
+    CHECK_EQ(io_destroy(ctx), 0);
+
+    REQUIRE(io_setup(READS, &ctx) == 0);
+    REQUIRE(io_submit(ctx, 1, reads.list.data()) == 1);
+    CHECK_EQ(test_minimal_getevents(ctx, 1, 1, events.data(), nullptr), -EINVAL);
+    CHECK_EQ(io_getevents(ctx, 1, 1, events.data(), nullptr), 1);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
+
+// MinimalConfig has no workers to run a sync on, and refuses it rather than block the submitter.
+AIO_TEST(minimal_config_refuses_syncs) {
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    struct iocb cb;
+    struct iocb* list[] = { &cb };
+    io_prep_fsync(&cb, fd);
+    CHECK_EQ(test_minimal_submit(ctx, 1, list), -EINVAL);
+    io_prep_fdsync(&cb, fd);
+    CHECK_EQ(test_minimal_submit(ctx, 1, list), -EINVAL);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
@@ -0,0 +1,87 @@
+/**
+ * @file test_context_pool.cpp
+ * @brief What io_destroy hands to the context pool, and what the next io_setup gets from it.
+ */
+#include "aio_test.h"
+
+#include <io.h>
+#include <windows.h>
+
+/// Reads one byte of `fd` through `ctx` and reaps it.
+static void read_once(io_context_t ctx, int fd) {
+    char byte = 0;
+    struct iocb cb;
+    io_prep_pread(&cb, fd, &byte, 1, 4096);
+    struct iocb* list[] = { &cb };
+    struct io_event event;
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    REQUIRE(io_getevents(ctx, 1, 1, &event, nullptr) == 1);
+    CHECK_EQ(event.res, 1);
+    CHECK_EQ((unsigned char)byte, test_file_byte(4096));
+}
+
+// A file stays associated with its first port while it is open, and packets of the application's
+// own overlapped I/O on it would reach whichever context leased that port next: such a port is
+// closed rather than pooled, and the file runs on the thread pool from then on.
+AIO_TEST(bound_port_is_not_leased) {
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    CHECK_EQ(io_file_backend(ctx, fd), IO_BACKEND_IOCP);
+    read_once(ctx, fd);
+    CHECK_EQ(io_destroy(ctx), 0);
+
+    REQUIRE(io_setup(8, &ctx) == 0);
+    HANDLE handle = (HANDLE)_get_osfhandle(fd);
+    OVERLAPPED overlapped = {};
+    char byte = 0;
+    DWORD bytes = 0;
+    BOOL ok = ReadFile(handle, &byte, 1, &bytes, &overlapped);
+    if (!ok && GetLastError() == ERROR_IO_PENDING) ok = GetOverlappedResult(handle, &overlapped, &bytes, TRUE);
+    CHECK(ok);
+    struct io_event event;
+    struct timespec wait = { 0, 20 * 1000 * 1000 };
+    CHECK_EQ(io_getevents(ctx, 1, 1, &event, &wait), 0);
+
+    CHECK_EQ(io_file_backend(ctx, fd), IO_BACKEND_THREADPOOL);
+    read_once(ctx, fd);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
+
+// The workers still go back to the pool with a port that cannot: the next context starts no threads.
+AIO_TEST(pooled_context_keeps_its_workers) {
+    int fd = test_open_file(true);
+    int sync_fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    read_once(ctx, fd);
+    read_once(ctx, sync_fd);
+    CHECK_EQ(io_destroy(ctx), 0);
+    long long handles = test_handle_count();
+
+    REQUIRE(io_setup(8, &ctx) == 0);
+    read_once(ctx, fd);
+    read_once(ctx, sync_fd);
+    CHECK_EQ(test_handle_count(), handles + 1); // The new port alone.
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(sync_fd);
+    test_close_file(fd);
+}
+
+// A port no file was associated with is pooled as it is.
+AIO_TEST(unbound_port_is_pooled) {
+    int sync_fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    read_once(ctx, sync_fd);
+    CHECK_EQ(io_destroy(ctx), 0);
+    long long handles = test_handle_count();
+
+    REQUIRE(io_setup(8, &ctx) == 0);
+    CHECK_EQ(test_handle_count(), handles);
+    read_once(ctx, sync_fd);
+    CHECK_EQ(test_handle_count(), handles);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(sync_fd);
+}
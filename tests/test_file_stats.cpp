@@ -0,0 +1,155 @@
+/**
+ * @file test_file_stats.cpp
+ * @brief Per-file stats: the exact counters of the first descriptors a context resolves, and the
+ * space-saving sketch that ranks the rest.
+ *
+ * The sketch test runs on the null engine, which completes every request at once without touching
+ * the file, and on pipes, which cost a handle each instead of a file of test data.
+ */
+#include "aio_test.h"
+
+#include <errno.h>
+#include <map>
+#include <vector>
+
+/// The sketch's entries; a descriptor above 1/SKETCH_CAPACITY of the sketched requests is always listed.
+static const unsigned SKETCH_CAPACITY = 64;
+
+static void reap(io_context_t ctx, long count) {
+    std::vector<struct io_event> events((size_t)count);
+    long reaped = 0;
+    while (reaped < count) {
+        int got = io_getevents(ctx, 1, count - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+}
+
+// Three files with known loads, all within the budget: every figure is exact, and the two orders
+// rank them differently.
+AIO_TEST(exact_file_stats_count_and_rank_each_file) {
+    int busy = test_open_file(true), big = test_open_file(true), idle = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(64, &ctx) == 0);
+    struct io_file_stats stats[8];
+    CHECK_EQ(io_file_stats_top(ctx, IO_FILE_STATS_BY_OPS, stats, 8), -ENOENT);
+    REQUIRE(io_file_stats_enable(ctx, 8) == 0);
+    CHECK_EQ(io_file_stats_top(ctx, IO_FILE_STATS_BY_OPS, stats, 8), 0);
+
+    // busy: 10 reads of 4 KiB. big: 4 writes of 16 KiB and an fsync. idle: 2 reads of 512 bytes.
+    std::vector<char> buffer(16384);
+    std::vector<struct iocb> cbs(17);
+    std::vector<struct iocb*> list;
+    for (unsigned i = 0; i < 10; ++i) io_prep_pread(&cbs[i], busy, buffer.data(), 4096, (long long)i * 4096);
+    for (unsigned i = 0; i < 4; ++i) io_prep_pwrite(&cbs[10 + i], big, buffer.data(), 16384, (long long)i * 16384);
+    io_prep_fsync(&cbs[14], big);
+    io_prep_pread(&cbs[15], idle, buffer.data(), 512, 0);
+    io_prep_pread(&cbs[16], idle, buffer.data(), 512, 512);
+    for (struct iocb& cb : cbs) list.push_back(&cb);
+    REQUIRE(io_submit(ctx, (long)list.size(), list.data()) == (int)list.size());
+    reap(ctx, (long)list.size());
+
+    REQUIRE(io_file_stats_top(ctx, IO_FILE_STATS_BY_OPS, stats, 8) == 3);
+    CHECK_EQ(stats[0].fd, busy);
+    CHECK_EQ(stats[1].fd, big);
+    CHECK_EQ(stats[2].fd, idle);
+    CHECK_EQ(stats[0].reads, 10);
+    CHECK_EQ(stats[0].read_bytes, 40960);
+    CHECK_EQ(stats[0].writes, 0);
+    CHECK_EQ(stats[0].completed, 10);
+    CHECK_EQ(stats[1].writes, 4);
+    CHECK_EQ(stats[1].syncs, 1);
+    CHECK_EQ(stats[1].write_bytes, 65536);
+    CHECK_EQ(stats[1].reads, 0);
+    CHECK_EQ(stats[1].completed, 5);
+    CHECK_EQ(stats[2].reads, 2);
+    CHECK_EQ(stats[2].read_bytes, 1024);
+    CHECK_EQ(stats[2].completed, 2);
+    for (int i = 0; i < 3; ++i) {
+        CHECK_EQ(stats[i].estimated, 0);
+        CHECK_EQ(stats[i].overcount, 0);
+        CHECK_EQ(stats[i].errors, 0);
+        CHECK(stats[i].latency_ns > 0);
+    }
+
+    REQUIRE(io_file_stats_top(ctx, IO_FILE_STATS_BY_BYTES, stats, 2) == 2);
+    CHECK_EQ(stats[0].fd, big);
+    CHECK_EQ(stats[1].fd, busy);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(busy);
+    test_close_file(big);
+    test_close_file(idle);
+}
+
+// With an exact budget of one, every later descriptor goes to the sketch. 80 descriptors read once
+// each, interleaved with two heavy hitters, overflow its 64 entries: the heavy hitters still rank
+// first, and every listed figure is within its overcount of the truth.
+AIO_TEST(sketch_ranks_heavy_hitters_within_its_error_bound) {
+    static const unsigned COLD = 80, FIRST_READS = 200, SECOND_READS = 100;
+    test_set_env("LIBAIO_WIN32_BACKEND", "null");
+    int exact = test_open_file(true);
+    TestPipe first = test_open_pipe(true), second = test_open_pipe(true);
+    std::vector<TestPipe> cold;
+    for (unsigned i = 0; i < COLD; ++i) cold.push_back(test_open_pipe(true));
+
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(1024, &ctx) == 0);
+    REQUIRE(io_file_stats_enable(ctx, 1) == 0);
+    char byte;
+    std::vector<struct iocb> cbs;
+    cbs.reserve(1 + FIRST_READS + SECOND_READS + COLD);
+    std::map<int, unsigned long long> truth;
+    auto read = [&](int fd) {
+        cbs.emplace_back();
+        io_prep_pread(&cbs.back(), fd, &byte, 1, 0);
+        truth[fd]++;
+    };
+    read(exact);
+    unsigned next_cold = 0;
+    for (unsigned step = 0; step < FIRST_READS; ++step) {
+        read(first.fd);
+        if (step % 2) read(second.fd);
+        if ((step % 5 == 0 || step % 5 == 2) && next_cold < COLD) read(cold[next_cold++].fd);
+    }
+    REQUIRE(next_cold == COLD);
+    std::vector<struct iocb*> list;
+    for (struct iocb& cb : cbs) list.push_back(&cb);
+    REQUIRE(io_submit(ctx, (long)list.size(), list.data()) == (int)list.size());
+    reap(ctx, (long)list.size());
+
+    unsigned long long sketched = FIRST_READS + SECOND_READS + COLD;
+    for (int order : { IO_FILE_STATS_BY_OPS, IO_FILE_STATS_BY_BYTES }) {
+        struct io_file_stats stats[SKETCH_CAPACITY + 1];
+        REQUIRE(io_file_stats_top(ctx, order, stats, SKETCH_CAPACITY + 1) == (int)SKETCH_CAPACITY + 1);
+        unsigned displaced = 0;
+        CHECK_EQ(stats[0].fd, first.fd);
+        CHECK_EQ(stats[1].fd, second.fd);
+        for (const struct io_file_stats& entry : stats) {
+            unsigned long long counted = entry.reads, actual = truth[entry.fd];
+            if (order == IO_FILE_STATS_BY_BYTES) CHECK_EQ(entry.read_bytes, entry.reads);
+            if (!entry.estimated) {
+                CHECK_EQ(entry.fd, exact);
+                CHECK_EQ(counted, 1);
+                CHECK_EQ(entry.completed, 1);
+                continue;
+            }
+            CHECK(counted <= actual);
+            CHECK(actual <= counted + entry.overcount);
+            CHECK(entry.overcount <= sketched / SKETCH_CAPACITY);
+            CHECK_EQ(entry.completed, 0);
+            if (entry.overcount) displaced++;
+        }
+        CHECK(displaced > 0);
+        // The heavy hitters entered the sketch before it filled up, so they carry no overcount.
+        CHECK_EQ(stats[0].reads, FIRST_READS);
+        CHECK_EQ(stats[0].overcount, 0);
+        CHECK_EQ(stats[1].reads, SECOND_READS);
+        CHECK_EQ(stats[1].overcount, 0);
+    }
+
+    CHECK_EQ(io_destroy(ctx), 0);
+    for (const TestPipe& pipe : cold) test_close_pipe(pipe);
+    test_close_pipe(first);
+    test_close_pipe(second);
+    test_close_file(exact);
+}
@@ -0,0 +1,199 @@
+/**
+ * @file test_footprint.cpp
+ * @brief Memory per in-flight request and per context, against the budget README.md documents,
+ * setup and teardown of contexts by the thousand, and when large pages touch the process token.
+ *
+ * Requests are held in flight on the null engine, which posts each completion at once: nothing
+ * reaps it until the measurement is taken, so every request's record is alive. The completion
+ * packets are the kernel's memory on Windows but the emulator's heap here, so their cost is
+ * measured on a port of the test's own and taken off.
+ */
+#include "aio_test.h"
+
+#include <windows.h>
+#include <psapi.h>
+
+#include <vector>
+
+static const unsigned DEPTH = 65536;
+static const int SEGMENTS = 4;
+
+// The x64 budget of README.md's "Memory per In-Flight Request".
+static const long long RECORD_BYTES = 64 + 4;         ///< Slab record and its free-list link.
+static const long long VECTORED_BYTES = sizeof(long) == 4 ? 56 : 72; ///< Header of a vectored request's heap block, whose longs LP64 widens...
+static const long long SEGMENT_BYTES = 40;            ///< ...and each of its buffers.
+static const long long DEDICATED_CONTEXT_BYTES = 16 << 10;
+static const long long THIN_CONTEXT_BYTES = 1536;
+
+static long long resident_bytes(void) {
+    PROCESS_MEMORY_COUNTERS counters;
+    REQUIRE(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)));
+    return (long long)counters.WorkingSetSize;
+}
+
+/// Heap bytes a port takes to queue `count` packets.
+static long long packet_bytes(unsigned count) {
+    HANDLE port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    REQUIRE(port != NULL);
+    long long before = test_heap_bytes();
+    for (unsigned i = 0; i < count; ++i) REQUIRE(PostQueuedCompletionStatus(port, 0, 0, NULL));
+    long long bytes = test_heap_bytes() - before;
+    CloseHandle(port);
+    return bytes;
+}
+
+static void reap_all(io_context_t ctx, std::vector<struct io_event>& events) {
+    long reaped = 0;
+    while (reaped < (long)events.size()) {
+        int got = io_getevents(ctx, 1, (long)events.size() - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+}
+
+// A single request costs its slab record and nothing from the heap; a vectored one costs one heap
+// block of a header and a segment per buffer. io_destroy gives all of it back.
+AIO_TEST(requests_stay_within_their_memory_budget) {
+    if (sizeof(void*) != 8) return; // The budget is x64's.
+    test_set_env("LIBAIO_WIN32_BACKEND", "null");
+    test_set_env("LIBAIO_WIN32_CONTEXT_POOL", "0"); // A pooled port would keep its queue.
+    int fd = test_open_file(true);
+    char buffer[512];
+    struct iovec vectors[SEGMENTS];
+    for (int i = 0; i < SEGMENTS; ++i) {
+        vectors[i].iov_base = buffer + i * (sizeof(buffer) / SEGMENTS);
+        vectors[i].iov_len = sizeof(buffer) / SEGMENTS;
+    }
+    std::vector<struct iocb> cbs(DEPTH);
+    std::vector<struct iocb*> list(DEPTH);
+    std::vector<struct io_event> events(DEPTH);
+    for (unsigned i = 0; i < DEPTH; ++i) list[i] = &cbs[i];
+    long long single_packets = packet_bytes(DEPTH), vectored_packets = packet_bytes(DEPTH * SEGMENTS);
+
+    long long heap = test_heap_bytes(), blocks = test_heap_blocks();
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(DEPTH, &ctx) == 0);
+    for (unsigned i = 0; i < DEPTH; ++i) io_prep_pread(&cbs[i], fd, buffer, sizeof(buffer), 0);
+    long long before = test_heap_bytes(), resident = resident_bytes();
+    REQUIRE(io_submit(ctx, DEPTH, list.data()) == (int)DEPTH);
+    long long grown = test_heap_bytes() - before;
+    CHECK((grown - single_packets) / DEPTH <= 0);
+    // Resident memory also holds the emulator's allocator headers on the packets' blocks.
+    CHECK((resident_bytes() - resident - grown) / DEPTH <= RECORD_BYTES + 4);
+    reap_all(ctx, events);
+
+    for (unsigned i = 0; i < DEPTH; ++i) io_prep_preadv(&cbs[i], fd, vectors, SEGMENTS, 0);
+    before = test_heap_bytes();
+    REQUIRE(io_submit(ctx, DEPTH, list.data()) == (int)DEPTH);
+    CHECK((test_heap_bytes() - before - vectored_packets) / DEPTH <= VECTORED_BYTES + SEGMENT_BYTES * SEGMENTS);
+    reap_all(ctx, events);
+    for (const struct io_event& event : events) CHECK_EQ(event.res, sizeof(buffer));
+    CHECK_EQ(io_destroy(ctx), 0);
+    CHECK_EQ(test_heap_bytes(), heap);
+    CHECK_EQ(test_heap_blocks(), blocks);
+    test_close_file(fd);
+}
+
+/// Sets up `count` contexts of depth 8, checks what each costs, destroys them and checks that
+/// everything came back.
+static void contexts_at_scale(unsigned count, bool thin, long long bytes_each, long long handles_each) {
+    std::vector<io_context_t> contexts(count);
+    long long heap = test_heap_bytes(), blocks = test_heap_blocks(), handles = test_handle_count();
+    for (unsigned i = 0; i < count; ++i) REQUIRE((thin ? io_setup_shared(8, &contexts[i]) : io_setup(8, &contexts[i])) == 0);
+    CHECK((test_heap_bytes() - heap) / count <= bytes_each);
+    CHECK_EQ(test_handle_count() - handles, handles_each * count);
+
+    for (unsigned i = 0; i < count; ++i) CHECK_EQ(io_destroy(contexts[i]), 0);
+    CHECK_EQ(test_heap_bytes(), heap);
+    CHECK_EQ(test_heap_blocks(), blocks);
+    CHECK_EQ(test_handle_count(), handles);
+}
+
+// A dedicated context costs its port and about 14 KB, most of it the in-flight index's minimum
+// of 256 slots; io_destroy returns both when the context pool is off.
+AIO_TEST(dedicated_contexts_set_up_and_tear_down_by_the_thousand) {
+    test_set_env("LIBAIO_WIN32_CONTEXT_POOL", "0");
+    contexts_at_scale(1024, false, DEDICATED_CONTEXT_BYTES, 1);
+}
+
+// Thin contexts share the engine the first one starts, and each costs no handle and about 1.3 KB.
+AIO_TEST(thin_contexts_set_up_and_tear_down_by_the_ten_thousand) {
+    io_context_t first = 0;
+    REQUIRE(io_setup_shared(8, &first) == 0);
+    contexts_at_scale(16384, true, THIN_CONTEXT_BYTES, 0);
+    CHECK_EQ(io_destroy(first), 0);
+}
+
+/// Whether SeLockMemoryPrivilege is enabled on the process token, which lists every privilege the
+/// account holds.
+static bool lock_memory_enabled(void) {
+    LUID lock_memory;
+    REQUIRE(LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &lock_memory));
+    HANDLE token;
+    REQUIRE(OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token));
+    DWORD length = 0;
+    GetTokenInformation(token, TokenPrivileges, nullptr, 0, &length);
+    REQUIRE(length >= sizeof(TOKEN_PRIVILEGES));
+    std::vector<char> buffer(length);
+    REQUIRE(GetTokenInformation(token, TokenPrivileges, buffer.data(), length, &length));
+    CloseHandle(token);
+    const TOKEN_PRIVILEGES* privileges = reinterpret_cast<const TOKEN_PRIVILEGES*>(buffer.data());
+    for (DWORD i = 0; i < privileges->PrivilegeCount; ++i) {
+        const LUID_AND_ATTRIBUTES& entry = privileges->Privileges[i];
+        if (entry.Luid.LowPart == lock_memory.LowPart && entry.Luid.HighPart == lock_memory.HighPart) {
+            return (entry.Attributes & SE_PRIVILEGE_ENABLED) != 0;
+        }
+    }
+    return false;
+}
+
+/// A context deep enough for its slab and in-flight index to go on large pages.
+static const int LARGE_PAGES_DEPTH = 4096;
+
+// Without LIBAIO_WIN32_LARGE_PAGES the library leaves the token alone, however deep the context.
+AIO_TEST(large_pages_off_leave_the_token_alone) {
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    CHECK(!(caps.features & IO_CAP_LARGE_PAGES));
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(LARGE_PAGES_DEPTH, &ctx) == 0);
+    CHECK(!lock_memory_enabled());
+    CHECK_EQ(io_destroy(ctx), 0);
+}
+
+// With it, the probe only reads the token; the first structure put on large pages enables the
+// privilege, and a context too shallow for them does not.
+AIO_TEST(first_large_page_structure_enables_the_privilege) {
+    test_set_env("LIBAIO_WIN32_LARGE_PAGES", "1");
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    if (!(caps.features & IO_CAP_LARGE_PAGES)) return; // Windows, on an account without the privilege.
+    CHECK(!lock_memory_enabled());
+    io_context_t shallow = 0, deep = 0;
+    REQUIRE(io_setup(64, &shallow) == 0);
+    CHECK(!lock_memory_enabled());
+
+    REQUIRE(io_setup(LARGE_PAGES_DEPTH, &deep) == 0);
+    CHECK(lock_memory_enabled());
+    struct io_large_page_counters counters;
+    REQUIRE(io_large_pages_read(&counters) == 0);
+    CHECK_EQ(counters.regions + counters.fallbacks, 2); // Both structures; Windows may lack the free memory.
+    CHECK_EQ(io_destroy(deep), 0);
+    CHECK_EQ(io_destroy(shallow), 0);
+}
+
+// An account without the privilege gets no IO_CAP_LARGE_PAGES, and its deep contexts small pages.
+AIO_TEST(missing_privilege_leaves_large_pages_off) {
+    test_set_env("LIBAIO_WIN32_LARGE_PAGES", "1");
+    test_set_env("WIN32EMU_NO_LOCK_PRIVILEGE", "1");
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    if (caps.features & IO_CAP_LARGE_PAGES) return; // Windows, on an account with the privilege.
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(LARGE_PAGES_DEPTH, &ctx) == 0);
+    CHECK(!lock_memory_enabled());
+    struct io_large_page_counters counters;
+    REQUIRE(io_large_pages_read(&counters) == 0);
+    CHECK_EQ(counters.regions, 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+}
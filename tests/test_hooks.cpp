@@ -0,0 +1,43 @@
+/**
+ * @file test_hooks.cpp
+ * @brief The library, compiled into the test program, and the internals tests look at.
+ *
+ * The tests themselves include libaio_win32.h with LIBAIO_WIN32_STATIC and see only the public
+ * API; this file compiles libaio_win32.cpp in header-only mode and adds the hooks below.
+ */
+#define LIBAIO_WIN32_IMPLEMENTATION
+#include "libaio_win32.h"
+
+// --- Engine Configurations ---
+
+/// The C API's configuration with every request record from the heap.
+struct HeapConfig {
+    typedef DefaultConfig::Backend Backend;
+    typedef HeapAllocator Allocator;
+    typedef DefaultConfig::Stats Stats;
+    typedef DefaultConfig::Tracing Tracing;
+    typedef DefaultConfig::Scheduler Scheduler;
+};
+
+int test_minimal_submit(io_context_t ctx, long nr, struct iocb** iocbs) {
+    return AioEngine<MinimalConfig>::submit(ctx, nr, iocbs);
+}
+
+int test_minimal_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+    return AioEngine<MinimalConfig>::getevents(ctx, min_nr, nr, events, timeout);
+}
+
+int test_heap_submit(io_context_t ctx, long nr, struct iocb** iocbs) {
+    return AioEngine<HeapConfig>::submit(ctx, nr, iocbs);
+}
+
+int test_heap_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+    return AioEngine<HeapConfig>::getevents(ctx, min_nr, nr, events, timeout);
+}
+
+// --- Worker Pool ---
+
+long test_pool_live_workers(io_context_t ctx) {
+    WinAioContext* context = static_cast<WinAioContext*>(ctx)->engine;
+    return context->pool ? (long)context->pool->live_workers.load() : 0;
+}
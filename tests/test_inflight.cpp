@@ -0,0 +1,185 @@
+/**
+ * @file test_inflight.cpp
+ * @brief The in-flight index: what io_list_inflight reports and in what order, what the watchdog
+ * reports and how often, and requests accepted while the index is full.
+ *
+ * The null engine posts each completion at once, but a request stays in flight until io_getevents
+ * returns it, so the test decides how long each one is listed. A read on a pipe is one that is
+ * really stuck, until the test writes to the pipe.
+ */
+#include "aio_test.h"
+
+#include <atomic>
+#include <errno.h>
+#include <vector>
+
+static void reap(io_context_t ctx, long count) {
+    std::vector<struct io_event> events((size_t)count);
+    long reaped = 0;
+    while (reaped < count) {
+        int got = io_getevents(ctx, 1, count - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+}
+
+// Requests are listed oldest first, with their descriptor, opcode, offset and length, and an age
+// that counts from the io_submit that accepted them; a short array gets the oldest.
+AIO_TEST(inflight_lists_oldest_first) {
+    test_set_env("LIBAIO_WIN32_BACKEND", "null");
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    char buffer[4096];
+    struct iovec vectors[2] = { { buffer, 1024 }, { buffer + 1024, 3072 } };
+    struct iocb first, second, third;
+    io_prep_pread(&first, fd, buffer, 512, 8192);
+    io_prep_preadv(&second, fd, vectors, 2, 65536);
+    io_prep_pwrite(&third, fd, buffer, 2048, 0);
+    struct iocb* list[] = { &first, &second, &third };
+
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    test_sleep_ms(40);
+    REQUIRE(io_submit(ctx, 1, list + 1) == 1);
+    test_sleep_ms(40);
+    REQUIRE(io_submit(ctx, 1, list + 2) == 1);
+
+    struct io_inflight_req reqs[8];
+    CHECK_EQ(io_list_inflight(ctx, reqs, 1), 3);
+    CHECK(reqs[0].obj == &first);
+    REQUIRE(io_list_inflight(ctx, reqs, 8) == 3);
+    CHECK(reqs[0].obj == &first);
+    CHECK(reqs[1].obj == &second);
+    CHECK(reqs[2].obj == &third);
+    CHECK(reqs[0].age_ns >= reqs[1].age_ns + 30000000ULL);
+    CHECK(reqs[1].age_ns >= reqs[2].age_ns + 30000000ULL);
+    CHECK(reqs[0].age_ns >= 80000000ULL);
+    CHECK_EQ(reqs[0].fd, fd);
+    CHECK_EQ(reqs[0].opcode, IO_CMD_PREAD);
+    CHECK_EQ(reqs[0].offset, 8192);
+    CHECK_EQ(reqs[0].length, 512);
+    CHECK_EQ(reqs[1].opcode, IO_CMD_PREADV);
+    CHECK_EQ(reqs[1].offset, 65536);
+    CHECK_EQ(reqs[1].length, 4096);
+    CHECK_EQ(reqs[2].opcode, IO_CMD_PWRITE);
+    CHECK_EQ(reqs[2].length, 2048);
+
+    // Ages keep growing while nothing reaps.
+    unsigned long long oldest = reqs[0].age_ns;
+    test_sleep_ms(20);
+    REQUIRE(io_list_inflight(ctx, reqs, 1) == 3);
+    CHECK(reqs[0].age_ns >= oldest + 10000000ULL);
+
+    reap(ctx, 3);
+    CHECK_EQ(io_list_inflight(ctx, reqs, 8), 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
+
+/// What the watchdog's callback saw, per pipe read.
+struct WatchdogReports {
+    struct iocb* reads[2];
+    std::atomic<int> count[2];
+    std::atomic<int> others;
+    std::atomic<unsigned long long> youngest_ns;
+};
+
+static void count_report(io_context_t, const struct io_inflight_req* req, void* arg) {
+    WatchdogReports* reports = static_cast<WatchdogReports*>(arg);
+    if (req->obj == reports->reads[0]) reports->count[0]++;
+    else if (req->obj == reports->reads[1]) reports->count[1]++;
+    else reports->others++;
+    unsigned long long age = req->age_ns;
+    unsigned long long youngest = reports->youngest_ns.load();
+    while (age < youngest && !reports->youngest_ns.compare_exchange_weak(youngest, age)) {}
+}
+
+// Each read stuck on a pipe past the threshold is reported exactly once, however many scans it
+// outlives; a file read that completes and is reaped at once never is.
+AIO_TEST(watchdog_reports_each_stuck_read_once) {
+    static const unsigned THRESHOLD_MS = 20;
+    TestPipe pipe = test_open_pipe(true);
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    WatchdogReports reports;
+    reports.count[0] = reports.count[1] = reports.others = 0;
+    reports.youngest_ns = ~0ULL;
+    REQUIRE(io_watchdog_start(THRESHOLD_MS, count_report, &reports) == 0);
+    CHECK_EQ(io_watchdog_start(THRESHOLD_MS, count_report, &reports), -EBUSY);
+
+    char bytes[2], data[512];
+    struct iocb stuck[2], quick;
+    io_prep_pread(&stuck[0], pipe.fd, &bytes[0], 1, 0);
+    io_prep_pread(&stuck[1], pipe.fd, &bytes[1], 1, 0);
+    io_prep_pread(&quick, fd, data, sizeof(data), 0);
+    struct iocb* list[] = { &stuck[0], &stuck[1], &quick };
+    reports.reads[0] = &stuck[0];
+    reports.reads[1] = &stuck[1];
+    REQUIRE(io_submit(ctx, 3, list) == 3);
+    struct io_event event;
+    REQUIRE(io_getevents(ctx, 1, 1, &event, nullptr) == 1);
+    CHECK(event.obj == &quick);
+
+    CHECK(test_wait_until(5000, [&] { return reports.count[0] > 0 && reports.count[1] > 0; }));
+    test_sleep_ms(THRESHOLD_MS * 10);    // Dozens of scans at the 10 ms minimum interval.
+    CHECK_EQ(io_watchdog_stop(), 0);
+    CHECK_EQ(reports.count[0].load(), 1);
+    CHECK_EQ(reports.count[1].load(), 1);
+    CHECK_EQ(reports.others.load(), 0);
+    CHECK(reports.youngest_ns.load() >= THRESHOLD_MS * 1000000ULL);
+    CHECK_EQ(io_watchdog_stop(), 0);
+
+    test_pipe_write(pipe, 2);
+    reap(ctx, 2);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+    test_close_pipe(pipe);
+}
+
+// io_setup(1) gets the minimum of 256 slots. The requests past them run but are not listed, and
+// reaping them must not take another request's slot: the slots they leave free hold new requests.
+AIO_TEST(full_index_leaves_the_rest_unlisted) {
+    static const unsigned SLOTS = 256, OVER = 300, REAPED = 50;
+    test_set_env("LIBAIO_WIN32_BACKEND", "null");
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(1, &ctx) == 0);
+    std::vector<char> buffer(512);
+    std::vector<struct iocb> cbs(OVER + REAPED);
+    std::vector<struct iocb*> list(OVER + REAPED);
+    for (unsigned i = 0; i < OVER + REAPED; ++i) {
+        io_prep_pread(&cbs[i], fd, buffer.data(), buffer.size(), (long long)i * 512);
+        list[i] = &cbs[i];
+    }
+    std::vector<struct io_inflight_req> reqs(OVER + REAPED);
+
+    REQUIRE(io_submit(ctx, OVER, list.data()) == (int)OVER);
+    CHECK_EQ(io_list_inflight(ctx, reqs.data(), (int)reqs.size()), SLOTS);
+    // The null engine completes in order, so these are all listed ones.
+    std::vector<struct io_event> events(OVER + REAPED);
+    long reaped = 0;
+    while (reaped < (long)REAPED) {
+        int got = io_getevents(ctx, 1, REAPED - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    CHECK_EQ(io_list_inflight(ctx, reqs.data(), (int)reqs.size()), SLOTS - REAPED);
+
+    REQUIRE(io_submit(ctx, REAPED, &list[OVER]) == (int)REAPED);
+    CHECK_EQ(io_list_inflight(ctx, reqs.data(), (int)reqs.size()), SLOTS);
+    while (reaped < (long)(OVER + REAPED)) {
+        int got = io_getevents(ctx, 1, OVER + REAPED - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    for (const struct io_event& completed : events) CHECK_EQ(completed.res, 512);
+    CHECK_EQ(io_list_inflight(ctx, reqs.data(), (int)reqs.size()), 0);
+
+    // Every slot came back, so the index fills up again.
+    REQUIRE(io_submit(ctx, OVER, list.data()) == (int)OVER);
+    CHECK_EQ(io_list_inflight(ctx, reqs.data(), (int)reqs.size()), SLOTS);
+    reap(ctx, OVER);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
@@ -0,0 +1,93 @@
+/**
+ * @file test_numa.cpp
+ * @brief NUMA placement on two simulated nodes: with it, threads bound to either node take request
+ * records and provided buffers on their own node and reap their completions there, and without
+ * it, io_numa_read counts the accesses that cross.
+ *
+ * The two threads run one after the other on one context, so each reaps only its own requests,
+ * and the second finds the records and buffers the first one used free again.
+ */
+#include "aio_test.h"
+
+#include <thread>
+#include <vector>
+
+static const unsigned ROUNDS = 4, BATCH = 16, BUFFERS = 64, LENGTH = 512;
+static const unsigned short GROUP = 1;
+
+/// Binds a new thread to `node` and has it submit and reap rounds of plain and select reads.
+static void run_on_node(io_context_t ctx, int fd, unsigned node) {
+    std::thread thread([=] {
+        REQUIRE(io_numa_bind_thread(node) == 0);
+        std::vector<char> data(BATCH * LENGTH);
+        struct iocb cbs[2 * BATCH];
+        struct iocb* list[2 * BATCH];
+        struct io_event events[2 * BATCH];
+        for (unsigned round = 0; round < ROUNDS; ++round) {
+            for (unsigned i = 0; i < BATCH; ++i) {
+                io_prep_pread(&cbs[i], fd, &data[i * LENGTH], LENGTH, (long long)i * LENGTH);
+                io_prep_pread_select(&cbs[BATCH + i], fd, LENGTH, (long long)i * LENGTH, GROUP);
+            }
+            for (unsigned i = 0; i < 2 * BATCH; ++i) list[i] = &cbs[i];
+            REQUIRE(io_submit(ctx, 2 * BATCH, list) == (int)(2 * BATCH));
+            REQUIRE(io_getevents(ctx, 2 * BATCH, 2 * BATCH, events, nullptr) == (int)(2 * BATCH));
+            for (const struct io_event& event : events) {
+                CHECK_EQ(event.res, LENGTH);
+                if (event.obj->aio_lio_opcode != IO_CMD_PREAD_SELECT) continue;
+                int bid = io_event_buffer_id(&event);
+                REQUIRE(bid >= 0);
+                CHECK_EQ(io_recycle_buffer(ctx, GROUP, (unsigned short)bid), 0);
+            }
+        }
+    });
+    thread.join();
+}
+
+/// Runs a thread on node 0, then one on node 1, on one context with a provided buffer group.
+static void run_on_both_nodes(void) {
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(4096, &ctx) == 0); // Room for a chunk of records per node.
+    std::vector<char> buffers(BUFFERS * LENGTH);
+    REQUIRE(io_provide_buffers(ctx, GROUP, buffers.data(), LENGTH, BUFFERS) == 0);
+    run_on_node(ctx, fd, 0);
+    run_on_node(ctx, fd, 1);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
+
+// With placement, each node's thread takes records and buffers from its own node and reaps them
+// there, so nothing crosses.
+AIO_TEST(placement_keeps_each_thread_on_its_own_node) {
+    test_set_env("LIBAIO_WIN32_NUMA_NODES", "2");
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    REQUIRE(caps.numa_nodes == 2);
+    CHECK(caps.features & IO_CAP_NUMA_SIMULATED);
+    CHECK(caps.features & IO_CAP_NUMA_PLACEMENT);
+
+    run_on_both_nodes();
+    struct io_numa_counters counters;
+    REQUIRE(io_numa_read(&counters) == 0);
+    CHECK_EQ(counters.remote_requests, 0);
+    CHECK_EQ(counters.remote_completions, 0);
+    CHECK_EQ(counters.remote_buffers, 0);
+}
+
+// LIBAIO_WIN32_NUMA=0 keeps one free stack of records and one of buffers, so the second thread
+// takes what the first one left on its node, and every kind of access is counted as crossing.
+AIO_TEST(without_placement_threads_cross_nodes) {
+    test_set_env("LIBAIO_WIN32_NUMA_NODES", "2");
+    test_set_env("LIBAIO_WIN32_NUMA", "0");
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    REQUIRE(caps.numa_nodes == 2);
+    CHECK(!(caps.features & IO_CAP_NUMA_PLACEMENT));
+
+    run_on_both_nodes();
+    struct io_numa_counters counters;
+    REQUIRE(io_numa_read(&counters) == 0);
+    CHECK(counters.remote_requests > 0);
+    CHECK(counters.remote_completions > 0);
+    CHECK(counters.remote_buffers > 0);
+}
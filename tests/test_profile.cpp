@@ -0,0 +1,156 @@
+/**
+ * @file test_profile.cpp
+ * @brief The self-profiler: how many calls each phase counts for the requests a test submits and
+ * reaps, what io_profile_stop and a second io_profile_start do to the counters, and the table
+ * io_profile_format prints.
+ *
+ * io_getevents is called with min_nr equal to nr and exactly that many completions queued, so
+ * each call dequeues exactly nr packets and never waits for one more.
+ */
+#include "aio_test.h"
+
+#include <errno.h>
+#include <string.h>
+#include <vector>
+
+static const unsigned BATCHES = 4, BATCH = 8, SEGMENTS = 3;
+
+static unsigned long long calls(const struct io_profile& profile, int phase) {
+    return profile.phases[phase].calls;
+}
+
+/// Reaps exactly `count` events in one io_getevents call.
+static void reap_exactly(io_context_t ctx, long count) {
+    std::vector<struct io_event> events((size_t)count);
+    REQUIRE(io_getevents(ctx, count, count, events.data(), nullptr) == count);
+}
+
+// Each phase counts one call per io_submit or io_getevents call, per iocb, per packet or per
+// request, as its place in the engine implies: 32 single reads in 4 batches on IOCP, then a
+// vectored read of 3 segments, then a read on the thread pool.
+AIO_TEST(profile_counts_each_phase_per_request) {
+    struct io_profile profile;
+    CHECK_EQ(io_profile_read(&profile), -ENOENT);
+    int fd = test_open_file(true), sync_fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(64, &ctx) == 0);
+    REQUIRE(io_profile_start() == 0);
+
+    std::vector<char> buffer(4096);
+    struct iocb cbs[BATCH];
+    struct iocb* list[BATCH];
+    for (unsigned batch = 0; batch < BATCHES; ++batch) {
+        for (unsigned i = 0; i < BATCH; ++i) {
+            io_prep_pread(&cbs[i], fd, buffer.data(), 512, (long long)(batch * BATCH + i) * 512);
+            list[i] = &cbs[i];
+        }
+        REQUIRE(io_submit(ctx, BATCH, list) == (int)BATCH);
+        reap_exactly(ctx, BATCH);
+    }
+    REQUIRE(io_profile_read(&profile) == 0);
+    unsigned reads = BATCHES * BATCH;
+    CHECK_EQ(calls(profile, IO_PROFILE_SUBMIT), BATCHES);
+    CHECK_EQ(calls(profile, IO_PROFILE_FILE_LOOKUP), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_REQUEST_ALLOC), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_ISSUE), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_GETEVENTS), BATCHES);
+    CHECK_EQ(calls(profile, IO_PROFILE_DEQUEUE), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_COMPLETION), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_VECTORED), 0);
+    CHECK_EQ(calls(profile, IO_PROFILE_REQUEST_FREE), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_WORKER), 0);
+
+    // A vectored read is one lookup and one allocation, but a transfer, a packet and an
+    // aggregation per segment, and one free.
+    struct iovec vectors[SEGMENTS];
+    for (unsigned i = 0; i < SEGMENTS; ++i) {
+        vectors[i].iov_base = &buffer[i * 1024];
+        vectors[i].iov_len = 1024;
+    }
+    io_prep_preadv(&cbs[0], fd, vectors, SEGMENTS, 0);
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    reap_exactly(ctx, 1);
+    REQUIRE(io_profile_read(&profile) == 0);
+    CHECK_EQ(calls(profile, IO_PROFILE_SUBMIT), BATCHES + 1);
+    CHECK_EQ(calls(profile, IO_PROFILE_FILE_LOOKUP), reads + 1);
+    CHECK_EQ(calls(profile, IO_PROFILE_REQUEST_ALLOC), reads + 1);
+    CHECK_EQ(calls(profile, IO_PROFILE_ISSUE), reads + SEGMENTS);
+    CHECK_EQ(calls(profile, IO_PROFILE_GETEVENTS), BATCHES + 1);
+    CHECK_EQ(calls(profile, IO_PROFILE_DEQUEUE), reads + SEGMENTS);
+    CHECK_EQ(calls(profile, IO_PROFILE_COMPLETION), reads);
+    CHECK_EQ(calls(profile, IO_PROFILE_VECTORED), SEGMENTS);
+    CHECK_EQ(calls(profile, IO_PROFILE_REQUEST_FREE), reads + 1);
+
+    // A pooled read is issued by handing it to a worker, which times its own phase. The worker
+    // closes that phase after posting the packet, so it may still be open when the event arrives.
+    io_prep_pread(&cbs[0], sync_fd, buffer.data(), 512, 0);
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    reap_exactly(ctx, 1);
+    CHECK(test_wait_until(5000, [&] {
+        REQUIRE(io_profile_read(&profile) == 0);
+        return calls(profile, IO_PROFILE_WORKER) == 1;
+    }));
+    CHECK_EQ(calls(profile, IO_PROFILE_ISSUE), reads + SEGMENTS + 1);
+    CHECK_EQ(calls(profile, IO_PROFILE_COMPLETION), reads + 1);
+    CHECK_EQ(profile.threads, 2);
+    CHECK(profile.seconds > 0);
+    CHECK(profile.cycles_per_second > 0);
+    for (int phase = 0; phase < IO_PROFILE_PHASES; ++phase) {
+        CHECK(profile.phases[phase].name != nullptr);
+        if (profile.phases[phase].calls) CHECK(profile.phases[phase].cycles > 0);
+    }
+    CHECK(profile.overhead_cycles >= profile.pair_cycles);
+
+    // Stopped, the counters keep their values through more I/O; started again, they restart from zero.
+    REQUIRE(io_profile_stop() == 0);
+    struct io_profile stopped;
+    REQUIRE(io_profile_read(&stopped) == 0);
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    reap_exactly(ctx, 1);
+    REQUIRE(io_profile_read(&profile) == 0);
+    for (int phase = 0; phase < IO_PROFILE_PHASES; ++phase) CHECK_EQ(calls(profile, phase), calls(stopped, phase));
+    CHECK(profile.seconds == stopped.seconds);
+    REQUIRE(io_profile_start() == 0);
+    REQUIRE(io_profile_read(&profile) == 0);
+    for (int phase = 0; phase < IO_PROFILE_PHASES; ++phase) CHECK_EQ(calls(profile, phase), 0);
+    REQUIRE(io_profile_stop() == 0);
+
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+    test_close_file(sync_fd);
+}
+
+// The table names every phase and the profiler's own overhead; a short buffer gets a truncated,
+// terminated copy, and the return value is always the whole table's length.
+AIO_TEST(profile_format_prints_every_phase) {
+    char none[1];
+    CHECK_EQ(io_profile_format(none, sizeof(none)), -ENOENT);
+    int fd = test_open_file(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(8, &ctx) == 0);
+    REQUIRE(io_profile_start() == 0);
+    char buffer[512];
+    struct iocb cb;
+    struct iocb* list[] = { &cb };
+    io_prep_pread(&cb, fd, buffer, sizeof(buffer), 0);
+    REQUIRE(io_submit(ctx, 1, list) == 1);
+    reap_exactly(ctx, 1);
+    REQUIRE(io_profile_stop() == 0);
+
+    int length = io_profile_format(nullptr, 0);
+    REQUIRE(length > 0);
+    std::vector<char> table((size_t)length + 1);
+    CHECK_EQ(io_profile_format(table.data(), table.size()), length);
+    CHECK_EQ(strlen(table.data()), length);
+    struct io_profile profile;
+    REQUIRE(io_profile_read(&profile) == 0);
+    for (int phase = 0; phase < IO_PROFILE_PHASES; ++phase) CHECK(strstr(table.data(), profile.phases[phase].name) != nullptr);
+    CHECK(strstr(table.data(), "profiler (estimated)") != nullptr);
+
+    char short_table[32];
+    CHECK_EQ(io_profile_format(short_table, sizeof(short_table)), length);
+    CHECK_EQ(strlen(short_table), sizeof(short_table) - 1);
+    CHECK(strncmp(short_table, table.data(), sizeof(short_table) - 1) == 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
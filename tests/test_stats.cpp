@@ -0,0 +1,169 @@
+/**
+ * @file test_stats.cpp
+ * @brief The shared-memory stats segment, read the way a monitor reads it: through the mapping's
+ * name and the layout in libaio_stats.h, with the seqlock copy aio-top makes.
+ */
+#include "aio_test.h"
+#include "libaio_stats.h"
+
+#include <windows.h>
+
+#include <atomic>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/// Copies a slot, retrying while its owner changes; false if it never held still.
+template <typename Slot>
+static bool read_slot(const Slot* shared, Slot* copy) {
+    const volatile uint32_t* sequence = &shared->sequence;
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        uint32_t before = *sequence;
+        if (before & 1) continue;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        memcpy(copy, shared, sizeof(Slot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (*sequence == before) {
+            copy->sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Opens this process's segment read-only, as aio-top opens another's.
+static const aio_stats_header* open_segment(void) {
+    std::string name = AIO_STATS_NAME_PREFIX + std::to_string(GetCurrentProcessId());
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+    REQUIRE(mapping != NULL);
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    REQUIRE(view != NULL);
+    return static_cast<const aio_stats_header*>(view);
+}
+
+static const aio_stats_context* context_slots(const aio_stats_header* header) {
+    return reinterpret_cast<const aio_stats_context*>(header + 1);
+}
+
+static const aio_stats_file* file_slots(const aio_stats_header* header) {
+    return reinterpret_cast<const aio_stats_file*>(context_slots(header) + header->max_contexts);
+}
+
+/// The one context slot in use, or false if there is none or more than one.
+static bool only_context(const aio_stats_header* header, aio_stats_context* copy) {
+    int found = 0;
+    for (uint32_t i = 0; i < header->max_contexts; ++i) {
+        aio_stats_context slot;
+        REQUIRE(read_slot(&context_slots(header)[i], &slot));
+        if (slot.in_use && found++ == 0) *copy = slot;
+    }
+    return found == 1;
+}
+
+static uint64_t histogram_total(const aio_stats_context& slot, unsigned request_class) {
+    uint64_t total = 0;
+    for (unsigned bucket = 0; bucket < AIO_STATS_LATENCY_BUCKETS; ++bucket) total += slot.latency[request_class][bucket];
+    return total;
+}
+
+// A published segment carries a header a monitor can check, a context slot whose counters and
+// histograms add up to the I/O the test ran, a file slot with the file's requests and path, and
+// both slots go back to the free pool when their context is destroyed.
+AIO_TEST(stats_segment_counts_the_io_issued) {
+    REQUIRE(io_stats_publish() == 0);
+    CHECK_EQ(io_stats_publish(), 0);
+    const aio_stats_header* header = open_segment();
+    CHECK(memcmp(header->magic, AIO_STATS_MAGIC, sizeof(header->magic)) == 0);
+    CHECK_EQ(header->version, AIO_STATS_VERSION);
+    CHECK_EQ(header->process_id, GetCurrentProcessId());
+    CHECK_EQ(header->max_contexts, AIO_STATS_MAX_CONTEXTS);
+    CHECK_EQ(header->max_files, AIO_STATS_MAX_FILES);
+    CHECK_EQ(header->context_size, sizeof(aio_stats_context));
+    CHECK_EQ(header->file_size, sizeof(aio_stats_file));
+    aio_stats_context context;
+    CHECK(!only_context(header, &context));
+
+    int fd = test_open_file(true);
+    TestPipe pipe = test_open_pipe(true);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(64, &ctx) == 0);
+    REQUIRE(only_context(header, &context));
+    CHECK_EQ(context.submitted, 0);
+
+    // 8 reads of 4 KiB, 3 writes of 8 KiB and an fsync, then a pipe read that stays in flight.
+    std::vector<char> buffer(8192);
+    std::vector<struct iocb> cbs(12);
+    std::vector<struct iocb*> list;
+    for (unsigned i = 0; i < 8; ++i) io_prep_pread(&cbs[i], fd, buffer.data(), 4096, (long long)i * 4096);
+    for (unsigned i = 0; i < 3; ++i) io_prep_pwrite(&cbs[8 + i], fd, buffer.data(), 8192, 65536 + (long long)i * 8192);
+    io_prep_fsync(&cbs[11], fd);
+    for (struct iocb& cb : cbs) list.push_back(&cb);
+    REQUIRE(io_submit(ctx, (long)list.size(), list.data()) == (int)list.size());
+    std::vector<struct io_event> events(list.size());
+    long reaped = 0;
+    while (reaped < (long)events.size()) {
+        int got = io_getevents(ctx, 1, (long)events.size() - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    char byte;
+    struct iocb stuck;
+    struct iocb* stuck_list[] = { &stuck };
+    io_prep_pread(&stuck, pipe.fd, &byte, 1, 0);
+    REQUIRE(io_submit(ctx, 1, stuck_list) == 1);
+
+    REQUIRE(only_context(header, &context));
+    CHECK_EQ(context.submitted, 13);
+    CHECK_EQ(context.completed[AIO_STATS_READ], 8);
+    CHECK_EQ(context.completed[AIO_STATS_WRITE], 3);
+    CHECK_EQ(context.completed[AIO_STATS_SYNC], 1);
+    CHECK_EQ(context.bytes[AIO_STATS_READ], 8 * 4096);
+    CHECK_EQ(context.bytes[AIO_STATS_WRITE], 3 * 8192);
+    CHECK_EQ(context.bytes[AIO_STATS_SYNC], 0);
+    CHECK_EQ(context.errors, 0);
+    // In flight: submitted minus every class's completions.
+    CHECK_EQ(context.submitted - context.completed[AIO_STATS_READ] - context.completed[AIO_STATS_WRITE]
+        - context.completed[AIO_STATS_SYNC], 1);
+    for (unsigned c = 0; c < AIO_STATS_CLASSES; ++c) CHECK_EQ(histogram_total(context, c), context.completed[c]);
+
+    // The file and the pipe each have a slot of their context's.
+    int files_found = 0;
+    for (uint32_t i = 0; i < header->max_files; ++i) {
+        aio_stats_file file;
+        REQUIRE(read_slot(&file_slots(header)[i], &file));
+        if (!file.in_use) continue;
+        files_found++;
+        CHECK_EQ(file.context, context.context);
+        if (file.fd == pipe.fd) {
+            CHECK_EQ(file.ops[AIO_STATS_READ], 1);
+            continue;
+        }
+        CHECK_EQ(file.fd, fd);
+        CHECK_EQ(file.ops[AIO_STATS_READ], 8);
+        CHECK_EQ(file.ops[AIO_STATS_WRITE], 3);
+        CHECK_EQ(file.ops[AIO_STATS_SYNC], 1);
+        CHECK_EQ(file.bytes[AIO_STATS_READ], 8 * 4096);
+        CHECK_EQ(file.bytes[AIO_STATS_WRITE], 3 * 8192);
+        CHECK(strstr(file.path, "data") != nullptr);
+    }
+    CHECK_EQ(files_found, 2);
+    CHECK_EQ(header->untracked_contexts, 0);
+    CHECK_EQ(header->untracked_files, 0);
+
+    test_pipe_write(pipe, 1);
+    struct io_event event;
+    REQUIRE(io_getevents(ctx, 1, 1, &event, nullptr) == 1);
+    REQUIRE(only_context(header, &context));
+    CHECK_EQ(context.completed[AIO_STATS_READ], 9);
+    CHECK_EQ(context.bytes[AIO_STATS_READ], 8 * 4096 + 1);
+
+    CHECK_EQ(io_destroy(ctx), 0);
+    CHECK(!only_context(header, &context));
+    for (uint32_t i = 0; i < header->max_files; ++i) {
+        aio_stats_file file;
+        REQUIRE(read_slot(&file_slots(header)[i], &file));
+        CHECK(!file.in_use);
+    }
+    test_close_pipe(pipe);
+    test_close_file(fd);
+}
@@ -0,0 +1,240 @@
+/**
+ * @file test_teardown.cpp
+ * @brief io_destroy with requests in flight: what it cancels, and what happens to a context it
+ * gives up waiting for.
+ *
+ * Reads on a pipe stay in flight until the test writes to it. Overlapped ones can be cancelled;
+ * synchronous ones run on a worker that only the write releases, so they hold their context past
+ * LIBAIO_WIN32_DESTROY_TIMEOUT_MS. Port pooling is off, so that a destroyed context's port and
+ * workers show in the handle count until they are really gone.
+ */
+#include "aio_test.h"
+
+#include <chrono>
+#include <errno.h>
+#include <vector>
+
+static const unsigned SEGMENTS = 4;
+
+/// Gives every single-read iocb its one-byte buffer and the vectored one its segments.
+struct PendingReads {
+    std::vector<struct iocb> cbs;
+    std::vector<struct iocb*> list;
+    std::vector<char> bytes;
+    struct iovec iov[SEGMENTS];
+    char segments[SEGMENTS][16];
+    struct iocb vectored;
+
+    PendingReads(int fd, unsigned singles) : cbs(singles), bytes(singles) {
+        for (unsigned i = 0; i < singles; ++i) {
+            io_prep_pread(&cbs[i], fd, &bytes[i], 1, 0);
+            list.push_back(&cbs[i]);
+        }
+        for (unsigned i = 0; i < SEGMENTS; ++i) {
+            iov[i].iov_base = segments[i];
+            iov[i].iov_len = sizeof(segments[i]);
+        }
+        io_prep_preadv(&vectored, fd, iov, SEGMENTS, 0);
+        list.push_back(&vectored);
+    }
+};
+
+/// Heap blocks and handles of a process with no context, once the library's one-time state exists.
+struct Baseline {
+    long long blocks;
+    long long handles;
+
+    Baseline() : blocks(test_heap_blocks()), handles(test_handle_count()) {}
+
+    bool restored() const {
+        return test_heap_blocks() == blocks && test_handle_count() == handles;
+    }
+};
+
+static void quiet_teardown_env(const char* timeout_ms) {
+    test_set_env("LIBAIO_WIN32_CONTEXT_POOL", "0");
+    test_set_env("LIBAIO_WIN32_NUMA", "0"); // One slab list of SLAB_CHUNK records.
+    test_set_env("LIBAIO_WIN32_DESTROY_TIMEOUT_MS", timeout_ms);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(1, &ctx) == 0);
+    REQUIRE(io_destroy(ctx) == 0);
+}
+
+/// Checks that a context sees no event, as a context that reused a destroyed one's memory would.
+static void check_no_late_event(io_context_t ctx) {
+    struct io_event event;
+    struct timespec wait = { 0, 20 * 1000 * 1000 };
+    CHECK_EQ(io_getevents(ctx, 1, 1, &event, &wait), 0);
+}
+
+// More single reads than the slab holds, so the last ones come from the heap, and a vectored read:
+// io_destroy cancels all of them and returns without waiting for the timeout.
+AIO_TEST(destroy_cancels_slab_heap_and_vectored_requests) {
+    quiet_teardown_env("20000");
+    Baseline baseline;
+    {
+        // The port lives on while a file is bound to it, so count after closing the pipe.
+        TestPipe pipe = test_open_pipe(true);
+        PendingReads reads(pipe.fd, 1100);
+        io_context_t ctx = 0;
+        REQUIRE(io_setup(2048, &ctx) == 0);
+        REQUIRE(io_submit(ctx, (long)reads.list.size(), reads.list.data()) == (int)reads.list.size());
+        struct io_event event;
+        struct timespec now = { 0, 0 };
+        CHECK_EQ(io_getevents(ctx, 1, 1, &event, &now), 0);
+
+        std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+        CHECK_EQ(io_destroy(ctx), 0);
+        CHECK(std::chrono::steady_clock::now() - started < std::chrono::seconds(10));
+        test_close_pipe(pipe);
+    }
+    CHECK(baseline.restored());
+}
+
+/**
+ * @brief Reads once from each descriptor through a thin context. The shared engine, its workers and
+ * its entries for the descriptors live as long as the process, so tests count after this.
+ */
+static void warm_shared_engine(const std::vector<int>& fds, const std::vector<TestPipe>& pipes) {
+    io_context_t ctx = 0;
+    REQUIRE(io_setup_shared(8, &ctx) == 0);
+    std::vector<int> all(fds);
+    for (const TestPipe& pipe : pipes) {
+        test_pipe_write(pipe, 1);
+        all.push_back(pipe.fd);
+    }
+    for (int fd : all) {
+        char byte;
+        struct iocb cb;
+        io_prep_pread(&cb, fd, &byte, 1, 0);
+        struct iocb* list[] = { &cb };
+        struct io_event event;
+        REQUIRE(io_submit(ctx, 1, list) == 1);
+        REQUIRE(io_getevents(ctx, 1, 1, &event, nullptr) == 1);
+    }
+    REQUIRE(io_destroy(ctx) == 0);
+}
+
+/// Starts a read that only a write to `pipe` completes, and destroys its context before then.
+static void destroy_with_stuck_read(io_context_t ctx, const TestPipe& pipe, struct iocb* cb, char* byte) {
+    io_prep_pread(cb, pipe.fd, byte, 1, 0);
+    REQUIRE(io_submit(ctx, 1, &cb) == 1);
+    test_sleep_ms(50); // Until a worker runs the read: one still queued would just be dropped.
+    CHECK_EQ(io_destroy(ctx), -ETIMEDOUT);
+}
+
+/// Destroys a context whose read outlasts the timeout, and checks that the context is freed once
+/// the read completes and that the context set up after it never sees the read's event.
+static void check_timed_out_context(bool shared) {
+    quiet_teardown_env("100");
+    int fd = test_open_file(false);
+    TestPipe pipe = {};
+    if (shared) {
+        pipe = test_open_pipe(false);
+        warm_shared_engine({ fd }, { pipe });
+    }
+    Baseline baseline;
+    // An emulated port lives as long as a file bound to it, so a dedicated context's pipe is only
+    // opened after counting and is closed before checking.
+    if (!shared) pipe = test_open_pipe(false);
+
+    io_context_t ctx = 0;
+    REQUIRE((shared ? io_setup_shared(8, &ctx) : io_setup(8, &ctx)) == 0);
+    char byte = 0;
+    struct iocb read_cb;
+    destroy_with_stuck_read(ctx, pipe, &read_cb, &byte);
+
+    io_context_t next = 0;
+    REQUIRE((shared ? io_setup_shared(8, &next) : io_setup(8, &next)) == 0);
+    test_pipe_write(pipe, 1);
+    check_no_late_event(next);
+    char data = 0;
+    struct iocb data_cb;
+    io_prep_pread(&data_cb, fd, &data, 1, 0);
+    struct iocb* list[] = { &data_cb };
+    struct io_event event;
+    REQUIRE(io_submit(next, 1, list) == 1);
+    REQUIRE(io_getevents(next, 1, 1, &event, nullptr) == 1);
+    CHECK(event.obj == &data_cb);
+    CHECK_EQ(io_destroy(next), 0);
+    CHECK_EQ(byte, 'p');
+
+    if (!shared) test_close_pipe(pipe);
+    CHECK(test_wait_until(5000, [&] { return baseline.restored(); }));
+    if (shared) test_close_pipe(pipe);
+    test_close_file(fd);
+}
+
+AIO_TEST(timed_out_dedicated_context_is_freed_after_its_requests) {
+    check_timed_out_context(false);
+}
+
+AIO_TEST(timed_out_thin_context_is_freed_after_its_requests) {
+    check_timed_out_context(true);
+}
+
+// Contexts of both kinds destroyed with cancelled, completed and stuck requests, over and over:
+// every context and its memory are gone at the end and none of their events reached another.
+AIO_TEST_TIMEOUT(teardown_churn_leaks_nothing, 60000) {
+    // Enough core workers for every stuck read of the shared engine, which keeps the slots of
+    // elastic workers it started and retired; a read left queued would complete as cancelled.
+    static const unsigned ROUNDS = 200, STUCK_EVERY = 15;
+    test_set_env("LIBAIO_WIN32_WORKERS", "16");
+    // Long enough to cancel a round's 1,030 pipe reads on a busy machine; each stuck round waits it out.
+    quiet_teardown_env("250");
+    int fd = test_open_file(true);
+    int sync_fd = test_open_file(false);
+
+    // Thin contexts share one port, so their pipes are opened, and bound to it, before counting.
+    TestPipe shared_pipe = test_open_pipe(true);
+    std::vector<TestPipe> shared_stuck;
+    for (unsigned i = 0; i < ROUNDS / STUCK_EVERY; ++i) shared_stuck.push_back(test_open_pipe(false));
+    std::vector<TestPipe> warm_pipes(shared_stuck);
+    warm_pipes.push_back(shared_pipe);
+    warm_shared_engine({ fd, sync_fd }, warm_pipes);
+    std::vector<TestPipe> dedicated_stuck;
+    dedicated_stuck.reserve(ROUNDS / STUCK_EVERY + 1);
+    std::vector<char> stuck_bytes(ROUNDS / STUCK_EVERY + 1);
+    std::vector<struct iocb> stuck_cbs(ROUNDS / STUCK_EVERY + 1);
+    io_context_t watcher = 0;
+    REQUIRE(io_setup(8, &watcher) == 0);
+    Baseline baseline;
+
+    unsigned stuck = 0;
+    for (unsigned round = 0; round < ROUNDS; ++round) {
+        bool shared = round % 2 != 0;
+        TestPipe pipe = shared ? shared_pipe : test_open_pipe(true);
+        PendingReads reads(pipe.fd, round % 3 == 0 ? 1030 : 8);
+        char data[512];
+        struct iocb done_cb;
+        io_prep_pread(&done_cb, fd, data, sizeof(data), (long long)round * sizeof(data));
+        reads.list.push_back(&done_cb);
+
+        io_context_t ctx = 0;
+        REQUIRE((shared ? io_setup_shared(2048, &ctx) : io_setup(2048, &ctx)) == 0);
+        REQUIRE(io_submit(ctx, (long)reads.list.size(), reads.list.data()) == (int)reads.list.size());
+        if (round % STUCK_EVERY == 3) {
+            if (!shared) dedicated_stuck.push_back(test_open_pipe(false));
+            const TestPipe& stuck_pipe = shared ? shared_stuck[stuck - dedicated_stuck.size()] : dedicated_stuck.back();
+            destroy_with_stuck_read(ctx, stuck_pipe, &stuck_cbs[stuck], &stuck_bytes[stuck]);
+            stuck++;
+        }
+        else {
+            CHECK_EQ(io_destroy(ctx), 0);
+        }
+        if (!shared) test_close_pipe(pipe);
+    }
+
+    for (const TestPipe& pipe : shared_stuck) test_pipe_write(pipe, 1);
+    for (const TestPipe& pipe : dedicated_stuck) test_pipe_write(pipe, 1);
+    check_no_late_event(watcher);
+    for (const TestPipe& pipe : dedicated_stuck) test_close_pipe(pipe);
+    CHECK(test_wait_until(10000, [&] { return baseline.restored(); }));
+    for (unsigned i = 0; i < stuck; ++i) CHECK_EQ(stuck_bytes[i], 'p');
+
+    CHECK_EQ(io_destroy(watcher), 0);
+    for (const TestPipe& pipe : shared_stuck) test_close_pipe(pipe);
+    test_close_pipe(shared_pipe);
+    test_close_file(sync_fd);
+    test_close_file(fd);
+}
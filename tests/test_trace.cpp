@@ -0,0 +1,135 @@
+/**
+ * @file test_trace.cpp
+ * @brief A trace read back through libaio_trace.h: its header, the FILE, SUBMIT and COMPLETE
+ * records of the I/O the test ran, and the END record.
+ */
+#include "aio_test.h"
+#include "libaio_trace.h"
+
+#include <windows.h>
+
+#include <errno.h>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/// What a traced iocb should have been recorded with.
+struct Expected {
+    uint8_t opcode;
+    uint16_t segments;
+    int64_t offset;
+    uint64_t length;
+};
+
+// Every iocb the test submits has one SUBMIT and one later COMPLETE record with its opcode,
+// offset and length; the file has one FILE record with its path, ahead of them all; and the trace
+// ends with an END record that reports nothing dropped.
+AIO_TEST(trace_records_the_io_issued) {
+    std::string path = test_temp_path("trace");
+    int fd = test_open_file(true);
+    REQUIRE(io_trace_start(path.c_str()) == 0);
+    CHECK_EQ(io_trace_start(path.c_str()), -EBUSY);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(16, &ctx) == 0);
+
+    // 4 reads, 2 writes, a two-segment vectored read and an fsync.
+    std::vector<char> buffer(8192);
+    struct iovec vectors[2] = { { &buffer[0], 1024 }, { &buffer[1024], 3072 } };
+    std::vector<struct iocb> cbs(8);
+    std::map<uint64_t, Expected> expected;
+    for (unsigned i = 0; i < 4; ++i) {
+        io_prep_pread(&cbs[i], fd, buffer.data(), 4096, (long long)i * 4096);
+        expected[(uintptr_t)&cbs[i]] = Expected{ AIO_TRACE_OP_PREAD, 0, (int64_t)i * 4096, 4096 };
+    }
+    for (unsigned i = 0; i < 2; ++i) {
+        io_prep_pwrite(&cbs[4 + i], fd, buffer.data(), 8192, 131072 + (long long)i * 8192);
+        expected[(uintptr_t)&cbs[4 + i]] = Expected{ AIO_TRACE_OP_PWRITE, 0, 131072 + (int64_t)i * 8192, 8192 };
+    }
+    io_prep_preadv(&cbs[6], fd, vectors, 2, 65536);
+    expected[(uintptr_t)&cbs[6]] = Expected{ AIO_TRACE_OP_PREADV, 2, 65536, 4096 };
+    io_prep_fsync(&cbs[7], fd);
+    expected[(uintptr_t)&cbs[7]] = Expected{ AIO_TRACE_OP_FSYNC, 0, 0, 0 };
+    std::vector<struct iocb*> list;
+    for (struct iocb& cb : cbs) list.push_back(&cb);
+    REQUIRE(io_submit(ctx, (long)list.size(), list.data()) == (int)list.size());
+    std::vector<struct io_event> events(list.size());
+    long reaped = 0;
+    while (reaped < (long)events.size()) {
+        int got = io_getevents(ctx, 1, (long)events.size() - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    CHECK_EQ(io_trace_stop(), 0);
+    CHECK_EQ(io_trace_stop(), 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+
+    FILE* trace = fopen(path.c_str(), "rb");
+    REQUIRE(trace != nullptr);
+    struct aio_trace_header header;
+    REQUIRE(fread(&header, sizeof(header), 1, trace) == 1);
+    CHECK(memcmp(header.magic, AIO_TRACE_MAGIC, sizeof(header.magic)) == 0);
+    CHECK_EQ(header.version, AIO_TRACE_VERSION);
+    CHECK_EQ(header.record_size, sizeof(aio_trace_record));
+    CHECK(header.ticks_per_second > 0);
+
+    std::vector<aio_trace_record> records;
+    struct aio_trace_record record;
+    int files = 0;
+    int64_t file_ticks = 0;
+    while (fread(&record, sizeof(record), 1, trace) == 1) {
+        if (record.kind != AIO_TRACE_FILE) {
+            records.push_back(record);
+            continue;
+        }
+        files++;
+        file_ticks = record.ticks;
+        CHECK_EQ(record.fd, fd);
+        // The path follows, NUL-padded to whole records.
+        size_t padded = (size_t)(record.length + sizeof(record) - 1) / sizeof(record) * sizeof(record);
+        std::vector<char> name(padded + 1, '\0');
+        REQUIRE(fread(name.data(), 1, padded, trace) == padded);
+        CHECK_EQ(strlen(name.data()), record.length);
+        CHECK(strstr(name.data(), "data") != nullptr);
+    }
+    fclose(trace);
+    DeleteFileA(path.c_str());
+    CHECK_EQ(files, 1);
+    REQUIRE(!records.empty());
+    CHECK_EQ(records.back().kind, AIO_TRACE_END);
+    CHECK_EQ(records.back().length, 0);
+    records.pop_back();
+
+    std::map<uint64_t, int64_t> submitted_at;
+    std::map<uint64_t, int> completions;
+    uint32_t context = records.front().context;
+    for (const aio_trace_record& traced : records) {
+        REQUIRE(expected.count(traced.id));
+        const Expected& want = expected[traced.id];
+        CHECK_EQ(traced.fd, fd);
+        CHECK_EQ(traced.context, context);
+        CHECK_EQ(traced.opcode, want.opcode);
+        CHECK_EQ(traced.offset, want.offset);
+        CHECK_EQ(traced.length, want.length);
+        if (traced.kind == AIO_TRACE_SUBMIT) {
+            CHECK_EQ(traced.segments, want.segments);
+            CHECK(!submitted_at.count(traced.id));
+            CHECK(traced.ticks >= file_ticks);
+            submitted_at[traced.id] = traced.ticks;
+        }
+        else {
+            CHECK_EQ(traced.kind, AIO_TRACE_COMPLETE);
+            CHECK_EQ(traced.error, 0);
+            completions[traced.id]++;
+        }
+    }
+    CHECK_EQ(submitted_at.size(), expected.size());
+    CHECK_EQ(completions.size(), expected.size());
+    for (const aio_trace_record& traced : records) {
+        if (traced.kind != AIO_TRACE_COMPLETE) continue;
+        CHECK_EQ(completions[traced.id], 1);
+        CHECK(submitted_at.count(traced.id) && traced.ticks >= submitted_at[traced.id]);
+    }
+    test_close_file(fd);
+}
@@ -0,0 +1,288 @@
+/**
+ * @file test_worker_pool.cpp
+ * @brief The thread-pool engine's workers: the queues they take requests from and in what order,
+ * the per-volume limit that keeps a stalled volume from occupying all of them, and how their
+ * number follows demand.
+ *
+ * A synchronous pipe read holds its worker until the test writes to the pipe, which makes the
+ * pipes' volume (serial 0) one that has stalled. Test files live on another volume.
+ */
+#include "aio_test.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const unsigned READ_BYTES = 512;
+
+/// Has several threads queue reads on one context at once, and checks that every one runs.
+static void run_from_several_submitters(void) {
+    static const unsigned SUBMITTERS = 4, READS = 512, BATCH = 16;
+    int fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(SUBMITTERS * READS, &ctx) == 0);
+    std::vector<unsigned char> data((size_t)SUBMITTERS * READS * READ_BYTES);
+    std::vector<struct iocb> cbs(SUBMITTERS * READS);
+    std::vector<std::thread> submitters;
+    for (unsigned t = 0; t < SUBMITTERS; ++t) {
+        submitters.emplace_back([&, t] {
+            for (unsigned done = 0; done < READS; done += BATCH) {
+                struct iocb* list[BATCH];
+                for (unsigned i = 0; i < BATCH; ++i) {
+                    size_t n = (size_t)t * READS + done + i;
+                    io_prep_pread(&cbs[n], fd, &data[n * READ_BYTES], READ_BYTES, (long long)(n * READ_BYTES % TEST_FILE_BYTES));
+                    list[i] = &cbs[n];
+                }
+                REQUIRE(io_submit(ctx, BATCH, list) == (int)BATCH);
+            }
+        });
+    }
+
+    std::vector<struct io_event> events(SUBMITTERS * READS);
+    long reaped = 0;
+    while (reaped < (long)events.size()) {
+        int got = io_getevents(ctx, 1, (long)events.size() - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    for (std::thread& submitter : submitters) submitter.join();
+    for (const struct io_event& event : events) {
+        CHECK_EQ(event.res, READ_BYTES);
+        const struct iocb* cb = event.obj;
+        CHECK_EQ(*(const unsigned char*)cb->u.c.buf, test_file_byte(cb->u.c.offset));
+        CHECK_EQ(((const unsigned char*)cb->u.c.buf)[READ_BYTES - 1], test_file_byte(cb->u.c.offset + READ_BYTES - 1));
+    }
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+}
+
+// LIBAIO_WIN32_POOL_QUEUE=locked puts every worker on one FIFO, which must still run every request.
+AIO_TEST(locked_pool_queue_runs_every_request) {
+    test_set_env("LIBAIO_WIN32_POOL_QUEUE", "locked");
+    test_set_env("LIBAIO_WIN32_WORKERS", "4");
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    CHECK(caps.features & IO_CAP_LOCKED_POOL_QUEUE);
+    run_from_several_submitters();
+}
+
+// The work-stealing deques must run every request too, whichever worker's inbox it went to and
+// whichever worker took it.
+AIO_TEST(work_stealing_pool_runs_every_request) {
+    test_set_env("LIBAIO_WIN32_WORKERS", "4");
+    struct io_backend_caps caps;
+    REQUIRE(io_query_backends(&caps) == 0);
+    CHECK(!(caps.features & IO_CAP_LOCKED_POOL_QUEUE));
+    run_from_several_submitters();
+}
+
+// One worker runs its requests in the order they were submitted. It is held in a pipe read while
+// more reads queue than its deque holds, so its first drain hands the rest back to its inbox,
+// and a second batch arrives while it works through the first.
+AIO_TEST(worker_runs_its_requests_oldest_first) {
+    static const unsigned FIRST = 600, SECOND = 100;
+    test_set_env("LIBAIO_WIN32_WORKERS", "1");
+    test_set_env("LIBAIO_WIN32_MAX_WORKERS", "1");
+    TestPipe pipe = test_open_pipe(false);
+    int fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(1 + FIRST + SECOND, &ctx) == 0);
+    char byte;
+    struct iocb stuck;
+    struct iocb* stuck_list[] = { &stuck };
+    io_prep_pread(&stuck, pipe.fd, &byte, 1, 0);
+    REQUIRE(io_submit(ctx, 1, stuck_list) == 1);
+    test_sleep_ms(50); // Until the worker blocks in the pipe's read.
+
+    std::vector<unsigned char> data(READ_BYTES);
+    std::vector<struct iocb> cbs(FIRST + SECOND);
+    std::vector<struct iocb*> list(FIRST + SECOND);
+    for (unsigned i = 0; i < FIRST + SECOND; ++i) {
+        io_prep_pread(&cbs[i], fd, data.data(), READ_BYTES, (long long)(i * READ_BYTES % TEST_FILE_BYTES));
+        list[i] = &cbs[i];
+    }
+    REQUIRE(io_submit(ctx, FIRST, list.data()) == (int)FIRST);
+    test_pipe_write(pipe, 1);
+    REQUIRE(io_submit(ctx, SECOND, &list[FIRST]) == (int)SECOND);
+
+    std::vector<struct io_event> events(1 + FIRST + SECOND);
+    long reaped = 0;
+    while (reaped < (long)events.size()) {
+        int got = io_getevents(ctx, 1, (long)events.size() - reaped, &events[reaped], nullptr);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    CHECK(events[0].obj == &stuck);
+    unsigned out_of_order = 0;
+    for (unsigned i = 0; i < FIRST + SECOND; ++i) {
+        if (events[1 + i].obj != &cbs[i]) out_of_order++;
+        CHECK_EQ(events[1 + i].res, READ_BYTES);
+    }
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+    test_close_pipe(pipe);
+}
+
+// Two submitting threads feed the two workers' inboxes. With one worker held in a pipe read, the
+// other takes the batches addressed to it, from its inbox or its deque, while it is still blocked.
+AIO_TEST(idle_worker_takes_a_blocked_workers_requests) {
+    static const unsigned READS = 64;
+    test_set_env("LIBAIO_WIN32_WORKERS", "2");
+    test_set_env("LIBAIO_WIN32_MAX_WORKERS", "2");
+    test_set_env("LIBAIO_WIN32_DEVICE_WORKERS", "2");
+    test_set_env("LIBAIO_WIN32_NUMA", "0"); // Submitter threads address workers in turn.
+    TestPipe pipe = test_open_pipe(false);
+    int fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(1 + 2 * READS, &ctx) == 0);
+    char byte;
+    struct iocb stuck;
+    struct iocb* stuck_list[] = { &stuck };
+    io_prep_pread(&stuck, pipe.fd, &byte, 1, 0);
+    REQUIRE(io_submit(ctx, 1, stuck_list) == 1);
+    test_sleep_ms(50); // Until a worker blocks in the pipe's read.
+
+    std::vector<unsigned char> data((size_t)2 * READS * READ_BYTES);
+    std::vector<struct iocb> cbs(2 * READS);
+    std::vector<struct iocb*> list(2 * READS);
+    for (unsigned i = 0; i < 2 * READS; ++i) {
+        io_prep_pread(&cbs[i], fd, &data[(size_t)i * READ_BYTES], READ_BYTES, (long long)i * READ_BYTES);
+        list[i] = &cbs[i];
+    }
+    // This thread addresses one worker and a new one the other, so one of the halves goes to the blocked worker.
+    REQUIRE(io_submit(ctx, READS, list.data()) == (int)READS);
+    std::thread other([&] { REQUIRE(io_submit(ctx, READS, &list[READS]) == (int)READS); });
+    other.join();
+
+    std::vector<struct io_event> events(2 * READS);
+    struct timespec wait = { 5, 0 };
+    long reaped = 0;
+    while (reaped < (long)events.size()) {
+        int got = io_getevents(ctx, 1, (long)events.size() - reaped, &events[reaped], &wait);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    for (const struct io_event& event : events) {
+        CHECK(event.obj != &stuck);
+        CHECK_EQ(event.res, READ_BYTES);
+        CHECK_EQ(*(const unsigned char*)event.obj->u.c.buf, test_file_byte(event.obj->u.c.offset));
+    }
+    test_pipe_write(pipe, 1);
+    struct io_event last;
+    REQUIRE(io_getevents(ctx, 1, 1, &last, &wait) == 1);
+    CHECK(last.obj == &stuck);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+    test_close_pipe(pipe);
+}
+
+// Reads on a stalled volume occupy at most LIBAIO_WIN32_DEVICE_WORKERS workers; the rest wait on
+// the volume's overflow list, and reads of another volume run on the workers left free.
+AIO_TEST(stalled_volume_leaves_workers_for_others) {
+    static const unsigned STALLED = 8, READS = 64;
+    test_set_env("LIBAIO_WIN32_WORKERS", "4");
+    test_set_env("LIBAIO_WIN32_MAX_WORKERS", "4");
+    test_set_env("LIBAIO_WIN32_DEVICE_WORKERS", "2");
+    TestPipe pipe = test_open_pipe(false);
+    int fd = test_open_file(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(STALLED + READS, &ctx) == 0);
+
+    char stalled_bytes[STALLED];
+    struct iocb stalled_cbs[STALLED];
+    struct iocb* stalled_list[STALLED];
+    for (unsigned i = 0; i < STALLED; ++i) {
+        io_prep_pread(&stalled_cbs[i], pipe.fd, &stalled_bytes[i], 1, 0);
+        stalled_list[i] = &stalled_cbs[i];
+    }
+    REQUIRE(io_submit(ctx, STALLED, stalled_list) == (int)STALLED);
+    test_sleep_ms(50); // Until two workers block in the pipe's reads.
+
+    std::vector<unsigned char> data((size_t)READS * READ_BYTES);
+    std::vector<struct iocb> cbs(READS);
+    std::vector<struct iocb*> list(READS);
+    for (unsigned i = 0; i < READS; ++i) {
+        io_prep_pread(&cbs[i], fd, &data[(size_t)i * READ_BYTES], READ_BYTES, (long long)i * READ_BYTES);
+        list[i] = &cbs[i];
+    }
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    REQUIRE(io_submit(ctx, READS, list.data()) == (int)READS);
+    std::vector<struct io_event> events(STALLED + READS);
+    struct timespec wait = { 5, 0 };
+    long reaped = 0;
+    while (reaped < (long)READS) {
+        int got = io_getevents(ctx, 1, READS - reaped, &events[reaped], &wait);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    CHECK(std::chrono::steady_clock::now() - started < std::chrono::seconds(1));
+    for (long i = 0; i < reaped; ++i) {
+        CHECK(events[i].obj->aio_fildes == fd);
+        CHECK_EQ(events[i].res, READ_BYTES);
+    }
+    struct timespec now = { 0, 0 };
+    CHECK_EQ(io_getevents(ctx, 1, STALLED, events.data(), &now), 0);
+
+    test_pipe_write(pipe, STALLED);
+    reaped = 0;
+    while (reaped < (long)STALLED) {
+        int got = io_getevents(ctx, 1, STALLED - reaped, &events[reaped], &wait);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    for (unsigned i = 0; i < STALLED; ++i) CHECK_EQ(events[i].res, 1);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_file(fd);
+    test_close_pipe(pipe);
+}
+
+// A burst that blocks every worker grows the pool one worker per submission, after the grow delay,
+// up to LIBAIO_WIN32_MAX_WORKERS and no further; once it is over, the extra workers exit one per
+// idle period, down to the core workers.
+AIO_TEST(pool_grows_under_a_burst_and_shrinks_after_it) {
+    static const unsigned CORE = 2, MAX = 6, BURST = 16;
+    test_set_env("LIBAIO_WIN32_WORKERS", "2");
+    test_set_env("LIBAIO_WIN32_MAX_WORKERS", "6");
+    test_set_env("LIBAIO_WIN32_DEVICE_WORKERS", "6");
+    test_set_env("LIBAIO_WIN32_GROW_AFTER_US", "1000");
+    test_set_env("LIBAIO_WIN32_SHRINK_AFTER_MS", "100");
+    TestPipe pipe = test_open_pipe(false);
+    io_context_t ctx = 0;
+    REQUIRE(io_setup(BURST, &ctx) == 0);
+
+    char bytes[BURST];
+    struct iocb cbs[BURST];
+    long most = 0;
+    for (unsigned i = 0; i < BURST; ++i) {
+        io_prep_pread(&cbs[i], pipe.fd, &bytes[i], 1, 0);
+        struct iocb* list[] = { &cbs[i] };
+        REQUIRE(io_submit(ctx, 1, list) == 1);
+        if (i == 0) CHECK_EQ(test_pool_live_workers(ctx), CORE);
+        test_sleep_ms(5);
+        long live = test_pool_live_workers(ctx);
+        CHECK(live <= (long)MAX);
+        if (live > most) most = live;
+    }
+    CHECK_EQ(most, MAX);
+
+    test_pipe_write(pipe, BURST);
+    struct io_event events[BURST];
+    struct timespec wait = { 5, 0 };
+    long reaped = 0;
+    while (reaped < (long)BURST) {
+        int got = io_getevents(ctx, 1, BURST - reaped, &events[reaped], &wait);
+        REQUIRE(got > 0);
+        reaped += got;
+    }
+    for (const struct io_event& event : events) CHECK_EQ(event.res, 1);
+
+    // One worker every 100 ms at the most, so not all at once.
+    test_sleep_ms(150);
+    CHECK(test_pool_live_workers(ctx) > (long)CORE);
+    CHECK(test_wait_until(5000, [&] { return test_pool_live_workers(ctx) == (long)CORE; }));
+    test_sleep_ms(300);
+    CHECK_EQ(test_pool_live_workers(ctx), CORE);
+    CHECK_EQ(io_destroy(ctx), 0);
+    test_close_pipe(pipe);
+}
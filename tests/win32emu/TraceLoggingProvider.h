@@ -0,0 +1,42 @@
+/**
+ * @file TraceLoggingProvider.h
+ * @brief TraceLogging for Linux builds against win32emu.cpp: no session ever enables the provider.
+ *
+ * The arguments of TraceLoggingWrite are still type-checked, so an event that would not compile on
+ * Windows does not compile here either.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef const struct EmulatedTraceLoggingProvider* TraceLoggingHProvider;
+struct EmulatedTraceLoggingProvider {
+    int unused;
+};
+
+#define WINEVENT_LEVEL_INFO 4
+#define WINEVENT_LEVEL_VERBOSE 5
+
+#define TRACELOGGING_DECLARE_PROVIDER(handle) extern TraceLoggingHProvider const handle
+#define TRACELOGGING_DEFINE_PROVIDER(handle, name, guid) \
+    static const EmulatedTraceLoggingProvider handle##_storage = { 0 }; \
+    TraceLoggingHProvider const handle = &handle##_storage
+#define TraceLoggingRegister(handle) ((void)(handle), 0)
+#define TraceLoggingUnregister(handle) ((void)(handle))
+#define TraceLoggingProviderEnabled(handle, level, keyword) ((void)(handle), (void)(level), (void)(keyword), false)
+
+#define TraceLoggingLevel(level) (void)(level)
+#define TraceLoggingOpcode(opcode) (void)(opcode)
+#define TraceLoggingKeyword(keyword) (void)(keyword)
+#define TraceLoggingUInt32(value, name) (void)(uint32_t)(value)
+#define TraceLoggingInt32(value, name) (void)(int32_t)(value)
+#define TraceLoggingUInt64(value, name) (void)(uint64_t)(value)
+#define TraceLoggingInt64(value, name) (void)(int64_t)(value)
+#define TraceLoggingWrite(handle, name, ...) \
+    do { \
+        if (false) { \
+            (void)(handle); \
+            (void)(__VA_ARGS__); \
+        } \
+    } while (0)
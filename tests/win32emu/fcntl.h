@@ -0,0 +1,12 @@
+/**
+ * @file fcntl.h
+ * @brief The CRT's open flags, for Linux builds against win32emu.cpp.
+ *
+ * It stands in for the system's fcntl.h, whose struct iovec would clash with libaio_win32.h's.
+ */
+
+#pragma once
+
+#define _O_RDONLY 0x0000
+#define _O_WRONLY 0x0001
+#define _O_RDWR 0x0002
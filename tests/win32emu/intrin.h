@@ -0,0 +1,8 @@
+/**
+ * @file intrin.h
+ * @brief __rdtsc for Linux builds against win32emu.cpp.
+ */
+
+#pragma once
+
+#include <x86intrin.h>
@@ -0,0 +1,21 @@
+/**
+ * @file io.h
+ * @brief The CRT descriptor calls libaio-win32 and its tools use, for Linux builds against win32emu.cpp.
+ *
+ * Descriptors are the emulation's own: _open_osfhandle hands out a Linux descriptor that stands for
+ * the handle, so they never collide with descriptors the process opened itself.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+extern "C" {
+intptr_t _get_osfhandle(int fd);
+int _open_osfhandle(intptr_t handle, int flags);
+int _close(int fd);
+long long _filelengthi64(int fd);
+void* _aligned_malloc(size_t size, size_t alignment);
+void _aligned_free(void* block);
+}
@@ -0,0 +1,1242 @@
+/**
+ * @file win32emu.cpp
+ * @brief An emulation on Linux of the Win32 calls libaio-win32, its tests and aio-bench make.
+ *
+ * It lets the library's own code run, unchanged, under the tests and under aio-bench on a Linux
+ * machine. It is not a model of Windows' performance: figures measured with it compare builds and
+ * options of the library against each other, never against Windows.
+ *
+ * What it models, because the library depends on it:
+ * - Handles are objects; GetProcessHandleCount counts those still open.
+ * - A completion port queues packets. A file handle can be associated with one port, once. Packets
+ *   for a closed port are dropped, and waiters on it fail with ERROR_ABANDONED_WAIT_0.
+ * - Overlapped I/O on a disk file runs at once and queues its completion. On a named pipe, a read
+ *   stays pending until the other end writes, CancelIoEx aborts it, or either end is closed, so
+ *   tests can hold requests in flight for as long as they like. A transfer the handle was not
+ *   opened for fails at once with ERROR_ACCESS_DENIED, as on Windows.
+ * - Synchronous handles block the caller, as they block a pool worker on Windows.
+ * - NtQueryInformationFile reports a handle's synchronous and no-buffering modes, and
+ *   GetFileInformationByHandle reports the volume (st_dev) of disk files and fails for pipes.
+ * - The machine has 4 processors in one group, 0-1 on NUMA node 0 and 2-3 on node 1. Threads that
+ *   never set an affinity are spread over them round-robin.
+ * - Large pages are 2 MiB transparent huge pages. WIN32EMU_LARGE_PAGES_FAIL makes every large-page
+ *   allocation fail, and WIN32EMU_NO_LOCK_PRIVILEGE makes the process lack the privilege they need.
+ * - Named file mappings are POSIX shared memory, which a process unlinks as it exits, like the
+ *   section Windows destroys with its last handle.
+ * - No ETW session is ever listening.
+ */
+
+#include "windows.h"
+#include "io.h"
+#include "psapi.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static thread_local DWORD t_last_error = ERROR_SUCCESS;
+
+extern "C" DWORD WINAPI GetLastError(void) {
+    return t_last_error;
+}
+
+extern "C" void WINAPI SetLastError(DWORD error) {
+    t_last_error = error;
+}
+
+/// Sets the thread's last error and returns FALSE, the shape of most failing Win32 calls.
+static BOOL fail(DWORD error) {
+    t_last_error = error;
+    return FALSE;
+}
+
+/// Waits on `ready` until `done()` or `timeout_ms` passes. False on timeout.
+template <class Lock, class Predicate>
+static bool wait_for(std::condition_variable& ready, Lock& lock, DWORD timeout_ms, Predicate done) {
+    if (timeout_ms == INFINITE) {
+        ready.wait(lock, done);
+        return true;
+    }
+    return ready.wait_for(lock, std::chrono::milliseconds(timeout_ms), done);
+}
+
+// --- Handles ---
+
+enum ObjectKind { OBJECT_PORT, OBJECT_FILE, OBJECT_EVENT, OBJECT_THREAD, OBJECT_MAPPING, OBJECT_TOKEN };
+
+/// Every handle the emulation returns points at one of these.
+struct Object {
+    ObjectKind kind;
+    explicit Object(ObjectKind object_kind);
+    virtual ~Object();
+};
+
+static std::atomic<long> g_open_handles(0);
+
+Object::Object(ObjectKind object_kind) : kind(object_kind) {
+    g_open_handles.fetch_add(1);
+}
+
+Object::~Object() {
+    g_open_handles.fetch_sub(1);
+}
+
+static const HANDLE CURRENT_PROCESS = (HANDLE)(LONG_PTR)-1;
+static const HANDLE CURRENT_THREAD = (HANDLE)(LONG_PTR)-2;
+
+extern "C" BOOL WINAPI GetProcessHandleCount(HANDLE, LPDWORD count) {
+    *count = (DWORD)g_open_handles.load();
+    return TRUE;
+}
+
+// --- Completion Ports ---
+
+struct Packet {
+    DWORD bytes;
+    ULONG_PTR key;
+    LPOVERLAPPED overlapped;
+    DWORD error;                ///< Reported as the dequeue's failure, as for a failed overlapped transfer.
+};
+
+/**
+ * @brief A completion port. It lives while its handle is open or a file is associated with it,
+ * or a thread is waiting on it.
+ */
+struct Port : Object {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<Packet> packets;
+    bool closed = false;
+    int references = 1;
+
+    Port() : Object(OBJECT_PORT) {
+    }
+};
+
+/// Drops one reference to `port`, which is locked by `held`, and frees it with the last.
+static void port_release(Port* port, std::unique_lock<std::mutex>& held) {
+    bool last = --port->references == 0;
+    held.unlock();
+    if (last) delete port;
+}
+
+static void port_post(Port* port, const Packet& packet) {
+    std::lock_guard<std::mutex> guard(port->lock);
+    if (port->closed) return;
+    port->packets.push_back(packet);
+    port->ready.notify_one();
+}
+
+extern "C" BOOL WINAPI PostQueuedCompletionStatus(HANDLE port, DWORD bytes, ULONG_PTR key, LPOVERLAPPED overlapped) {
+    port_post(static_cast<Port*>(port), Packet{ bytes, key, overlapped, ERROR_SUCCESS });
+    return TRUE;
+}
+
+/// Waits up to `timeout_ms` for packets and moves up to `count` of them out. Returns the number moved.
+static ULONG port_dequeue(Port* port, Packet* out, ULONG count, DWORD timeout_ms, DWORD* error) {
+    std::unique_lock<std::mutex> held(port->lock);
+    port->references++;
+    bool ready = wait_for(port->ready, held, timeout_ms, [&] { return port->closed || !port->packets.empty(); });
+    ULONG moved = 0;
+    if (port->closed) {
+        *error = ERROR_ABANDONED_WAIT_0;
+    }
+    else if (!ready) {
+        *error = WAIT_TIMEOUT;
+    }
+    else {
+        while (moved < count && !port->packets.empty()) {
+            out[moved++] = port->packets.front();
+            port->packets.pop_front();
+        }
+    }
+    port_release(port, held);
+    return moved;
+}
+
+extern "C" BOOL WINAPI GetQueuedCompletionStatus(HANDLE port, LPDWORD bytes, PULONG_PTR key, LPOVERLAPPED* overlapped, DWORD timeout_ms) {
+    Packet packet;
+    DWORD error = ERROR_SUCCESS;
+    if (port_dequeue(static_cast<Port*>(port), &packet, 1, timeout_ms, &error) == 0) {
+        *overlapped = NULL;
+        return fail(error);
+    }
+    *bytes = packet.bytes;
+    *key = packet.key;
+    *overlapped = packet.overlapped;
+    return packet.error == ERROR_SUCCESS ? TRUE : fail(packet.error);
+}
+
+extern "C" BOOL WINAPI GetQueuedCompletionStatusEx(HANDLE port, LPOVERLAPPED_ENTRY entries, ULONG count, ULONG* removed, DWORD timeout_ms, BOOL) {
+    Packet packets[64];
+    DWORD error = ERROR_SUCCESS;
+    ULONG moved = port_dequeue(static_cast<Port*>(port), packets, std::min<ULONG>(count, 64), timeout_ms, &error);
+    for (ULONG i = 0; i < moved; ++i) {
+        entries[i].lpCompletionKey = packets[i].key;
+        entries[i].lpOverlapped = packets[i].overlapped;
+        entries[i].Internal = packets[i].error;
+        entries[i].dwNumberOfBytesTransferred = packets[i].bytes;
+    }
+    *removed = moved;
+    return moved ? TRUE : fail(error);
+}
+
+// --- Files and Pipes ---
+
+struct Pipe;
+
+/**
+ * @brief A disk file or one end of a named pipe.
+ *
+ * Every file holds a Linux descriptor: the file itself, or /dev/null for a pipe end. The CRT
+ * descriptor _open_osfhandle returns for it is that descriptor.
+ */
+struct File : Object {
+    int fd = -1;
+    bool overlapped = false;
+    bool no_buffering = false;
+    DWORD access = GENERIC_READ | GENERIC_WRITE;   ///< Disk files: the transfers CreateFileA allowed.
+    std::string delete_on_close;    ///< Path to remove when the handle closes, if FILE_FLAG_DELETE_ON_CLOSE.
+    Port* port = nullptr;           ///< Completion port the handle is associated with.
+    ULONG_PTR key = 0;
+    Pipe* pipe = nullptr;
+    int end = 0;                    ///< 0 for a pipe's server end, 1 for its client end.
+
+    File() : Object(OBJECT_FILE) {
+    }
+};
+
+/// An overlapped read on a pipe, waiting for data.
+struct PendingRead {
+    File* file;
+    LPOVERLAPPED overlapped;
+    char* buffer;
+    DWORD length;
+};
+
+/**
+ * @brief A named pipe instance: bytes written at one end queue for reads at the other.
+ */
+struct Pipe {
+    std::mutex lock;
+    std::condition_variable readable;   ///< Synchronous readers wait on it.
+    std::string name;
+    std::string data[2];                ///< Bytes waiting to be read at end 0 and end 1.
+    std::deque<PendingRead> readers[2]; ///< Overlapped reads waiting at each end.
+    bool open[2] = { true, false };
+    int references = 1;                 ///< Open ends.
+};
+
+static std::mutex g_pipes_lock;
+static std::map<std::string, Pipe*> g_listening_pipes;   ///< Pipes no client has opened yet, by name.
+
+/**
+ * @brief Reports an overlapped operation as finished: through its OVERLAPPED, its event and, unless
+ * the event's low bit is set, a packet on the file's completion port.
+ */
+static void complete_overlapped(File* file, LPOVERLAPPED overlapped, DWORD error, DWORD bytes) {
+    overlapped->Internal = error;
+    overlapped->InternalHigh = bytes;
+    ULONG_PTR event = (ULONG_PTR)overlapped->hEvent;
+    if (event & ~(ULONG_PTR)1) SetEvent((HANDLE)(event & ~(ULONG_PTR)1));
+    if (file->port && !(event & 1)) port_post(file->port, Packet{ bytes, file->key, overlapped, error });
+}
+
+/// Hands queued bytes at `end` to the overlapped reads waiting there. Called with the pipe locked.
+static void pipe_feed(Pipe* pipe, int end) {
+    std::deque<PendingRead>& readers = pipe->readers[end];
+    std::string& data = pipe->data[end];
+    while (!readers.empty() && (!data.empty() || !pipe->open[1 - end])) {
+        PendingRead read = readers.front();
+        readers.pop_front();
+        if (data.empty()) {
+            complete_overlapped(read.file, read.overlapped, ERROR_BROKEN_PIPE, 0);
+            continue;
+        }
+        DWORD bytes = (DWORD)std::min<size_t>(read.length, data.size());
+        memcpy(read.buffer, data.data(), bytes);
+        data.erase(0, bytes);
+        complete_overlapped(read.file, read.overlapped, ERROR_SUCCESS, bytes);
+    }
+    pipe->readable.notify_all();
+}
+
+static BOOL pipe_read(File* file, char* buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped) {
+    Pipe* pipe = file->pipe;
+    std::unique_lock<std::mutex> held(pipe->lock);
+    std::string& data = pipe->data[file->end];
+    if (file->overlapped) {
+        pipe->readers[file->end].push_back(PendingRead{ file, overlapped, buffer, length });
+        pipe_feed(pipe, file->end);
+        return fail(ERROR_IO_PENDING);
+    }
+    pipe->readable.wait(held, [&] { return !data.empty() || !pipe->open[1 - file->end]; });
+    if (data.empty()) return fail(ERROR_BROKEN_PIPE);
+    DWORD moved = (DWORD)std::min<size_t>(length, data.size());
+    memcpy(buffer, data.data(), moved);
+    data.erase(0, moved);
+    if (bytes) *bytes = moved;
+    if (overlapped) {
+        overlapped->Internal = ERROR_SUCCESS;
+        overlapped->InternalHigh = moved;
+    }
+    return TRUE;
+}
+
+static BOOL pipe_write(File* file, const char* buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped) {
+    Pipe* pipe = file->pipe;
+    std::lock_guard<std::mutex> guard(pipe->lock);
+    int peer = 1 - file->end;
+    if (!pipe->open[peer]) return fail(ERROR_NO_DATA);
+    pipe->data[peer].append(buffer, length);
+    pipe_feed(pipe, peer);
+    if (bytes) *bytes = length;
+    if (overlapped && file->overlapped) {
+        complete_overlapped(file, overlapped, ERROR_SUCCESS, length);
+        return fail(ERROR_IO_PENDING);
+    }
+    return TRUE;
+}
+
+/// Aborts `file`'s pending reads, or only the one on `overlapped`. Returns how many it aborted.
+static int pipe_cancel(File* file, LPOVERLAPPED overlapped) {
+    Pipe* pipe = file->pipe;
+    std::lock_guard<std::mutex> guard(pipe->lock);
+    std::deque<PendingRead>& readers = pipe->readers[file->end];
+    int cancelled = 0;
+    for (size_t i = 0; i < readers.size();) {
+        if (readers[i].file == file && (!overlapped || readers[i].overlapped == overlapped)) {
+            PendingRead read = readers[i];
+            readers.erase(readers.begin() + i);
+            complete_overlapped(read.file, read.overlapped, ERROR_OPERATION_ABORTED, 0);
+            cancelled++;
+        }
+        else {
+            ++i;
+        }
+    }
+    return cancelled;
+}
+
+static void pipe_close(File* file) {
+    Pipe* pipe = file->pipe;
+    pipe_cancel(file, NULL);
+    std::unique_lock<std::mutex> held(pipe->lock);
+    pipe->open[file->end] = false;
+    pipe_feed(pipe, 1 - file->end);
+    bool last = --pipe->references == 0;
+    held.unlock();
+    if (!last) return;
+    {
+        std::lock_guard<std::mutex> guard(g_pipes_lock);
+        std::map<std::string, Pipe*>::iterator it = g_listening_pipes.find(pipe->name);
+        if (it != g_listening_pipes.end() && it->second == pipe) g_listening_pipes.erase(it);
+    }
+    delete pipe;
+}
+
+static const char PIPE_PREFIX[] = "\\\\.\\pipe\\";
+
+extern "C" HANDLE WINAPI CreateNamedPipeA(LPCSTR name, DWORD open_mode, DWORD, DWORD, DWORD, DWORD, DWORD, LPSECURITY_ATTRIBUTES) {
+    if (strncmp(name, PIPE_PREFIX, sizeof(PIPE_PREFIX) - 1) != 0) {
+        fail(ERROR_INVALID_PARAMETER);
+        return INVALID_HANDLE_VALUE;
+    }
+    Pipe* pipe = new Pipe();
+    pipe->name = name;
+    File* file = new File();
+    file->fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    file->overlapped = (open_mode & FILE_FLAG_OVERLAPPED) != 0;
+    file->pipe = pipe;
+    file->end = 0;
+    std::lock_guard<std::mutex> guard(g_pipes_lock);
+    if (g_listening_pipes.count(name)) {
+        delete file;
+        delete pipe;
+        fail(ERROR_ACCESS_DENIED);
+        return INVALID_HANDLE_VALUE;
+    }
+    g_listening_pipes[name] = pipe;
+    return file;
+}
+
+extern "C" BOOL WINAPI ConnectNamedPipe(HANDLE handle, LPOVERLAPPED) {
+    File* file = static_cast<File*>(handle);
+    std::lock_guard<std::mutex> guard(file->pipe->lock);
+    return file->pipe->open[1] ? fail(ERROR_PIPE_CONNECTED) : fail(ERROR_IO_PENDING);
+}
+
+/// Opens the client end of a listening pipe.
+static HANDLE open_pipe_client(LPCSTR name, DWORD flags) {
+    Pipe* pipe;
+    {
+        std::lock_guard<std::mutex> guard(g_pipes_lock);
+        std::map<std::string, Pipe*>::iterator it = g_listening_pipes.find(name);
+        if (it == g_listening_pipes.end()) {
+            fail(ERROR_FILE_NOT_FOUND);
+            return INVALID_HANDLE_VALUE;
+        }
+        pipe = it->second;
+        g_listening_pipes.erase(it);
+    }
+    File* file = new File();
+    file->fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    file->overlapped = (flags & FILE_FLAG_OVERLAPPED) != 0;
+    file->pipe = pipe;
+    file->end = 1;
+    std::lock_guard<std::mutex> guard(pipe->lock);
+    pipe->open[1] = true;
+    pipe->references++;
+    return file;
+}
+
+extern "C" HANDLE WINAPI CreateFileA(LPCSTR name, DWORD access, DWORD, LPSECURITY_ATTRIBUTES, DWORD disposition, DWORD flags, HANDLE) {
+    if (strncmp(name, PIPE_PREFIX, sizeof(PIPE_PREFIX) - 1) == 0) return open_pipe_client(name, flags);
+
+    int mode = (access & GENERIC_WRITE) ? ((access & GENERIC_READ) ? O_RDWR : O_WRONLY) : O_RDONLY;
+    switch (disposition) {
+    case CREATE_NEW: mode |= O_CREAT | O_EXCL; break;
+    case CREATE_ALWAYS: mode |= O_CREAT | O_TRUNC; break;
+    case OPEN_ALWAYS: mode |= O_CREAT; break;
+    case TRUNCATE_EXISTING: mode |= O_TRUNC; break;
+    default: break;
+    }
+    int fd = open(name, mode | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fail(errno == ENOENT ? ERROR_FILE_NOT_FOUND : errno == EEXIST ? ERROR_FILE_EXISTS : ERROR_ACCESS_DENIED);
+        return INVALID_HANDLE_VALUE;
+    }
+    File* file = new File();
+    file->fd = fd;
+    file->overlapped = (flags & FILE_FLAG_OVERLAPPED) != 0;
+    file->no_buffering = (flags & FILE_FLAG_NO_BUFFERING) != 0;
+    file->access = access;
+    if (flags & FILE_FLAG_DELETE_ON_CLOSE) file->delete_on_close = name;
+    return file;
+}
+
+/// Transfers at the OVERLAPPED's offset, or the file position without one. Returns a Win32 error.
+static DWORD disk_transfer(File* file, bool is_write, char* buffer, DWORD length, LPOVERLAPPED overlapped, DWORD* bytes) {
+    long long offset = overlapped ? ((long long)overlapped->OffsetHigh << 32 | overlapped->Offset) : 0;
+    ssize_t done = overlapped
+        ? (is_write ? pwrite(file->fd, buffer, length, offset) : pread(file->fd, buffer, length, offset))
+        : (is_write ? write(file->fd, buffer, length) : read(file->fd, buffer, length));
+    *bytes = done > 0 ? (DWORD)done : 0;
+    if (done < 0) return errno == ENOSPC ? ERROR_DISK_FULL : ERROR_IO_DEVICE;
+    // Windows fails an overlapped read that starts at or past the end; a synchronous one returns 0 bytes.
+    if (done == 0 && !is_write && length > 0 && file->overlapped) return ERROR_HANDLE_EOF;
+    return ERROR_SUCCESS;
+}
+
+static BOOL file_transfer(HANDLE handle, bool is_write, char* buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped) {
+    File* file = static_cast<File*>(handle);
+    if (!file || file->kind != OBJECT_FILE) return fail(ERROR_INVALID_HANDLE);
+    if (file->overlapped && !overlapped) return fail(ERROR_INVALID_PARAMETER);
+    if (file->pipe) {
+        return is_write ? pipe_write(file, buffer, length, bytes, overlapped) : pipe_read(file, buffer, length, bytes, overlapped);
+    }
+    // A transfer the handle was not opened for fails at once, with no packet.
+    if (!(file->access & (is_write ? GENERIC_WRITE : GENERIC_READ))) return fail(ERROR_ACCESS_DENIED);
+    DWORD moved = 0;
+    DWORD error = disk_transfer(file, is_write, buffer, length, overlapped, &moved);
+    if (file->overlapped) {
+        if (error == ERROR_HANDLE_EOF) {
+            // Failed at once, as Windows fails a read past the end: no packet and no event.
+            overlapped->Internal = error;
+            overlapped->InternalHigh = 0;
+            return fail(ERROR_HANDLE_EOF);
+        }
+        complete_overlapped(file, overlapped, error, moved);
+        return fail(ERROR_IO_PENDING);
+    }
+    if (bytes) *bytes = moved;
+    if (overlapped) {
+        overlapped->Internal = error;
+        overlapped->InternalHigh = moved;
+    }
+    return error == ERROR_SUCCESS ? TRUE : fail(error);
+}
+
+extern "C" BOOL WINAPI ReadFile(HANDLE file, LPVOID buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped) {
+    return file_transfer(file, false, static_cast<char*>(buffer), length, bytes, overlapped);
+}
+
+extern "C" BOOL WINAPI WriteFile(HANDLE file, LPCVOID buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped) {
+    return file_transfer(file, true, (char*)buffer, length, bytes, overlapped);
+}
+
+extern "C" BOOL WINAPI GetOverlappedResult(HANDLE, LPOVERLAPPED overlapped, LPDWORD bytes, BOOL) {
+    *bytes = (DWORD)overlapped->InternalHigh;
+    return overlapped->Internal == ERROR_SUCCESS ? TRUE : fail((DWORD)overlapped->Internal);
+}
+
+extern "C" BOOL WINAPI FlushFileBuffers(HANDLE handle) {
+    File* file = static_cast<File*>(handle);
+    if (file->pipe) return TRUE;
+    return fsync(file->fd) == 0 ? TRUE : fail(ERROR_IO_DEVICE);
+}
+
+extern "C" BOOL WINAPI CancelIoEx(HANDLE handle, LPOVERLAPPED overlapped) {
+    File* file = static_cast<File*>(handle);
+    // Disk transfers have finished by the time their call returns; only pipe reads can be pending.
+    if (!file->pipe || pipe_cancel(file, overlapped) == 0) return fail(ERROR_NOT_FOUND);
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI GetFileInformationByHandle(HANDLE handle, BY_HANDLE_FILE_INFORMATION* info) {
+    File* file = static_cast<File*>(handle);
+    struct stat status;
+    if (file->pipe || fstat(file->fd, &status) != 0) return fail(ERROR_INVALID_FUNCTION);
+    memset(info, 0, sizeof(*info));
+    info->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+    info->dwVolumeSerialNumber = (DWORD)status.st_dev;
+    info->nFileSizeHigh = (DWORD)((unsigned long long)status.st_size >> 32);
+    info->nFileSizeLow = (DWORD)status.st_size;
+    info->nNumberOfLinks = (DWORD)status.st_nlink;
+    info->nFileIndexHigh = (DWORD)((unsigned long long)status.st_ino >> 32);
+    info->nFileIndexLow = (DWORD)status.st_ino;
+    return TRUE;
+}
+
+extern "C" DWORD WINAPI GetFinalPathNameByHandleA(HANDLE handle, LPSTR path, DWORD length, DWORD) {
+    File* file = static_cast<File*>(handle);
+    char link[64], target[MAX_PATH];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", file->fd);
+    ssize_t used = file->pipe ? -1 : readlink(link, target, sizeof(target) - 1);
+    if (used < 0) return fail(ERROR_INVALID_FUNCTION);
+    target[used] = '\0';
+    if ((DWORD)used >= length) return (DWORD)used + 1;
+    memcpy(path, target, (size_t)used + 1);
+    return (DWORD)used;
+}
+
+extern "C" BOOL WINAPI SetFileCompletionNotificationModes(HANDLE, UCHAR) {
+    return TRUE;
+}
+
+extern "C" DWORD WINAPI GetTempPathA(DWORD length, LPSTR path) {
+    const char* directory = getenv("TMPDIR");
+    std::string temp = std::string(directory && *directory ? directory : "/tmp") + "/";
+    if (temp.size() >= length) return (DWORD)temp.size() + 1;
+    memcpy(path, temp.c_str(), temp.size() + 1);
+    return (DWORD)temp.size();
+}
+
+extern "C" BOOL WINAPI DeleteFileA(LPCSTR name) {
+    return unlink(name) == 0 ? TRUE : fail(ERROR_FILE_NOT_FOUND);
+}
+
+extern "C" HANDLE WINAPI CreateIoCompletionPort(HANDLE handle, HANDLE port, ULONG_PTR key, DWORD) {
+    if (handle == INVALID_HANDLE_VALUE) return new Port();
+    File* file = static_cast<File*>(handle);
+    Port* target = static_cast<Port*>(port);
+    if (file->port) {
+        fail(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+    std::lock_guard<std::mutex> guard(target->lock);
+    target->references++;
+    file->port = target;
+    file->key = key;
+    return port;
+}
+
+/// Descriptors _open_osfhandle has handed out, and the files they stand for.
+static std::mutex g_descriptors_lock;
+static std::map<int, File*> g_descriptors;
+
+static void close_file(File* file) {
+    if (file->pipe) pipe_close(file);
+    if (file->port) {
+        std::unique_lock<std::mutex> held(file->port->lock);
+        port_release(file->port, held);
+    }
+    if (file->fd >= 0) close(file->fd);
+    if (!file->delete_on_close.empty()) unlink(file->delete_on_close.c_str());
+    delete file;
+}
+
+// --- Threads and Events ---
+
+struct Event : Object {
+    std::mutex lock;
+    std::condition_variable signalled;
+    bool set;
+    bool manual_reset;
+
+    Event(bool manual, bool initial) : Object(OBJECT_EVENT), set(initial), manual_reset(manual) {
+    }
+};
+
+/// A thread. It lives while its handle is open or it is running.
+struct Thread : Object {
+    std::mutex lock;
+    std::condition_variable exited;
+    bool running = true;
+    int references = 2;
+
+    Thread() : Object(OBJECT_THREAD) {
+    }
+};
+
+static void thread_release(Thread* thread) {
+    std::unique_lock<std::mutex> held(thread->lock);
+    bool last = --thread->references == 0;
+    held.unlock();
+    if (last) delete thread;
+}
+
+extern "C" HANDLE WINAPI CreateThread(LPSECURITY_ATTRIBUTES, SIZE_T, LPTHREAD_START_ROUTINE start, LPVOID parameter, DWORD, LPDWORD thread_id) {
+    Thread* thread = new Thread();
+    std::thread([thread, start, parameter] {
+        start(parameter);
+        {
+            std::lock_guard<std::mutex> guard(thread->lock);
+            thread->running = false;
+            thread->exited.notify_all();
+        }
+        thread_release(thread);
+    }).detach();
+    if (thread_id) *thread_id = 0;
+    return thread;
+}
+
+extern "C" HANDLE WINAPI CreateEventW(LPSECURITY_ATTRIBUTES, BOOL manual_reset, BOOL initial_state, LPCWSTR) {
+    return new Event(manual_reset != FALSE, initial_state != FALSE);
+}
+
+extern "C" BOOL WINAPI SetEvent(HANDLE handle) {
+    Event* event = static_cast<Event*>(handle);
+    std::lock_guard<std::mutex> guard(event->lock);
+    event->set = true;
+    event->signalled.notify_all();
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI ResetEvent(HANDLE handle) {
+    Event* event = static_cast<Event*>(handle);
+    std::lock_guard<std::mutex> guard(event->lock);
+    event->set = false;
+    return TRUE;
+}
+
+extern "C" DWORD WINAPI WaitForSingleObject(HANDLE handle, DWORD timeout_ms) {
+    Object* object = static_cast<Object*>(handle);
+    if (object->kind == OBJECT_THREAD) {
+        Thread* thread = static_cast<Thread*>(object);
+        std::unique_lock<std::mutex> held(thread->lock);
+        return wait_for(thread->exited, held, timeout_ms, [&] { return !thread->running; }) ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+    }
+    Event* event = static_cast<Event*>(object);
+    std::unique_lock<std::mutex> held(event->lock);
+    if (!wait_for(event->signalled, held, timeout_ms, [&] { return event->set; })) return WAIT_TIMEOUT;
+    if (!event->manual_reset) event->set = false;
+    return WAIT_OBJECT_0;
+}
+
+extern "C" void WINAPI Sleep(DWORD ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+extern "C" BOOL WINAPI SwitchToThread(void) {
+    std::this_thread::yield();
+    return TRUE;
+}
+
+// --- Locks and Condition Variables ---
+
+extern "C" void WINAPI InitializeSRWLock(PSRWLOCK lock) {
+    pthread_rwlock_init(&lock->lock, NULL);
+}
+
+extern "C" void WINAPI AcquireSRWLockExclusive(PSRWLOCK lock) {
+    pthread_rwlock_wrlock(&lock->lock);
+}
+
+extern "C" void WINAPI ReleaseSRWLockExclusive(PSRWLOCK lock) {
+    pthread_rwlock_unlock(&lock->lock);
+}
+
+extern "C" void WINAPI AcquireSRWLockShared(PSRWLOCK lock) {
+    pthread_rwlock_rdlock(&lock->lock);
+}
+
+extern "C" void WINAPI ReleaseSRWLockShared(PSRWLOCK lock) {
+    pthread_rwlock_unlock(&lock->lock);
+}
+
+extern "C" BOOL WINAPI TryAcquireSRWLockExclusive(PSRWLOCK lock) {
+    return pthread_rwlock_trywrlock(&lock->lock) == 0;
+}
+
+/// An SRW lock held in one mode, as std::condition_variable_any wants to release and retake it.
+struct HeldSrwLock {
+    PSRWLOCK srw;
+    bool shared;
+
+    void lock() {
+        if (shared) pthread_rwlock_rdlock(&srw->lock);
+        else pthread_rwlock_wrlock(&srw->lock);
+    }
+    void unlock() {
+        pthread_rwlock_unlock(&srw->lock);
+    }
+};
+
+/**
+ * Condition variables hash onto a fixed set of waiting queues, so they need no storage of their own
+ * and CONDITION_VARIABLE_INIT stays a constant. Sharing a queue only adds spurious wake-ups, which
+ * callers of SleepConditionVariableSRW must tolerate on Windows too.
+ */
+static const unsigned CONDITION_QUEUES = 64;
+static std::condition_variable_any g_condition_queues[CONDITION_QUEUES];
+
+static std::condition_variable_any& condition_queue(PCONDITION_VARIABLE condition) {
+    return g_condition_queues[((uintptr_t)condition / sizeof(void*)) % CONDITION_QUEUES];
+}
+
+extern "C" void WINAPI InitializeConditionVariable(PCONDITION_VARIABLE condition) {
+    condition->Ptr = NULL;
+}
+
+extern "C" BOOL WINAPI SleepConditionVariableSRW(PCONDITION_VARIABLE condition, PSRWLOCK lock, DWORD timeout_ms, ULONG flags) {
+    HeldSrwLock held = { lock, (flags & CONDITION_VARIABLE_LOCKMODE_SHARED) != 0 };
+    std::condition_variable_any& queue = condition_queue(condition);
+    if (timeout_ms == INFINITE) {
+        queue.wait(held);
+        return TRUE;
+    }
+    return queue.wait_for(held, std::chrono::milliseconds(timeout_ms)) == std::cv_status::no_timeout ? TRUE : fail(ERROR_TIMEOUT);
+}
+
+extern "C" void WINAPI WakeConditionVariable(PCONDITION_VARIABLE condition) {
+    condition_queue(condition).notify_all();
+}
+
+extern "C" void WINAPI WakeAllConditionVariable(PCONDITION_VARIABLE condition) {
+    condition_queue(condition).notify_all();
+}
+
+extern "C" void WINAPI InitOnceInitialize(PINIT_ONCE once) {
+    pthread_mutex_init(&once->lock, NULL);
+    once->done = 0;
+    once->context = NULL;
+}
+
+extern "C" BOOL WINAPI InitOnceExecuteOnce(PINIT_ONCE once, PINIT_ONCE_FN function, PVOID parameter, LPVOID* context) {
+    pthread_mutex_lock(&once->lock);
+    BOOL ok = TRUE;
+    if (!once->done) {
+        ok = function(once, parameter, &once->context);
+        if (ok) once->done = 1;
+    }
+    if (ok && context) *context = once->context;
+    pthread_mutex_unlock(&once->lock);
+    return ok;
+}
+
+// --- Processors and NUMA ---
+
+static const unsigned EMULATED_PROCESSORS = 4;
+static const unsigned PROCESSORS_PER_NODE = 2;
+
+static std::atomic<unsigned> g_next_processor(0);
+static thread_local int t_processor = -1;
+
+static unsigned current_processor() {
+    if (t_processor < 0) t_processor = (int)(g_next_processor.fetch_add(1) % EMULATED_PROCESSORS);
+    return (unsigned)t_processor;
+}
+
+extern "C" HANDLE WINAPI GetCurrentProcess(void) {
+    return CURRENT_PROCESS;
+}
+
+extern "C" HANDLE WINAPI GetCurrentThread(void) {
+    return CURRENT_THREAD;
+}
+
+extern "C" DWORD WINAPI GetCurrentProcessId(void) {
+    return (DWORD)getpid();
+}
+
+extern "C" DWORD WINAPI GetCurrentThreadId(void) {
+    return (DWORD)syscall(SYS_gettid);
+}
+
+extern "C" void WINAPI GetCurrentProcessorNumberEx(PROCESSOR_NUMBER* processor) {
+    processor->Group = 0;
+    processor->Number = (BYTE)current_processor();
+    processor->Reserved = 0;
+}
+
+extern "C" DWORD WINAPI GetActiveProcessorCount(WORD) {
+    return EMULATED_PROCESSORS;
+}
+
+extern "C" WORD WINAPI GetActiveProcessorGroupCount(void) {
+    return 1;
+}
+
+extern "C" BOOL WINAPI GetNumaHighestNodeNumber(ULONG* highest) {
+    *highest = EMULATED_PROCESSORS / PROCESSORS_PER_NODE - 1;
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI GetNumaProcessorNodeEx(PROCESSOR_NUMBER* processor, USHORT* node) {
+    *node = (USHORT)(processor->Number / PROCESSORS_PER_NODE);
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI SetThreadGroupAffinity(HANDLE thread, const GROUP_AFFINITY* affinity, GROUP_AFFINITY*) {
+    unsigned allowed[EMULATED_PROCESSORS];
+    unsigned count = 0;
+    for (unsigned cpu = 0; cpu < EMULATED_PROCESSORS; ++cpu) {
+        if ((affinity->Mask >> cpu) & 1) allowed[count++] = cpu;
+    }
+    if (thread != CURRENT_THREAD || affinity->Group != 0 || count == 0) return fail(ERROR_INVALID_PARAMETER);
+    t_processor = (int)allowed[g_next_processor.fetch_add(1) % count];
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI GetLogicalProcessorInformationEx(LOGICAL_PROCESSOR_RELATIONSHIP relationship, PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX buffer, DWORD* length) {
+    const unsigned nodes = EMULATED_PROCESSORS / PROCESSORS_PER_NODE;
+    DWORD needed = nodes * sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX);
+    if (relationship != RelationNumaNode) return fail(ERROR_NOT_SUPPORTED);
+    if (!buffer || *length < needed) {
+        *length = needed;
+        return fail(ERROR_INSUFFICIENT_BUFFER);
+    }
+    memset(buffer, 0, needed);
+    for (unsigned node = 0; node < nodes; ++node) {
+        buffer[node].Relationship = RelationNumaNode;
+        buffer[node].Size = sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX);
+        buffer[node].NumaNode.NodeNumber = node;
+        buffer[node].NumaNode.GroupCount = 1;
+        buffer[node].NumaNode.GroupMask.Mask = (((KAFFINITY)1 << PROCESSORS_PER_NODE) - 1) << (node * PROCESSORS_PER_NODE);
+    }
+    *length = needed;
+    return TRUE;
+}
+
+extern "C" void WINAPI GetSystemInfo(SYSTEM_INFO* info) {
+    memset(info, 0, sizeof(*info));
+    info->dwPageSize = 4096;
+    info->dwNumberOfProcessors = EMULATED_PROCESSORS;
+    info->dwActiveProcessorMask = ((ULONG_PTR)1 << EMULATED_PROCESSORS) - 1;
+    info->dwAllocationGranularity = 65536;
+}
+
+/// Converts a duration in microseconds to FILETIME's 100 ns units.
+static void set_filetime(FILETIME* time, unsigned long long microseconds) {
+    unsigned long long units = microseconds * 10;
+    time->dwLowDateTime = (DWORD)units;
+    time->dwHighDateTime = (DWORD)(units >> 32);
+}
+
+extern "C" BOOL WINAPI GetProcessTimes(HANDLE, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    set_filetime(creation, 0);
+    set_filetime(exit, 0);
+    set_filetime(kernel, usage.ru_stime.tv_sec * 1000000ULL + usage.ru_stime.tv_usec);
+    set_filetime(user, usage.ru_utime.tv_sec * 1000000ULL + usage.ru_utime.tv_usec);
+    return TRUE;
+}
+
+// --- Time ---
+
+extern "C" BOOL WINAPI QueryPerformanceCounter(LARGE_INTEGER* counter) {
+    counter->QuadPart = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI QueryPerformanceFrequency(LARGE_INTEGER* frequency) {
+    frequency->QuadPart = 1000000000LL;
+    return TRUE;
+}
+
+extern "C" ULONGLONG WINAPI GetTickCount64(void) {
+    return (ULONGLONG)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// --- Memory ---
+
+static const size_t PAGE_SIZE_BYTES = 4096;
+static const size_t LARGE_PAGE_SIZE = 2u << 20;
+
+struct Region {
+    size_t size;
+    bool large_pages;
+};
+
+static std::mutex g_regions_lock;
+static std::map<uintptr_t, Region> g_regions;   ///< Reservations by base address.
+
+/// Maps `size` bytes aligned to a large page and asks for huge pages behind them.
+static void* map_large_pages(size_t size) {
+    char* raw = (char*)mmap(NULL, size + LARGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    char* base = (char*)(((uintptr_t)raw + LARGE_PAGE_SIZE - 1) & ~(uintptr_t)(LARGE_PAGE_SIZE - 1));
+    if (base > raw) munmap(raw, base - raw);
+    munmap(base + size, raw + LARGE_PAGE_SIZE - base);
+    madvise(base, size, MADV_HUGEPAGE);
+    // Large pages are committed and resident from the start on Windows.
+    for (size_t offset = 0; offset < size; offset += PAGE_SIZE_BYTES) base[offset] = 0;
+    return base;
+}
+
+static bool g_lock_memory_enabled = false;   ///< Set by AdjustTokenPrivileges.
+
+extern "C" LPVOID WINAPI VirtualAlloc(LPVOID address, SIZE_T size, DWORD type, DWORD) {
+    if (address && (type & MEM_COMMIT) && !(type & MEM_RESERVE)) {
+        uintptr_t start = (uintptr_t)address & ~(uintptr_t)(PAGE_SIZE_BYTES - 1);
+        uintptr_t end = ((uintptr_t)address + size + PAGE_SIZE_BYTES - 1) & ~(uintptr_t)(PAGE_SIZE_BYTES - 1);
+        if (mprotect((void*)start, end - start, PROT_READ | PROT_WRITE) != 0) {
+            fail(ERROR_INVALID_PARAMETER);
+            return NULL;
+        }
+        return address;
+    }
+    void* base;
+    if (type & MEM_LARGE_PAGES) {
+        if (size % LARGE_PAGE_SIZE || !(type & MEM_COMMIT) || !g_lock_memory_enabled || getenv("WIN32EMU_LARGE_PAGES_FAIL")) {
+            fail(ERROR_NO_SYSTEM_RESOURCES);
+            return NULL;
+        }
+        base = map_large_pages(size);
+    }
+    else {
+        int protection = (type & MEM_COMMIT) ? PROT_READ | PROT_WRITE : PROT_NONE;
+        base = mmap(NULL, size, protection, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) base = NULL;
+    }
+    if (!base) {
+        fail(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    std::lock_guard<std::mutex> guard(g_regions_lock);
+    g_regions[(uintptr_t)base] = Region{ size, (type & MEM_LARGE_PAGES) != 0 };
+    return base;
+}
+
+extern "C" LPVOID WINAPI VirtualAllocExNuma(HANDLE, LPVOID address, SIZE_T size, DWORD type, DWORD protect, DWORD) {
+    return VirtualAlloc(address, size, type, protect);
+}
+
+extern "C" BOOL WINAPI VirtualFree(LPVOID address, SIZE_T size, DWORD type) {
+    std::lock_guard<std::mutex> guard(g_regions_lock);
+    if (type & MEM_DECOMMIT) {
+        return madvise(address, size, MADV_DONTNEED) == 0 && mprotect(address, size, PROT_NONE) == 0 ? TRUE : fail(ERROR_INVALID_PARAMETER);
+    }
+    std::map<uintptr_t, Region>::iterator it = g_regions.find((uintptr_t)address);
+    if (it == g_regions.end()) return fail(ERROR_INVALID_PARAMETER);
+    munmap(address, it->second.size);
+    g_regions.erase(it);
+    return TRUE;
+}
+
+extern "C" SIZE_T WINAPI GetLargePageMinimum(void) {
+    return LARGE_PAGE_SIZE;
+}
+
+extern "C" BOOL WINAPI GetProcessMemoryInfo(HANDLE, PPROCESS_MEMORY_COUNTERS counters, DWORD length) {
+    FILE* status = fopen("/proc/self/status", "r");
+    if (!status) return fail(ERROR_ACCESS_DENIED);
+    char line[256];
+    size_t resident_kb = 0, peak_kb = 0;
+    while (fgets(line, sizeof(line), status)) {
+        sscanf(line, "VmRSS: %zu", &resident_kb);
+        sscanf(line, "VmHWM: %zu", &peak_kb);
+    }
+    fclose(status);
+    memset(counters, 0, length);
+    counters->cb = length;
+    counters->WorkingSetSize = resident_kb * 1024;
+    counters->PeakWorkingSetSize = peak_kb * 1024;
+    // Linux commits lazily, so private bytes that were never touched are not counted.
+    counters->PagefileUsage = resident_kb * 1024;
+    if (length >= sizeof(PROCESS_MEMORY_COUNTERS_EX)) ((PROCESS_MEMORY_COUNTERS_EX*)counters)->PrivateUsage = resident_kb * 1024;
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI QueryWorkingSetEx(HANDLE, PVOID info, DWORD length) {
+    PSAPI_WORKING_SET_EX_INFORMATION* pages = static_cast<PSAPI_WORKING_SET_EX_INFORMATION*>(info);
+    for (DWORD i = 0; i < length / sizeof(*pages); ++i) {
+        uintptr_t page = (uintptr_t)pages[i].VirtualAddress & ~(uintptr_t)(PAGE_SIZE_BYTES - 1);
+        unsigned char resident = 0;
+        pages[i].VirtualAttributes.Flags = 0;
+        if (mincore((void*)page, PAGE_SIZE_BYTES, &resident) != 0 || !(resident & 1)) continue;
+        pages[i].VirtualAttributes.Valid = 1;
+        pages[i].VirtualAttributes.Node = current_processor() / PROCESSORS_PER_NODE;
+        std::lock_guard<std::mutex> guard(g_regions_lock);
+        std::map<uintptr_t, Region>::iterator it = g_regions.upper_bound(page);
+        if (it != g_regions.begin()) {
+            --it;
+            if (page < it->first + it->second.size) pages[i].VirtualAttributes.LargePage = it->second.large_pages;
+        }
+    }
+    return TRUE;
+}
+
+// --- File Mappings ---
+
+/// A named shared-memory section, backed by POSIX shared memory.
+struct Mapping : Object {
+    int fd;
+
+    Mapping() : Object(OBJECT_MAPPING), fd(-1) {
+    }
+    ~Mapping() {
+        if (fd >= 0) close(fd);
+    }
+};
+
+static std::string shared_memory_name(LPCSTR name) {
+    std::string converted = "/";
+    for (const char* c = name; *c; ++c) converted += (*c == '\\' || *c == '/') ? '_' : *c;
+    return converted;
+}
+
+/// Unlinks the sections this process created when it exits, as Windows destroys a named section
+/// with its last handle; otherwise a later process with the same ID would find it still there.
+static struct CreatedSections {
+    std::mutex lock;
+    std::vector<std::string> names;
+    ~CreatedSections() {
+        for (const std::string& name : names) shm_unlink(name.c_str());
+    }
+} g_created_sections;
+
+extern "C" HANDLE WINAPI CreateFileMappingA(HANDLE, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD size_low, LPCSTR name) {
+    std::string shm = shared_memory_name(name);
+    bool existed = false;
+    int fd = shm_open(shm.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        fd = shm_open(shm.c_str(), O_RDWR, 0600);
+        existed = true;
+    }
+    if (fd < 0 || (!existed && ftruncate(fd, size_low) != 0)) {
+        if (fd >= 0) close(fd);
+        fail(ERROR_ACCESS_DENIED);
+        return NULL;
+    }
+    if (!existed) {
+        std::lock_guard<std::mutex> hold(g_created_sections.lock);
+        g_created_sections.names.push_back(shm);
+    }
+    Mapping* mapping = new Mapping();
+    mapping->fd = fd;
+    SetLastError(existed ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS);
+    return mapping;
+}
+
+extern "C" HANDLE WINAPI OpenFileMappingA(DWORD, BOOL, LPCSTR name) {
+    int fd = shm_open(shared_memory_name(name).c_str(), O_RDONLY, 0600);
+    if (fd < 0) {
+        fail(ERROR_FILE_NOT_FOUND);
+        return NULL;
+    }
+    Mapping* mapping = new Mapping();
+    mapping->fd = fd;
+    return mapping;
+}
+
+extern "C" LPVOID WINAPI MapViewOfFile(HANDLE handle, DWORD access, DWORD, DWORD, SIZE_T size) {
+    Mapping* mapping = static_cast<Mapping*>(handle);
+    if (size == 0) {
+        struct stat status;
+        if (fstat(mapping->fd, &status) != 0) return NULL;
+        size = (SIZE_T)status.st_size;
+    }
+    int protection = access == FILE_MAP_READ ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* view = mmap(NULL, size, protection, MAP_SHARED, mapping->fd, 0);
+    return view == MAP_FAILED ? NULL : view;
+}
+
+extern "C" BOOL WINAPI UnmapViewOfFile(LPCVOID) {
+    // Views are small and few; they stay mapped until the process exits.
+    return TRUE;
+}
+
+// --- Tokens ---
+
+struct Token : Object {
+    Token() : Object(OBJECT_TOKEN) {
+    }
+};
+
+extern "C" BOOL WINAPI OpenProcessToken(HANDLE, DWORD, HANDLE* token) {
+    *token = new Token();
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI LookupPrivilegeValueW(LPCWSTR, LPCWSTR, LUID* luid) {
+    luid->LowPart = 4;  // SeLockMemoryPrivilege, the only privilege the library asks for.
+    luid->HighPart = 0;
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI AdjustTokenPrivileges(HANDLE, BOOL, TOKEN_PRIVILEGES* state, DWORD, TOKEN_PRIVILEGES*, DWORD*) {
+    // Like Windows, the call succeeds even when the account lacks the privilege, and says so in the last error.
+    if (getenv("WIN32EMU_NO_LOCK_PRIVILEGE")) {
+        SetLastError(ERROR_NOT_ALL_ASSIGNED);
+        return TRUE;
+    }
+    g_lock_memory_enabled = (state->Privileges[0].Attributes & SE_PRIVILEGE_ENABLED) != 0;
+    SetLastError(ERROR_SUCCESS);
+    return TRUE;
+}
+
+extern "C" BOOL WINAPI GetTokenInformation(HANDLE, TOKEN_INFORMATION_CLASS information_class, LPVOID information, DWORD length, DWORD* returned) {
+    *returned = sizeof(TOKEN_PRIVILEGES);
+    if (information_class != TokenPrivileges) return fail(ERROR_INVALID_PARAMETER);
+    if (length < sizeof(TOKEN_PRIVILEGES)) return fail(ERROR_INSUFFICIENT_BUFFER);
+    TOKEN_PRIVILEGES* privileges = static_cast<TOKEN_PRIVILEGES*>(information);
+    // The token lists the privileges the account holds, enabled or not.
+    privileges->PrivilegeCount = getenv("WIN32EMU_NO_LOCK_PRIVILEGE") ? 0 : 1;
+    LookupPrivilegeValueW(NULL, SE_LOCK_MEMORY_NAME, &privileges->Privileges[0].Luid);
+    privileges->Privileges[0].Attributes = g_lock_memory_enabled ? SE_PRIVILEGE_ENABLED : 0;
+    return TRUE;
+}
+
+// --- Modules, Environment and Debugging ---
+
+/// NtQueryInformationFile for FileModeInformation: the handle's synchronous and no-buffering modes.
+static LONG NTAPI query_information_file(HANDLE handle, void*, PVOID information, ULONG, int) {
+    static const ULONG FILE_NO_INTERMEDIATE_BUFFERING = 0x8;
+    static const ULONG FILE_SYNCHRONOUS_IO_NONALERT = 0x20;
+    File* file = static_cast<File*>(handle);
+    ULONG mode = 0;
+    if (!file->overlapped) mode |= FILE_SYNCHRONOUS_IO_NONALERT;
+    if (file->no_buffering) mode |= FILE_NO_INTERMEDIATE_BUFFERING;
+    *static_cast<ULONG*>(information) = mode;
+    return 0;
+}
+
+extern "C" HMODULE WINAPI GetModuleHandleW(LPCWSTR) {
+    return (HMODULE)&query_information_file;
+}
+
+extern "C" FARPROC WINAPI GetProcAddress(HMODULE, LPCSTR name) {
+    if (strcmp(name, "NtQueryInformationFile") == 0) return (FARPROC)(void (*)(void))&query_information_file;
+    fail(ERROR_NOT_FOUND);
+    return NULL;
+}
+
+extern "C" DWORD WINAPI GetEnvironmentVariableA(LPCSTR name, LPSTR value, DWORD length) {
+    const char* found = getenv(name);
+    if (!found) return fail(ERROR_NOT_FOUND);
+    size_t used = strlen(found);
+    if (used + 1 > length) return (DWORD)used + 1;
+    memcpy(value, found, used + 1);
+    return (DWORD)used;
+}
+
+extern "C" BOOL WINAPI SetEnvironmentVariableA(LPCSTR name, LPCSTR value) {
+    return (value ? setenv(name, value, 1) : unsetenv(name)) == 0 ? TRUE : fail(ERROR_INVALID_PARAMETER);
+}
+
+extern "C" int WINAPI lstrcmpiA(LPCSTR first, LPCSTR second) {
+    return strcasecmp(first, second);
+}
+
+extern "C" void WINAPI OutputDebugStringA(LPCSTR message) {
+    fputs(message, stderr);
+}
+
+// --- Handle Closing ---
+
+extern "C" BOOL WINAPI CloseHandle(HANDLE handle) {
+    if (!handle || handle == INVALID_HANDLE_VALUE || handle == CURRENT_THREAD) return fail(ERROR_INVALID_HANDLE);
+    Object* object = static_cast<Object*>(handle);
+    switch (object->kind) {
+    case OBJECT_PORT: {
+        Port* port = static_cast<Port*>(object);
+        std::unique_lock<std::mutex> held(port->lock);
+        port->closed = true;
+        port->packets.clear();
+        port->ready.notify_all();
+        port_release(port, held);
+        break;
+    }
+    case OBJECT_FILE:
+        close_file(static_cast<File*>(object));
+        break;
+    case OBJECT_THREAD:
+        thread_release(static_cast<Thread*>(object));
+        break;
+    default:
+        delete object;
+        break;
+    }
+    return TRUE;
+}
+
+// --- CRT Descriptors ---
+
+extern "C" int _open_osfhandle(intptr_t handle, int) {
+    File* file = reinterpret_cast<File*>(handle);
+    std::lock_guard<std::mutex> guard(g_descriptors_lock);
+    g_descriptors[file->fd] = file;
+    return file->fd;
+}
+
+extern "C" intptr_t _get_osfhandle(int fd) {
+    std::lock_guard<std::mutex> guard(g_descriptors_lock);
+    std::map<int, File*>::iterator it = g_descriptors.find(fd);
+    if (it == g_descriptors.end()) {
+        errno = EBADF;
+        return (intptr_t)INVALID_HANDLE_VALUE;
+    }
+    return reinterpret_cast<intptr_t>(it->second);
+}
+
+extern "C" int _close(int fd) {
+    File* file;
+    {
+        std::lock_guard<std::mutex> guard(g_descriptors_lock);
+        std::map<int, File*>::iterator it = g_descriptors.find(fd);
+        if (it == g_descriptors.end()) {
+            errno = EBADF;
+            return -1;
+        }
+        file = it->second;
+        g_descriptors.erase(it);
+    }
+    close_file(file);
+    return 0;
+}
+
+extern "C" long long _filelengthi64(int fd) {
+    File* file = reinterpret_cast<File*>(_get_osfhandle(fd));
+    struct stat status;
+    if ((HANDLE)file == INVALID_HANDLE_VALUE || fstat(file->fd, &status) != 0) return -1;
+    return (long long)status.st_size;
+}
+
+extern "C" void* _aligned_malloc(size_t size, size_t alignment) {
+    void* block = nullptr;
+    return posix_memalign(&block, std::max(alignment, sizeof(void*)), size) == 0 ? block : nullptr;
+}
+
+extern "C" void _aligned_free(void* block) {
+    free(block);
+}
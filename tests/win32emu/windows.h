@@ -0,0 +1,391 @@
+/**
+ * @file windows.h
+ * @brief The subset of the Win32 API that libaio-win32, its tests and aio-bench use, for Linux builds
+ * against win32emu.cpp.
+ *
+ * Types keep their Windows widths (DWORD and LONG are 32 bits) so the library's arithmetic is the
+ * same as on Windows. Only what the tree calls is declared; a new call fails to compile here until
+ * the emulation gains it.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned char UCHAR;
+typedef unsigned short WORD;
+typedef unsigned short USHORT;
+typedef int INT;
+typedef int LONG;
+typedef unsigned int ULONG;
+typedef unsigned int DWORD;
+typedef long long LONGLONG;
+typedef long long LONG64;
+typedef unsigned long long ULONGLONG;
+typedef long long LONG_PTR;
+typedef unsigned long long ULONG_PTR;
+typedef ULONG_PTR KAFFINITY;
+typedef size_t SIZE_T;
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef DWORD* LPDWORD;
+typedef ULONG_PTR* PULONG_PTR;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t WCHAR;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef long (*FARPROC)();
+
+#define WINAPI __attribute__((stdcall))
+#define NTAPI __attribute__((stdcall))
+#define CALLBACK __attribute__((stdcall))
+
+#define TRUE 1
+#define FALSE 0
+#define INFINITE 0xFFFFFFFF
+#define MAXDWORD 0xFFFFFFFF
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define MAX_PATH 260
+
+#define CONTAINING_RECORD(address, type, field) ((type*)((char*)(address) - offsetof(type, field)))
+#define ZeroMemory(destination, length) memset((destination), 0, (length))
+#define YieldProcessor() __builtin_ia32_pause()
+#define MemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define InterlockedIncrement(target) __atomic_add_fetch((volatile LONG*)(target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd64(target, value) __atomic_fetch_add((volatile LONG64*)(target), (value), __ATOMIC_SEQ_CST)
+
+// --- Errors ---
+
+#define ERROR_SUCCESS 0L
+#define ERROR_INVALID_FUNCTION 1L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_OUTOFMEMORY 14L
+#define ERROR_INVALID_DRIVE 15L
+#define ERROR_WRITE_PROTECT 19L
+#define ERROR_BAD_COMMAND 22L
+#define ERROR_SHARING_VIOLATION 32L
+#define ERROR_LOCK_VIOLATION 33L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_NOT_SUPPORTED 50L
+#define ERROR_FILE_EXISTS 80L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_BROKEN_PIPE 109L
+#define ERROR_DISK_FULL 112L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_NO_DATA 232L
+#define ERROR_PIPE_CONNECTED 535L
+#define ERROR_ABANDONED_WAIT_0 735L
+#define ERROR_OPERATION_ABORTED 995L
+#define ERROR_IO_INCOMPLETE 996L
+#define ERROR_IO_PENDING 997L
+#define ERROR_IO_DEVICE 1117L
+#define ERROR_NOT_FOUND 1168L
+#define ERROR_NOT_ALL_ASSIGNED 1300L
+#define ERROR_NO_SYSTEM_RESOURCES 1450L
+#define ERROR_TIMEOUT 1460L
+#define WAIT_OBJECT_0 0L
+#define WAIT_TIMEOUT 258L
+
+// --- Files, pipes and completion ports ---
+
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define FILE_SHARE_DELETE 0x4
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_FLAG_DELETE_ON_CLOSE 0x04000000
+#define FILE_FLAG_NO_BUFFERING 0x20000000
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#define FILE_SKIP_SET_EVENT_ON_HANDLE 0x2
+#define PIPE_ACCESS_INBOUND 0x1
+#define PIPE_ACCESS_OUTBOUND 0x2
+#define PIPE_ACCESS_DUPLEX 0x3
+#define PIPE_TYPE_BYTE 0x0
+#define PIPE_READMODE_BYTE 0x0
+#define PIPE_WAIT 0x0
+#define PIPE_UNLIMITED_INSTANCES 255
+#define VOLUME_NAME_DOS 0x0
+#define FILE_NAME_NORMALIZED 0x0
+
+typedef struct _OVERLAPPED {
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    union {
+        struct {
+            DWORD Offset;
+            DWORD OffsetHigh;
+        };
+        PVOID Pointer;
+    };
+    HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct _OVERLAPPED_ENTRY {
+    ULONG_PTR lpCompletionKey;
+    LPOVERLAPPED lpOverlapped;
+    ULONG_PTR Internal;
+    DWORD dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+
+typedef struct _SECURITY_ATTRIBUTES {
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _BY_HANDLE_FILE_INFORMATION {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD dwVolumeSerialNumber;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD nNumberOfLinks;
+    DWORD nFileIndexHigh;
+    DWORD nFileIndexLow;
+} BY_HANDLE_FILE_INFORMATION;
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+// --- Synchronization ---
+
+typedef struct _SRWLOCK {
+    pthread_rwlock_t lock;
+} SRWLOCK, *PSRWLOCK;
+
+typedef struct _CONDITION_VARIABLE {
+    PVOID Ptr;
+} CONDITION_VARIABLE, *PCONDITION_VARIABLE;
+
+typedef struct _INIT_ONCE {
+    pthread_mutex_t lock;
+    int done;
+    PVOID context;
+} INIT_ONCE, *PINIT_ONCE;
+
+#define SRWLOCK_INIT { PTHREAD_RWLOCK_INITIALIZER }
+#define CONDITION_VARIABLE_INIT { 0 }
+#define CONDITION_VARIABLE_LOCKMODE_SHARED 0x1
+#define INIT_ONCE_STATIC_INIT { PTHREAD_MUTEX_INITIALIZER, 0, 0 }
+
+typedef DWORD (WINAPI* LPTHREAD_START_ROUTINE)(LPVOID);
+typedef BOOL (WINAPI* PINIT_ONCE_FN)(PINIT_ONCE, PVOID, PVOID*);
+
+// --- Processors, NUMA and memory ---
+
+#define ALL_PROCESSOR_GROUPS 0xFFFF
+#define THREAD_PRIORITY_NORMAL 0
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_DECOMMIT 0x4000
+#define MEM_RELEASE 0x8000
+#define MEM_LARGE_PAGES 0x20000000
+#define PAGE_NOACCESS 0x01
+#define PAGE_READWRITE 0x04
+#define FILE_MAP_WRITE 0x2
+#define FILE_MAP_READ 0x4
+#define FILE_MAP_ALL_ACCESS 0xF001F
+
+typedef struct _PROCESSOR_NUMBER {
+    WORD Group;
+    BYTE Number;
+    BYTE Reserved;
+} PROCESSOR_NUMBER;
+
+typedef struct _GROUP_AFFINITY {
+    KAFFINITY Mask;
+    WORD Group;
+    WORD Reserved[3];
+} GROUP_AFFINITY;
+
+typedef enum _LOGICAL_PROCESSOR_RELATIONSHIP {
+    RelationProcessorCore = 0,
+    RelationNumaNode = 1,
+} LOGICAL_PROCESSOR_RELATIONSHIP;
+
+typedef struct _NUMA_NODE_RELATIONSHIP {
+    DWORD NodeNumber;
+    BYTE Reserved[18];
+    WORD GroupCount;
+    union {
+        GROUP_AFFINITY GroupMask;
+        GROUP_AFFINITY GroupMasks[1];
+    };
+} NUMA_NODE_RELATIONSHIP;
+
+typedef struct _SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX {
+    LOGICAL_PROCESSOR_RELATIONSHIP Relationship;
+    DWORD Size;
+    union {
+        NUMA_NODE_RELATIONSHIP NumaNode;
+    };
+} SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX, *PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX;
+
+typedef struct _SYSTEM_INFO {
+    WORD wProcessorArchitecture;
+    WORD wReserved;
+    DWORD dwPageSize;
+    LPVOID lpMinimumApplicationAddress;
+    LPVOID lpMaximumApplicationAddress;
+    ULONG_PTR dwActiveProcessorMask;
+    DWORD dwNumberOfProcessors;
+    DWORD dwProcessorType;
+    DWORD dwAllocationGranularity;
+    WORD wProcessorLevel;
+    WORD wProcessorRevision;
+} SYSTEM_INFO;
+
+// --- Tokens ---
+
+#define TOKEN_QUERY 0x0008
+#define TOKEN_ADJUST_PRIVILEGES 0x0020
+#define SE_PRIVILEGE_ENABLED 0x00000002
+#define SE_LOCK_MEMORY_NAME L"SeLockMemoryPrivilege"
+
+typedef struct _LUID {
+    DWORD LowPart;
+    LONG HighPart;
+} LUID;
+
+typedef struct _LUID_AND_ATTRIBUTES {
+    LUID Luid;
+    DWORD Attributes;
+} LUID_AND_ATTRIBUTES;
+
+typedef struct _TOKEN_PRIVILEGES {
+    DWORD PrivilegeCount;
+    LUID_AND_ATTRIBUTES Privileges[1];
+} TOKEN_PRIVILEGES;
+
+typedef enum _TOKEN_INFORMATION_CLASS {
+    TokenPrivileges = 3,
+} TOKEN_INFORMATION_CLASS;
+
+extern "C" {
+
+// Errors
+DWORD WINAPI GetLastError(void);
+void WINAPI SetLastError(DWORD error);
+
+// Handles, files, pipes and completion ports
+BOOL WINAPI CloseHandle(HANDLE handle);
+HANDLE WINAPI CreateFileA(LPCSTR name, DWORD access, DWORD share, LPSECURITY_ATTRIBUTES security, DWORD disposition, DWORD flags, HANDLE template_file);
+HANDLE WINAPI CreateNamedPipeA(LPCSTR name, DWORD open_mode, DWORD pipe_mode, DWORD max_instances, DWORD out_size, DWORD in_size, DWORD timeout_ms, LPSECURITY_ATTRIBUTES security);
+BOOL WINAPI ConnectNamedPipe(HANDLE pipe, LPOVERLAPPED overlapped);
+BOOL WINAPI ReadFile(HANDLE file, LPVOID buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped);
+BOOL WINAPI WriteFile(HANDLE file, LPCVOID buffer, DWORD length, LPDWORD bytes, LPOVERLAPPED overlapped);
+BOOL WINAPI FlushFileBuffers(HANDLE file);
+BOOL WINAPI GetOverlappedResult(HANDLE file, LPOVERLAPPED overlapped, LPDWORD bytes, BOOL wait);
+BOOL WINAPI CancelIoEx(HANDLE file, LPOVERLAPPED overlapped);
+BOOL WINAPI GetFileInformationByHandle(HANDLE file, BY_HANDLE_FILE_INFORMATION* info);
+DWORD WINAPI GetFinalPathNameByHandleA(HANDLE file, LPSTR path, DWORD length, DWORD flags);
+BOOL WINAPI SetFileCompletionNotificationModes(HANDLE file, UCHAR flags);
+DWORD WINAPI GetTempPathA(DWORD length, LPSTR path);
+BOOL WINAPI DeleteFileA(LPCSTR name);
+HANDLE WINAPI CreateIoCompletionPort(HANDLE file, HANDLE port, ULONG_PTR key, DWORD threads);
+BOOL WINAPI GetQueuedCompletionStatus(HANDLE port, LPDWORD bytes, PULONG_PTR key, LPOVERLAPPED* overlapped, DWORD timeout_ms);
+BOOL WINAPI GetQueuedCompletionStatusEx(HANDLE port, LPOVERLAPPED_ENTRY entries, ULONG count, ULONG* removed, DWORD timeout_ms, BOOL alertable);
+BOOL WINAPI PostQueuedCompletionStatus(HANDLE port, DWORD bytes, ULONG_PTR key, LPOVERLAPPED overlapped);
+
+// Threads, events and synchronization
+HANDLE WINAPI CreateThread(LPSECURITY_ATTRIBUTES security, SIZE_T stack_size, LPTHREAD_START_ROUTINE start, LPVOID parameter, DWORD flags, LPDWORD thread_id);
+HANDLE WINAPI CreateEventW(LPSECURITY_ATTRIBUTES security, BOOL manual_reset, BOOL initial_state, LPCWSTR name);
+BOOL WINAPI SetEvent(HANDLE event);
+BOOL WINAPI ResetEvent(HANDLE event);
+DWORD WINAPI WaitForSingleObject(HANDLE handle, DWORD timeout_ms);
+void WINAPI Sleep(DWORD ms);
+BOOL WINAPI SwitchToThread(void);
+void WINAPI InitializeSRWLock(PSRWLOCK lock);
+void WINAPI AcquireSRWLockExclusive(PSRWLOCK lock);
+void WINAPI ReleaseSRWLockExclusive(PSRWLOCK lock);
+void WINAPI AcquireSRWLockShared(PSRWLOCK lock);
+void WINAPI ReleaseSRWLockShared(PSRWLOCK lock);
+BOOL WINAPI TryAcquireSRWLockExclusive(PSRWLOCK lock);
+void WINAPI InitializeConditionVariable(PCONDITION_VARIABLE condition);
+BOOL WINAPI SleepConditionVariableSRW(PCONDITION_VARIABLE condition, PSRWLOCK lock, DWORD timeout_ms, ULONG flags);
+void WINAPI WakeConditionVariable(PCONDITION_VARIABLE condition);
+void WINAPI WakeAllConditionVariable(PCONDITION_VARIABLE condition);
+void WINAPI InitOnceInitialize(PINIT_ONCE once);
+BOOL WINAPI InitOnceExecuteOnce(PINIT_ONCE once, PINIT_ONCE_FN function, PVOID parameter, LPVOID* context);
+
+// Processes, processors and NUMA
+HANDLE WINAPI GetCurrentProcess(void);
+HANDLE WINAPI GetCurrentThread(void);
+DWORD WINAPI GetCurrentProcessId(void);
+DWORD WINAPI GetCurrentThreadId(void);
+void WINAPI GetCurrentProcessorNumberEx(PROCESSOR_NUMBER* processor);
+DWORD WINAPI GetActiveProcessorCount(WORD group);
+WORD WINAPI GetActiveProcessorGroupCount(void);
+BOOL WINAPI GetNumaHighestNodeNumber(ULONG* highest);
+BOOL WINAPI GetNumaProcessorNodeEx(PROCESSOR_NUMBER* processor, USHORT* node);
+BOOL WINAPI SetThreadGroupAffinity(HANDLE thread, const GROUP_AFFINITY* affinity, GROUP_AFFINITY* previous);
+BOOL WINAPI GetLogicalProcessorInformationEx(LOGICAL_PROCESSOR_RELATIONSHIP relationship, PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX buffer, DWORD* length);
+void WINAPI GetSystemInfo(SYSTEM_INFO* info);
+BOOL WINAPI GetProcessTimes(HANDLE process, FILETIME* creation, FILETIME* exit, FILETIME* kernel, FILETIME* user);
+BOOL WINAPI GetProcessHandleCount(HANDLE process, LPDWORD count);
+
+// Time
+BOOL WINAPI QueryPerformanceCounter(LARGE_INTEGER* counter);
+BOOL WINAPI QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+ULONGLONG WINAPI GetTickCount64(void);
+
+// Memory and file mappings
+LPVOID WINAPI VirtualAlloc(LPVOID address, SIZE_T size, DWORD type, DWORD protect);
+LPVOID WINAPI VirtualAllocExNuma(HANDLE process, LPVOID address, SIZE_T size, DWORD type, DWORD protect, DWORD node);
+BOOL WINAPI VirtualFree(LPVOID address, SIZE_T size, DWORD type);
+SIZE_T WINAPI GetLargePageMinimum(void);
+HANDLE WINAPI CreateFileMappingA(HANDLE file, LPSECURITY_ATTRIBUTES security, DWORD protect, DWORD size_high, DWORD size_low, LPCSTR name);
+HANDLE WINAPI OpenFileMappingA(DWORD access, BOOL inherit, LPCSTR name);
+LPVOID WINAPI MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, SIZE_T size);
+BOOL WINAPI UnmapViewOfFile(LPCVOID address);
+
+// Tokens
+BOOL WINAPI OpenProcessToken(HANDLE process, DWORD access, HANDLE* token);
+BOOL WINAPI LookupPrivilegeValueW(LPCWSTR system, LPCWSTR name, LUID* luid);
+BOOL WINAPI AdjustTokenPrivileges(HANDLE token, BOOL disable_all, TOKEN_PRIVILEGES* state, DWORD length, TOKEN_PRIVILEGES* previous, DWORD* returned);
+BOOL WINAPI GetTokenInformation(HANDLE token, TOKEN_INFORMATION_CLASS information_class, LPVOID information, DWORD length, DWORD* returned);
+
+// Modules, environment and debugging
+HMODULE WINAPI GetModuleHandleW(LPCWSTR name);
+FARPROC WINAPI GetProcAddress(HMODULE module, LPCSTR name);
+DWORD WINAPI GetEnvironmentVariableA(LPCSTR name, LPSTR value, DWORD length);
+BOOL WINAPI SetEnvironmentVariableA(LPCSTR name, LPCSTR value);
+int WINAPI lstrcmpiA(LPCSTR first, LPCSTR second);
+void WINAPI OutputDebugStringA(LPCSTR message);
+
+}
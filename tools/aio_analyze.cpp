@@ -0,0 +1,779 @@
+/**
+ * @file aio_analyze.cpp
+ * @brief Characterises the workload in an I/O trace: sizes, sequentiality, reuse, mix and hot spots.
+ *
+ * The trace is streamed, never loaded whole. A reader thread parses records into fixed-size
+ * chunks and hands every chunk to all workers. Each worker owns a slice of the files, for
+ * the per-file metrics, and a hash-selected slice of the blocks, for reuse distances. Workers
+ * therefore never share mutable state, and the results are merged once at the end. Memory use is
+ * bounded by the number of files and distinct blocks, not by the length of the trace.
+ *
+ * Threads append records to the trace a buffer at a time, so a record may follow records submitted
+ * after it. The reader restores submission order through a heap of the last --reorder records and
+ * counts the records that arrive later than that window reaches.
+ *
+ * Reuse distances are exact within each worker's block slice. A slice is a uniform spatial sample
+ * of the block population, so a slice distance multiplied by the worker count estimates the true
+ * LRU stack distance; this is the spatially hashed sampling of SHARDS (Waldspurger et al., 2015).
+ */
+
+#include "libaio_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// --- Options ---
+
+struct Options {
+    const char* trace_path = nullptr;
+    const char* json_path = nullptr;
+    unsigned threads = 0;
+    uint64_t block_size = 4096;
+    double interval_s = 1.0;
+    uint64_t merge_window_ns = 100000;
+    uint64_t near_distance = 128 * 1024;
+    unsigned top_files = 20;
+    size_t reorder_records = 1 << 18;
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: aio-analyze [options] TRACE\n"
+        "  --json FILE             also write the full report as JSON to FILE (- for stdout)\n"
+        "  --threads N             worker threads (default: hardware concurrency)\n"
+        "  --block-size BYTES      cache block size for reuse distances (default 4096)\n"
+        "  --interval SECONDS      width of the read/write mix timeline buckets (default 1)\n"
+        "  --merge-window-us US    how close in time two adjacent requests must be to merge (default 100)\n"
+        "  --top N                 files listed in the report (default 20)\n"
+        "  --reorder N             records held back to restore submission order (default 262144)\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--json") == 0 && value) { options->json_path = value; ++i; }
+        else if (strcmp(arg, "--threads") == 0 && value) { options->threads = (unsigned)atoi(value); ++i; }
+        else if (strcmp(arg, "--block-size") == 0 && value) { options->block_size = strtoull(value, nullptr, 10); ++i; }
+        else if (strcmp(arg, "--interval") == 0 && value) { options->interval_s = atof(value); ++i; }
+        else if (strcmp(arg, "--merge-window-us") == 0 && value) { options->merge_window_ns = strtoull(value, nullptr, 10) * 1000; ++i; }
+        else if (strcmp(arg, "--top") == 0 && value) { options->top_files = (unsigned)atoi(value); ++i; }
+        else if (strcmp(arg, "--reorder") == 0 && value) { options->reorder_records = (size_t)strtoull(value, nullptr, 10); ++i; }
+        else if (arg[0] != '-' && !options->trace_path) options->trace_path = arg;
+        else return false;
+    }
+    if (options->threads == 0) options->threads = std::max(1u, std::thread::hardware_concurrency());
+    return options->trace_path && options->block_size > 0 && options->interval_s > 0;
+}
+
+// --- Shared Definitions ---
+
+/// A submission, reduced to what the metrics need.
+struct Access {
+    uint32_t file;
+    uint8_t opcode;
+    int64_t offset;
+    uint64_t length;
+    int64_t time_ns;
+};
+
+static bool is_read(uint8_t opcode) { return opcode == AIO_TRACE_OP_PREAD || opcode == AIO_TRACE_OP_PREADV || opcode == AIO_TRACE_OP_PREAD_SELECT; }
+static bool is_write(uint8_t opcode) { return opcode == AIO_TRACE_OP_PWRITE || opcode == AIO_TRACE_OP_PWRITEV; }
+
+enum { READ = 0, WRITE = 1, DIRECTIONS = 2 };
+static const char* const DIRECTION_NAMES[DIRECTIONS] = { "read", "write" };
+
+static const unsigned SIZE_BUCKETS = 48;    ///< log2 buckets; bucket b holds sizes in [2^(b-1), 2^b).
+static const unsigned HEAT_BINS = 64;
+static const uint64_t HEAT_MIN_BIN_BYTES = 1 << 20;
+
+static unsigned log2_bucket(uint64_t value) {
+    unsigned bucket = 0;
+    while (value) { value >>= 1; ++bucket; }
+    return std::min(bucket, SIZE_BUCKETS - 1);
+}
+
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// --- Per-File Metrics ---
+
+struct FileStats {
+    uint64_t ops[DIRECTIONS] = {};
+    uint64_t bytes[DIRECTIONS] = {};
+    uint64_t syncs = 0;
+    uint64_t sequential[DIRECTIONS] = {};   ///< Started exactly where the previous request in that direction ended.
+    uint64_t near[DIRECTIONS] = {};         ///< Started within near_distance of it.
+    uint64_t mergeable[DIRECTIONS] = {};    ///< Sequential and submitted within the merge window of it.
+    int64_t last_end[DIRECTIONS] = { -1, -1 };
+    int64_t last_time[DIRECTIONS] = {};
+    uint64_t heat_bin_bytes = HEAT_MIN_BIN_BYTES;
+    uint64_t heat[HEAT_BINS] = {};
+    uint64_t max_offset = 0;
+
+    /// Halves the heat map's resolution, doubling the range it covers.
+    void heat_coarsen() {
+        for (unsigned i = 0; i < HEAT_BINS / 2; ++i) heat[i] = heat[2 * i] + heat[2 * i + 1];
+        std::fill(heat + HEAT_BINS / 2, heat + HEAT_BINS, 0);
+        heat_bin_bytes *= 2;
+    }
+
+    void heat_add(uint64_t offset, uint64_t count = 1) {
+        while (offset / heat_bin_bytes >= HEAT_BINS) heat_coarsen();
+        heat[offset / heat_bin_bytes] += count;
+        max_offset = std::max(max_offset, offset);
+    }
+
+    void merge_from(const FileStats& other) {
+        for (int d = 0; d < DIRECTIONS; ++d) {
+            ops[d] += other.ops[d];
+            bytes[d] += other.bytes[d];
+            sequential[d] += other.sequential[d];
+            near[d] += other.near[d];
+            mergeable[d] += other.mergeable[d];
+        }
+        syncs += other.syncs;
+        while (heat_bin_bytes < other.heat_bin_bytes) heat_coarsen();
+        for (unsigned i = 0; i < HEAT_BINS; ++i) {
+            if (other.heat[i]) heat_add(i * other.heat_bin_bytes, other.heat[i]);
+        }
+        max_offset = std::max(max_offset, other.max_offset);
+    }
+};
+
+struct TimeBucket {
+    uint64_t ops[DIRECTIONS] = {};
+    uint64_t bytes[DIRECTIONS] = {};
+};
+
+// --- Reuse Distance ---
+
+/**
+ * @brief Exact LRU stack distances for one slice of the block population.
+ *
+ * Each block's most recent access time is marked in a Fenwick tree; the stack distance of a
+ * re-access is the number of marks after the block's previous time. When the time axis fills
+ * up, live marks are renumbered densely, so memory stays proportional to the distinct blocks.
+ */
+class ReuseSlice {
+public:
+    ReuseSlice() : capacity_(1 << 20), tree_(capacity_ + 1, 0), now_(0) {}
+
+    /// Returns the stack distance of an access, or UINT64_MAX for a first access.
+    uint64_t access(uint64_t key) {
+        if (now_ == capacity_) compact();
+        uint64_t distance = UINT64_MAX;
+        auto it = last_.find(key);
+        if (it != last_.end()) {
+            distance = prefix(now_) - prefix(it->second + 1);
+            add(it->second, -1);
+            it->second = now_;
+        }
+        else {
+            last_.emplace(key, now_);
+        }
+        add(now_, 1);
+        now_++;
+        return distance;
+    }
+
+private:
+    void add(uint64_t position, int delta) {
+        for (uint64_t i = position + 1; i <= capacity_; i += i & (~i + 1)) tree_[i] += delta;
+    }
+
+    /// Number of marks in [0, position).
+    uint64_t prefix(uint64_t position) const {
+        int64_t sum = 0;
+        for (uint64_t i = position; i > 0; i -= i & (~i + 1)) sum += tree_[i];
+        return (uint64_t)sum;
+    }
+
+    void compact() {
+        std::vector<std::pair<uint64_t, uint64_t>> live;
+        live.reserve(last_.size());
+        for (const auto& entry : last_) live.emplace_back(entry.second, entry.first);
+        std::sort(live.begin(), live.end());
+        if (live.size() * 2 > capacity_) capacity_ *= 2;
+        tree_.assign(capacity_ + 1, 0);
+        now_ = 0;
+        for (const auto& entry : live) {
+            last_[entry.second] = now_;
+            add(now_, 1);
+            now_++;
+        }
+    }
+
+    uint64_t capacity_;
+    std::vector<int64_t> tree_;
+    uint64_t now_;
+    std::unordered_map<uint64_t, uint64_t> last_;
+};
+
+static const unsigned DISTANCE_BUCKETS = 64;    ///< log2 buckets of the distance in bytes, plus one for first accesses.
+
+// --- Workers ---
+
+struct Chunk {
+    std::vector<Access> accesses;
+};
+
+/// Everything one worker accumulates. Workers own disjoint files and blocks.
+struct WorkerResult {
+    std::unordered_map<uint32_t, FileStats> files;
+    uint64_t sizes[DIRECTIONS][SIZE_BUCKETS] = {};
+    std::map<int64_t, TimeBucket> timeline;
+    uint64_t distances[DISTANCE_BUCKETS + 1] = {};  ///< The last bucket counts first accesses.
+    uint64_t block_accesses = 0;
+};
+
+class Worker {
+public:
+    Worker(const Options& options, unsigned index, unsigned count)
+        : options_(options), index_(index), count_(count), done_(false) {
+        thread_ = std::thread(&Worker::run, this);
+    }
+
+    /// Queues a chunk, blocking while this worker is far behind so memory stays bounded.
+    void post(const std::shared_ptr<Chunk>& chunk) {
+        std::unique_lock<std::mutex> guard(lock_);
+        space_.wait(guard, [&] { return queue_.size() < 8; });
+        queue_.push_back(chunk);
+        ready_.notify_one();
+    }
+
+    void finish() {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            done_ = true;
+        }
+        ready_.notify_one();
+        thread_.join();
+    }
+
+    WorkerResult result;
+
+private:
+    void run() {
+        for (;;) {
+            std::shared_ptr<Chunk> chunk;
+            {
+                std::unique_lock<std::mutex> guard(lock_);
+                ready_.wait(guard, [&] { return !queue_.empty() || done_; });
+                if (queue_.empty()) return;
+                chunk = queue_.front();
+                queue_.pop_front();
+                space_.notify_one();
+            }
+            for (const Access& access : chunk->accesses) process(access);
+        }
+    }
+
+    void process(const Access& access) {
+        bool read = is_read(access.opcode);
+        bool write = is_write(access.opcode);
+
+        // Blocks hash to workers independently of files, which spreads a single hot file's reuse work.
+        if (read || write) {
+            uint64_t first = (uint64_t)access.offset / options_.block_size;
+            uint64_t last = ((uint64_t)access.offset + std::max<uint64_t>(access.length, 1) - 1) / options_.block_size;
+            for (uint64_t block = first; block <= last; ++block) {
+                uint64_t key = ((uint64_t)access.file << 44) ^ block;
+                if (mix64(key) % count_ != index_) continue;
+                uint64_t distance = reuse_.access(key);
+                result.block_accesses++;
+                if (distance == UINT64_MAX) result.distances[DISTANCE_BUCKETS]++;
+                else result.distances[std::min<unsigned>(log2_bucket(distance * count_ * options_.block_size), DISTANCE_BUCKETS - 1)]++;
+            }
+        }
+
+        if (access.file % count_ != index_) return;
+        FileStats& file = result.files[access.file];
+        if (!read && !write) {
+            file.syncs++;
+            return;
+        }
+        int d = read ? READ : WRITE;
+        file.ops[d]++;
+        file.bytes[d] += access.length;
+        file.heat_add((uint64_t)access.offset);
+        if (file.last_end[d] >= 0) {
+            int64_t gap = access.offset - file.last_end[d];
+            if (gap == 0) {
+                file.sequential[d]++;
+                // A record later than the reorder window reaches can precede its predecessor.
+                int64_t since = access.time_ns - file.last_time[d];
+                if ((uint64_t)(since < 0 ? -since : since) <= options_.merge_window_ns) file.mergeable[d]++;
+            }
+            else if ((uint64_t)(gap < 0 ? -gap : gap) <= options_.near_distance) {
+                file.near[d]++;
+            }
+        }
+        file.last_end[d] = access.offset + (int64_t)access.length;
+        file.last_time[d] = access.time_ns;
+
+        result.sizes[d][log2_bucket(access.length)]++;
+        TimeBucket& bucket = result.timeline[(int64_t)(access.time_ns / (options_.interval_s * 1e9))];
+        bucket.ops[d]++;
+        bucket.bytes[d] += access.length;
+    }
+
+    const Options& options_;
+    unsigned index_;
+    unsigned count_;
+    ReuseSlice reuse_;
+    std::mutex lock_;
+    std::condition_variable ready_;
+    std::condition_variable space_;
+    std::deque<std::shared_ptr<Chunk>> queue_;
+    bool done_;
+    std::thread thread_;
+};
+
+// --- Trace Reading ---
+
+struct TraceSummary {
+    uint64_t records = 0;
+    uint64_t submits = 0;
+    uint64_t completes = 0;
+    uint64_t dropped = 0;
+    uint64_t late = 0;               ///< Submissions older than one already handed to the workers.
+    bool complete = false;
+    int64_t first_ns = INT64_MAX;
+    int64_t last_ns = 0;
+    std::vector<std::string> paths;  ///< Indexed by Access::file.
+};
+
+/// Streams records out of a trace file through a large read buffer.
+class TraceReader {
+public:
+    explicit TraceReader(FILE* file) : file_(file), buffer_(1 << 22), begin_(0), end_(0) {}
+
+    bool read(void* out, size_t length) {
+        char* target = static_cast<char*>(out);
+        while (length) {
+            if (begin_ == end_) {
+                end_ = fread(buffer_.data(), 1, buffer_.size(), file_);
+                begin_ = 0;
+                if (end_ == 0) return false;
+            }
+            size_t take = std::min(length, end_ - begin_);
+            memcpy(target, buffer_.data() + begin_, take);
+            begin_ += take;
+            target += take;
+            length -= take;
+        }
+        return true;
+    }
+
+private:
+    FILE* file_;
+    std::vector<char> buffer_;
+    size_t begin_;
+    size_t end_;
+};
+
+/**
+ * @brief Hands accesses on in submission order, as far as a window of the most recent ones allows.
+ *
+ * Ties keep trace order, so a trace that is already ordered passes through unchanged.
+ */
+class ReorderWindow {
+public:
+    ReorderWindow(size_t capacity, uint64_t* late) : capacity_(capacity), late_(late), sequence_(0), emitted_ns_(INT64_MIN) {}
+
+    template <class Emit>
+    void push(const Access& access, Emit emit) {
+        pending_.push(Pending{ access, sequence_++ });
+        if (pending_.size() > capacity_) pop(emit);
+    }
+
+    template <class Emit>
+    void flush(Emit emit) {
+        while (!pending_.empty()) pop(emit);
+    }
+
+private:
+    struct Pending {
+        Access access;
+        uint64_t sequence;
+    };
+    struct Later {
+        bool operator()(const Pending& a, const Pending& b) const {
+            return a.access.time_ns != b.access.time_ns ? a.access.time_ns > b.access.time_ns : a.sequence > b.sequence;
+        }
+    };
+
+    template <class Emit>
+    void pop(Emit emit) {
+        const Access& access = pending_.top().access;
+        if (access.time_ns < emitted_ns_) (*late_)++;
+        else emitted_ns_ = access.time_ns;
+        emit(access);
+        pending_.pop();
+    }
+
+    size_t capacity_;
+    uint64_t* late_;
+    uint64_t sequence_;
+    int64_t emitted_ns_;
+    std::priority_queue<Pending, std::vector<Pending>, Later> pending_;
+};
+
+static int64_t ticks_to_ns(int64_t ticks, int64_t ticks_per_second) {
+    return ticks / ticks_per_second * 1000000000LL + ticks % ticks_per_second * 1000000000LL / ticks_per_second;
+}
+
+static bool stream_trace(const Options& options, std::vector<std::unique_ptr<Worker>>& workers, TraceSummary* summary) {
+    FILE* file = fopen(options.trace_path, "rb");
+    if (!file) {
+        fprintf(stderr, "aio-analyze: cannot open %s\n", options.trace_path);
+        return false;
+    }
+    TraceReader reader(file);
+    aio_trace_header header;
+    if (!reader.read(&header, sizeof(header)) || memcmp(header.magic, AIO_TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != AIO_TRACE_VERSION || header.record_size != sizeof(aio_trace_record) || header.ticks_per_second <= 0) {
+        fprintf(stderr, "aio-analyze: %s is not a version %d trace\n", options.trace_path, AIO_TRACE_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    const size_t CHUNK_SIZE = 1 << 16;
+    std::map<std::pair<uint32_t, int32_t>, uint32_t> context_files;
+    std::map<int32_t, uint32_t> fd_files;
+    std::map<std::string, uint32_t> file_ids;
+    auto file_id = [&](const std::string& path) {
+        auto inserted = file_ids.emplace(path, (uint32_t)summary->paths.size());
+        if (inserted.second) summary->paths.push_back(path);
+        return inserted.first->second;
+    };
+
+    std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+    chunk->accesses.reserve(CHUNK_SIZE);
+    auto emit = [&](const Access& access) {
+        chunk->accesses.push_back(access);
+        if (chunk->accesses.size() == CHUNK_SIZE) {
+            for (auto& worker : workers) worker->post(chunk);
+            chunk = std::make_shared<Chunk>();
+            chunk->accesses.reserve(CHUNK_SIZE);
+        }
+    };
+    ReorderWindow window(options.reorder_records, &summary->late);
+    aio_trace_record record;
+    while (reader.read(&record, sizeof(record))) {
+        summary->records++;
+        if (record.kind == AIO_TRACE_FILE) {
+            size_t padded = (size_t)(record.length + sizeof(record) - 1) / sizeof(record) * sizeof(record);
+            std::vector<char> path(padded);
+            if (padded && !reader.read(path.data(), padded)) break;
+            uint32_t id = file_id(std::string(path.data(), (size_t)record.length));
+            context_files[std::make_pair(record.context, record.fd)] = id;
+            fd_files[record.fd] = id;
+            continue;
+        }
+        if (record.kind == AIO_TRACE_END) {
+            summary->dropped = record.length;
+            summary->complete = true;
+            continue;
+        }
+        if (record.kind == AIO_TRACE_COMPLETE) {
+            summary->completes++;
+            continue;
+        }
+        if (record.kind != AIO_TRACE_SUBMIT) continue;
+
+        summary->submits++;
+        Access access;
+        auto by_context = context_files.find(std::make_pair(record.context, record.fd));
+        auto by_fd = fd_files.find(record.fd);
+        if (by_context != context_files.end()) access.file = by_context->second;
+        else if (by_fd != fd_files.end()) access.file = by_fd->second;
+        else access.file = file_id("fd " + std::to_string(record.fd));
+        access.opcode = record.opcode;
+        access.offset = record.offset;
+        access.length = record.length;
+        access.time_ns = ticks_to_ns(record.ticks, header.ticks_per_second);
+        summary->first_ns = std::min(summary->first_ns, access.time_ns);
+        summary->last_ns = std::max(summary->last_ns, access.time_ns);
+        window.push(access, emit);
+    }
+    window.flush(emit);
+    if (!chunk->accesses.empty()) {
+        for (auto& worker : workers) worker->post(chunk);
+    }
+    fclose(file);
+    return true;
+}
+
+// --- Report ---
+
+struct Report {
+    TraceSummary summary;
+    std::vector<std::pair<uint32_t, FileStats>> files;  ///< Sorted by ops, descending.
+    FileStats totals;
+    uint64_t sizes[DIRECTIONS][SIZE_BUCKETS] = {};
+    std::map<int64_t, TimeBucket> timeline;
+    uint64_t distances[DISTANCE_BUCKETS + 1] = {};
+    uint64_t block_accesses = 0;
+};
+
+static void merge_results(std::vector<std::unique_ptr<Worker>>& workers, Report* report) {
+    for (auto& worker : workers) {
+        WorkerResult& result = worker->result;
+        for (auto& file : result.files) {
+            report->files.emplace_back(file.first, file.second);
+            report->totals.merge_from(file.second);
+        }
+        for (int d = 0; d < DIRECTIONS; ++d) {
+            for (unsigned b = 0; b < SIZE_BUCKETS; ++b) report->sizes[d][b] += result.sizes[d][b];
+        }
+        for (auto& bucket : result.timeline) {
+            TimeBucket& into = report->timeline[bucket.first];
+            for (int d = 0; d < DIRECTIONS; ++d) {
+                into.ops[d] += bucket.second.ops[d];
+                into.bytes[d] += bucket.second.bytes[d];
+            }
+        }
+        for (unsigned b = 0; b <= DISTANCE_BUCKETS; ++b) report->distances[b] += result.distances[b];
+        report->block_accesses += result.block_accesses;
+    }
+    std::sort(report->files.begin(), report->files.end(), [](const std::pair<uint32_t, FileStats>& a, const std::pair<uint32_t, FileStats>& b) {
+        uint64_t ops_a = a.second.ops[READ] + a.second.ops[WRITE] + a.second.syncs;
+        uint64_t ops_b = b.second.ops[READ] + b.second.ops[WRITE] + b.second.syncs;
+        return ops_a != ops_b ? ops_a > ops_b : a.first < b.first;
+    });
+}
+
+static double ratio(uint64_t part, uint64_t whole) {
+    return whole ? (double)part / (double)whole : 0.0;
+}
+
+/// Hit ratio of an LRU cache of 2^b bytes: accesses whose reuse distance bucket lies below it.
+static double hit_ratio(const Report& report, unsigned b) {
+    uint64_t hits = 0;
+    for (unsigned i = 0; i <= b && i < DISTANCE_BUCKETS; ++i) hits += report.distances[i];
+    return ratio(hits, report.block_accesses);
+}
+
+static std::string json_string(const std::string& value) {
+    std::string out = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if ((unsigned char)c < 0x20) { char escaped[8]; snprintf(escaped, sizeof(escaped), "\\u%04x", c); out += escaped; }
+        else out += c;
+    }
+    return out + "\"";
+}
+
+static void write_json(FILE* out, const Options& options, const Report& report) {
+    const TraceSummary& summary = report.summary;
+    double duration_s = summary.submits ? (double)(summary.last_ns - summary.first_ns) / 1e9 : 0;
+    fprintf(out, "{\n  \"trace\": {\"path\": %s, \"records\": %llu, \"submits\": %llu, \"completes\": %llu, "
+        "\"dropped\": %llu, \"late\": %llu, \"complete\": %s, \"duration_s\": %.6f, \"files\": %zu},\n",
+        json_string(options.trace_path).c_str(), (unsigned long long)summary.records, (unsigned long long)summary.submits,
+        (unsigned long long)summary.completes, (unsigned long long)summary.dropped, (unsigned long long)summary.late, summary.complete ? "true" : "false",
+        duration_s, report.files.size());
+
+    fprintf(out, "  \"size_histogram\": {");
+    for (int d = 0; d < DIRECTIONS; ++d) {
+        fprintf(out, "%s\n    \"%s\": [", d ? "," : "", DIRECTION_NAMES[d]);
+        bool first = true;
+        for (unsigned b = 0; b < SIZE_BUCKETS; ++b) {
+            if (!report.sizes[d][b]) continue;
+            fprintf(out, "%s{\"min_bytes\": %llu, \"max_bytes\": %llu, \"count\": %llu}", first ? "" : ", ",
+                b ? 1ULL << (b - 1) : 0ULL, b ? (1ULL << b) - 1 : 0ULL, (unsigned long long)report.sizes[d][b]);
+            first = false;
+        }
+        fprintf(out, "]");
+    }
+    fprintf(out, "\n  },\n");
+
+    const FileStats& t = report.totals;
+    fprintf(out, "  \"sequentiality\": {");
+    for (int d = 0; d < DIRECTIONS; ++d) {
+        fprintf(out, "%s\n    \"%s\": {\"requests\": %llu, \"sequential\": %.4f, \"near_sequential\": %.4f, \"random\": %.4f}",
+            d ? "," : "", DIRECTION_NAMES[d], (unsigned long long)t.ops[d], ratio(t.sequential[d], t.ops[d]), ratio(t.near[d], t.ops[d]),
+            1.0 - ratio(t.sequential[d] + t.near[d], t.ops[d]));
+    }
+    fprintf(out, ",\n    \"near_distance_bytes\": %llu\n  },\n", (unsigned long long)options.near_distance);
+
+    fprintf(out, "  \"merge\": {\"window_us\": %llu", (unsigned long long)(options.merge_window_ns / 1000));
+    for (int d = 0; d < DIRECTIONS; ++d) {
+        uint64_t merged_requests = t.ops[d] - t.mergeable[d];
+        fprintf(out, ", \"%s\": {\"mergeable\": %.4f, \"requests_after_merging\": %llu, \"mean_bytes_after_merging\": %.1f}",
+            DIRECTION_NAMES[d], ratio(t.mergeable[d], t.ops[d]), (unsigned long long)merged_requests,
+            merged_requests ? (double)t.bytes[d] / (double)merged_requests : 0.0);
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"reuse\": {\"block_size\": %llu, \"block_accesses\": %llu, \"first_accesses\": %llu, \"sampling_slices\": %u,\n",
+        (unsigned long long)options.block_size, (unsigned long long)report.block_accesses,
+        (unsigned long long)report.distances[DISTANCE_BUCKETS], options.threads);
+    fprintf(out, "    \"distance_histogram\": [");
+    bool first = true;
+    for (unsigned b = 0; b < DISTANCE_BUCKETS; ++b) {
+        if (!report.distances[b]) continue;
+        fprintf(out, "%s{\"max_distance_bytes\": %llu, \"count\": %llu}", first ? "" : ", ",
+            b ? (1ULL << b) - 1 : 0ULL, (unsigned long long)report.distances[b]);
+        first = false;
+    }
+    fprintf(out, "],\n    \"lru_hit_ratio\": [");
+    first = true;
+    for (unsigned b = log2_bucket(options.block_size); b < DISTANCE_BUCKETS - 1; ++b) {
+        fprintf(out, "%s{\"cache_bytes\": %llu, \"hit_ratio\": %.4f}", first ? "" : ", ", 1ULL << b, hit_ratio(report, b));
+        first = false;
+        if (hit_ratio(report, b) >= hit_ratio(report, DISTANCE_BUCKETS - 1)) break;
+    }
+    fprintf(out, "]\n  },\n");
+
+    fprintf(out, "  \"timeline\": {\"interval_s\": %g, \"buckets\": [", options.interval_s);
+    first = true;
+    for (const auto& bucket : report.timeline) {
+        fprintf(out, "%s\n    {\"start_s\": %g, \"read_ops\": %llu, \"read_bytes\": %llu, \"write_ops\": %llu, \"write_bytes\": %llu}",
+            first ? "" : ",", (double)bucket.first * options.interval_s, (unsigned long long)bucket.second.ops[READ],
+            (unsigned long long)bucket.second.bytes[READ], (unsigned long long)bucket.second.ops[WRITE], (unsigned long long)bucket.second.bytes[WRITE]);
+        first = false;
+    }
+    fprintf(out, "\n  ]},\n");
+
+    fprintf(out, "  \"files\": [");
+    for (size_t i = 0; i < report.files.size() && i < options.top_files; ++i) {
+        const FileStats& file = report.files[i].second;
+        fprintf(out, "%s\n    {\"path\": %s, \"read_ops\": %llu, \"write_ops\": %llu, \"syncs\": %llu, \"read_bytes\": %llu, "
+            "\"write_bytes\": %llu, \"max_offset\": %llu, \"heat_bin_bytes\": %llu, \"heat\": [",
+            i ? "," : "", json_string(summary.paths[report.files[i].first]).c_str(), (unsigned long long)file.ops[READ],
+            (unsigned long long)file.ops[WRITE], (unsigned long long)file.syncs, (unsigned long long)file.bytes[READ],
+            (unsigned long long)file.bytes[WRITE], (unsigned long long)file.max_offset, (unsigned long long)file.heat_bin_bytes);
+        unsigned used = (unsigned)std::min<uint64_t>(HEAT_BINS, file.max_offset / file.heat_bin_bytes + 1);
+        for (unsigned b = 0; b < used; ++b) fprintf(out, "%s%llu", b ? ", " : "", (unsigned long long)file.heat[b]);
+        fprintf(out, "]}");
+    }
+    fprintf(out, "\n  ]\n}\n");
+}
+
+static std::string human_bytes(double bytes) {
+    static const char* units[] = { "B", "KiB", "MiB", "GiB", "TiB", "PiB" };
+    unsigned unit = 0;
+    while (bytes >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) { bytes /= 1024; ++unit; }
+    char text[32];
+    snprintf(text, sizeof(text), bytes < 10 && unit ? "%.1f %s" : "%.0f %s", bytes, units[unit]);
+    return text;
+}
+
+static void write_text(const Options& options, const Report& report) {
+    const TraceSummary& summary = report.summary;
+    const FileStats& t = report.totals;
+    double duration_s = summary.submits ? (double)(summary.last_ns - summary.first_ns) / 1e9 : 0;
+    printf("trace: %llu submissions over %.3f s on %zu files%s", (unsigned long long)summary.submits, duration_s,
+        report.files.size(), summary.complete ? "" : " (no end record)");
+    if (summary.dropped) printf(", %llu records dropped while recording", (unsigned long long)summary.dropped);
+    if (summary.late) printf(", %llu submissions out of order beyond --reorder", (unsigned long long)summary.late);
+    printf("\n");
+
+    uint64_t ops = t.ops[READ] + t.ops[WRITE];
+    printf("\nmix: %.1f%% reads, %.1f%% writes by count; %.1f%% reads by bytes; %llu syncs\n",
+        100 * ratio(t.ops[READ], ops), 100 * ratio(t.ops[WRITE], ops), 100 * ratio(t.bytes[READ], t.bytes[READ] + t.bytes[WRITE]),
+        (unsigned long long)t.syncs);
+
+    for (int d = 0; d < DIRECTIONS; ++d) {
+        if (!t.ops[d]) continue;
+        printf("\n%s sizes (mean %s)\n", DIRECTION_NAMES[d], human_bytes((double)t.bytes[d] / (double)t.ops[d]).c_str());
+        uint64_t peak = *std::max_element(report.sizes[d], report.sizes[d] + SIZE_BUCKETS);
+        for (unsigned b = 0; b < SIZE_BUCKETS; ++b) {
+            if (!report.sizes[d][b]) continue;
+            std::string bar((size_t)(40.0 * (double)report.sizes[d][b] / (double)peak + 0.5), '#');
+            printf("  %10s .. %-10s %6.2f%% %s\n", human_bytes(b ? (double)(1ULL << (b - 1)) : 0).c_str(),
+                human_bytes((double)(1ULL << b)).c_str(), 100 * ratio(report.sizes[d][b], t.ops[d]), bar.c_str());
+        }
+        printf("  sequential %.1f%%, within %s %.1f%%, random %.1f%%\n", 100 * ratio(t.sequential[d], t.ops[d]),
+            human_bytes((double)options.near_distance).c_str(), 100 * ratio(t.near[d], t.ops[d]),
+            100 * (1 - ratio(t.sequential[d] + t.near[d], t.ops[d])));
+        uint64_t merged = t.ops[d] - t.mergeable[d];
+        printf("  mergeable within %llu us: %.1f%% (%llu requests of %s on average after merging)\n",
+            (unsigned long long)(options.merge_window_ns / 1000), 100 * ratio(t.mergeable[d], t.ops[d]),
+            (unsigned long long)merged, human_bytes(merged ? (double)t.bytes[d] / (double)merged : 0).c_str());
+    }
+
+    printf("\nLRU cache hit ratio by size (%s blocks, %llu accesses, %.1f%% first accesses)\n",
+        human_bytes((double)options.block_size).c_str(), (unsigned long long)report.block_accesses,
+        100 * ratio(report.distances[DISTANCE_BUCKETS], report.block_accesses));
+    double ceiling = hit_ratio(report, DISTANCE_BUCKETS - 1);
+    for (unsigned b = log2_bucket(options.block_size); b < DISTANCE_BUCKETS - 1; b += 2) {
+        double hits = hit_ratio(report, b);
+        printf("  %10s %6.2f%%\n", human_bytes((double)(1ULL << b)).c_str(), 100 * hits);
+        if (hits >= ceiling) break;
+    }
+
+    if (report.timeline.size() > 1) {
+        printf("\nread/write mix over time (%g s buckets, %% reads by count)\n  ", options.interval_s);
+        size_t step = (report.timeline.size() + 59) / 60;
+        size_t i = 0;
+        for (const auto& bucket : report.timeline) {
+            if (i++ % step) continue;
+            uint64_t total = bucket.second.ops[READ] + bucket.second.ops[WRITE];
+            int share = (int)(10 * ratio(bucket.second.ops[READ], total));
+            putchar("0123456789*"[std::min(share, 10)]);
+        }
+        printf("\n  (0 = under 10%% reads ... * = all reads)\n");
+    }
+
+    printf("\nhottest files (heat across each file's offset range)\n");
+    static const char shades[] = " .:-=+*#%@";
+    for (size_t i = 0; i < report.files.size() && i < options.top_files; ++i) {
+        const FileStats& file = report.files[i].second;
+        uint64_t peak = *std::max_element(file.heat, file.heat + HEAT_BINS);
+        unsigned used = (unsigned)std::min<uint64_t>(HEAT_BINS, file.max_offset / file.heat_bin_bytes + 1);
+        std::string strip;
+        for (unsigned b = 0; b < used; ++b) strip += shades[peak ? (size_t)(9.0 * (double)file.heat[b] / (double)peak + 0.5) : 0];
+        printf("  %9llu ops %10s  |%s| %s\n", (unsigned long long)(file.ops[READ] + file.ops[WRITE] + file.syncs),
+            human_bytes((double)(file.bytes[READ] + file.bytes[WRITE])).c_str(), strip.c_str(), summary.paths[report.files[i].first].c_str());
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < options.threads; ++i) workers.emplace_back(new Worker(options, i, options.threads));
+    Report report;
+    bool streamed = stream_trace(options, workers, &report.summary);
+    for (auto& worker : workers) worker->finish();
+    if (!streamed) return 1;
+
+    merge_results(workers, &report);
+    // With the JSON on stdout, the text report would make it unparseable.
+    bool json_to_stdout = options.json_path && strcmp(options.json_path, "-") == 0;
+    if (!json_to_stdout) write_text(options, report);
+    if (options.json_path) {
+        FILE* out = json_to_stdout ? stdout : fopen(options.json_path, "w");
+        if (!out) {
+            fprintf(stderr, "aio-analyze: cannot create %s\n", options.json_path);
+            return 1;
+        }
+        write_json(out, options, report);
+        if (out != stdout) fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,2195 @@
+/**
+ * @file aio_bench.cpp
+ * @brief Open-loop latency benchmark: offers I/O at fixed rates and reports latency percentiles.
+ *
+ * Requests are issued on a schedule, with Poisson or constant inter-arrival times, whether or not
+ * earlier ones have completed, and each latency is measured from the time the request was due to
+ * be sent. A stall therefore shows up in the latency of every request that should have been sent
+ * during it, instead of silently lowering the request rate as in a closed-loop benchmark
+ * (coordinated omission). Sweeping the offered load gives a latency-throughput curve per engine.
+ *
+ * With --scale it instead sweeps threads, contexts, queue depth and batch size in closed loops, to
+ * show where the submission and completion paths stop scaling; on Windows the null and simulated
+ * engines take the device out of the measurement. With --footprint it holds a given number of
+ * requests in flight and reports the memory the library spends on each, and what provided buffers
+ * save on queued reads, with --churn it
+ * times io_setup/io_destroy cycles, and with --many-contexts it compares the memory and
+ * throughput of many dedicated contexts against as many thin ones. With --call-cost it times single
+ * API calls, so that builds linking the library as a DLL, statically or inline can be compared.
+ *
+ * The tool builds unchanged on Windows, where it drives libaio-win32 and can compare its engines,
+ * and on Linux, where it drives the native libaio or, built with LIBAIO_LINUX_ENGINE as
+ * aio-bench-engine, libaio-linux, whose kernel and thread-pool engines it can compare the same way.
+ */
+
+#include "libaio_win32.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#include <psapi.h>
+#else
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// --- Options ---
+
+enum Arrivals {
+    ARRIVALS_POISSON,
+    ARRIVALS_CONSTANT,
+};
+
+struct Options {
+    const char* path = nullptr;
+    std::vector<double> rates;          ///< Offered loads in requests per second.
+    unsigned closed_qd = 0;             ///< Non-zero: closed loop at this queue depth instead of a rate sweep.
+    Arrivals arrivals = ARRIVALS_POISSON;
+    double duration_s = 10.0;
+    double warmup_s = 1.0;
+    size_t block_size = 4096;
+    unsigned long long size = 0;        ///< 0 = the whole file.
+    bool write = false;
+    bool direct = false;
+    unsigned max_inflight = 1024;
+    std::vector<std::string> backends;
+    const char* csv_path = nullptr;
+    unsigned long long seed = 1;
+    bool suite = false;                 ///< Run the standard closed-loop workloads instead.
+    bool compare = false;               ///< Print CSVs side by side instead of measuring.
+    std::vector<const char*> compare_paths;
+    bool scale = false;                 ///< Sweep threads x contexts x QD x batch instead.
+    bool churn = false;                 ///< Time io_setup/io_destroy cycles, and teardown under load, instead.
+    std::vector<unsigned> threads;
+    std::vector<std::string> contexts;  ///< Context counts, or "thread" for one per thread.
+    std::vector<unsigned> qds;          ///< Requests each thread keeps in flight.
+    std::vector<unsigned> batches;      ///< Most requests per io_submit and per io_getevents.
+    const char* sim_latency_us = nullptr; ///< Completion latency of the simulated engine.
+    bool locked_pool_queue = false;     ///< Run the thread-pool engine on its single locked queue.
+    bool profile = false;               ///< Time the library's submit and reap paths with its self-profiler.
+    bool numa = false;                  ///< Bind sweep threads to NUMA nodes round-robin and count cross-node accesses.
+    bool tlb = false;                   ///< Count the sweep threads' data-TLB misses and the structures on large pages.
+    unsigned long long footprint = 0;   ///< Non-zero: measure the memory of this many requests in flight instead.
+    unsigned many_contexts = 0;         ///< Non-zero: open this many dedicated, then thin, contexts instead.
+    bool call_cost = false;             ///< Time single API calls instead, to compare how the library is linked.
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: aio-bench [options] FILE\n"
+        "       aio-bench --scale [scaling options] [options] FILE\n"
+        "       aio-bench --churn [options] FILE\n"
+        "       aio-bench --call-cost [options] FILE\n"
+        "       aio-bench --compare BASE.csv OTHER.csv...\n"
+#if defined(_WIN32)
+        "       aio-bench --footprint N FILE\n"
+        "       aio-bench --many-contexts N [options] FILE\n"
+#endif
+        "  --rate LIST             offered loads in IOPS, comma-separated (default 1000,2000,5000,10000,20000,50000)\n"
+        "  --sweep MIN:MAX:N       N offered loads spaced geometrically from MIN to MAX IOPS\n"
+        "  --closed QD             closed loop instead: keep QD requests in flight, latency from submission\n"
+        "  --suite                 run the standard closed-loop workloads with direct I/O; writes only with --write\n"
+        "  --arrivals poisson|constant  inter-arrival times (default poisson)\n"
+        "  --duration SECONDS      measured time per load (default 10)\n"
+        "  --warmup SECONDS        unmeasured time before each load (default 1)\n"
+        "  --bs BYTES              request size (default 4096)\n"
+        "  --size BYTES            use only the first BYTES of FILE (default: all of it)\n"
+        "  --write                 issue writes instead of reads; FILE's contents are overwritten\n"
+        "  --direct                open FILE for direct I/O (O_DIRECT, FILE_FLAG_NO_BUFFERING)\n"
+        "  --max-inflight N        requests in flight before further ones wait (default 1024)\n"
+#if defined(_WIN32)
+        "  --backend LIST          engines to measure, from iocp,threadpool (default both), or one of\n"
+        "                          null, which completes requests at once, and simulated, which completes\n"
+        "                          them after a fixed latency; neither touches FILE's data\n"
+        "  --sim-latency US        completion latency of the simulated engine (default 100)\n"
+        "  --pool-queue stealing|locked  queue of the thread-pool engine's workers (default stealing); locked is\n"
+        "                          the single locked FIFO, reported as threadpool-locked\n"
+#elif defined(LIBAIO_LINUX_ENGINE)
+        "  --backend LIST          libaio-linux engines to measure, from kernel,threadpool (default both), or\n"
+        "                          auto, which picks kernel AIO for --direct and the thread pool otherwise\n"
+#endif
+        "  --csv PATH              also write one CSV row per load\n"
+        "  --seed N                random seed for offsets and arrivals (default 1)\n"
+        "  --compare               print --csv files side by side, relative to the first\n"
+        "  --churn                 time io_setup/io_destroy cycles, empty and with one read, at depth --max-inflight,\n"
+        "                          and io_destroy with --max-inflight reads still in flight\n"
+        "  --call-cost             time single calls into the library, for comparing DLL, static and inline builds\n"
+        "scaling options, each a comma-separated list swept in every combination:\n"
+        "  --threads LIST          submitting threads (default 1,2,4,8)\n"
+        "  --contexts LIST         contexts the threads share round-robin; 'thread' gives each its own (default 1,thread)\n"
+        "  --qd LIST               requests each thread keeps in flight (default 32)\n"
+        "  --batch LIST            most requests per io_submit and io_getevents (default 1,8)\n"
+        "  --tlb                   also report the sweep threads' data-TLB load misses per request where the\n"
+        "                          CPU's counters can be read (Linux), and the library's structures on large pages (Windows)\n"
+#if defined(_WIN32)
+        "  --profile               also report the library's submit and reap cycles per request\n"
+        "  --numa                  bind thread i to NUMA node i %% nodes and report the library's cross-node\n"
+        "                          request and completion accesses per 1000 requests\n"
+        "  --footprint N           instead, hold N requests in flight on the null engine, then N reads queued\n"
+        "                          on the thread pool with and without provided buffers, and report the\n"
+        "                          process memory they take\n"
+        "  --many-contexts N       instead, open N contexts with io_setup, then N with io_setup_shared, and\n"
+        "                          report the memory of each and the rate of one read per context at a time\n"
+#endif
+        );
+}
+
+static bool parse_rates(const char* value, std::vector<double>* rates) {
+    rates->clear();
+    for (const char* p = value; *p;) {
+        char* end = nullptr;
+        double rate = strtod(p, &end);
+        if (end == p || rate <= 0) return false;
+        rates->push_back(rate);
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return false;
+    }
+    return !rates->empty();
+}
+
+static bool parse_sweep(const char* value, std::vector<double>* rates) {
+    double low = 0, high = 0;
+    unsigned points = 0;
+    if (sscanf(value, "%lf:%lf:%u", &low, &high, &points) != 3 || low <= 0 || high < low || points == 0) return false;
+    rates->clear();
+    for (unsigned i = 0; i < points; ++i) {
+        double fraction = points > 1 ? (double)i / (points - 1) : 0;
+        rates->push_back(low * pow(high / low, fraction));
+    }
+    return true;
+}
+
+/// Splits a comma-separated list; false if any entry is empty.
+static bool parse_list(const char* value, std::vector<std::string>* items) {
+    items->clear();
+    std::string list = value;
+    for (size_t start = 0; start <= list.size();) {
+        size_t comma = list.find(',', start);
+        std::string item = list.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (item.empty()) return false;
+        items->push_back(item);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return true;
+}
+
+static bool parse_counts(const char* value, std::vector<unsigned>* counts) {
+    std::vector<std::string> items;
+    if (!parse_list(value, &items)) return false;
+    counts->clear();
+    for (const std::string& item : items) {
+        char* end = nullptr;
+        unsigned long count = strtoul(item.c_str(), &end, 10);
+        if (*end || count == 0 || count > 65536) return false;
+        counts->push_back((unsigned)count);
+    }
+    return true;
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    if (!parse_rates("1000,2000,5000,10000,20000,50000", &options->rates)) return false;
+    parse_counts("1,2,4,8", &options->threads);
+    parse_list("1,thread", &options->contexts);
+    parse_counts("32", &options->qds);
+    parse_counts("1,8", &options->batches);
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--write") == 0) options->write = true;
+        else if (strcmp(arg, "--direct") == 0) options->direct = true;
+        else if (strcmp(arg, "--suite") == 0) options->suite = options->direct = true;
+        else if (strcmp(arg, "--compare") == 0) options->compare = true;
+        else if (strcmp(arg, "--scale") == 0) options->scale = true;
+        else if (strcmp(arg, "--churn") == 0) options->churn = true;
+        else if (strcmp(arg, "--call-cost") == 0) options->call_cost = true;
+        else if (strcmp(arg, "--threads") == 0 && value) { if (!parse_counts(value, &options->threads)) return false; ++i; }
+        else if (strcmp(arg, "--qd") == 0 && value) { if (!parse_counts(value, &options->qds)) return false; ++i; }
+        else if (strcmp(arg, "--batch") == 0 && value) { if (!parse_counts(value, &options->batches)) return false; ++i; }
+        else if (strcmp(arg, "--contexts") == 0 && value) {
+            if (!parse_list(value, &options->contexts)) return false;
+            for (const std::string& item : options->contexts) {
+                if (item != "thread" && strtoul(item.c_str(), nullptr, 10) == 0) return false;
+            }
+            ++i;
+        }
+        else if (strcmp(arg, "--rate") == 0 && value) { if (!parse_rates(value, &options->rates)) return false; ++i; }
+        else if (strcmp(arg, "--sweep") == 0 && value) { if (!parse_sweep(value, &options->rates)) return false; ++i; }
+        else if (strcmp(arg, "--closed") == 0 && value) { options->closed_qd = (unsigned)atoi(value); ++i; }
+        else if (strcmp(arg, "--arrivals") == 0 && value) {
+            if (strcmp(value, "poisson") == 0) options->arrivals = ARRIVALS_POISSON;
+            else if (strcmp(value, "constant") == 0) options->arrivals = ARRIVALS_CONSTANT;
+            else return false;
+            ++i;
+        }
+        else if (strcmp(arg, "--duration") == 0 && value) { options->duration_s = atof(value); ++i; }
+        else if (strcmp(arg, "--warmup") == 0 && value) { options->warmup_s = atof(value); ++i; }
+        else if (strcmp(arg, "--bs") == 0 && value) { options->block_size = (size_t)strtoull(value, nullptr, 0); ++i; }
+        else if (strcmp(arg, "--size") == 0 && value) { options->size = strtoull(value, nullptr, 0); ++i; }
+        else if (strcmp(arg, "--max-inflight") == 0 && value) { options->max_inflight = (unsigned)atoi(value); ++i; }
+#if defined(_WIN32)
+        else if (strcmp(arg, "--backend") == 0 && value) {
+            if (!parse_list(value, &options->backends)) return false;
+            for (const std::string& name : options->backends) {
+                if (name == "null" || name == "simulated") {
+                    // These replace the engine for the whole process, so they cannot share a run.
+                    if (options->backends.size() != 1) return false;
+                }
+                else if (name != "iocp" && name != "threadpool") return false;
+            }
+            ++i;
+        }
+        else if (strcmp(arg, "--sim-latency") == 0 && value) { options->sim_latency_us = value; ++i; }
+        else if (strcmp(arg, "--pool-queue") == 0 && value) {
+            if (strcmp(value, "locked") == 0) options->locked_pool_queue = true;
+            else if (strcmp(value, "stealing") != 0) return false;
+            ++i;
+        }
+        else if (strcmp(arg, "--profile") == 0) options->profile = true;
+        else if (strcmp(arg, "--numa") == 0) options->numa = true;
+        else if (strcmp(arg, "--footprint") == 0 && value) {
+            options->footprint = strtoull(value, nullptr, 0);
+            if (options->footprint == 0) return false;
+            ++i;
+        }
+        else if (strcmp(arg, "--many-contexts") == 0 && value) {
+            options->many_contexts = (unsigned)strtoul(value, nullptr, 0);
+            if (options->many_contexts == 0) return false;
+            ++i;
+        }
+#elif defined(LIBAIO_LINUX_ENGINE)
+        else if (strcmp(arg, "--backend") == 0 && value) {
+            if (!parse_list(value, &options->backends)) return false;
+            for (const std::string& name : options->backends) {
+                if (name != "kernel" && name != "threadpool" && name != "auto") return false;
+            }
+            ++i;
+        }
+#endif
+        else if (strcmp(arg, "--tlb") == 0) options->tlb = true;
+        else if (strcmp(arg, "--csv") == 0 && value) { options->csv_path = value; ++i; }
+        else if (strcmp(arg, "--seed") == 0 && value) { options->seed = strtoull(value, nullptr, 0); ++i; }
+        else if (arg[0] != '-' && options->compare) options->compare_paths.push_back(arg);
+        else if (arg[0] != '-' && !options->path) options->path = arg;
+        else return false;
+    }
+    if (options->compare) return !options->path && options->compare_paths.size() >= 2;
+#if defined(_WIN32)
+    if (options->footprint) {
+        // Only the null engine can hold any number of requests without a device behind them.
+        if (!options->backends.empty() && options->backends[0] != "null") return false;
+        options->backends = { "null" };
+    }
+#endif
+    if (options->backends.empty()) {
+#if defined(_WIN32)
+        if (options->scale || options->many_contexts || options->call_cost) options->backends = { "null" };
+        else options->backends = { "iocp", "threadpool" };
+#elif defined(LIBAIO_LINUX_ENGINE)
+        options->backends = { "kernel", "threadpool" };
+#else
+        options->backends = { "native" };
+#endif
+    }
+    if (options->closed_qd) options->max_inflight = options->closed_qd;
+    if (options->scale && (options->suite || options->closed_qd)) return false;
+    if ((options->numa || options->tlb) && !options->scale) return false;
+    if (options->footprint && (options->scale || options->suite || options->closed_qd)) return false;
+    if (options->churn && (options->scale || options->suite || options->closed_qd || options->footprint || options->csv_path)) return false;
+    if (options->many_contexts && (options->scale || options->suite || options->closed_qd || options->footprint || options->churn
+                                   || options->csv_path || options->backends.size() != 1)) return false;
+    if (options->call_cost && (options->scale || options->suite || options->closed_qd || options->footprint || options->churn
+                               || options->many_contexts || options->csv_path || options->backends.size() != 1)) return false;
+    return options->path && options->duration_s > 0 && options->warmup_s >= 0 && options->block_size > 0 && options->max_inflight > 0;
+}
+
+// --- Latency Histogram ---
+
+/**
+ * @brief An HDR-style histogram of nanosecond latencies: 128 linear sub-buckets per power of two,
+ * so every value up to about 2.4 hours is kept to within 1%, in a fixed 37 KB.
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts_(BUCKETS) {}
+
+    void record(int64_t ns) {
+        uint64_t value = ns > 0 ? (uint64_t)ns : 0;
+        if (value > MAX_NS) value = MAX_NS;
+        counts_[bucket(value)]++;
+        total_++;
+        sum_ += (double)value;
+        max_ = std::max(max_, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (unsigned i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    unsigned long long count() const { return total_; }
+    double mean_us() const { return total_ ? sum_ / (double)total_ / 1000.0 : 0; }
+    double max_us() const { return (double)max_ / 1000.0; }
+
+    /// Returns the p-th percentile in microseconds, as the midpoint of the bucket that holds it.
+    double percentile_us(double p) const {
+        if (!total_) return 0;
+        unsigned long long rank = (unsigned long long)(p / 100.0 * (double)total_ + 0.999999);
+        rank = std::max(1ull, std::min(rank, total_));
+        unsigned long long seen = 0;
+        for (unsigned i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(midpoint(i), (double)max_) / 1000.0;
+        }
+        return max_us();
+    }
+
+private:
+    static const unsigned SUB_BITS = 7;
+    static const unsigned SUB_BUCKETS = 1u << SUB_BITS;
+    static const uint64_t MAX_NS = (1ull << 43) - 1;
+    static const unsigned BUCKETS = (43 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    static unsigned bucket(uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) return (unsigned)value;
+        unsigned top = 63;
+        while (!(value >> top)) --top;
+        unsigned shift = top - SUB_BITS;
+        return shift * SUB_BUCKETS + (unsigned)(value >> shift);
+    }
+
+    static double midpoint(unsigned index) {
+        if (index < 2 * SUB_BUCKETS) return (double)index;
+        unsigned shift = index / SUB_BUCKETS - 1;
+        uint64_t low = (uint64_t)(index - shift * SUB_BUCKETS) << shift;
+        return (double)low + (double)(1ull << shift) / 2;
+    }
+
+    std::vector<unsigned long long> counts_;
+    unsigned long long total_ = 0;
+    double sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+// --- Platform ---
+
+static const size_t SECTOR_SIZE = 4096;
+
+static void* alloc_buffer(size_t length) {
+#if defined(_WIN32)
+    return _aligned_malloc(length, SECTOR_SIZE);
+#else
+    void* buffer = nullptr;
+    return posix_memalign(&buffer, SECTOR_SIZE, length) == 0 ? buffer : nullptr;
+#endif
+}
+
+static void free_buffer(void* buffer) {
+#if defined(_WIN32)
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+/**
+ * @brief Opens the benchmark file for one engine. On Windows the handle's mode selects iocp or
+ * threadpool; libaio-linux reads LIBAIO_WIN32_BACKEND at each io_setup, which follows the open.
+ */
+static int open_bench_file(const Options& options, const std::string& backend) {
+#if defined(_WIN32)
+    DWORD access = GENERIC_READ | (options.write ? GENERIC_WRITE : 0);
+    DWORD flags = (backend != "threadpool" ? FILE_FLAG_OVERLAPPED : 0) | (options.direct ? FILE_FLAG_NO_BUFFERING : 0);
+    HANDLE handle = CreateFileA(options.path, access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, flags, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return -1;
+    int fd = _open_osfhandle((intptr_t)handle, options.write ? 0 : _O_RDONLY);
+    if (fd < 0) CloseHandle(handle);
+    return fd;
+#else
+#if defined(LIBAIO_LINUX_ENGINE)
+    setenv("LIBAIO_WIN32_BACKEND", backend.c_str(), 1);
+#else
+    (void)backend;
+#endif
+    int flags = options.write ? O_RDWR : O_RDONLY;
+    if (options.direct) flags |= O_DIRECT;
+    return open(options.path, flags);
+#endif
+}
+
+/// The engine as reports and CSVs name it: the thread-pool engine on its locked queue is told apart.
+static std::string engine_name(const Options& options, const std::string& backend) {
+    return options.locked_pool_queue && backend == "threadpool" ? backend + "-locked" : backend;
+}
+
+static long long bench_file_size(int fd) {
+#if defined(_WIN32)
+    return _filelengthi64(fd);
+#else
+    return (long long)lseek(fd, 0, SEEK_END);
+#endif
+}
+
+static void close_bench_file(int fd) {
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+#if defined(_WIN32)
+static const char PLATFORM_NAME[] = "windows";
+#else
+static const char PLATFORM_NAME[] = "linux";
+#endif
+
+/// User plus kernel CPU time of every thread in the process, including the library's workers.
+static double process_cpu_seconds() {
+#if defined(_WIN32)
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    unsigned long long ticks = ((unsigned long long)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime)
+                             + ((unsigned long long)user.dwHighDateTime << 32 | user.dwLowDateTime);
+    return (double)ticks / 1e7; // FILETIME counts 100 ns units.
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+    return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+/// Context switches of every thread in the process so far, or -1 where the platform cannot say cheaply.
+static long long process_context_switches() {
+#if defined(_WIN32)
+    return -1;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return (long long)usage.ru_nvcsw + (long long)usage.ru_nivcsw;
+#endif
+}
+
+/**
+ * @brief Opens a counter of the calling thread's data-TLB load misses, in kernel mode too where
+ * perf_event_paranoid permits. Returns -1 on Windows, where only kernel-mode profilers read the
+ * CPU's counters, and where the CPU or hypervisor exposes no such event.
+ */
+static int open_tlb_counter() {
+#if defined(_WIN32)
+    return -1;
+#else
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_hv = 1;
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        attr.exclude_kernel = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    return fd;
+#endif
+}
+
+/// The counter's value, or -1 if it is not open.
+static long long read_tlb_counter(int fd) {
+#if defined(_WIN32)
+    (void)fd;
+    return -1;
+#else
+    long long value;
+    return fd >= 0 && read(fd, &value, sizeof(value)) == (ssize_t)sizeof(value) ? value : -1;
+#endif
+}
+
+static void close_tlb_counter(int fd) {
+#if !defined(_WIN32)
+    if (fd >= 0) close(fd);
+#else
+    (void)fd;
+#endif
+}
+
+#if defined(_WIN32)
+struct MemorySample {
+    long long resident = 0;             ///< Working set bytes.
+    long long committed = 0;            ///< Private committed bytes.
+};
+
+static MemorySample sample_memory() {
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    counters.cb = sizeof(counters);
+    MemorySample sample;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters))) {
+        sample.resident = (long long)counters.WorkingSetSize;
+        sample.committed = (long long)counters.PrivateUsage;
+    }
+    return sample;
+}
+#endif
+
+/// True if a completion reports failure. libaio-win32 reports Win32 errors in res2; Linux a negative res.
+static bool event_failed(const struct io_event& event) {
+#if defined(_WIN32)
+    return event.res2 != 0;
+#else
+    return (long)event.res < 0;
+#endif
+}
+
+#if defined(LIBAIO_WIN32_EXTENSIONS)
+/// True if an io_getevents2 completion reports failure.
+static bool event_failed(const struct io_event2& event) {
+    return event.res < 0;
+}
+#endif
+
+// --- Load Generation ---
+
+typedef std::chrono::steady_clock Clock;
+
+/// A request buffer and its iocb. A slot is owned by the submitter while free and by the reaper in flight.
+struct Slot {
+    struct iocb cb;
+    void* buffer;
+    Clock::time_point intended;     ///< When the schedule said to send it.
+    Clock::time_point submitted;    ///< When io_submit was called.
+};
+
+/// The outcome of one load point.
+struct PointResult {
+    double offered_iops = 0;        ///< 0 for a closed loop.
+    double achieved_iops = 0;
+    double cpu_us_per_op = -1;      ///< Closed loop only; an open loop's pacing spin would swamp it.
+    unsigned long long failed = 0;
+    unsigned long long abandoned = 0; ///< Requests still unsent when the point ran out of time.
+    bool saturated = false;         ///< Completions trailed the schedule: the engine could not keep up.
+    LatencyHistogram response;      ///< Completion minus intended send time.
+    LatencyHistogram service;       ///< Completion minus io_submit call.
+    LatencyHistogram lag;           ///< io_submit call minus intended send time.
+};
+
+/// State shared by the submitter and the reaper during one load point.
+struct Run {
+    io_context_t ctx;
+    std::atomic<bool> submitting;
+    std::atomic<long> inflight;
+    std::mutex returned_lock;
+    std::vector<Slot*> returned;    ///< Completed slots, handed back to the submitter in bulk.
+    Clock::time_point measure_from; ///< Requests due before this are warm-up and not recorded.
+    Clock::time_point last_completion;
+    unsigned long long submit_failed; ///< Kept apart from PointResult::failed, which the reaper counts.
+    PointResult* result;
+};
+
+static void reap(Run* run) {
+    struct io_event events[64];
+    std::vector<Slot*> done;
+    done.reserve(64);
+    for (;;) {
+        struct timespec timeout = { 0, 10 * 1000 * 1000 };
+        int n = io_getevents(run->ctx, 1, 64, events, &timeout);
+        Clock::time_point now = Clock::now();
+        for (int i = 0; i < n; ++i) {
+            Slot* slot = static_cast<Slot*>(events[i].data);
+            if (slot->intended >= run->measure_from) {
+                if (event_failed(events[i])) run->result->failed++;
+                else {
+                    run->result->response.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - slot->intended).count());
+                    run->result->service.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - slot->submitted).count());
+                }
+                run->last_completion = now;
+            }
+            done.push_back(slot);
+        }
+        if (n > 0) {
+            {
+                std::lock_guard<std::mutex> guard(run->returned_lock);
+                run->returned.insert(run->returned.end(), done.begin(), done.end());
+            }
+            done.clear();
+            run->inflight.fetch_sub(n);
+        }
+        if (n <= 0 && !run->submitting.load() && run->inflight.load() == 0) return;
+    }
+}
+
+/// Sleeps most of the way to `due`, then spins, so requests go out within microseconds of schedule.
+static void wait_until(Clock::time_point due) {
+    Clock::time_point now = Clock::now();
+    if (due - now > std::chrono::milliseconds(2)) std::this_thread::sleep_for(due - now - std::chrono::milliseconds(1));
+    while (Clock::now() < due) std::this_thread::yield();
+}
+
+/// Takes a free slot, refilling the free list from completed slots; null if every slot is in flight.
+static Slot* take_slot(Run* run, std::vector<Slot*>* free_slots) {
+    if (free_slots->empty()) {
+        std::lock_guard<std::mutex> guard(run->returned_lock);
+        free_slots->swap(run->returned);
+    }
+    if (free_slots->empty()) return nullptr;
+    Slot* slot = free_slots->back();
+    free_slots->pop_back();
+    return slot;
+}
+
+/// Points a slot's iocb at a random block-aligned offset in the region.
+static struct iocb* prepare_request(Slot* slot, int fd, unsigned long long blocks, const Options& options, std::mt19937_64& rng) {
+    long long offset = (long long)(rng() % blocks * options.block_size);
+    if (options.write) io_prep_pwrite(&slot->cb, fd, slot->buffer, options.block_size, offset);
+    else io_prep_pread(&slot->cb, fd, slot->buffer, options.block_size, offset);
+    slot->cb.data = slot;
+    return &slot->cb;
+}
+
+/// Submits a batch, retrying while the context is full; requests it cannot submit count as failed.
+static void submit_batch(Run* run, struct iocb** batch, int count, std::vector<Slot*>* free_slots) {
+    Clock::time_point now = Clock::now();
+    for (int i = 0; i < count; ++i) {
+        Slot* slot = static_cast<Slot*>(batch[i]->data);
+        slot->submitted = now;
+        if (slot->intended >= run->measure_from) {
+            run->result->lag.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - slot->intended).count());
+        }
+    }
+    run->inflight.fetch_add(count);
+    int done = 0;
+    while (done < count) {
+        int result = io_submit(run->ctx, count - done, batch + done);
+        if (result > 0) done += result;
+        else if (result == -EAGAIN || result == 0) std::this_thread::yield();
+        else {
+            for (int i = done; i < count; ++i) {
+                Slot* slot = static_cast<Slot*>(batch[i]->data);
+                if (slot->intended >= run->measure_from) run->submit_failed++;
+                free_slots->push_back(slot);
+            }
+            run->inflight.fetch_sub(count - done);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Runs one open-loop load point at `rate` requests per second. Requests whose slot is not
+ * free when they fall due wait for one, and that wait counts towards their latency.
+ */
+static void run_point(io_context_t ctx, int fd, unsigned long long region, std::vector<Slot>& slots,
+                      const Options& options, double rate, PointResult* result) {
+    Run run;
+    run.ctx = ctx;
+    run.submitting.store(true);
+    run.inflight.store(0);
+    run.submit_failed = 0;
+    run.result = result;
+    result->offered_iops = rate;
+
+    std::vector<Slot*> free_slots;
+    for (Slot& slot : slots) free_slots.push_back(&slot);
+    std::mt19937_64 rng(options.seed);
+    std::exponential_distribution<double> poisson_gap(rate / 1e9);
+    unsigned long long blocks = region / options.block_size;
+
+    Clock::time_point start = Clock::now() + std::chrono::milliseconds(1);
+    run.measure_from = start + std::chrono::nanoseconds((int64_t)(options.warmup_s * 1e9));
+    run.last_completion = run.measure_from;
+    Clock::time_point end = run.measure_from + std::chrono::nanoseconds((int64_t)(options.duration_s * 1e9));
+    Clock::time_point give_up = end + (end - start);
+    std::thread reaper(reap, &run);
+
+    double next_ns = 0;
+    unsigned long long issued = 0;
+    struct iocb* batch[64];
+    for (;;) {
+        Clock::time_point due = start + std::chrono::nanoseconds((int64_t)next_ns);
+        if (due >= end) break;
+        // A load the engine cannot sustain falls further behind forever; stop at twice the
+        // planned time and count what was never sent rather than run on indefinitely.
+        if (Clock::now() >= give_up) {
+            result->abandoned = (unsigned long long)(std::chrono::duration<double>(end - std::max(due, run.measure_from)).count() * rate);
+            break;
+        }
+        wait_until(due);
+
+        // Everything already due goes out in one io_submit, each request keeping its own due time.
+        Clock::time_point now = Clock::now();
+        int count = 0;
+        while (count < 64 && due < end && due <= now) {
+            Slot* slot = take_slot(&run, &free_slots);
+            if (!slot) break;
+            slot->intended = due;
+            batch[count++] = prepare_request(slot, fd, blocks, options, rng);
+            issued++;
+            next_ns = options.arrivals == ARRIVALS_CONSTANT ? (double)issued * 1e9 / rate : next_ns + poisson_gap(rng);
+            due = start + std::chrono::nanoseconds((int64_t)next_ns);
+        }
+        if (count) submit_batch(&run, batch, count, &free_slots);
+        else std::this_thread::yield(); // Every slot is in flight; the due request waits for one.
+    }
+    run.submitting.store(false);
+    reaper.join();
+    result->failed += run.submit_failed;
+
+    // Poisson arrivals make the achieved rate wander from the offered one; falling behind does not.
+    result->saturated = result->abandoned || run.last_completion - end > (end - run.measure_from) / 20;
+    double span_s = std::chrono::duration<double>(std::max(end, run.last_completion) - run.measure_from).count();
+    result->achieved_iops = span_s > 0 ? (double)(result->response.count() + result->failed) / span_s : 0;
+}
+
+/**
+ * @brief Runs a closed loop with every slot in flight. Each completion is replaced from the same
+ * thread, as fio's libaio engine does, so the process's CPU time over the measured window is the
+ * cost of the I/O path alone. Latency runs from the io_submit call.
+ */
+static void run_closed(io_context_t ctx, int fd, unsigned long long region, std::vector<Slot>& slots,
+                       const Options& options, PointResult* result) {
+    std::mt19937_64 rng(options.seed);
+    unsigned long long blocks = region / options.block_size;
+    std::vector<struct iocb*> batch;
+    std::vector<struct io_event> events(slots.size());
+    batch.reserve(slots.size());
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point measure_from = start + std::chrono::nanoseconds((int64_t)(options.warmup_s * 1e9));
+    Clock::time_point end = measure_from + std::chrono::nanoseconds((int64_t)(options.duration_s * 1e9));
+    Clock::time_point window_start = measure_from, window_end = end;
+    double cpu_start = 0, cpu_end = 0;
+    enum { WARMING_UP, MEASURING, DRAINING } phase = WARMING_UP;
+    unsigned long long measured = 0;
+
+    long inflight = 0;
+    for (Slot& slot : slots) batch.push_back(prepare_request(&slot, fd, blocks, options, rng));
+    for (;;) {
+        // Submit what the last batch of completions freed, then wait for the next completions.
+        Clock::time_point now = Clock::now();
+        size_t done = 0;
+        for (struct iocb* cb : batch) static_cast<Slot*>(cb->data)->submitted = now;
+        while (done < batch.size()) {
+            int submitted = io_submit(ctx, (long)(batch.size() - done), batch.data() + done);
+            if (submitted > 0) done += (size_t)submitted;
+            else if (submitted == -EAGAIN || submitted == 0) std::this_thread::yield();
+            else break;
+        }
+        if (phase == MEASURING) result->failed += batch.size() - done;
+        inflight += (long)done;
+        if (inflight == 0) break;
+
+        int n = io_getevents(ctx, 1, (long)events.size(), events.data(), NULL);
+        if (n < 0 && n != -EINTR) {
+            fprintf(stderr, "aio-bench: io_getevents failed: %s\n", strerror(-n));
+            break;
+        }
+        now = Clock::now();
+        if (phase == WARMING_UP && now >= measure_from) {
+            phase = MEASURING;
+            window_start = now;
+            cpu_start = process_cpu_seconds();
+        }
+        else if (phase == MEASURING && now >= end) {
+            phase = DRAINING;
+            window_end = now;
+            cpu_end = process_cpu_seconds();
+        }
+        batch.clear();
+        for (int i = 0; i < n; ++i) {
+            Slot* slot = static_cast<Slot*>(events[i].data);
+            if (phase == MEASURING) {
+                if (event_failed(events[i])) result->failed++;
+                else {
+                    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - slot->submitted).count();
+                    result->response.record(ns);
+                    result->service.record(ns);
+                }
+                measured++;
+            }
+            if (phase != DRAINING) batch.push_back(prepare_request(slot, fd, blocks, options, rng));
+        }
+        if (n > 0) inflight -= n;
+    }
+    if (phase == MEASURING) {
+        window_end = Clock::now();
+        cpu_end = process_cpu_seconds();
+    }
+
+    double window_s = std::chrono::duration<double>(window_end - window_start).count();
+    result->achieved_iops = window_s > 0 ? (double)measured / window_s : 0;
+    if (measured) result->cpu_us_per_op = (cpu_end - cpu_start) * 1e6 / (double)measured;
+}
+
+// --- Workloads ---
+
+/// A request size and direction, run either as a closed loop at `closed_qd` or as the rate sweep.
+struct Workload {
+    std::string name;
+    size_t block_size;
+    bool write;
+    unsigned closed_qd;
+};
+
+/// The head-to-head workloads behind --suite, chosen to expose per-request overhead.
+static const struct {
+    const char* name;
+    size_t block_size;
+    bool write;
+    unsigned qd;
+} SUITE[] = {
+    { "randread-4k-qd1",   4096,  false, 1 },
+    { "randread-4k-qd32",  4096,  false, 32 },
+    { "randread-64k-qd8",  65536, false, 8 },
+    { "randwrite-4k-qd1",  4096,  true,  1 },
+    { "randwrite-4k-qd32", 4096,  true,  32 },
+};
+
+static std::vector<Workload> plan_workloads(const Options& options) {
+    std::vector<Workload> workloads;
+    if (options.suite) {
+        for (const auto& entry : SUITE) {
+            if (entry.write && !options.write) continue;
+            workloads.push_back(Workload{ entry.name, entry.block_size, entry.write, entry.qd });
+        }
+        return workloads;
+    }
+    char name[64];
+    size_t size = options.block_size;
+    int length = size % 1024 == 0 ? snprintf(name, sizeof(name), "rand%s-%zuk", options.write ? "write" : "read", size / 1024)
+                                  : snprintf(name, sizeof(name), "rand%s-%zu", options.write ? "write" : "read", size);
+    if (options.closed_qd) length += snprintf(name + length, sizeof(name) - (size_t)length, "-qd%u", options.closed_qd);
+    // A buffered run measures the page cache, so --compare must not take a direct run as its baseline.
+    if (!options.direct) snprintf(name + length, sizeof(name) - (size_t)length, "-buffered");
+    workloads.push_back(Workload{ name, options.block_size, options.write, options.closed_qd });
+    return workloads;
+}
+
+// --- Report ---
+
+static void print_header(const Workload& workload) {
+    if (workload.closed_qd) {
+        printf("  %8s %9s %9s %9s %9s %9s %9s %9s %9s\n", "qd", "achieved", "cpu us/op", "p50", "p90", "p99", "p99.9", "p99.99", "max");
+    }
+    else {
+        printf("  %8s %9s %9s %9s %9s %9s %9s %9s %11s %9s\n",
+            "offered", "achieved", "p50", "p90", "p99", "p99.9", "p99.99", "max", "service p99", "lag p99");
+    }
+}
+
+static void print_point(const Workload& workload, const PointResult& point) {
+    const LatencyHistogram& h = point.response;
+    if (workload.closed_qd) {
+        printf("  %8u %9.0f %9.2f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f", workload.closed_qd, point.achieved_iops, point.cpu_us_per_op,
+            h.percentile_us(50), h.percentile_us(90), h.percentile_us(99), h.percentile_us(99.9), h.percentile_us(99.99), h.max_us());
+    }
+    else {
+        printf("  %8.0f %9.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %11.1f %9.1f", point.offered_iops, point.achieved_iops,
+            h.percentile_us(50), h.percentile_us(90), h.percentile_us(99), h.percentile_us(99.9), h.percentile_us(99.99), h.max_us(),
+            point.service.percentile_us(99), point.lag.percentile_us(99));
+        if (point.saturated) printf("  saturated");
+    }
+    if (point.failed) printf("  %llu failed", point.failed);
+    if (point.abandoned) printf("  %llu never sent", point.abandoned);
+    printf("\n");
+}
+
+static const char CSV_HEADER[] =
+    "platform,workload,backend,arrivals,qd,offered_iops,achieved_iops,cpu_us_per_op,mean_us,p50_us,p90_us,p99_us,"
+    "p99_9_us,p99_99_us,max_us,service_p99_us,lag_p99_us,failed,abandoned\n";
+
+static void write_csv_row(FILE* csv, const Workload& workload, const std::string& backend, const Options& options, const PointResult& point) {
+    const LatencyHistogram& h = point.response;
+    char cpu[32] = "";
+    if (point.cpu_us_per_op >= 0) snprintf(cpu, sizeof(cpu), "%.3f", point.cpu_us_per_op);
+    fprintf(csv, "%s,%s,%s,%s,%u,%.1f,%.1f,%s,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%llu,%llu\n",
+        PLATFORM_NAME, workload.name.c_str(), engine_name(options, backend).c_str(),
+        workload.closed_qd ? "closed" : options.arrivals == ARRIVALS_POISSON ? "poisson" : "constant",
+        workload.closed_qd, point.offered_iops, point.achieved_iops, cpu, h.mean_us(),
+        h.percentile_us(50), h.percentile_us(90), h.percentile_us(99), h.percentile_us(99.9), h.percentile_us(99.99), h.max_us(),
+        point.service.percentile_us(99), point.lag.percentile_us(99), point.failed, point.abandoned);
+}
+
+// --- Scaling Sweep ---
+
+/// One combination of the --scale lists.
+struct ScalePoint {
+    unsigned threads;
+    std::string contexts;           ///< As given: a count, or "thread".
+    unsigned context_count;
+    unsigned qd;                    ///< Per thread.
+    unsigned batch;
+};
+
+struct ScaleResult {
+    double iops = 0;
+    double cpu_us_per_op = 0;
+    double efficiency = -1;         ///< IOPS per thread relative to the fewest-thread point of the same series.
+    double p99_us = 0;              ///< Latency from io_submit to io_getevents.
+    double ops_per_submit = 0;      ///< Requests per io_submit call actually achieved.
+    double empty_reaps_per_kop = 0; ///< io_getevents calls that timed out empty, per 1000 requests.
+    double switches_per_op = -1;    ///< Context switches; Linux only.
+    double submit_cycles_per_op = -1; ///< Library self-profile; Windows with --profile only.
+    double reap_cycles_per_op = -1; ///< io_getevents minus the wait for completions.
+    double remote_requests_per_kop = -1;    ///< Records from another node's memory; Windows with --numa only.
+    double remote_completions_per_kop = -1; ///< Requests reaped on another node than their record's.
+    double tlb_misses_per_op = -1;  ///< Data-TLB load misses of the sweep threads; with --tlb where readable.
+    long long large_page_regions = -1; ///< Library structures on large pages; Windows with --tlb only.
+    unsigned long long failed = 0;
+};
+
+enum ScalePhase {
+    SCALE_WARMING_UP,
+    SCALE_MEASURING,
+    SCALE_STOPPED,
+};
+
+/// Per-thread counters, on their own cache lines so the tally does not become the contention measured.
+struct alignas(64) ScaleTally {
+    unsigned long long ops = 0;
+    unsigned long long submits = 0;
+    unsigned long long empty_reaps = 0;
+    unsigned long long failed = 0;
+    long long tlb_misses = -1;          ///< Over the measured window, or -1 if not counted.
+    LatencyHistogram latency;           ///< Of the requests this thread reaped.
+};
+
+/// A context and the requests it owns, counting those reaped but not yet resubmitted.
+struct alignas(64) ScaleContext {
+    io_context_t ctx = 0;
+    std::atomic<long> owned{ 0 };
+};
+
+/// Submits `batch` in io_submit calls of at most `limit`; returns how many could not be submitted.
+static size_t scale_submit(io_context_t ctx, std::vector<struct iocb*>& batch, unsigned limit, bool measuring, ScaleTally* tally) {
+    size_t done = 0;
+    while (done < batch.size()) {
+        long count = (long)std::min<size_t>(limit, batch.size() - done);
+        Clock::time_point now = Clock::now();
+        for (long i = 0; i < count; ++i) static_cast<Slot*>(batch[done + i]->data)->submitted = now;
+        int submitted = io_submit(ctx, count, batch.data() + done);
+        if (submitted > 0) {
+            done += (size_t)submitted;
+            if (measuring) tally->submits++;
+        }
+        else if (submitted == -EAGAIN || submitted == 0) std::this_thread::yield();
+        else break;
+    }
+    if (measuring) tally->failed += batch.size() - done;
+    return batch.size() - done;
+}
+
+/**
+ * @brief One sweep thread: fills its share of the context's queue, then resubmits whatever it
+ * reaps, which on a shared context may be another thread's requests. Once the sweep stops it
+ * reaps until the context owns nothing, so every thread on a context drains it together.
+ */
+static void scale_thread(ScaleContext* context, Slot* slots, const ScalePoint& point, int fd, unsigned long long blocks,
+                         const Options& options, unsigned index, const std::atomic<int>* phase, ScaleTally* tally) {
+#if defined(_WIN32)
+    struct io_backend_caps caps;
+    if (options.numa && io_query_backends(&caps) == 0) io_numa_bind_thread(index % caps.numa_nodes);
+#endif
+    std::mt19937_64 rng(options.seed + index);
+    std::vector<struct iocb*> batch;
+    std::vector<struct io_event> events(point.batch);
+    for (unsigned i = 0; i < point.qd; ++i) batch.push_back(prepare_request(&slots[i], fd, blocks, options, rng));
+    context->owned.fetch_add((long)batch.size());
+    context->owned.fetch_sub((long)scale_submit(context->ctx, batch, point.batch, false, tally));
+
+    int tlb_counter = options.tlb ? open_tlb_counter() : -1;
+    long long tlb_start = -1;
+    int seen = SCALE_WARMING_UP;
+    for (;;) {
+        int current = phase->load();
+        if (current != seen) {
+            long long misses = read_tlb_counter(tlb_counter);
+            if (current == SCALE_MEASURING) tlb_start = misses;
+            else if (tlb_start >= 0 && misses >= 0) tally->tlb_misses = misses - tlb_start;
+            seen = current;
+        }
+        if (current == SCALE_STOPPED && context->owned.load() == 0) break;
+        struct timespec timeout = { 0, 10 * 1000 * 1000 };
+        int n = io_getevents(context->ctx, 1, (long)point.batch, events.data(), &timeout);
+        current = phase->load();
+        if (n <= 0) {
+            if (current == SCALE_MEASURING) tally->empty_reaps++;
+            continue;
+        }
+        if (current == SCALE_MEASURING) {
+            Clock::time_point now = Clock::now();
+            tally->ops += (unsigned long long)n;
+            for (int i = 0; i < n; ++i) {
+                if (event_failed(events[i])) tally->failed++;
+                else tally->latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - static_cast<Slot*>(events[i].data)->submitted).count());
+            }
+        }
+        if (current == SCALE_STOPPED) {
+            context->owned.fetch_sub(n);
+            continue;
+        }
+        batch.clear();
+        for (int i = 0; i < n; ++i) batch.push_back(prepare_request(static_cast<Slot*>(events[i].data), fd, blocks, options, rng));
+        size_t unsent = scale_submit(context->ctx, batch, point.batch, current == SCALE_MEASURING, tally);
+        if (unsent) context->owned.fetch_sub((long)unsent);
+    }
+    close_tlb_counter(tlb_counter);
+}
+
+/// Runs one point of the sweep. Returns false if the contexts or buffers cannot be set up.
+static bool run_scale_point(const Options& options, const ScalePoint& point, int fd, unsigned long long region, ScaleResult* result) {
+    unsigned per_context = (point.threads + point.context_count - 1) / point.context_count;
+    std::vector<ScaleContext> contexts(point.context_count);
+    std::vector<Slot> slots((size_t)point.threads * point.qd);
+    std::vector<ScaleTally> tallies(point.threads);
+    bool ok = true;
+    for (ScaleContext& context : contexts) {
+        int setup = io_setup((int)(per_context * point.qd + 64), &context.ctx);
+        if (setup < 0) {
+            fprintf(stderr, "aio-bench: io_setup failed: %s\n", strerror(-setup));
+            context.ctx = 0;
+            ok = false;
+        }
+    }
+    for (Slot& slot : slots) {
+        slot.buffer = ok ? alloc_buffer(options.block_size) : nullptr;
+        if (!slot.buffer) ok = false;
+        else memset(slot.buffer, 0xA5, options.block_size);
+    }
+
+    if (ok) {
+        std::atomic<int> phase{ SCALE_WARMING_UP };
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i < point.threads; ++i) {
+            threads.emplace_back(scale_thread, &contexts[i % point.context_count], &slots[(size_t)i * point.qd], std::cref(point),
+                fd, region / options.block_size, std::cref(options), i, &phase, &tallies[i]);
+        }
+        std::this_thread::sleep_for(std::chrono::nanoseconds((int64_t)(options.warmup_s * 1e9)));
+
+#if defined(_WIN32)
+        if (options.profile) io_profile_start();
+        struct io_numa_counters numa_start = {}, numa_end = {};
+        if (options.numa) io_numa_read(&numa_start);
+        struct io_large_page_counters large_pages;
+        if (options.tlb && io_large_pages_read(&large_pages) == 0) result->large_page_regions = (long long)large_pages.regions;
+#endif
+        long long switches_start = process_context_switches();
+        double cpu_start = process_cpu_seconds();
+        Clock::time_point start = Clock::now();
+        phase.store(SCALE_MEASURING);
+        std::this_thread::sleep_for(std::chrono::nanoseconds((int64_t)(options.duration_s * 1e9)));
+        phase.store(SCALE_STOPPED);
+        double window_s = std::chrono::duration<double>(Clock::now() - start).count();
+        double cpu_s = process_cpu_seconds() - cpu_start;
+        long long switches = process_context_switches() - switches_start;
+#if defined(_WIN32)
+        struct io_profile profile;
+        bool profiled = options.profile && io_profile_stop() == 0 && io_profile_read(&profile) == 0;
+        bool numa_counted = options.numa && io_numa_read(&numa_end) == 0;
+#endif
+        for (std::thread& thread : threads) thread.join();
+
+        ScaleTally total;
+        bool tlb_counted = options.tlb;
+        long long tlb_misses = 0;
+        for (const ScaleTally& tally : tallies) {
+            total.ops += tally.ops;
+            total.submits += tally.submits;
+            total.empty_reaps += tally.empty_reaps;
+            total.failed += tally.failed;
+            if (tally.tlb_misses < 0) tlb_counted = false;
+            else tlb_misses += tally.tlb_misses;
+            total.latency.merge(tally.latency);
+        }
+        double ops = (double)std::max(total.ops, 1ull);
+        result->iops = (double)total.ops / window_s;
+        result->cpu_us_per_op = cpu_s * 1e6 / ops;
+        result->p99_us = total.latency.percentile_us(99);
+        result->ops_per_submit = total.submits ? (double)total.ops / (double)total.submits : 0;
+        result->empty_reaps_per_kop = (double)total.empty_reaps * 1000.0 / ops;
+        if (switches_start >= 0) result->switches_per_op = (double)switches / ops;
+        if (tlb_counted) result->tlb_misses_per_op = (double)tlb_misses / ops;
+#if defined(_WIN32)
+        if (profiled) {
+            result->submit_cycles_per_op = (double)profile.phases[IO_PROFILE_SUBMIT].cycles / ops;
+            result->reap_cycles_per_op = (double)(profile.phases[IO_PROFILE_GETEVENTS].cycles - profile.phases[IO_PROFILE_DEQUEUE].cycles) / ops;
+        }
+        if (numa_counted) {
+            result->remote_requests_per_kop = (double)(numa_end.remote_requests - numa_start.remote_requests) * 1000.0 / ops;
+            result->remote_completions_per_kop = (double)(numa_end.remote_completions - numa_start.remote_completions) * 1000.0 / ops;
+        }
+#endif
+        result->failed = total.failed;
+    }
+    else fprintf(stderr, "aio-bench: cannot set up %u contexts and %zu buffers\n", point.context_count, slots.size());
+
+    for (ScaleContext& context : contexts) {
+        if (context.ctx) io_destroy(context.ctx);
+    }
+    for (Slot& slot : slots) {
+        if (slot.buffer) free_buffer(slot.buffer);
+    }
+    return ok;
+}
+
+static const char SCALE_CSV_HEADER[] =
+    "platform,backend,sim_latency_us,threads,contexts,context_count,qd,batch,iops,cpu_us_per_op,efficiency,"
+    "ops_per_submit,empty_reaps_per_kop,switches_per_op,submit_cycles_per_op,reap_cycles_per_op,failed,"
+    "remote_requests_per_kop,remote_completions_per_kop,dtlb_misses_per_op,large_page_regions,p99_us\n";
+
+/// Formats an optional figure for the table or the CSV: empty or "-" when it was not measured.
+static const char* optional_figure(char* text, size_t size, double value, const char* missing) {
+    if (value < 0) snprintf(text, size, "%s", missing);
+    else snprintf(text, size, "%.2f", value);
+    return text;
+}
+
+/// As optional_figure, for a count.
+static const char* optional_count(char* text, size_t size, long long value, const char* missing) {
+    if (value < 0) snprintf(text, size, "%s", missing);
+    else snprintf(text, size, "%lld", value);
+    return text;
+}
+
+/**
+ * @brief Runs every combination of the --scale lists on one engine. Points with more contexts
+ * than threads are skipped, since a context without a thread has nothing to submit.
+ */
+static bool run_scale(const Options& options, const std::string& backend, FILE* csv) {
+    int fd = open_bench_file(options, backend);
+    if (fd < 0) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", options.path, strerror(errno));
+        return false;
+    }
+    long long file_size = bench_file_size(fd);
+    unsigned long long region = options.size ? options.size : (unsigned long long)std::max(file_size, 0LL);
+    if (region < options.block_size) {
+        fprintf(stderr, "aio-bench: %s is smaller than one %zu-byte request; use --size on a larger file\n", options.path, options.block_size);
+        close_bench_file(fd);
+        return false;
+    }
+    std::string sim_latency;
+    if (backend == "simulated") sim_latency = options.sim_latency_us ? options.sim_latency_us : "100";
+
+    std::string engine = engine_name(options, backend);
+    printf("\nscaling on %s%s%s\n", engine.c_str(), sim_latency.empty() ? "" : ", device latency us ", sim_latency.c_str());
+#if defined(_WIN32)
+    struct io_backend_caps caps;
+    if (options.numa && io_query_backends(&caps) == 0) {
+        printf("%u NUMA nodes%s, placement %s (LIBAIO_WIN32_NUMA)\n", caps.numa_nodes, (caps.features & IO_CAP_NUMA_SIMULATED) ? " (simulated)" : "",
+            (caps.features & IO_CAP_NUMA_PLACEMENT) ? "on" : "off");
+    }
+    if (options.tlb && io_query_backends(&caps) == 0) {
+        if (caps.features & IO_CAP_LARGE_PAGES) printf("large pages of %u KiB (LIBAIO_WIN32_LARGE_PAGES)\n", caps.large_page_size / 1024);
+        else printf("large pages off or not permitted (LIBAIO_WIN32_LARGE_PAGES, \"Lock pages in memory\")\n");
+    }
+#endif
+    printf("  %7s %8s %5s %5s %10s %6s %9s %9s %9s %9s %9s %11s %11s", "threads", "contexts", "qd", "batch", "iops", "eff", "p99 us", "cpu us/op",
+        "ops/submit", "empty/kop", "csw/op", "submit cyc", "reap cyc");
+    if (options.numa) printf(" %9s %9s", "rreq/kop", "rcpl/kop");
+    if (options.tlb) printf(" %9s %8s", "dtlb/op", "lg pages");
+    printf("\n");
+    bool ok = true;
+    for (unsigned qd : options.qds) {
+        for (unsigned batch : options.batches) {
+            for (const std::string& contexts : options.contexts) {
+                double base_iops_per_thread = 0;
+                for (unsigned threads : options.threads) {
+                    unsigned count = contexts == "thread" ? threads : (unsigned)strtoul(contexts.c_str(), nullptr, 10);
+                    if (count > threads) continue;
+                    ScalePoint point = { threads, contexts, count, qd, std::min(batch, qd) };
+                    ScaleResult result;
+                    if (!run_scale_point(options, point, fd, region, &result)) { ok = false; continue; }
+                    double iops_per_thread = result.iops / threads;
+                    if (base_iops_per_thread == 0) base_iops_per_thread = iops_per_thread;
+                    if (base_iops_per_thread > 0) result.efficiency = iops_per_thread / base_iops_per_thread;
+
+                    char eff[32], csw[32], submit[32], reap[32], remote_requests[32], remote_completions[32], tlb[32], large_pages[32];
+                    printf("  %7u %8s %5u %5u %10.0f %6s %9.1f %9.2f %9.2f %9.2f %9s %11s %11s", threads, contexts.c_str(), qd, point.batch,
+                        result.iops, optional_figure(eff, sizeof(eff), result.efficiency, "-"), result.p99_us, result.cpu_us_per_op, result.ops_per_submit,
+                        result.empty_reaps_per_kop, optional_figure(csw, sizeof(csw), result.switches_per_op, "-"),
+                        optional_figure(submit, sizeof(submit), result.submit_cycles_per_op, "-"),
+                        optional_figure(reap, sizeof(reap), result.reap_cycles_per_op, "-"));
+                    if (options.numa) {
+                        printf(" %9s %9s", optional_figure(remote_requests, sizeof(remote_requests), result.remote_requests_per_kop, "-"),
+                            optional_figure(remote_completions, sizeof(remote_completions), result.remote_completions_per_kop, "-"));
+                    }
+                    if (options.tlb) {
+                        printf(" %9s %8s", optional_figure(tlb, sizeof(tlb), result.tlb_misses_per_op, "-"),
+                            optional_count(large_pages, sizeof(large_pages), result.large_page_regions, "-"));
+                    }
+                    if (result.failed) printf("  %llu failed", result.failed);
+                    printf("\n");
+                    fflush(stdout);
+                    if (csv) {
+                        fprintf(csv, "%s,%s,%s,%u,%s,%u,%u,%u,%.1f,%.3f,%s,%.2f,%.3f,%s,%s,%s,%llu,%s,%s,%s,%s,%.2f\n",
+                            PLATFORM_NAME, engine.c_str(), sim_latency.c_str(), threads, contexts.c_str(), count, qd, point.batch,
+                            result.iops, result.cpu_us_per_op, optional_figure(eff, sizeof(eff), result.efficiency, ""), result.ops_per_submit,
+                            result.empty_reaps_per_kop, optional_figure(csw, sizeof(csw), result.switches_per_op, ""),
+                            optional_figure(submit, sizeof(submit), result.submit_cycles_per_op, ""),
+                            optional_figure(reap, sizeof(reap), result.reap_cycles_per_op, ""), result.failed,
+                            optional_figure(remote_requests, sizeof(remote_requests), result.remote_requests_per_kop, ""),
+                            optional_figure(remote_completions, sizeof(remote_completions), result.remote_completions_per_kop, ""),
+                            optional_figure(tlb, sizeof(tlb), result.tlb_misses_per_op, ""),
+                            optional_count(large_pages, sizeof(large_pages), result.large_page_regions, ""), result.p99_us);
+                    }
+                }
+            }
+        }
+    }
+    close_bench_file(fd);
+    return ok;
+}
+
+// --- Context Churn ---
+
+/// What each --churn cycle does between io_setup and io_destroy.
+enum ChurnShape {
+    CHURN_EMPTY,                        ///< Nothing: the bare cost of a context.
+    CHURN_ONE_READ,                     ///< One read, reaped before io_destroy, which starts the engine the file needs.
+    CHURN_FULL_LOAD,                    ///< --max-inflight reads left in flight, so io_destroy must cancel or wait for them.
+};
+
+/**
+ * @brief Runs one io_setup/io_destroy cycle.
+ * @return Its duration in nanoseconds, only io_destroy's under full load, or -1 on failure.
+ */
+static int64_t churn_cycle(const Options& options, int fd, ChurnShape shape, void* buffer, std::vector<struct iocb*>& load) {
+    Clock::time_point started = Clock::now();
+    io_context_t ctx = 0;
+    int result = io_setup((int)options.max_inflight, &ctx);
+    if (result < 0) {
+        fprintf(stderr, "aio-bench: io_setup failed: %s\n", strerror(-result));
+        return -1;
+    }
+    bool ok = true;
+    if (shape == CHURN_ONE_READ) {
+        struct iocb request;
+        struct iocb* list[1] = { &request };
+        struct io_event event;
+        io_prep_pread(&request, fd, buffer, options.block_size, 0);
+        ok = io_submit(ctx, 1, list) == 1 && io_getevents(ctx, 1, 1, &event, nullptr) == 1 && !event_failed(event);
+        if (!ok) fprintf(stderr, "aio-bench: the read of a --churn cycle failed\n");
+    }
+    else if (shape == CHURN_FULL_LOAD) {
+        size_t submitted = 0;
+        while (ok && submitted < load.size()) {
+            result = io_submit(ctx, (long)(load.size() - submitted), load.data() + submitted);
+            if (result > 0) submitted += (size_t)result;
+            else ok = false;
+        }
+        if (!ok) fprintf(stderr, "aio-bench: io_submit of a --churn cycle failed: %s\n", strerror(result < 0 ? -result : EAGAIN));
+        started = Clock::now();
+    }
+    result = io_destroy(ctx);
+    if (result < 0) {
+        fprintf(stderr, "aio-bench: io_destroy failed: %s\n", strerror(-result));
+        ok = false;
+    }
+    return ok ? std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count() : -1;
+}
+
+/**
+ * @brief Times back-to-back io_setup/io_destroy cycles on one engine, as a component that creates a
+ * context per job would see them, and io_destroy of contexts with every request still in flight.
+ */
+static bool run_churn(const Options& options, const std::string& backend) {
+    int fd = open_bench_file(options, backend);
+    if (fd < 0) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", options.path, strerror(errno));
+        return false;
+    }
+    void* buffer = alloc_buffer(options.block_size);
+    if (!buffer) {
+        fprintf(stderr, "aio-bench: out of memory for the buffer\n");
+        close_bench_file(fd);
+        return false;
+    }
+    static const struct { ChurnShape shape; const char* name; } SHAPES[] = {
+        { CHURN_EMPTY, "setup+destroy" },
+        { CHURN_ONE_READ, "setup+read+destroy" },
+        { CHURN_FULL_LOAD, "destroy under load" },
+    };
+    // The loaded reads share one buffer; spread them over the file so the device sees distinct blocks.
+    long long file_size = bench_file_size(fd);
+    unsigned long long blocks = file_size > 0 ? (unsigned long long)file_size / options.block_size : 0;
+    std::vector<struct iocb> iocbs(options.max_inflight);
+    std::vector<struct iocb*> load(options.max_inflight);
+    for (size_t i = 0; i < iocbs.size(); ++i) {
+        io_prep_pread(&iocbs[i], fd, buffer, options.block_size, blocks ? (long long)((i % blocks) * options.block_size) : 0);
+        load[i] = &iocbs[i];
+    }
+    printf("\n%s\n", backend.c_str());
+    printf("  %-20s %12s %10s %10s %10s %10s", "cycle", "cycles/s", "mean us", "p50 us", "p99 us", "max us");
+#if defined(_WIN32)
+    printf(" %12s", "private KiB");
+#endif
+    printf("\n");
+    bool ok = true;
+    for (const auto& entry : SHAPES) {
+        LatencyHistogram histogram;
+        Clock::time_point warm_until = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup_s));
+        while (ok && Clock::now() < warm_until) ok = churn_cycle(options, fd, entry.shape, buffer, load) >= 0;
+#if defined(_WIN32)
+        MemorySample before = sample_memory();
+#endif
+        Clock::time_point started = Clock::now();
+        Clock::time_point stop_at = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+        while (ok && Clock::now() < stop_at) {
+            int64_t ns = churn_cycle(options, fd, entry.shape, buffer, load);
+            if (ns < 0) ok = false;
+            else histogram.record(ns);
+        }
+        if (!ok) break;
+        double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+        printf("  %-20s %12.0f %10.1f %10.1f %10.1f %10.1f", entry.name, histogram.count() / elapsed, histogram.mean_us(),
+            histogram.percentile_us(50), histogram.percentile_us(99), histogram.max_us());
+#if defined(_WIN32)
+        // Whatever a cycle fails to release shows up as private bytes that grow with the cycle count.
+        MemorySample after = sample_memory();
+        printf(" %+12.1f", (after.committed - before.committed) / 1024.0);
+#endif
+        printf("\n");
+        fflush(stdout);
+    }
+    free_buffer(buffer);
+    close_bench_file(fd);
+    return ok;
+}
+
+// --- Call Cost ---
+
+/// How this build reaches the library, printed by --call-cost so that runs of differently linked builds can be told apart.
+#if defined(LIBAIO_WIN32_IMPLEMENTATION)
+static const char* const LINK_MODE = "inline";
+#elif defined(LIBAIO_WIN32_STATIC)
+static const char* const LINK_MODE = "static";
+#elif defined(_WIN32)
+static const char* const LINK_MODE = "dll";
+#else
+static const char* const LINK_MODE = "shared";
+#endif
+
+/// Calls made between two reads of the clock, so that reading it stays out of the measurement.
+static const unsigned CALL_COST_STRIDE = 1024;
+
+/**
+ * @brief Repeats a call through the warm-up, then for the measured duration.
+ * @param units Operations each call performs; the result is per operation.
+ * @return Nanoseconds per operation, or a negative value if a call failed.
+ */
+template <typename Call>
+static double time_calls(const Options& options, unsigned units, Call call) {
+    Clock::time_point warm_until = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup_s));
+    while (Clock::now() < warm_until) {
+        for (unsigned i = 0; i < CALL_COST_STRIDE; ++i) {
+            if (!call()) return -1;
+        }
+    }
+    unsigned long long calls = 0;
+    Clock::time_point started = Clock::now();
+    Clock::time_point stop_at = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+    Clock::time_point now;
+    do {
+        for (unsigned i = 0; i < CALL_COST_STRIDE; ++i) {
+            if (!call()) return -1;
+        }
+        calls += CALL_COST_STRIDE;
+        now = Clock::now();
+    } while (now < stop_at);
+    return std::chrono::duration<double, std::nano>(now - started).count() / ((double)calls * units);
+}
+
+/// The library's C API, as the engine round_trip drives by default.
+struct CApiEngine {
+    static int submit(io_context_t ctx, long nr, struct iocb** iocbs) { return io_submit(ctx, nr, iocbs); }
+    static int getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+        return io_getevents(ctx, min_nr, nr, events, timeout);
+    }
+};
+
+#if defined(LIBAIO_WIN32_EXTENSIONS)
+/// The C API, reaping through io_getevents2.
+struct CApiEngine2 {
+    static int submit(io_context_t ctx, long nr, struct iocb** iocbs) { return io_submit(ctx, nr, iocbs); }
+    static int getevents(io_context_t ctx, long min_nr, long nr, struct io_event2* events, struct timespec* timeout) {
+        return io_getevents2(ctx, min_nr, nr, events, timeout);
+    }
+};
+#endif
+
+/// Submits `count` prepared reads through `Engine` and reaps them all. False if any failed.
+template <class Engine, class Event>
+static bool round_trip(io_context_t ctx, unsigned count, struct iocb** list, Event* events) {
+    if (Engine::submit(ctx, (long)count, list) != (int)count) return false;
+    for (unsigned reaped = 0; reaped < count;) {
+        int got = Engine::getevents(ctx, 1, (long)(count - reaped), events, nullptr);
+        if (got <= 0) return false;
+        for (int e = 0; e < got; ++e) {
+            if (event_failed(events[e])) return false;
+        }
+        reaped += (unsigned)got;
+    }
+    return true;
+}
+
+#if defined(LIBAIO_WIN32_IMPLEMENTATION)
+/// The C API's configuration without the in-flight index, trace recording and ETW events.
+struct UntrackedConfig {
+    typedef DefaultConfig::Backend Backend;
+    typedef DefaultConfig::Allocator Allocator;
+    typedef DefaultConfig::Stats Stats;
+    typedef NoTracing Tracing;
+    typedef DefaultConfig::Scheduler Scheduler;
+};
+
+/// The C API's configuration with every request record from the heap, as before the slab.
+struct HeapRecordsConfig {
+    typedef DefaultConfig::Backend Backend;
+    typedef HeapAllocator Allocator;
+    typedef DefaultConfig::Stats Stats;
+    typedef DefaultConfig::Tracing Tracing;
+    typedef DefaultConfig::Scheduler Scheduler;
+};
+#endif
+
+/**
+ * @brief Times the calls an application makes per request, on an engine that completes them at once.
+ *
+ * On Windows the null engine leaves little but the library's own code in each call, so the
+ * difference between a DLL, a static and an inline build is the cost of crossing into it; on
+ * Linux every call is a system call and the build only changes how libaio's stubs are reached.
+ * With the extensions it also times reads reaped by io_getevents2, with per-file counters and with
+ * the self-profiler on, and
+ * an inline build times them through the library's untracked and minimal engine configurations.
+ */
+static int run_call_cost(const Options& options) {
+    const std::string& backend = options.backends[0];
+    int fd = open_bench_file(options, backend);
+    if (fd < 0) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", options.path, strerror(errno));
+        return 1;
+    }
+    static const unsigned BATCH = 32;
+    void* buffer = alloc_buffer(options.block_size);
+    io_context_t ctx = 0;
+    int result = buffer ? io_setup((int)BATCH * 2, &ctx) : -ENOMEM;
+    if (result < 0) {
+        fprintf(stderr, "aio-bench: cannot set up the context: %s\n", strerror(-result));
+        if (buffer) free_buffer(buffer);
+        close_bench_file(fd);
+        return 1;
+    }
+    // Every read goes to the same block: the point is the calls, not the device.
+    struct iocb iocbs[BATCH];
+    struct iocb* list[BATCH];
+    struct io_event events[BATCH];
+    for (unsigned i = 0; i < BATCH; ++i) {
+        io_prep_pread(&iocbs[i], fd, buffer, options.block_size, 0);
+        list[i] = &iocbs[i];
+    }
+
+    printf("aio-bench: call cost, %s build, on %s (%s), %g s per call after %g s warm-up\n", LINK_MODE, options.path,
+        backend.c_str(), options.duration_s, options.warmup_s);
+    printf("  %-32s %12s %14s\n", "call", "ns", "per second");
+    struct Row { const char* name; double ns; };
+    std::vector<Row> rows;
+#if defined(LIBAIO_WIN32_EXTENSIONS)
+    rows.push_back({ "io_query_backends", time_calls(options, 1, [&] {
+        struct io_backend_caps caps;
+        return io_query_backends(&caps) == 0;
+    }) });
+#endif
+    rows.push_back({ "io_submit of no requests", time_calls(options, 1, [&] { return io_submit(ctx, 0, list) == 0; }) });
+    rows.push_back({ "one read, submitted and reaped", time_calls(options, 1, [&] { return round_trip<CApiEngine>(ctx, 1, list, events); }) });
+    rows.push_back({ "per read, 32 per call", time_calls(options, BATCH, [&] { return round_trip<CApiEngine>(ctx, BATCH, list, events); }) });
+#if defined(LIBAIO_WIN32_EXTENSIONS)
+    // The same reads with exact per-file counters, on a context of their own so the rows above stay clean.
+    io_context_t counted = 0;
+    if (io_setup((int)BATCH * 2, &counted) == 0) {
+        if (io_file_stats_enable(counted, 1) == 0) {
+            rows.push_back({ "per read, per-file counters", time_calls(options, BATCH, [&] { return round_trip<CApiEngine>(counted, BATCH, list, events); }) });
+        }
+        io_destroy(counted);
+    }
+    // The same reads reaped with 64-bit results and completion timestamps.
+    struct io_event2 events2[BATCH];
+    rows.push_back({ "per read, io_getevents2", time_calls(options, BATCH, [&] { return round_trip<CApiEngine2>(ctx, BATCH, list, events2); }) });
+    // The same reads with every phase timed; the rows above show what the profiler costs while it is off.
+    if (io_profile_start() == 0) {
+        rows.push_back({ "per read, profiler on", time_calls(options, BATCH, [&] { return round_trip<CApiEngine>(ctx, BATCH, list, events); }) });
+        io_profile_stop();
+    }
+#endif
+#if defined(LIBAIO_WIN32_IMPLEMENTATION)
+    // Each configuration gets a context of its own: a context is bound to the configuration that submits on it first.
+    io_context_t untracked_ctx = 0;
+    if (io_setup((int)BATCH * 2, &untracked_ctx) == 0) {
+        // Trace recording and ETW are off at run time here, so this row leaves out the in-flight index.
+        typedef AioEngine<UntrackedConfig> Untracked;
+        rows.push_back({ "per read, no in-flight index", time_calls(options, BATCH, [&] { return round_trip<Untracked>(untracked_ctx, BATCH, list, events); }) });
+        io_destroy(untracked_ctx);
+    }
+    io_context_t heap_ctx = 0;
+    if (io_setup((int)BATCH * 2, &heap_ctx) == 0) {
+        typedef AioEngine<HeapRecordsConfig> HeapRecords;
+        rows.push_back({ "per read, heap records", time_calls(options, BATCH, [&] { return round_trip<HeapRecords>(heap_ctx, BATCH, list, events); }) });
+        io_destroy(heap_ctx);
+    }
+    io_context_t minimal_ctx = 0;
+    if (io_setup((int)BATCH * 2, &minimal_ctx) == 0) {
+        // Stats, tracing, the in-flight index, the thread pool and backlog limits compiled out.
+        typedef AioEngine<MinimalConfig> Minimal;
+        rows.push_back({ "one read, minimal engine", time_calls(options, 1, [&] { return round_trip<Minimal>(minimal_ctx, 1, list, events); }) });
+        rows.push_back({ "per read, 32 per call, minimal", time_calls(options, BATCH, [&] { return round_trip<Minimal>(minimal_ctx, BATCH, list, events); }) });
+        io_destroy(minimal_ctx);
+    }
+#endif
+    int status = 0;
+    for (const Row& row : rows) {
+        if (row.ns < 0) {
+            fprintf(stderr, "aio-bench: %s failed\n", row.name);
+            status = 1;
+            continue;
+        }
+        printf("  %-32s %12.1f %14.0f\n", row.name, row.ns, 1e9 / row.ns);
+    }
+
+    io_destroy(ctx);
+    free_buffer(buffer);
+    close_bench_file(fd);
+    return status;
+}
+
+// --- Comparison ---
+
+/// One row of a CSV written by --csv, keyed by column name.
+typedef std::map<std::string, std::string> CsvRow;
+
+static bool load_csv(const char* path, std::vector<CsvRow>* rows) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::vector<std::string> columns;
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        std::vector<std::string> fields(1);
+        for (const char* c = line; *c && *c != '\n' && *c != '\r'; ++c) {
+            if (*c == ',') fields.emplace_back();
+            else fields.back() += *c;
+        }
+        if (columns.empty()) { columns = fields; continue; }
+        CsvRow row;
+        for (size_t i = 0; i < columns.size() && i < fields.size(); ++i) row[columns[i]] = fields[i];
+        rows->push_back(row);
+    }
+    fclose(file);
+    if (std::find(columns.begin(), columns.end(), "workload") == columns.end()
+        && std::find(columns.begin(), columns.end(), "threads") == columns.end()) {
+        fprintf(stderr, "aio-bench: %s was not written by aio-bench --csv\n", path);
+        return false;
+    }
+    return true;
+}
+
+static double csv_number(const CsvRow& row, const char* column) {
+    auto it = row.find(column);
+    return it == row.end() || it->second.empty() ? -1 : atof(it->second.c_str());
+}
+
+static void print_change(const char* label, double base, double value) {
+    if (base > 0 && value >= 0) printf("  %s %+.1f%%", label, (value - base) / base * 100.0);
+}
+
+/// Formats a CSV figure for the comparison, or "-" if the CSV does not have it.
+static const char* compare_figure(char* text, size_t size, double value, const char* format) {
+    if (value < 0) snprintf(text, size, "-");
+    else snprintf(text, size, format, value);
+    return text;
+}
+
+/**
+ * @brief Prints the rows of several CSVs side by side, grouped by workload and offered load, or by
+ * point of a --scale sweep, with each row's change relative to the first row of its group.
+ */
+static int run_compare(const Options& options) {
+    std::vector<std::string> order;
+    std::map<std::string, std::vector<CsvRow>> groups;
+    for (const char* path : options.compare_paths) {
+        std::vector<CsvRow> rows;
+        if (!load_csv(path, &rows)) return 1;
+        for (const CsvRow& row : rows) {
+            std::string key;
+            if (row.count("workload")) {
+                key = row.at("workload");
+                if (row.count("arrivals") && row.at("arrivals") != "closed") key += " @" + std::to_string((long long)csv_number(row, "offered_iops"));
+            }
+            else {
+                key = "t" + row.at("threads") + " ctx " + row.at("contexts") + " qd" + row.at("qd") + " b" + row.at("batch");
+            }
+            if (!groups.count(key)) order.push_back(key);
+            groups[key].push_back(row);
+        }
+    }
+
+    printf("%-28s %-26s %10s %10s %10s %10s %10s\n", "workload", "platform/backend", "iops", "cpu us/op", "p50 us", "p99 us", "p99.9 us");
+    for (const std::string& key : order) {
+        const std::vector<CsvRow>& rows = groups[key];
+        for (size_t i = 0; i < rows.size(); ++i) {
+            const CsvRow& row = rows[i];
+            std::string source = (row.count("platform") ? row.at("platform") : std::string("?")) + "/" + row.at("backend");
+            // --scale CSVs name the achieved rate "iops", and have no p50 or p99.9.
+            const char* iops_column = row.count("achieved_iops") ? "achieved_iops" : "iops";
+            double cpu = csv_number(row, "cpu_us_per_op");
+            char cpu_text[32], p50[32], p99[32], p99_9[32];
+            printf("%-28s %-26s %10.0f %10s %10s %10s %10s", i == 0 ? key.c_str() : "", source.c_str(), csv_number(row, iops_column),
+                compare_figure(cpu_text, sizeof(cpu_text), cpu, "%.2f"), compare_figure(p50, sizeof(p50), csv_number(row, "p50_us"), "%.1f"),
+                compare_figure(p99, sizeof(p99), csv_number(row, "p99_us"), "%.1f"), compare_figure(p99_9, sizeof(p99_9), csv_number(row, "p99_9_us"), "%.1f"));
+            if (i > 0) {
+                const CsvRow& base = rows[0];
+                print_change("iops", csv_number(base, iops_column), csv_number(row, iops_column));
+                print_change("cpu", csv_number(base, "cpu_us_per_op"), cpu);
+                print_change("p99", csv_number(base, "p99_us"), csv_number(row, "p99_us"));
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+// --- Memory Footprint ---
+
+#if defined(_WIN32)
+/// Requests given to each context, which keeps every in-flight index at most half full.
+static const unsigned FOOTPRINT_CONTEXT_DEPTH = 65536;
+/// Buffers in each request of the vectored measurement.
+static const int FOOTPRINT_SEGMENTS = 4;
+/// Provided buffers each context registers for the queued select reads.
+static const unsigned FOOTPRINT_POOL = 256;
+/// The buffer group of the queued select reads.
+static const unsigned short FOOTPRINT_GROUP = 1;
+
+static void print_footprint(const char* label, const MemorySample& before, const MemorySample& after, unsigned long long count) {
+    long long resident = after.resident - before.resident;
+    long long committed = after.committed - before.committed;
+    printf("%-32s %12.1f %12.1f %12.1f %12.1f\n", label, resident / 1048576.0, committed / 1048576.0,
+        (double)resident / count, (double)committed / count);
+}
+
+static size_t footprint_share(size_t context, unsigned long long total) {
+    unsigned long long first = (unsigned long long)context * FOOTPRINT_CONTEXT_DEPTH;
+    return (size_t)std::min<unsigned long long>(total - first, FOOTPRINT_CONTEXT_DEPTH);
+}
+
+/// Submits every iocb, each context taking the next FOOTPRINT_CONTEXT_DEPTH of them.
+static bool footprint_submit(const std::vector<io_context_t>& contexts, std::vector<struct iocb*>& pointers) {
+    size_t done = 0;
+    for (size_t c = 0; c < contexts.size(); ++c) {
+        size_t end = done + footprint_share(c, pointers.size());
+        while (done < end) {
+            int result = io_submit(contexts[c], (long)(end - done), pointers.data() + done);
+            if (result <= 0) {
+                fprintf(stderr, "aio-bench: io_submit failed after %zu requests: %s\n", done, strerror(result < 0 ? -result : EAGAIN));
+                return false;
+            }
+            done += (size_t)result;
+        }
+    }
+    return true;
+}
+
+/// Collects every event, and `extra` more per context; the null engine has completed its requests by the time io_submit returns.
+static bool footprint_reap(const std::vector<io_context_t>& contexts, unsigned long long total, std::vector<struct io_event>& events,
+    size_t extra = 0) {
+    for (size_t c = 0; c < contexts.size(); ++c) {
+        size_t left = footprint_share(c, total) + extra;
+        while (left) {
+            struct timespec timeout = { 5, 0 };
+            long wanted = (long)std::min(left, events.size());
+            int got = io_getevents(contexts[c], 1, wanted, events.data(), &timeout);
+            if (got <= 0) {
+                fprintf(stderr, "aio-bench: %zu requests never completed\n", left);
+                return false;
+            }
+            left -= (size_t)got;
+        }
+    }
+    return true;
+}
+
+/// A pipe whose reads block a worker until the client end writes to it.
+struct FootprintPipe {
+    int fd = -1;
+    HANDLE client = INVALID_HANDLE_VALUE;
+};
+
+static bool open_footprint_pipe(FootprintPipe* pipe) {
+    char name[64];
+    snprintf(name, sizeof(name), "\\\\.\\pipe\\aio-bench-footprint-%lu", (unsigned long)GetCurrentProcessId());
+    HANDLE server = CreateNamedPipeA(name, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, NULL);
+    if (server == INVALID_HANDLE_VALUE) return false;
+    pipe->client = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    pipe->fd = pipe->client != INVALID_HANDLE_VALUE ? _open_osfhandle((intptr_t)server, 0) : -1;
+    if (pipe->fd < 0) {
+        CloseHandle(server);
+        return false;
+    }
+    return true;
+}
+
+static void close_footprint_pipe(const FootprintPipe& pipe) {
+    if (pipe.fd >= 0) _close(pipe.fd);
+    if (pipe.client != INVALID_HANDLE_VALUE) CloseHandle(pipe.client);
+}
+
+/// Commits and touches a region of its own, so that none of it is heap memory an earlier round freed.
+static void* alloc_footprint_region(size_t length) {
+    void* region = VirtualAlloc(NULL, length, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (region) memset(region, 0xA5, length);
+    return region;
+}
+
+/// Occupies each context's one worker with a read on the pipe, so everything submitted after it stays queued.
+static bool footprint_block(const std::vector<io_context_t>& contexts, const FootprintPipe& pipe, std::vector<struct iocb>& blockers,
+    char* bytes) {
+    for (size_t c = 0; c < contexts.size(); ++c) {
+        struct iocb* list[] = { &blockers[c] };
+        io_prep_pread(&blockers[c], pipe.fd, &bytes[c], 1, 0);
+        int result = io_submit(contexts[c], 1, list);
+        if (result != 1) {
+            fprintf(stderr, "aio-bench: io_submit of the pipe read failed: %s\n", strerror(result < 0 ? -result : EAGAIN));
+            return false;
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50)); // Until every worker waits in its read.
+    return true;
+}
+
+/// Completes the pipe reads, which lets each worker go on to the requests queued behind its own.
+static bool footprint_unblock(const std::vector<io_context_t>& contexts, const FootprintPipe& pipe) {
+    std::vector<char> data(contexts.size(), 'p');
+    DWORD written = 0;
+    if (!WriteFile(pipe.client, data.data(), (DWORD)data.size(), &written, NULL) || written != data.size()) {
+        fprintf(stderr, "aio-bench: cannot write to the pipe\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Holds N reads queued behind busy workers, first into the caller's own buffers and then into
+ * provided buffers, and reports the process memory each costs with the buffers included.
+ *
+ * Each context gets one worker, which a read on a pipe keeps busy, so the thread-pool engine queues
+ * every read after it. A queued read into a caller's buffer pins that buffer already, while a select
+ * read takes a buffer only once a worker runs it, so the group can be sized for the reads running at
+ * a time. Released, the select reads past the group's size fail with ENOBUFS, which is not measured.
+ */
+static bool run_footprint_queued(const Options& options, const std::vector<io_context_t>& contexts, unsigned long long total,
+    std::vector<struct iocb>& iocbs, std::vector<struct iocb*>& pointers, std::vector<struct io_event>& events) {
+    int fd = open_bench_file(options, "threadpool");
+    FootprintPipe pipe;
+    if (fd < 0 || !open_footprint_pipe(&pipe)) {
+        fprintf(stderr, "aio-bench: cannot open the file and a pipe for queued reads\n");
+        if (fd >= 0) close_bench_file(fd);
+        return false;
+    }
+    std::vector<struct iocb> blockers(contexts.size());
+    std::vector<char> bytes(contexts.size());
+    size_t length = options.block_size;
+
+    // The first round also starts each context's worker, so the samples leave out its thread.
+    bool ok = footprint_block(contexts, pipe, blockers, bytes.data());
+    if (ok) {
+        MemorySample before = sample_memory();
+        char* buffers = (char*)alloc_footprint_region((size_t)total * length);
+        ok = buffers != nullptr;
+        if (ok) {
+            for (size_t i = 0; i < pointers.size(); ++i) io_prep_pread(&iocbs[i], fd, buffers + i * length, length, 0);
+            ok = footprint_submit(contexts, pointers);
+        }
+        if (ok) {
+            MemorySample queued = sample_memory();
+            char label[64];
+            snprintf(label, sizeof(label), "queued reads, own %zu B buffers", length);
+            print_footprint(label, before, queued, total);
+        }
+        ok = footprint_unblock(contexts, pipe) && ok && footprint_reap(contexts, total, events, 1);
+        if (buffers) VirtualFree(buffers, 0, MEM_RELEASE);
+    }
+    if (ok) ok = footprint_block(contexts, pipe, blockers, bytes.data());
+    if (ok) {
+        MemorySample before = sample_memory();
+        char* pool = (char*)alloc_footprint_region(contexts.size() * FOOTPRINT_POOL * length);
+        ok = pool != nullptr;
+        for (size_t c = 0; c < contexts.size() && ok; ++c) {
+            int result = io_provide_buffers(contexts[c], FOOTPRINT_GROUP, pool + c * FOOTPRINT_POOL * length, length, FOOTPRINT_POOL);
+            if (result < 0) {
+                fprintf(stderr, "aio-bench: io_provide_buffers failed: %s\n", strerror(-result));
+                ok = false;
+            }
+        }
+        if (ok) {
+            for (size_t i = 0; i < pointers.size(); ++i) io_prep_pread_select(&iocbs[i], fd, (unsigned long)length, 0, FOOTPRINT_GROUP);
+            ok = footprint_submit(contexts, pointers);
+        }
+        if (ok) {
+            MemorySample queued = sample_memory();
+            char label[64];
+            snprintf(label, sizeof(label), "queued select, %u-buffer groups", FOOTPRINT_POOL);
+            print_footprint(label, before, queued, total);
+        }
+        ok = footprint_unblock(contexts, pipe) && ok && footprint_reap(contexts, total, events, 1);
+        // The contexts hold the group until io_destroy, so the pool outlives them.
+        for (io_context_t ctx : contexts) io_destroy(ctx);
+        if (pool) VirtualFree(pool, 0, MEM_RELEASE);
+    }
+    else {
+        for (io_context_t ctx : contexts) io_destroy(ctx);
+    }
+    close_footprint_pipe(pipe);
+    close_bench_file(fd);
+    return ok;
+}
+
+/**
+ * @brief Holds N requests in flight, first single reads and then vectored ones, and reports the
+ * process memory each costs on top of the contexts that carry them. Then holds N reads queued on
+ * the thread-pool engine, with and without provided buffers (see run_footprint_queued).
+ *
+ * The null engine posts each completion at once and nothing reaps it until the measurement is
+ * taken, so every request's record is alive, without any device queueing N operations. The
+ * iocbs, iovecs and buffer are the caller's and are allocated before the first sample.
+ */
+static int run_footprint(const Options& options) {
+    unsigned long long total = options.footprint;
+    size_t context_count = (size_t)((total + FOOTPRINT_CONTEXT_DEPTH - 1) / FOOTPRINT_CONTEXT_DEPTH);
+    int fd = open_bench_file(options, "null");
+    if (fd < 0) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", options.path, strerror(errno));
+        return 1;
+    }
+    size_t segment_size = std::max<size_t>(options.block_size / FOOTPRINT_SEGMENTS, 1);
+    void* buffer = alloc_buffer(segment_size * FOOTPRINT_SEGMENTS);
+    if (!buffer) {
+        fprintf(stderr, "aio-bench: out of memory for the buffer\n");
+        close_bench_file(fd);
+        return 1;
+    }
+    std::vector<struct iocb> iocbs((size_t)total);
+    std::vector<struct iocb*> pointers((size_t)total);
+    std::vector<struct io_event> events(4096);
+    struct iovec vectors[FOOTPRINT_SEGMENTS];
+    for (int i = 0; i < FOOTPRINT_SEGMENTS; ++i) {
+        vectors[i].iov_base = (char*)buffer + i * segment_size;
+        vectors[i].iov_len = segment_size;
+    }
+    for (size_t i = 0; i < pointers.size(); ++i) {
+        io_prep_pread(&iocbs[i], fd, buffer, options.block_size, 0);
+        pointers[i] = &iocbs[i];
+    }
+
+    printf("aio-bench: memory of %llu requests in flight on %zu context%s of depth %u (null engine, then queued on the thread pool)\n", total,
+        context_count, context_count == 1 ? "" : "s", FOOTPRINT_CONTEXT_DEPTH);
+    printf("%-32s %12s %12s %12s %12s\n", "", "resident MiB", "private MiB", "resident B", "private B");
+    std::vector<io_context_t> contexts;
+    bool ok = true;
+    MemorySample empty = sample_memory();
+    for (size_t c = 0; c < context_count && ok; ++c) {
+        io_context_t ctx = 0;
+        int result = io_setup(FOOTPRINT_CONTEXT_DEPTH, &ctx);
+        if (result < 0) {
+            fprintf(stderr, "aio-bench: io_setup failed: %s\n", strerror(-result));
+            ok = false;
+        }
+        else contexts.push_back(ctx);
+    }
+    if (ok) {
+        MemorySample setup = sample_memory();
+        print_footprint("io_setup, per maxevents", empty, setup, (unsigned long long)context_count * FOOTPRINT_CONTEXT_DEPTH);
+        ok = footprint_submit(contexts, pointers);
+        if (ok) {
+            MemorySample singles = sample_memory();
+            print_footprint("single reads, per request", setup, singles, total);
+            ok = footprint_reap(contexts, total, events);
+        }
+    }
+    if (ok) {
+        // The first round left each context's request records committed for reuse, so this one
+        // measures only what vectored requests add.
+        for (size_t i = 0; i < pointers.size(); ++i) io_prep_preadv(&iocbs[i], fd, vectors, FOOTPRINT_SEGMENTS, 0);
+        MemorySample before = sample_memory();
+        ok = footprint_submit(contexts, pointers);
+        if (ok) {
+            MemorySample vectored = sample_memory();
+            char label[64];
+            snprintf(label, sizeof(label), "%d-buffer preadv, per request", FOOTPRINT_SEGMENTS);
+            print_footprint(label, before, vectored, total);
+            ok = footprint_reap(contexts, total, events);
+        }
+    }
+    if (ok) ok = run_footprint_queued(options, contexts, total, iocbs, pointers, events);
+    else {
+        for (io_context_t ctx : contexts) io_destroy(ctx);
+    }
+    free_buffer(buffer);
+    close_bench_file(fd);
+    return ok ? 0 : 1;
+}
+
+// --- Many Contexts ---
+
+/// Reads each context has in flight at a time during the throughput measurement.
+static const unsigned MANY_CONTEXTS_DEPTH = 4;
+
+/**
+ * @brief Issues one read on every context, then reaps every context, for the benchmark's duration.
+ * @return Reads completed per second, or a negative value if a request failed.
+ */
+static double many_contexts_rate(const Options& options, const std::vector<io_context_t>& contexts, int fd, void* buffer) {
+    std::vector<struct iocb> iocbs(contexts.size());
+    for (size_t c = 0; c < contexts.size(); ++c) io_prep_pread(&iocbs[c], fd, buffer, options.block_size, 0);
+    unsigned long long completed = 0;
+    Clock::time_point warm_until = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup_s));
+    Clock::time_point started = warm_until;
+    Clock::time_point end = warm_until + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+    bool measuring = false;
+    for (;;) {
+        Clock::time_point now = Clock::now();
+        if (!measuring && now >= warm_until) { measuring = true; started = now; completed = 0; }
+        if (now >= end) break;
+        for (size_t c = 0; c < contexts.size(); ++c) {
+            struct iocb* pointer = &iocbs[c];
+            if (io_submit(contexts[c], 1, &pointer) != 1) return -1;
+        }
+        for (size_t c = 0; c < contexts.size(); ++c) {
+            struct io_event event;
+            struct timespec timeout = { 5, 0 };
+            if (io_getevents(contexts[c], 1, 1, &event, &timeout) != 1 || event_failed(event)) return -1;
+        }
+        completed += contexts.size();
+    }
+    return completed / std::chrono::duration<double>(Clock::now() - started).count();
+}
+
+/**
+ * @brief Opens N thin contexts, then N dedicated ones, and reports what one costs in memory and handles,
+ * and the read rate when every context has one request outstanding.
+ *
+ * Dedicated contexts each hold a completion port; thin ones share the process's engine, so the
+ * first thin context also pays for the engine and its dispatcher thread.
+ */
+static int run_many_contexts(const Options& options) {
+    unsigned count = options.many_contexts;
+    const std::string& backend = options.backends[0];
+    int fd = open_bench_file(options, backend);
+    if (fd < 0) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", options.path, strerror(errno));
+        return 1;
+    }
+    void* buffer = alloc_buffer(options.block_size);
+    if (!buffer) {
+        fprintf(stderr, "aio-bench: out of memory for the buffer\n");
+        close_bench_file(fd);
+        return 1;
+    }
+
+    printf("aio-bench: %u contexts of depth %u on %s (%s), %g s after %g s warm-up\n", count, MANY_CONTEXTS_DEPTH,
+        options.path, backend.c_str(), options.duration_s, options.warmup_s);
+    printf("%-32s %12s %12s %12s %12s %10s %12s\n", "", "resident MiB", "private MiB", "resident B", "private B", "handles", "reads/s");
+    bool ok = true;
+    // Thin contexts go first, so that they cannot reuse what the dedicated ones freed.
+    for (int shared = 1; shared >= 0 && ok; --shared) {
+        std::vector<io_context_t> contexts;
+        contexts.reserve(count);
+        DWORD handles_before = 0, handles_after = 0;
+        GetProcessHandleCount(GetCurrentProcess(), &handles_before);
+        MemorySample before = sample_memory();
+        for (unsigned c = 0; c < count && ok; ++c) {
+            io_context_t ctx = 0;
+            int result = shared ? io_setup_shared(MANY_CONTEXTS_DEPTH, &ctx) : io_setup(MANY_CONTEXTS_DEPTH, &ctx);
+            if (result < 0) {
+                fprintf(stderr, "aio-bench: %s failed after %u contexts: %s\n", shared ? "io_setup_shared" : "io_setup", c, strerror(-result));
+                ok = false;
+            }
+            else contexts.push_back(ctx);
+        }
+        MemorySample after = sample_memory();
+        GetProcessHandleCount(GetCurrentProcess(), &handles_after);
+        if (ok) {
+            double rate = many_contexts_rate(options, contexts, fd, buffer);
+            if (rate < 0) {
+                fprintf(stderr, "aio-bench: a read on one of the contexts failed\n");
+                ok = false;
+            }
+            long long resident = after.resident - before.resident;
+            long long committed = after.committed - before.committed;
+            printf("%-32s %12.1f %12.1f %12.1f %12.1f %10.2f %12.0f\n", shared ? "io_setup_shared, per context" : "io_setup, per context",
+                resident / 1048576.0, committed / 1048576.0, (double)resident / count, (double)committed / count,
+                (double)((long long)handles_after - (long long)handles_before) / count, rate < 0 ? 0 : rate);
+        }
+        for (io_context_t ctx : contexts) io_destroy(ctx);
+    }
+
+    free_buffer(buffer);
+    close_bench_file(fd);
+    return ok ? 0 : 1;
+}
+#endif
+
+// --- Driver ---
+
+/// Measures one workload on one engine. Returns false if the file or context cannot be set up.
+static bool run_backend(const Options& options, const Workload& workload, const std::string& backend, FILE* csv) {
+    Options run_options = options;
+    run_options.block_size = workload.block_size;
+    run_options.write = workload.write;
+    unsigned slot_count = workload.closed_qd ? workload.closed_qd : options.max_inflight;
+
+    int fd = open_bench_file(run_options, backend);
+    if (fd < 0) {
+        fprintf(stderr, "aio-bench: cannot open %s: %s\n", options.path, strerror(errno));
+        return false;
+    }
+    long long file_size = bench_file_size(fd);
+    unsigned long long region = options.size ? options.size : (unsigned long long)std::max(file_size, 0LL);
+    if (region < workload.block_size) {
+        fprintf(stderr, "aio-bench: %s is smaller than one %zu-byte request; use --size on a larger file\n", options.path, workload.block_size);
+        close_bench_file(fd);
+        return false;
+    }
+
+    io_context_t ctx = 0;
+    int result = io_setup((int)slot_count + 64, &ctx);
+    if (result < 0) {
+        fprintf(stderr, "aio-bench: io_setup failed: %s\n", strerror(-result));
+        close_bench_file(fd);
+        return false;
+    }
+    std::vector<Slot> slots(slot_count);
+    bool ok = true;
+    for (Slot& slot : slots) {
+        slot.buffer = alloc_buffer(workload.block_size);
+        if (!slot.buffer) ok = false;
+        else memset(slot.buffer, 0xA5, workload.block_size);
+    }
+
+    if (ok) {
+        printf("\n%s on %s\n", workload.name.c_str(), engine_name(options, backend).c_str());
+        print_header(workload);
+        std::vector<double> rates = workload.closed_qd ? std::vector<double>(1, 0.0) : options.rates;
+        for (double rate : rates) {
+            PointResult point;
+            if (workload.closed_qd) run_closed(ctx, fd, region, slots, run_options, &point);
+            else run_point(ctx, fd, region, slots, run_options, rate, &point);
+            print_point(workload, point);
+            fflush(stdout);
+            if (csv) write_csv_row(csv, workload, backend, options, point);
+        }
+    }
+    else fprintf(stderr, "aio-bench: out of memory for %u buffers\n", slot_count);
+
+    for (Slot& slot : slots) {
+        if (slot.buffer) free_buffer(slot.buffer);
+    }
+    io_destroy(ctx);
+    close_bench_file(fd);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+    if (options.compare) return run_compare(options);
+#if defined(_WIN32)
+    // The library reads these once, at its first call, and they apply to every context.
+    if (options.backends[0] == "null" || options.backends[0] == "simulated") {
+        SetEnvironmentVariableA("LIBAIO_WIN32_BACKEND", options.backends[0].c_str());
+    }
+    if (options.sim_latency_us) SetEnvironmentVariableA("LIBAIO_WIN32_SIM_LATENCY_US", options.sim_latency_us);
+    if (options.locked_pool_queue) SetEnvironmentVariableA("LIBAIO_WIN32_POOL_QUEUE", "locked");
+    if (options.footprint) {
+        // One worker per context, which a pipe read can keep busy while the queued reads are measured.
+        SetEnvironmentVariableA("LIBAIO_WIN32_WORKERS", "1");
+        SetEnvironmentVariableA("LIBAIO_WIN32_MAX_WORKERS", "1");
+        return run_footprint(options);
+    }
+    if (options.many_contexts) return run_many_contexts(options);
+#endif
+    if (options.call_cost) return run_call_cost(options);
+
+    FILE* csv = nullptr;
+    if (options.csv_path) {
+        csv = fopen(options.csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "aio-bench: cannot create %s: %s\n", options.csv_path, strerror(errno));
+            return 1;
+        }
+        fputs(options.scale ? SCALE_CSV_HEADER : CSV_HEADER, csv);
+    }
+
+    if (options.churn) {
+        printf("aio-bench: io_setup/io_destroy cycles on %s%s at depth %u, %g s per cycle type after %g s warm-up\n", options.path,
+            options.direct ? " (direct)" : "", options.max_inflight, options.duration_s, options.warmup_s);
+#if defined(_WIN32)
+        struct io_backend_caps caps;
+        if (io_query_backends(&caps) == 0) printf("context pool: %u idle ports (LIBAIO_WIN32_CONTEXT_POOL)\n", caps.context_pool);
+#endif
+        int status = 0;
+        for (const std::string& backend : options.backends) {
+            if (!run_churn(options, backend)) status = 1;
+        }
+        return status;
+    }
+
+    if (options.scale) {
+        printf("aio-bench: %s scaling sweep on %s%s, %g s per point after %g s warm-up\n", options.write ? "write" : "read",
+            options.path, options.direct ? " (direct)" : "", options.duration_s, options.warmup_s);
+        int status = 0;
+        for (const std::string& backend : options.backends) {
+            if (!run_scale(options, backend, csv)) status = 1;
+        }
+        if (csv) fclose(csv);
+        return status;
+    }
+
+    bool closed = options.suite || options.closed_qd;
+    printf("aio-bench: random I/O on %s%s, ", options.path, options.direct ? " (direct)" : "");
+    if (closed) printf("closed loop");
+    else printf("%s arrivals, at most %u in flight", options.arrivals == ARRIVALS_POISSON ? "Poisson" : "constant", options.max_inflight);
+    printf(", %g s per load after %g s warm-up\n", options.duration_s, options.warmup_s);
+    printf("latency in us, from the time each request was due%s\n", closed ? " (its submission, in a closed loop)" : "");
+
+    int status = 0;
+    for (const Workload& workload : plan_workloads(options)) {
+        for (const std::string& backend : options.backends) {
+            if (!run_backend(options, workload, backend, csv)) status = 1;
+        }
+    }
+    if (csv) fclose(csv);
+    return status;
+}
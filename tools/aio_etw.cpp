@@ -0,0 +1,394 @@
+/**
+ * @file aio_etw.cpp
+ * @brief Latency histograms and event dumps from libaio-win32's ETW provider.
+ *
+ * aio-etw starts a real-time ETW session, enables the LibaioWin32 provider described in
+ * libaio_etw.h, and aggregates its events until it is interrupted or its duration ends: request
+ * latency per opcode class, time spent queued for a pool worker, time spent waiting in
+ * io_getevents, and request sizes, printed as power-of-two histograms in the style of bpftrace's
+ * hist(). With --trace it prints every event instead. It can also read a file recorded with
+ * logman or WPR. Real-time sessions need administrator rights or membership of the Performance
+ * Log Users group; the traced processes need nothing.
+ */
+
+#include <windows.h>
+#include <evntrace.h>
+#include <evntcons.h>
+#include "libaio_win32.h"
+#include "libaio_etw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define AIO_ETW_GUID_INIT(l, w1, w2, b0, b1, b2, b3, b4, b5, b6, b7) { l, w1, w2, { b0, b1, b2, b3, b4, b5, b6, b7 } }
+#define AIO_ETW_EXPAND(macro, args) macro args
+static const GUID kProviderGuid = AIO_ETW_EXPAND(AIO_ETW_GUID_INIT, AIO_ETW_PROVIDER_GUID);
+
+// --- Options ---
+
+struct Options {
+    DWORD pid = 0;              ///< 0 = every process.
+    double duration_s = 0;      ///< 0 = until Ctrl-C.
+    bool trace = false;
+    const char* file = nullptr; ///< Read a recorded .etl file instead of starting a session.
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: aio-etw [options]\n"
+        "  -p, --pid PID           only events from this process\n"
+        "  -d, --duration SECONDS  stop after this long (default: until Ctrl-C)\n"
+        "  --trace                 print every event instead of histograms\n"
+        "  --file TRACE.etl        read a recorded trace instead of starting a live session\n"
+        "A live session needs administrator rights or the Performance Log Users group.\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if ((strcmp(arg, "-p") == 0 || strcmp(arg, "--pid") == 0) && value) { options->pid = (DWORD)strtoul(value, nullptr, 10); ++i; }
+        else if ((strcmp(arg, "-d") == 0 || strcmp(arg, "--duration") == 0) && value) { options->duration_s = atof(value); ++i; }
+        else if (strcmp(arg, "--trace") == 0) options->trace = true;
+        else if (strcmp(arg, "--file") == 0 && value) { options->file = value; ++i; }
+        else return false;
+    }
+    return options->duration_s >= 0;
+}
+
+// --- Histograms ---
+
+/**
+ * @struct Histogram
+ * @brief Power-of-two buckets: bucket 0 holds the value 0, bucket k holds [2^(k-1), 2^k).
+ */
+struct Histogram {
+    unsigned long long buckets[65] = {};
+    unsigned long long count = 0;
+
+    void add(unsigned long long value) {
+        unsigned bucket = 0;
+        while (bucket < 64 && (value >> bucket)) ++bucket;
+        ++buckets[bucket];
+        ++count;
+    }
+};
+
+/// Formats a bucket bound the way bpftrace does: 1K is 1024.
+static std::string format_bound(unsigned long long value) {
+    static const char* suffixes[] = { "", "K", "M", "G", "T", "P", "E" };
+    unsigned suffix = 0;
+    while (value >= 1024 && value % 1024 == 0 && suffix < 6) { value /= 1024; ++suffix; }
+    return std::to_string(value) + suffixes[suffix];
+}
+
+static void print_histogram(const char* name, const Histogram& histogram) {
+    if (!histogram.count) return;
+    unsigned first = 0, last = 64;
+    while (!histogram.buckets[first]) ++first;
+    while (!histogram.buckets[last]) --last;
+    unsigned long long peak = 0;
+    for (unsigned b = first; b <= last; ++b) if (histogram.buckets[b] > peak) peak = histogram.buckets[b];
+
+    printf("%s:\n", name);
+    for (unsigned b = first; b <= last; ++b) {
+        std::string range = b == 0 ? "[0]"
+            : "[" + format_bound(1ULL << (b - 1)) + ", " + (b == 64 ? std::string("...") : format_bound(1ULL << b)) + ")";
+        int width = (int)(histogram.buckets[b] * 52 / peak);
+        printf("%-20s %8llu |%s%*s|\n", range.c_str(), histogram.buckets[b], std::string(width, '@').c_str(), 52 - width, "");
+    }
+    printf("\n");
+}
+
+// --- Event Decoding ---
+
+/// Reads the packed fields of an event in order; see libaio_etw.h.
+struct FieldReader {
+    const unsigned char* next;
+    const unsigned char* end;
+
+    template <typename T>
+    T take() {
+        T value = T();
+        if (end - next >= (ptrdiff_t)sizeof(T)) memcpy(&value, next, sizeof(T));
+        next += sizeof(T);
+        return value;
+    }
+};
+
+static const char* opcode_name(unsigned opcode) {
+    switch (opcode) {
+    case IO_CMD_PREAD:          return "pread";
+    case IO_CMD_PWRITE:         return "pwrite";
+    case IO_CMD_FSYNC:          return "fsync";
+    case IO_CMD_FDSYNC:         return "fdsync";
+    case IO_CMD_PREADV:         return "preadv";
+    case IO_CMD_PWRITEV:        return "pwritev";
+    case IO_CMD_PREAD_SELECT:   return "pread_select";
+    default:                    return "unknown";
+    }
+}
+
+static const char* backend_name(unsigned backend) {
+    switch (backend) {
+    case IO_BACKEND_THREADPOOL: return "threadpool";
+    case IO_BACKEND_NULL:       return "null";
+    case IO_BACKEND_SIMULATED:  return "simulated";
+    default:                    return "iocp";
+    }
+}
+
+/// Opcode classes that histograms are kept for.
+enum { CLASS_READ, CLASS_WRITE, CLASS_SYNC, CLASS_COUNT };
+
+static unsigned opcode_class(unsigned opcode) {
+    if (opcode == IO_CMD_PWRITE || opcode == IO_CMD_PWRITEV) return CLASS_WRITE;
+    if (opcode == IO_CMD_FSYNC || opcode == IO_CMD_FDSYNC) return CLASS_SYNC;
+    return CLASS_READ;
+}
+
+static const char* const kClassNames[CLASS_COUNT] = { "read", "write", "sync" };
+
+struct Aggregate {
+    Options options;
+    long long first_timestamp = 0;      ///< ProcessTrace reports system time, in 100 ns units.
+    Histogram latency[CLASS_COUNT];     ///< Submission to dequeue, per whole iocb.
+    Histogram size[CLASS_COUNT];        ///< Bytes requested at submission.
+    Histogram queued;                   ///< Submission to a pool worker picking the request up.
+    Histogram reap_wait;                ///< Time spent inside io_getevents.
+    unsigned long long events[AIO_ETW_REAP + 1] = {};
+    unsigned long long errors = 0;
+};
+
+static double event_time_us(Aggregate* aggregate, const EVENT_RECORD* record) {
+    long long timestamp = record->EventHeader.TimeStamp.QuadPart;
+    if (!aggregate->first_timestamp) aggregate->first_timestamp = timestamp;
+    return (double)(timestamp - aggregate->first_timestamp) / 10.0;
+}
+
+static void print_event(Aggregate* aggregate, const EVENT_RECORD* record, unsigned char opcode, FieldReader fields) {
+    printf("%12.1f %6lu ", event_time_us(aggregate, record), record->EventHeader.ProcessId);
+    unsigned long long ctx = fields.take<uint64_t>();
+    if (opcode == AIO_ETW_SETUP) {
+        unsigned serial = fields.take<uint32_t>();
+        int maxevents = fields.take<int32_t>();
+        printf("setup     ctx=%llx serial=%u maxevents=%d\n", ctx, serial, maxevents);
+        return;
+    }
+    if (opcode == AIO_ETW_REAP) {
+        long long min_nr = fields.take<int64_t>(), nr = fields.take<int64_t>(), events = fields.take<int64_t>();
+        unsigned long long wait_ns = fields.take<uint64_t>();
+        printf("reap      ctx=%llx min_nr=%lld nr=%lld events=%lld wait=%lluns\n", ctx, min_nr, nr, events, wait_ns);
+        return;
+    }
+    unsigned long long iocb = fields.take<uint64_t>();
+    if (opcode == AIO_ETW_SUBMIT) {
+        int fd = fields.take<int32_t>();
+        unsigned op = fields.take<uint32_t>();
+        long long offset = fields.take<int64_t>();
+        unsigned long long length = fields.take<uint64_t>();
+        printf("submit    ctx=%llx iocb=%llx fd=%d %s offset=%lld length=%llu\n", ctx, iocb, fd, opcode_name(op), offset, length);
+    }
+    else if (opcode == AIO_ETW_ISSUE) {
+        unsigned backend = fields.take<uint32_t>();
+        long long offset = fields.take<int64_t>();
+        unsigned long long length = fields.take<uint64_t>();
+        unsigned long long queued_ns = fields.take<uint64_t>();
+        printf("issue     ctx=%llx iocb=%llx %s offset=%lld length=%llu queued=%lluns\n", ctx, iocb,
+            backend_name(backend), offset, length, queued_ns);
+    }
+    else if (opcode == AIO_ETW_VECTORED_COMPLETE) {
+        unsigned op = fields.take<uint32_t>(), segments = fields.take<uint32_t>();
+        unsigned long long bytes = fields.take<uint64_t>();
+        unsigned error = fields.take<uint32_t>();
+        unsigned long long latency_ns = fields.take<uint64_t>();
+        printf("vcomplete ctx=%llx iocb=%llx %s segments=%u bytes=%llu error=%u latency=%lluns\n", ctx, iocb, opcode_name(op),
+            segments, bytes, error, latency_ns);
+    }
+    else {
+        unsigned op = fields.take<uint32_t>();
+        unsigned long long bytes = fields.take<uint64_t>();
+        unsigned error = fields.take<uint32_t>();
+        unsigned long long latency_ns = fields.take<uint64_t>();
+        printf("%s ctx=%llx iocb=%llx %s bytes=%llu error=%u latency=%lluns\n", opcode == AIO_ETW_COMPLETE ? "complete " : "segment  ",
+            ctx, iocb, opcode_name(op), bytes, error, latency_ns);
+    }
+}
+
+static void aggregate_event(Aggregate* aggregate, unsigned char opcode, FieldReader fields) {
+    fields.take<uint64_t>(); // ctx
+    if (opcode == AIO_ETW_REAP) {
+        fields.take<int64_t>();
+        fields.take<int64_t>();
+        fields.take<int64_t>();
+        aggregate->reap_wait.add(fields.take<uint64_t>());
+        return;
+    }
+    if (opcode == AIO_ETW_SETUP) return;
+    fields.take<uint64_t>(); // iocb
+    if (opcode == AIO_ETW_SUBMIT) {
+        fields.take<int32_t>();
+        unsigned op = fields.take<uint32_t>();
+        fields.take<int64_t>();
+        unsigned long long length = fields.take<uint64_t>();
+        if (opcode_class(op) != CLASS_SYNC) aggregate->size[opcode_class(op)].add(length);
+    }
+    else if (opcode == AIO_ETW_ISSUE) {
+        unsigned backend = fields.take<uint32_t>();
+        fields.take<int64_t>();
+        fields.take<uint64_t>();
+        unsigned long long queued_ns = fields.take<uint64_t>();
+        if (backend == IO_BACKEND_THREADPOOL) aggregate->queued.add(queued_ns);
+    }
+    else if (opcode == AIO_ETW_COMPLETE || opcode == AIO_ETW_VECTORED_COMPLETE) {
+        unsigned op = fields.take<uint32_t>();
+        if (opcode == AIO_ETW_VECTORED_COMPLETE) fields.take<uint32_t>(); // segments
+        fields.take<uint64_t>();
+        unsigned error = fields.take<uint32_t>();
+        unsigned long long latency_ns = fields.take<uint64_t>();
+        if (error) aggregate->errors++;
+        aggregate->latency[opcode_class(op)].add(latency_ns);
+    }
+}
+
+static void WINAPI on_event(PEVENT_RECORD record) {
+    Aggregate* aggregate = static_cast<Aggregate*>(record->UserContext);
+    if (!IsEqualGUID(record->EventHeader.ProviderId, kProviderGuid)) return;
+    if (aggregate->options.pid && record->EventHeader.ProcessId != aggregate->options.pid) return;
+    unsigned char opcode = record->EventHeader.EventDescriptor.Opcode;
+    if (opcode < AIO_ETW_SETUP || opcode > AIO_ETW_REAP) return;
+
+    const unsigned char* data = static_cast<const unsigned char*>(record->UserData);
+    FieldReader fields{ data, data + record->UserDataLength };
+    aggregate->events[opcode]++;
+    if (aggregate->options.trace) print_event(aggregate, record, opcode, fields);
+    else aggregate_event(aggregate, opcode, fields);
+}
+
+static void print_report(const Aggregate& aggregate) {
+    static const char* const event_names[] = { "setup", "submit", "issue", "complete", "segment", "vcomplete", "reap" };
+    printf("events:");
+    for (unsigned op = AIO_ETW_SETUP; op <= AIO_ETW_REAP; ++op) printf(" %s %llu", event_names[op - AIO_ETW_SETUP], aggregate.events[op]);
+    printf("\nerrors: %llu\n\n", aggregate.errors);
+    if (aggregate.options.trace) return;
+
+    for (unsigned c = 0; c < CLASS_COUNT; ++c) {
+        std::string name = std::string("@latency_ns[") + kClassNames[c] + "]";
+        print_histogram(name.c_str(), aggregate.latency[c]);
+    }
+    print_histogram("@pool_queued_ns", aggregate.queued);
+    print_histogram("@getevents_wait_ns", aggregate.reap_wait);
+    for (unsigned c = 0; c < CLASS_SYNC; ++c) {
+        std::string name = std::string("@bytes[") + kClassNames[c] + "]";
+        print_histogram(name.c_str(), aggregate.size[c]);
+    }
+}
+
+// --- Session ---
+
+static HANDLE g_stop_event;
+
+static BOOL WINAPI on_console_ctrl(DWORD) {
+    SetEvent(g_stop_event);
+    return TRUE;
+}
+
+static DWORD WINAPI consume_main(LPVOID param) {
+    TRACEHANDLE* trace = static_cast<TRACEHANDLE*>(param);
+    ProcessTrace(trace, 1, NULL, NULL);
+    return 0;
+}
+
+/// Session properties followed by room for the session name, as StartTrace and ControlTrace expect.
+struct SessionProperties {
+    EVENT_TRACE_PROPERTIES properties;
+    wchar_t name[64];
+};
+
+static void init_properties(SessionProperties* session) {
+    ZeroMemory(session, sizeof(*session));
+    session->properties.Wnode.BufferSize = sizeof(*session);
+    session->properties.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    session->properties.Wnode.ClientContext = 1; // QPC resolution; ProcessTrace still reports system time
+    session->properties.LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
+    session->properties.BufferSize = 256;        // KiB
+    session->properties.MinimumBuffers = 16;
+    session->properties.LoggerNameOffset = offsetof(SessionProperties, name);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+    Aggregate* aggregate = new Aggregate();
+    aggregate->options = options;
+
+    wchar_t session_name[64];
+    _snwprintf(session_name, 64, L"aio-etw-%lu", GetCurrentProcessId());
+    std::wstring file_name;
+    EVENT_TRACE_LOGFILEW log;
+    ZeroMemory(&log, sizeof(log));
+    log.EventRecordCallback = on_event;
+    log.Context = aggregate;
+    log.ProcessTraceMode = PROCESS_TRACE_MODE_EVENT_RECORD;
+
+    TRACEHANDLE session = 0;
+    SessionProperties properties;
+    if (options.file) {
+        file_name.assign(options.file, options.file + strlen(options.file));
+        log.LogFileName = &file_name[0];
+    }
+    else {
+        init_properties(&properties);
+        ULONG status = StartTraceW(&session, session_name, &properties.properties);
+        if (status != ERROR_SUCCESS) {
+            fprintf(stderr, "aio-etw: cannot start an ETW session (error %lu)%s\n", status,
+                status == ERROR_ACCESS_DENIED ? "; run as administrator or join Performance Log Users" : "");
+            return 1;
+        }
+        status = EnableTraceEx2(session, &kProviderGuid, EVENT_CONTROL_CODE_ENABLE_PROVIDER, TRACE_LEVEL_VERBOSE,
+            AIO_ETW_KEYWORD_SUBMIT | AIO_ETW_KEYWORD_COMPLETE, 0, 0, NULL);
+        if (status != ERROR_SUCCESS) {
+            fprintf(stderr, "aio-etw: cannot enable the %s provider (error %lu)\n", AIO_ETW_PROVIDER_NAME, status);
+            ControlTraceW(session, NULL, &properties.properties, EVENT_TRACE_CONTROL_STOP);
+            return 1;
+        }
+        log.LoggerName = session_name;
+        log.ProcessTraceMode |= PROCESS_TRACE_MODE_REAL_TIME;
+    }
+
+    TRACEHANDLE trace = OpenTraceW(&log);
+    if (trace == INVALID_PROCESSTRACE_HANDLE) {
+        fprintf(stderr, "aio-etw: cannot open the trace (error %lu)\n", GetLastError());
+        if (session) ControlTraceW(session, NULL, &properties.properties, EVENT_TRACE_CONTROL_STOP);
+        return 1;
+    }
+
+    if (options.file) {
+        // A file is consumed to its end on this thread.
+        ProcessTrace(&trace, 1, NULL, NULL);
+    }
+    else {
+        g_stop_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+        SetConsoleCtrlHandler(on_console_ctrl, TRUE);
+        HANDLE consumer = CreateThread(NULL, 0, consume_main, &trace, 0, NULL);
+        fprintf(stderr, "aio-etw: tracing %s; %s\n", options.pid ? "one process" : "all processes",
+            options.duration_s > 0 ? "waiting for the duration to end" : "Ctrl-C to stop");
+        WaitForSingleObject(g_stop_event, options.duration_s > 0 ? (DWORD)(options.duration_s * 1000) : INFINITE);
+
+        // Stopping the session flushes its buffers and ends ProcessTrace.
+        EnableTraceEx2(session, &kProviderGuid, EVENT_CONTROL_CODE_DISABLE_PROVIDER, 0, 0, 0, 0, NULL);
+        init_properties(&properties);
+        ControlTraceW(session, NULL, &properties.properties, EVENT_TRACE_CONTROL_STOP);
+        WaitForSingleObject(consumer, INFINITE);
+        CloseHandle(consumer);
+    }
+    CloseTrace(trace);
+    print_report(*aggregate);
+    delete aggregate;
+    return 0;
+}
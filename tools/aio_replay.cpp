@@ -0,0 +1,516 @@
+/**
+ * @file aio_replay.cpp
+ * @brief Replays an I/O trace recorded by libaio-win32 or libaio_trace_preload and compares latencies.
+ *
+ * The trace's requests are resubmitted through the libaio API, either at their recorded times
+ * (optionally sped up) or as fast as possible with a bounded number in flight. The tool builds
+ * unchanged on Windows, where it drives libaio-win32, and on Linux, where libaio_win32.h forwards
+ * to the native libaio, so a trace captured on one platform can be replayed on the other.
+ *
+ * Writes are replayed as reads of the same range unless --allow-writes is given. Vectored
+ * requests are replayed as one contiguous transfer of the same total length.
+ */
+
+#include "libaio_win32.h"
+#include "libaio_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// --- Options ---
+
+struct Options {
+    const char* trace_path = nullptr;
+    bool fast = false;
+    unsigned max_inflight = 64;
+    double speed = 1.0;
+    bool allow_writes = false;
+    bool direct = false;
+    bool overlapped = true;                 ///< Windows only: IOCP engine if true, thread-pool engine if false.
+    std::map<int, std::string> file_overrides;
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: aio-replay [options] TRACE\n"
+        "  --fast                  submit as fast as possible instead of at the recorded times\n"
+        "  --max-inflight N        with --fast, keep at most N requests in flight (default 64)\n"
+        "  --speed X               replay X times faster than recorded (default 1)\n"
+        "  --allow-writes          replay writes as writes; by default they are read back instead\n"
+        "  --direct                open files for direct I/O (O_DIRECT, FILE_FLAG_NO_BUFFERING)\n"
+#if defined(_WIN32)
+        "  --backend iocp|threadpool  engine that drives the files (default iocp)\n"
+#endif
+        "  --file FD=PATH          replay descriptor FD against PATH instead of the recorded path\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (strcmp(arg, "--fast") == 0) options->fast = true;
+        else if (strcmp(arg, "--allow-writes") == 0) options->allow_writes = true;
+        else if (strcmp(arg, "--direct") == 0) options->direct = true;
+        else if (strcmp(arg, "--max-inflight") == 0 && value) { options->max_inflight = (unsigned)atoi(value); ++i; }
+        else if (strcmp(arg, "--speed") == 0 && value) { options->speed = atof(value); ++i; }
+#if defined(_WIN32)
+        else if (strcmp(arg, "--backend") == 0 && value) {
+            if (strcmp(value, "iocp") == 0) options->overlapped = true;
+            else if (strcmp(value, "threadpool") == 0) options->overlapped = false;
+            else return false;
+            ++i;
+        }
+#endif
+        else if (strcmp(arg, "--file") == 0 && value && strchr(value, '=')) {
+            options->file_overrides[atoi(value)] = strchr(value, '=') + 1;
+            ++i;
+        }
+        else if (arg[0] != '-' && !options->trace_path) options->trace_path = arg;
+        else return false;
+    }
+    return options->trace_path && options->max_inflight > 0 && options->speed > 0;
+}
+
+// --- Trace Loading ---
+
+/// One request from the trace, with its recorded and replayed outcome.
+struct TraceOp {
+    uint32_t context;
+    uint8_t opcode;
+    int64_t offset;
+    uint64_t length;
+    int64_t submit_ns;          ///< Recorded submission time, relative to the start of the trace.
+    int64_t original_ns;        ///< Recorded latency, or -1 if the completion is not in the trace.
+    bool original_failed;
+    size_t file;                ///< Index into Trace::paths.
+    int64_t replay_ns;          ///< Replayed latency, or -1 if the request could not be replayed.
+    bool replay_failed;
+};
+
+struct Trace {
+    std::vector<TraceOp> ops;
+    std::vector<std::string> paths;
+    unsigned long long dropped = 0;
+    bool complete = false;      ///< An END record was found.
+    unsigned peak_inflight = 0;
+};
+
+static int64_t ticks_to_ns(int64_t ticks, int64_t ticks_per_second) {
+    return ticks / ticks_per_second * 1000000000LL + ticks % ticks_per_second * 1000000000LL / ticks_per_second;
+}
+
+static bool load_trace(const Options& options, Trace* trace) {
+    FILE* file = fopen(options.trace_path, "rb");
+    if (!file) {
+        fprintf(stderr, "aio-replay: cannot open %s: %s\n", options.trace_path, strerror(errno));
+        return false;
+    }
+    aio_trace_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, AIO_TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != AIO_TRACE_VERSION || header.record_size != sizeof(aio_trace_record) || header.ticks_per_second <= 0) {
+        fprintf(stderr, "aio-replay: %s is not a version %d trace\n", options.trace_path, AIO_TRACE_VERSION);
+        fclose(file);
+        return false;
+    }
+
+    // Records are only roughly ordered on disk; sort them, keeping each path with its record.
+    std::vector<aio_trace_record> records;
+    std::vector<std::string> record_paths;
+    aio_trace_record record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (record.kind == AIO_TRACE_FILE) {
+            std::string path((size_t)record.length, '\0');
+            size_t padded = (size_t)(record.length + sizeof(record) - 1) / sizeof(record) * sizeof(record);
+            std::vector<char> buffer(padded);
+            if (padded && fread(buffer.data(), 1, padded, file) != padded) break;
+            path.assign(buffer.data(), (size_t)record.length);
+            record.length = record_paths.size();
+            record_paths.push_back(path);
+        }
+        else if (record.kind == AIO_TRACE_END) {
+            trace->dropped = record.length;
+            trace->complete = true;
+            continue;
+        }
+        records.push_back(record);
+    }
+    fclose(file);
+    std::stable_sort(records.begin(), records.end(), [](const aio_trace_record& a, const aio_trace_record& b) {
+        if (a.ticks != b.ticks) return a.ticks < b.ticks;
+        auto rank = [](uint8_t kind) { return kind == AIO_TRACE_FILE ? 0 : kind == AIO_TRACE_SUBMIT ? 1 : 2; };
+        return rank(a.kind) < rank(b.kind);
+    });
+
+    std::map<std::pair<uint32_t, int32_t>, std::string> context_paths;
+    std::map<int32_t, std::string> fd_paths;
+    std::map<std::string, size_t> path_index;
+    std::unordered_map<uint64_t, size_t> pending;
+    for (const aio_trace_record& r : records) {
+        if (r.kind == AIO_TRACE_FILE) {
+            context_paths[std::make_pair(r.context, r.fd)] = record_paths[(size_t)r.length];
+            fd_paths[r.fd] = record_paths[(size_t)r.length];
+        }
+        else if (r.kind == AIO_TRACE_SUBMIT) {
+            std::string path;
+            auto override_path = options.file_overrides.find(r.fd);
+            auto context_path = context_paths.find(std::make_pair(r.context, r.fd));
+            auto fd_path = fd_paths.find(r.fd);
+            if (override_path != options.file_overrides.end()) path = override_path->second;
+            else if (context_path != context_paths.end()) path = context_path->second;
+            else if (fd_path != fd_paths.end()) path = fd_path->second;
+            if (path.empty()) {
+                fprintf(stderr, "aio-replay: no path recorded for fd %d; use --file %d=PATH\n", r.fd, r.fd);
+                return false;
+            }
+            auto index = path_index.emplace(path, trace->paths.size());
+            if (index.second) trace->paths.push_back(path);
+
+            TraceOp op;
+            op.context = r.context;
+            op.opcode = r.opcode;
+            op.offset = r.offset;
+            op.length = r.length;
+            op.submit_ns = ticks_to_ns(r.ticks, header.ticks_per_second);
+            op.original_ns = -1;
+            op.original_failed = false;
+            op.file = index.first->second;
+            op.replay_ns = -1;
+            op.replay_failed = false;
+            pending[r.id] = trace->ops.size();
+            trace->ops.push_back(op);
+            trace->peak_inflight = std::max(trace->peak_inflight, (unsigned)pending.size());
+        }
+        else if (r.kind == AIO_TRACE_COMPLETE) {
+            auto it = pending.find(r.id);
+            if (it == pending.end()) continue; // Submitted before the trace started.
+            TraceOp& op = trace->ops[it->second];
+            op.original_ns = ticks_to_ns(r.ticks, header.ticks_per_second) - op.submit_ns;
+            op.original_failed = r.error != 0;
+            pending.erase(it);
+        }
+    }
+    return true;
+}
+
+// --- Platform ---
+
+static const size_t SECTOR_SIZE = 4096;
+
+static void* alloc_buffer(size_t length) {
+#if defined(_WIN32)
+    return _aligned_malloc(length ? length : SECTOR_SIZE, SECTOR_SIZE);
+#else
+    void* buffer = nullptr;
+    return posix_memalign(&buffer, SECTOR_SIZE, length ? length : SECTOR_SIZE) == 0 ? buffer : nullptr;
+#endif
+}
+
+static void free_buffer(void* buffer) {
+#if defined(_WIN32)
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+}
+
+static int open_replay_file(const std::string& path, const Options& options) {
+#if defined(_WIN32)
+    DWORD access = GENERIC_READ | (options.allow_writes ? GENERIC_WRITE : 0);
+    DWORD flags = (options.overlapped ? FILE_FLAG_OVERLAPPED : 0) | (options.direct ? FILE_FLAG_NO_BUFFERING : 0);
+    HANDLE handle = CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, flags, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return -1;
+    int fd = _open_osfhandle((intptr_t)handle, options.allow_writes ? 0 : _O_RDONLY);
+    if (fd < 0) CloseHandle(handle);
+    return fd;
+#else
+    int flags = options.allow_writes ? O_RDWR : O_RDONLY;
+    if (options.direct) flags |= O_DIRECT;
+    return open(path.c_str(), flags);
+#endif
+}
+
+static void close_replay_file(int fd) {
+#if defined(_WIN32)
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+/// True if a completion reports failure. libaio-win32 reports Win32 errors in res2; Linux a negative res.
+static bool event_failed(const struct io_event& event) {
+#if defined(_WIN32)
+    return event.res2 != 0;
+#else
+    return (long)event.res < 0;
+#endif
+}
+
+// --- Replay ---
+
+typedef std::chrono::steady_clock Clock;
+
+/// An in-flight request. Slots live as long as the replay, so the iocb stays valid until it is reaped.
+struct Slot {
+    struct iocb cb;
+    TraceOp* op;
+    void* buffer;
+    Clock::time_point submitted_at;
+};
+
+struct ReplayContext {
+    io_context_t ctx;
+    std::atomic<long> inflight;
+    std::thread reaper;
+};
+
+struct Replay {
+    std::vector<ReplayContext*> contexts;
+    std::atomic<bool> submitting;
+    std::atomic<long> inflight;
+    std::mutex wait_lock;
+    std::condition_variable wait_cv;
+    std::atomic<bool> submitter_waiting;
+};
+
+static void reap(Replay* replay, ReplayContext* context) {
+    struct io_event events[64];
+    for (;;) {
+        struct timespec timeout = { 0, 10 * 1000 * 1000 };
+        int n = io_getevents(context->ctx, 1, 64, events, &timeout);
+        Clock::time_point now = Clock::now();
+        for (int i = 0; i < n; ++i) {
+            Slot* slot = static_cast<Slot*>(events[i].data);
+            slot->op->replay_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - slot->submitted_at).count();
+            slot->op->replay_failed = event_failed(events[i]);
+            free_buffer(slot->buffer);
+        }
+        if (n > 0) {
+            context->inflight.fetch_sub(n);
+            replay->inflight.fetch_sub(n);
+            if (replay->submitter_waiting.load()) {
+                std::lock_guard<std::mutex> guard(replay->wait_lock);
+                replay->wait_cv.notify_one();
+            }
+        }
+        if (n <= 0 && !replay->submitting.load() && context->inflight.load() == 0) return;
+    }
+}
+
+/// Fills `cb` for a replayed op; direct I/O rounds the range out to whole sectors.
+static void prepare(struct iocb* cb, TraceOp& op, int fd, void* buffer, size_t length, long long offset, const Options& options) {
+    switch (op.opcode) {
+    case AIO_TRACE_OP_FSYNC:
+        io_prep_fsync(cb, fd);
+        break;
+    case AIO_TRACE_OP_FDSYNC:
+        io_prep_fdsync(cb, fd);
+        break;
+    case AIO_TRACE_OP_PWRITE:
+    case AIO_TRACE_OP_PWRITEV:
+        if (options.allow_writes) io_prep_pwrite(cb, fd, buffer, length, offset);
+        else io_prep_pread(cb, fd, buffer, length, offset);
+        break;
+    default:
+        io_prep_pread(cb, fd, buffer, length, offset);
+        break;
+    }
+}
+
+static bool run_replay(Trace& trace, const Options& options, double* elapsed_s, std::vector<int64_t>* lag_ns) {
+    std::vector<int> fds;
+    for (const std::string& path : trace.paths) {
+        int fd = open_replay_file(path, options);
+        if (fd < 0) {
+            fprintf(stderr, "aio-replay: cannot open %s: %s\n", path.c_str(), strerror(errno));
+            for (int open_fd : fds) close_replay_file(open_fd);
+            return false;
+        }
+        fds.push_back(fd);
+    }
+
+    Replay replay;
+    replay.submitting.store(true);
+    replay.inflight.store(0);
+    replay.submitter_waiting.store(false);
+    std::map<uint32_t, ReplayContext*> by_serial;
+    int nr_events = (int)std::max(options.fast ? options.max_inflight : trace.peak_inflight, 1u) + 64;
+    for (const TraceOp& op : trace.ops) {
+        if (by_serial.count(op.context)) continue;
+        ReplayContext* context = new ReplayContext();
+        context->ctx = 0;
+        context->inflight.store(0);
+        int result = io_setup(nr_events, &context->ctx);
+        if (result < 0) {
+            fprintf(stderr, "aio-replay: io_setup failed: %s\n", strerror(-result));
+            delete context;
+            for (ReplayContext* created : replay.contexts) {
+                io_destroy(created->ctx);
+                delete created;
+            }
+            for (int open_fd : fds) close_replay_file(open_fd);
+            return false;
+        }
+        by_serial[op.context] = context;
+        replay.contexts.push_back(context);
+    }
+    for (ReplayContext* context : replay.contexts) {
+        context->reaper = std::thread(reap, &replay, context);
+    }
+
+    std::vector<Slot> slots(trace.ops.size());
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < trace.ops.size(); ++i) {
+        TraceOp& op = trace.ops[i];
+        if (options.fast) {
+            while (replay.inflight.load() >= (long)options.max_inflight) {
+                std::unique_lock<std::mutex> guard(replay.wait_lock);
+                replay.submitter_waiting.store(true);
+                replay.wait_cv.wait_for(guard, std::chrono::milliseconds(1), [&] { return replay.inflight.load() < (long)options.max_inflight; });
+                replay.submitter_waiting.store(false);
+            }
+        }
+        else {
+            // Sleep most of the way, then spin, so submissions land within microseconds of their slot.
+            Clock::time_point due = start + std::chrono::nanoseconds((int64_t)(op.submit_ns / options.speed));
+            Clock::time_point now = Clock::now();
+            if (due - now > std::chrono::milliseconds(2)) std::this_thread::sleep_for(due - now - std::chrono::milliseconds(1));
+            while (Clock::now() < due) std::this_thread::yield();
+            lag_ns->push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count());
+        }
+
+        long long offset = op.offset;
+        size_t length = (size_t)op.length;
+        if (options.direct && length) {
+            long long end = offset + (long long)length;
+            offset -= offset % SECTOR_SIZE;
+            length = (size_t)((end - offset + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE);
+        }
+        Slot* slot = &slots[i];
+        slot->op = &op;
+        slot->buffer = alloc_buffer(length);
+        if (!slot->buffer) break;
+        memset(slot->buffer, 0xA5, length);
+        prepare(&slot->cb, op, fds[op.file], slot->buffer, length, offset, options);
+        slot->cb.data = slot;
+
+        ReplayContext* context = by_serial[op.context];
+        struct iocb* list[1] = { &slot->cb };
+        context->inflight.fetch_add(1);
+        replay.inflight.fetch_add(1);
+        slot->submitted_at = Clock::now();
+        int result;
+        while ((result = io_submit(context->ctx, 1, list)) == -EAGAIN) std::this_thread::yield();
+        if (result != 1) {
+            context->inflight.fetch_sub(1);
+            replay.inflight.fetch_sub(1);
+            free_buffer(slot->buffer);
+            op.replay_failed = true;
+        }
+    }
+    replay.submitting.store(false);
+    for (ReplayContext* context : replay.contexts) {
+        context->reaper.join();
+        io_destroy(context->ctx);
+        delete context;
+    }
+    *elapsed_s = std::chrono::duration<double>(Clock::now() - start).count();
+    for (int fd : fds) close_replay_file(fd);
+    return true;
+}
+
+// --- Report ---
+
+static double percentile(std::vector<int64_t>& values, double p) {
+    if (values.empty()) return 0;
+    size_t rank = (size_t)(p / 100.0 * (double)(values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    return (double)values[rank] / 1000.0;
+}
+
+static void report_class(const char* name, const Trace& trace, bool (*member)(uint8_t)) {
+    std::vector<int64_t> original, replayed;
+    for (const TraceOp& op : trace.ops) {
+        if (!member(op.opcode) || op.original_ns < 0 || op.replay_ns < 0) continue;
+        original.push_back(op.original_ns);
+        replayed.push_back(op.replay_ns);
+    }
+    if (original.empty()) return;
+
+    printf("\n%s latency, %zu requests (us)\n", name, original.size());
+    printf("  %-6s %12s %12s %12s\n", "", "original", "replay", "delta");
+    static const double points[] = { 50, 90, 99, 99.9, 100 };
+    static const char* labels[] = { "p50", "p90", "p99", "p99.9", "max" };
+    for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); ++i) {
+        double before = percentile(original, points[i]);
+        double after = percentile(replayed, points[i]);
+        double change = before > 0 ? (after - before) / before * 100.0 : 0;
+        printf("  %-6s %12.1f %12.1f %+11.1f%%\n", labels[i], before, after, change);
+    }
+}
+
+static bool is_any(uint8_t) { return true; }
+static bool is_read(uint8_t opcode) { return opcode == AIO_TRACE_OP_PREAD || opcode == AIO_TRACE_OP_PREADV || opcode == AIO_TRACE_OP_PREAD_SELECT; }
+static bool is_write(uint8_t opcode) { return opcode == AIO_TRACE_OP_PWRITE || opcode == AIO_TRACE_OP_PWRITEV; }
+static bool is_sync(uint8_t opcode) { return opcode == AIO_TRACE_OP_FSYNC || opcode == AIO_TRACE_OP_FDSYNC; }
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+    Trace trace;
+    if (!load_trace(options, &trace)) return 1;
+    if (trace.ops.empty()) {
+        fprintf(stderr, "aio-replay: the trace contains no requests\n");
+        return 1;
+    }
+
+    double recorded_s = (double)(trace.ops.back().submit_ns - trace.ops.front().submit_ns) / 1e9;
+    printf("trace: %zu requests on %zu files over %.3f s, peak %u in flight%s",
+        trace.ops.size(), trace.paths.size(), recorded_s, trace.peak_inflight, trace.complete ? "" : " (no end record)");
+    if (trace.dropped) printf(", %llu records dropped while recording", trace.dropped);
+    printf("\n");
+
+    double elapsed_s = 0;
+    std::vector<int64_t> lag_ns;
+    if (!run_replay(trace, options, &elapsed_s, &lag_ns)) return 1;
+
+    size_t failed = 0, originally_failed = 0;
+    for (const TraceOp& op : trace.ops) {
+        if (op.replay_failed) failed++;
+        if (op.original_failed) originally_failed++;
+    }
+    printf("replay: %s, %.3f s, %zu failed (%zu failed when recorded)\n",
+        options.fast ? "as fast as possible" : "recorded timing", elapsed_s, failed, originally_failed);
+    if (!lag_ns.empty()) {
+        printf("submission lag behind schedule: p50 %.1f us, p99 %.1f us\n", percentile(lag_ns, 50), percentile(lag_ns, 99));
+    }
+    report_class("all", trace, is_any);
+    report_class("read", trace, is_read);
+    report_class("write", trace, is_write);
+    report_class("sync", trace, is_sync);
+    return 0;
+}
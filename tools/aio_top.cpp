@@ -0,0 +1,285 @@
+/**
+ * @file aio_top.cpp
+ * @brief Live view of a process's libaio-win32 counters, read from its shared-memory stats segment.
+ *
+ * The watched process must have called io_stats_publish or run with LIBAIO_WIN32_STATS=1.
+ * aio-top maps the segment read-only, copies every slot through its seqlock once per interval,
+ * and shows the difference between consecutive copies: IOPS, bandwidth, requests in flight,
+ * latency percentiles and the busiest files. It never blocks the watched process.
+ */
+
+#include <windows.h>
+#include "libaio_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// --- Options ---
+
+struct Options {
+    DWORD pid = 0;
+    double interval_s = 1.0;
+    unsigned iterations = 0;    ///< 0 = until the process exits or aio-top is interrupted.
+    unsigned top_files = 10;
+};
+
+static void usage() {
+    fprintf(stderr,
+        "usage: aio-top [options] PID\n"
+        "  -i, --interval SECONDS  refresh interval (default 1)\n"
+        "  -n, --iterations N      stop after N refreshes (default: run until the process exits)\n"
+        "  --top N                 files listed (default 10)\n"
+        "The process must call io_stats_publish() or run with LIBAIO_WIN32_STATS=1.\n");
+}
+
+static bool parse_options(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if ((strcmp(arg, "-i") == 0 || strcmp(arg, "--interval") == 0) && value) { options->interval_s = atof(value); ++i; }
+        else if ((strcmp(arg, "-n") == 0 || strcmp(arg, "--iterations") == 0) && value) { options->iterations = (unsigned)atoi(value); ++i; }
+        else if (strcmp(arg, "--top") == 0 && value) { options->top_files = (unsigned)atoi(value); ++i; }
+        else if (arg[0] != '-' && !options->pid) options->pid = (DWORD)strtoul(arg, nullptr, 10);
+        else return false;
+    }
+    return options->pid != 0 && options->interval_s > 0;
+}
+
+// --- Segment Access ---
+
+/**
+ * @brief Copies a slot consistently: retries while its owner is changing or changed during the copy.
+ * @return false if the slot stayed busy, which only happens while contexts churn very quickly.
+ */
+template <typename Slot>
+static bool read_slot(const Slot* shared, Slot* copy) {
+    const volatile uint32_t* sequence = &shared->sequence;
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        uint32_t before = *sequence;
+        if (before & 1) {
+            YieldProcessor();
+            continue;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        memcpy(copy, shared, sizeof(Slot));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (*sequence == before) {
+            copy->sequence = before;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct Snapshot {
+    std::vector<aio_stats_context> contexts;    ///< Indexed by slot; unused slots have in_use == 0.
+    std::vector<aio_stats_file> files;
+    uint64_t untracked_contexts = 0;
+    uint64_t untracked_files = 0;
+    long long taken_at = 0;
+};
+
+static void take_snapshot(const aio_stats_header* header, Snapshot* snapshot) {
+    const aio_stats_context* contexts = reinterpret_cast<const aio_stats_context*>(header + 1);
+    const aio_stats_file* files = reinterpret_cast<const aio_stats_file*>(contexts + header->max_contexts);
+    snapshot->contexts.resize(header->max_contexts);
+    snapshot->files.resize(header->max_files);
+    for (unsigned i = 0; i < header->max_contexts; ++i) {
+        if (!read_slot(&contexts[i], &snapshot->contexts[i])) snapshot->contexts[i].in_use = 0;
+    }
+    for (unsigned i = 0; i < header->max_files; ++i) {
+        if (!read_slot(&files[i], &snapshot->files[i])) snapshot->files[i].in_use = 0;
+    }
+    snapshot->untracked_contexts = header->untracked_contexts;
+    snapshot->untracked_files = header->untracked_files;
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    snapshot->taken_at = now.QuadPart;
+}
+
+/**
+ * @brief Returns the copy that a slot's counters should be measured against.
+ *
+ * A slot whose sequence changed has a new owner whose counters started at zero, so it is
+ * measured against an all-zero slot and all of its current values count as new activity.
+ */
+template <typename Slot>
+static const Slot& baseline(const Slot& previous, const Slot& current) {
+    static const Slot zero = {};
+    return previous.in_use && previous.sequence == current.sequence ? previous : zero;
+}
+
+// --- Display ---
+
+/// Counters of one context, or of all of them, over one interval.
+struct Activity {
+    uint64_t completed[AIO_STATS_CLASSES] = {};
+    uint64_t bytes[AIO_STATS_CLASSES] = {};
+    uint64_t errors = 0;
+    uint64_t latency[AIO_STATS_CLASSES][AIO_STATS_LATENCY_BUCKETS] = {};
+    int64_t in_flight = 0;
+
+    void add(const Activity& other) {
+        for (int c = 0; c < AIO_STATS_CLASSES; ++c) {
+            completed[c] += other.completed[c];
+            bytes[c] += other.bytes[c];
+            for (int b = 0; b < AIO_STATS_LATENCY_BUCKETS; ++b) latency[c][b] += other.latency[c][b];
+        }
+        errors += other.errors;
+        in_flight += other.in_flight;
+    }
+};
+
+/// The latency below which `fraction` of the interval's requests of a class completed, in ns.
+static uint64_t percentile(const uint64_t* histogram, double fraction) {
+    uint64_t total = 0;
+    for (int b = 0; b < AIO_STATS_LATENCY_BUCKETS; ++b) total += histogram[b];
+    if (!total) return 0;
+    uint64_t rank = (uint64_t)(fraction * (double)total);
+    uint64_t seen = 0;
+    for (int b = 0; b < AIO_STATS_LATENCY_BUCKETS; ++b) {
+        seen += histogram[b];
+        if (seen > rank) return aio_stats_bucket_floor(b);
+    }
+    return aio_stats_bucket_floor(AIO_STATS_LATENCY_BUCKETS - 1);
+}
+
+static std::string format_latency(uint64_t ns) {
+    char text[16];
+    if (ns < 10000) snprintf(text, sizeof(text), "%lluns", (unsigned long long)ns);
+    else if (ns < 10000000) snprintf(text, sizeof(text), "%lluus", (unsigned long long)(ns / 1000));
+    else if (ns < 10000000000ULL) snprintf(text, sizeof(text), "%llums", (unsigned long long)(ns / 1000000));
+    else snprintf(text, sizeof(text), "%llus", (unsigned long long)(ns / 1000000000));
+    return text;
+}
+
+static std::string format_percentiles(const uint64_t* histogram) {
+    uint64_t total = 0;
+    for (int b = 0; b < AIO_STATS_LATENCY_BUCKETS; ++b) total += histogram[b];
+    if (!total) return "-";
+    return format_latency(percentile(histogram, 0.5)) + "/" + format_latency(percentile(histogram, 0.99)) + "/"
+        + format_latency(percentile(histogram, 0.999));
+}
+
+static void print_activity(const char* label, const Activity& activity, double seconds) {
+    printf("%6s %8.0f %8.0f %6.0f %8.1f %8.1f %7lld %6.0f  %-22s %-22s\n", label,
+        activity.completed[AIO_STATS_READ] / seconds, activity.completed[AIO_STATS_WRITE] / seconds,
+        activity.completed[AIO_STATS_SYNC] / seconds, activity.bytes[AIO_STATS_READ] / seconds / 1048576.0,
+        activity.bytes[AIO_STATS_WRITE] / seconds / 1048576.0, (long long)activity.in_flight, activity.errors / seconds,
+        format_percentiles(activity.latency[AIO_STATS_READ]).c_str(), format_percentiles(activity.latency[AIO_STATS_WRITE]).c_str());
+}
+
+static void print_frame(const Options& options, const Snapshot& previous, const Snapshot& current, double frequency, bool clear) {
+    double seconds = (double)(current.taken_at - previous.taken_at) / frequency;
+    if (clear) fputs("\x1b[H\x1b[J", stdout);
+
+    std::vector<std::pair<unsigned, Activity>> contexts;
+    Activity total;
+    for (size_t i = 0; i < current.contexts.size(); ++i) {
+        const aio_stats_context& now = current.contexts[i];
+        if (!now.in_use) continue;
+        const aio_stats_context& before = baseline(previous.contexts[i], now);
+        Activity activity;
+        for (int c = 0; c < AIO_STATS_CLASSES; ++c) {
+            activity.completed[c] = now.completed[c] - before.completed[c];
+            activity.bytes[c] = now.bytes[c] - before.bytes[c];
+            for (int b = 0; b < AIO_STATS_LATENCY_BUCKETS; ++b) {
+                activity.latency[c][b] = now.latency[c][b] - before.latency[c][b];
+            }
+        }
+        activity.errors = now.errors - before.errors;
+        activity.in_flight = (int64_t)(now.submitted - now.completed[0] - now.completed[1] - now.completed[2]);
+        contexts.emplace_back(now.context, activity);
+        total.add(activity);
+    }
+    std::sort(contexts.begin(), contexts.end(), [](const std::pair<unsigned, Activity>& a, const std::pair<unsigned, Activity>& b) { return a.first < b.first; });
+
+    size_t file_count = 0;
+    for (const aio_stats_file& file : current.files) file_count += file.in_use ? 1 : 0;
+    printf("aio-top  pid %lu  interval %.1f s  contexts %zu  files %zu", (unsigned long)options.pid, seconds, contexts.size(), file_count);
+    if (current.untracked_contexts || current.untracked_files) {
+        printf("  (untracked: %llu contexts, %llu files)", (unsigned long long)current.untracked_contexts, (unsigned long long)current.untracked_files);
+    }
+    printf("\n\n%6s %8s %8s %6s %8s %8s %7s %6s  %-22s %-22s\n", "ctx", "read/s", "write/s", "sync/s", "rd MiB/s", "wr MiB/s",
+        "flight", "err/s", "read p50/p99/p99.9", "write p50/p99/p99.9");
+    for (const auto& context : contexts) {
+        char label[16];
+        snprintf(label, sizeof(label), "%u", context.first);
+        print_activity(label, context.second, seconds);
+    }
+    if (contexts.size() > 1) print_activity("all", total, seconds);
+
+    // Files are ranked by operations per second over the interval.
+    struct FileRow { double ops; double bytes; const aio_stats_file* file; };
+    std::vector<FileRow> rows;
+    for (size_t i = 0; i < current.files.size(); ++i) {
+        const aio_stats_file& now = current.files[i];
+        if (!now.in_use) continue;
+        const aio_stats_file& before = baseline(previous.files[i], now);
+        double ops = 0, bytes = 0;
+        for (int c = 0; c < AIO_STATS_CLASSES; ++c) {
+            ops += (double)(now.ops[c] - before.ops[c]);
+            bytes += (double)(now.bytes[c] - before.bytes[c]);
+        }
+        if (ops > 0) rows.push_back({ ops / seconds, bytes / seconds, &now });
+    }
+    std::sort(rows.begin(), rows.end(), [](const FileRow& a, const FileRow& b) { return a.ops > b.ops; });
+    printf("\n%10s %10s %6s %6s  %s\n", "ops/s", "MiB/s", "ctx", "fd", "file");
+    for (size_t i = 0; i < rows.size() && i < options.top_files; ++i) {
+        printf("%10.0f %10.1f %6u %6d  %.*s\n", rows[i].ops, rows[i].bytes / 1048576.0, rows[i].file->context, rows[i].file->fd,
+            AIO_STATS_PATH_MAX, rows[i].file->path);
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s%lu", AIO_STATS_NAME_PREFIX, (unsigned long)options.pid);
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!mapping) {
+        fprintf(stderr, "aio-top: process %lu publishes no libaio-win32 stats (error %lu)\n", (unsigned long)options.pid, GetLastError());
+        return 1;
+    }
+    const aio_stats_header* header = static_cast<const aio_stats_header*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!header || memcmp(header->magic, AIO_STATS_MAGIC, sizeof(header->magic)) != 0 || header->version != AIO_STATS_VERSION
+        || header->context_size != sizeof(aio_stats_context) || header->file_size != sizeof(aio_stats_file)) {
+        fprintf(stderr, "aio-top: the stats segment of process %lu has an unknown layout\n", (unsigned long)options.pid);
+        return 1;
+    }
+
+    // Waiting on the process doubles as the refresh timer and notices when it exits.
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, options.pid);
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    bool clear = GetConsoleMode(console, &mode) && SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    Snapshot previous, current;
+    take_snapshot(header, &previous);
+    bool exited = false;
+    for (unsigned frame = 0; !exited && (options.iterations == 0 || frame < options.iterations); ++frame) {
+        DWORD wait_ms = (DWORD)(options.interval_s * 1000);
+        if (process) exited = WaitForSingleObject(process, wait_ms) == WAIT_OBJECT_0;
+        else Sleep(wait_ms);
+        take_snapshot(header, &current);
+        print_frame(options, previous, current, (double)frequency.QuadPart, clear);
+        std::swap(previous, current);
+    }
+    if (exited) printf("\nprocess %lu exited\n", (unsigned long)options.pid);
+    if (process) CloseHandle(process);
+    UnmapViewOfFile(header);
+    CloseHandle(mapping);
+    return 0;
+}
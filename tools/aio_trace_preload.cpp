@@ -0,0 +1,435 @@
+/**
+ * @file aio_trace_preload.cpp
+ * @brief Records libaio traces on Linux, where applications call the native libaio directly.
+ *
+ * Built as a shared object and loaded with LD_PRELOAD, it wraps io_setup, io_submit,
+ * io_getevents and io_destroy and writes the same trace format as libaio-win32
+ * (libaio_trace.h), so aio-replay handles traces from either platform:
+ *
+ *     LIBAIO_WIN32_TRACE=app.trace LD_PRELOAD=./libaio_trace_preload.so ./app
+ *
+ * Recording works like the Windows library's: threads append records to a bounded lock-free
+ * ring and a background thread writes them out every few milliseconds, dropping and counting
+ * records if it falls behind. close() is wrapped too, so a reused descriptor gets a new path record.
+ *
+ * The wrappers are also USDT probes, provider libaio_win32, which bpftrace can attach to in a
+ * running process with or without a trace file (tools/aio_latency.bt, tools/aio_events.bt):
+ *
+ *     setup      (ctx, maxevents, result)
+ *     submit     (ctx, iocb, opcode, fd, offset, length, submitted_ns)   per accepted iocb
+ *     complete   (ctx, iocb, opcode, res, res2)                          per reaped event
+ *     getevents  (ctx, min_nr, nr, result, waited_ns)
+ *     destroy    (ctx, result)
+ *
+ * submitted_ns is CLOCK_MONOTONIC on entry to io_submit, bpftrace's nsecs, so a completion's
+ * latency is nsecs at its complete probe less the submit probe's submitted_ns. Each probe has a
+ * semaphore that the tracer raises while attached; until then its arguments are not computed.
+ * Without <sys/sdt.h> (systemtap-sdt-dev) the probes compile to nothing.
+ */
+
+#include "libaio_trace.h"
+
+#include "libaio_win32.h"  // libaio's declarations; the native libaio's where installed
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define AIO_PROBES 1
+#endif
+#endif
+
+#ifdef AIO_PROBES
+#define AIO_PROBE_SEMAPHORE(name) \
+    __attribute__((visibility("hidden"), section(".probes"))) volatile unsigned short libaio_win32_##name##_semaphore
+AIO_PROBE_SEMAPHORE(setup);
+AIO_PROBE_SEMAPHORE(submit);
+AIO_PROBE_SEMAPHORE(complete);
+AIO_PROBE_SEMAPHORE(getevents);
+AIO_PROBE_SEMAPHORE(destroy);
+#define AIO_PROBE_ENABLED(name) (__builtin_expect(libaio_win32_##name##_semaphore != 0, 0))
+#else
+template <typename... Args>
+inline void aio_no_probe(const Args&...) {}
+#define AIO_PROBE_ENABLED(name) false
+#define DTRACE_PROBE2(provider, name, ...) aio_no_probe(__VA_ARGS__)
+#define DTRACE_PROBE3(provider, name, ...) aio_no_probe(__VA_ARGS__)
+#define DTRACE_PROBE5(provider, name, ...) aio_no_probe(__VA_ARGS__)
+#define DTRACE_PROBE7(provider, name, ...) aio_no_probe(__VA_ARGS__)
+#endif
+
+namespace {
+
+// --- Recorder ---
+
+const unsigned RING_SIZE = 65536;
+const unsigned BATCH_SIZE = 1024;
+const unsigned FD_TABLE_SIZE = 65536;  ///< Descriptors at or above this get a path record on every submission.
+
+struct Slot {
+    std::atomic<unsigned long long> sequence;
+    aio_trace_record record;
+};
+
+struct Recorder {
+    int fd = -1;
+    long long start_ns = 0;
+    Slot* slots = nullptr;
+    alignas(64) std::atomic<unsigned long long> enqueue_position{ 0 };
+    alignas(64) unsigned long long dequeue_position = 0;
+    std::atomic<unsigned long long> dropped{ 0 };
+    std::atomic<unsigned> fd_traced[FD_TABLE_SIZE];    ///< Context serial + 1 that recorded the fd's path, or 0.
+    std::mutex write_lock;                              ///< Serializes path records with ring flushes.
+    std::thread flusher;
+    std::mutex stop_lock;
+    std::condition_variable stop_cv;
+    std::atomic<bool> stopping{ false };                ///< Set once the trace file is closed.
+    aio_trace_record batch[BATCH_SIZE];
+};
+
+Recorder* g_recorder;   // Set once by the constructor; null when not recording.
+std::atomic<unsigned> g_next_context_serial{ 0 };
+
+typedef int (*io_setup_fn)(int, io_context_t*);
+typedef int (*io_submit_fn)(io_context_t, long, struct iocb**);
+typedef int (*io_getevents_fn)(io_context_t, long, long, struct io_event*, struct timespec*);
+typedef int (*io_destroy_fn)(io_context_t);
+typedef int (*close_fn)(int);
+
+io_setup_fn real_io_setup;
+io_submit_fn real_io_submit;
+io_getevents_fn real_io_getevents;
+io_destroy_fn real_io_destroy;
+close_fn real_close;
+
+long long now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * Contexts are numbered on first sight; a per-thread cache keeps the lookup off the hot path.
+ * io_destroy bumps the generation, which invalidates every thread's cache: libaio may hand the
+ * destroyed context's address to the next io_setup, on any thread, and that context needs a new serial.
+ */
+struct ContextSerial {
+    io_context_t ctx;
+    unsigned serial;
+    unsigned generation;
+};
+const unsigned CONTEXT_TABLE_SIZE = 1024;
+std::mutex g_contexts_lock;
+ContextSerial g_contexts[CONTEXT_TABLE_SIZE];
+unsigned g_context_count;
+std::atomic<unsigned> g_context_generation{ 1 };
+thread_local ContextSerial t_last_context;
+
+unsigned context_serial(io_context_t ctx) {
+    unsigned generation = g_context_generation.load(std::memory_order_acquire);
+    if (t_last_context.ctx == ctx && t_last_context.generation == generation) return t_last_context.serial;
+    std::lock_guard<std::mutex> guard(g_contexts_lock);
+    unsigned serial = ~0u;
+    for (unsigned i = 0; i < g_context_count; ++i) {
+        if (g_contexts[i].ctx == ctx) serial = g_contexts[i].serial;
+    }
+    if (serial == ~0u) {
+        serial = g_next_context_serial.fetch_add(1);
+        if (g_context_count < CONTEXT_TABLE_SIZE) g_contexts[g_context_count++] = ContextSerial{ ctx, serial, 0 };
+    }
+    t_last_context = ContextSerial{ ctx, serial, generation };
+    return serial;
+}
+
+void forget_context(io_context_t ctx) {
+    std::lock_guard<std::mutex> guard(g_contexts_lock);
+    for (unsigned i = 0; i < g_context_count; ++i) {
+        if (g_contexts[i].ctx == ctx) g_contexts[i] = g_contexts[--g_context_count];
+    }
+    g_context_generation.fetch_add(1, std::memory_order_release);
+}
+
+void push(const aio_trace_record& record) {
+    Recorder* recorder = g_recorder;
+    unsigned long long position = recorder->enqueue_position.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &recorder->slots[position & (RING_SIZE - 1)];
+        long long lag = (long long)(slot->sequence.load(std::memory_order_acquire) - position);
+        if (lag == 0) {
+            if (recorder->enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        }
+        else if (lag < 0) {
+            recorder->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            position = recorder->enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+    slot->record = record;
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void write_all(const void* data, size_t length) {
+    const char* bytes = static_cast<const char*>(data);
+    while (length) {
+        ssize_t written = write(g_recorder->fd, bytes, length);
+        if (written <= 0) return;
+        bytes += written;
+        length -= (size_t)written;
+    }
+}
+
+void flush() {
+    Recorder* recorder = g_recorder;
+    std::lock_guard<std::mutex> guard(recorder->write_lock);
+    unsigned batched = 0;
+    for (;;) {
+        Slot* slot = &recorder->slots[recorder->dequeue_position & (RING_SIZE - 1)];
+        if (slot->sequence.load(std::memory_order_acquire) != recorder->dequeue_position + 1) break;
+        recorder->batch[batched++] = slot->record;
+        slot->sequence.store(recorder->dequeue_position + RING_SIZE, std::memory_order_release);
+        recorder->dequeue_position++;
+        if (batched == BATCH_SIZE) {
+            write_all(recorder->batch, batched * sizeof(aio_trace_record));
+            batched = 0;
+        }
+    }
+    if (batched) write_all(recorder->batch, batched * sizeof(aio_trace_record));
+}
+
+/**
+ * Writes the path behind `fd` the first time a context submits to it. The timestamp is taken
+ * before the descriptor is marked, so it precedes every submission that skips this step.
+ */
+void trace_file(unsigned serial, int fd) {
+    Recorder* recorder = g_recorder;
+    long long seen_at = now_ns() - recorder->start_ns;
+    if (fd >= 0 && (unsigned)fd < FD_TABLE_SIZE) {
+        unsigned expected = 0;
+        if (!recorder->fd_traced[fd].compare_exchange_strong(expected, serial + 1)) return;
+    }
+    char link[64], path[4096];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t length = readlink(link, path, sizeof(path));
+    if (length < 0 || length == (ssize_t)sizeof(path)) length = 0;
+
+    aio_trace_record record = {};
+    record.kind = AIO_TRACE_FILE;
+    record.fd = fd;
+    record.context = serial;
+    record.length = (uint64_t)length;
+    record.ticks = seen_at;
+    static const char padding[sizeof(aio_trace_record)] = {};
+
+    std::lock_guard<std::mutex> guard(recorder->write_lock);
+    if (recorder->stopping.load()) return;
+    write_all(&record, sizeof(record));
+    write_all(path, (size_t)length);
+    write_all(padding, (sizeof(record) - (size_t)length % sizeof(record)) % sizeof(record));
+}
+
+bool is_vectored(const struct iocb* cb) {
+    return cb->aio_lio_opcode == IO_CMD_PREADV || cb->aio_lio_opcode == IO_CMD_PWRITEV;
+}
+
+/// Bytes a read or write asks for, its segments' total if vectored; 0 for a sync.
+unsigned long long requested_length(const struct iocb* cb) {
+    unsigned long long length = 0;
+    if (is_vectored(cb)) {
+        for (int s = 0; s < cb->u.v.nr; ++s) length += cb->u.v.vec[s].iov_len;
+    }
+    else if (cb->aio_lio_opcode == IO_CMD_PREAD || cb->aio_lio_opcode == IO_CMD_PWRITE) {
+        length = cb->u.c.nbytes;
+    }
+    return length;
+}
+
+void fill(aio_trace_record* record, uint8_t kind, unsigned serial, const struct iocb* cb) {
+    *record = aio_trace_record();
+    record->kind = kind;
+    record->opcode = (uint8_t)cb->aio_lio_opcode; // Linux numbering is the trace's numbering.
+    record->segments = is_vectored(cb) ? (uint16_t)cb->u.v.nr : 0;
+    record->fd = cb->aio_fildes;
+    record->context = serial;
+    record->id = (uint64_t)(uintptr_t)cb;
+    record->offset = is_vectored(cb) ? cb->u.v.offset : cb->u.c.offset;
+}
+
+void flusher_main() {
+    std::unique_lock<std::mutex> guard(g_recorder->stop_lock);
+    while (!g_recorder->stopping.load()) {
+        g_recorder->stop_cv.wait_for(guard, std::chrono::milliseconds(5));
+        flush();
+    }
+}
+
+template <typename T>
+T resolve(const char* name) {
+    return reinterpret_cast<T>(dlsym(RTLD_NEXT, name));
+}
+
+__attribute__((constructor)) void start_recording() {
+    real_io_setup = resolve<io_setup_fn>("io_setup");
+    real_io_submit = resolve<io_submit_fn>("io_submit");
+    real_io_getevents = resolve<io_getevents_fn>("io_getevents");
+    real_io_destroy = resolve<io_destroy_fn>("io_destroy");
+    real_close = resolve<close_fn>("close");
+
+    const char* path = getenv("LIBAIO_WIN32_TRACE");
+    if (!path || !*path) return;
+    Recorder* recorder = new Recorder();
+    recorder->slots = new Slot[RING_SIZE];
+    for (unsigned i = 0; i < RING_SIZE; ++i) recorder->slots[i].sequence.store(i, std::memory_order_relaxed);
+    for (unsigned i = 0; i < FD_TABLE_SIZE; ++i) recorder->fd_traced[i].store(0, std::memory_order_relaxed);
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (recorder->fd < 0) {
+        fprintf(stderr, "libaio_trace_preload: cannot create %s\n", path);
+        delete[] recorder->slots;
+        delete recorder;
+        return;
+    }
+    recorder->start_ns = now_ns();
+    g_recorder = recorder;
+
+    aio_trace_header header = {};
+    memcpy(header.magic, AIO_TRACE_MAGIC, sizeof(header.magic));
+    header.version = AIO_TRACE_VERSION;
+    header.record_size = sizeof(aio_trace_record);
+    header.ticks_per_second = 1000000000LL;
+    write_all(&header, sizeof(header));
+    recorder->flusher = std::thread(flusher_main);
+}
+
+__attribute__((destructor)) void stop_recording() {
+    Recorder* recorder = g_recorder;
+    if (!recorder) return;
+    {
+        std::lock_guard<std::mutex> guard(recorder->stop_lock);
+        recorder->stopping.store(true);
+    }
+    recorder->stop_cv.notify_one();
+    recorder->flusher.join();
+    flush();
+
+    aio_trace_record end = {};
+    end.kind = AIO_TRACE_END;
+    end.length = recorder->dropped.load();
+    end.ticks = now_ns() - recorder->start_ns;
+    std::lock_guard<std::mutex> guard(recorder->write_lock);
+    write_all(&end, sizeof(end));
+    real_close(recorder->fd);
+    recorder->fd = -1;
+    // The ring stays allocated: threads that outlive the destructors may still append to it.
+}
+
+} // namespace
+
+// --- Interposed Entry Points ---
+
+extern "C" int io_setup(int maxevents, io_context_t* ctxp) {
+    int result = real_io_setup(maxevents, ctxp);
+    if (result == 0 && g_recorder) context_serial(*ctxp);
+    if (AIO_PROBE_ENABLED(setup)) DTRACE_PROBE3(libaio_win32, setup, result == 0 ? *ctxp : nullptr, maxevents, result);
+    return result;
+}
+
+extern "C" int io_destroy(io_context_t ctx) {
+    if (g_recorder) forget_context(ctx);
+    int result = real_io_destroy(ctx);
+    if (AIO_PROBE_ENABLED(destroy)) DTRACE_PROBE2(libaio_win32, destroy, ctx, result);
+    return result;
+}
+
+extern "C" int io_submit(io_context_t ctx, long nr, struct iocb** iocbs) {
+    bool probing = AIO_PROBE_ENABLED(submit);
+    if (!g_recorder && !probing) return real_io_submit(ctx, nr, iocbs);
+
+    // The kernel fails a null iocb with -EFAULT, or stops submission before it.
+    if (nr > 0 && !iocbs) return -EFAULT;
+    for (long i = 0; i < nr; ++i) {
+        if (iocbs[i]) continue;
+        if (i == 0) return -EFAULT;
+        nr = i;
+        break;
+    }
+    unsigned serial = 0;
+    if (g_recorder) {
+        serial = context_serial(ctx);
+        for (long i = 0; i < nr; ++i) {
+            int fd = iocbs[i]->aio_fildes;
+            if (fd < 0 || (unsigned)fd >= FD_TABLE_SIZE || g_recorder->fd_traced[fd].load(std::memory_order_relaxed) == 0) {
+                trace_file(serial, fd);
+            }
+        }
+    }
+    long long submitted_at = now_ns();
+    int result = real_io_submit(ctx, nr, iocbs);
+    for (long i = 0; i < result; ++i) {
+        const struct iocb* cb = iocbs[i];
+        unsigned long long length = requested_length(cb);
+        if (g_recorder) {
+            aio_trace_record record;
+            fill(&record, AIO_TRACE_SUBMIT, serial, cb);
+            record.length = length;
+            record.ticks = submitted_at - g_recorder->start_ns;
+            push(record);
+        }
+        if (probing) {
+            long long offset = is_vectored(cb) ? cb->u.v.offset : cb->u.c.offset;
+            DTRACE_PROBE7(libaio_win32, submit, ctx, cb, (int)cb->aio_lio_opcode, cb->aio_fildes, offset, length, submitted_at);
+        }
+    }
+    return result;
+}
+
+extern "C" int io_getevents(io_context_t ctx, long min_nr, long nr, struct io_event* events, struct timespec* timeout) {
+    long long entered_at = AIO_PROBE_ENABLED(getevents) ? now_ns() : 0;
+    int result = real_io_getevents(ctx, min_nr, nr, events, timeout);
+    if (AIO_PROBE_ENABLED(getevents)) {
+        long long waited = entered_at ? now_ns() - entered_at : 0; // 0 if the tracer attached meanwhile.
+        DTRACE_PROBE5(libaio_win32, getevents, ctx, min_nr, nr, result, waited);
+    }
+    if (result <= 0) return result;
+    if (AIO_PROBE_ENABLED(complete)) {
+        for (int i = 0; i < result; ++i) {
+            DTRACE_PROBE5(libaio_win32, complete, ctx, events[i].obj, (int)events[i].obj->aio_lio_opcode, (long)events[i].res, (long)events[i].res2);
+        }
+    }
+    if (!g_recorder) return result;
+
+    unsigned serial = context_serial(ctx);
+    long long completed_at = now_ns() - g_recorder->start_ns;
+    for (int i = 0; i < result; ++i) {
+        aio_trace_record record;
+        fill(&record, AIO_TRACE_COMPLETE, serial, events[i].obj);
+        long res = (long)events[i].res;
+        record.error = res < 0 ? (uint32_t)-res : 0;
+        record.length = res < 0 ? 0 : (uint64_t)res;
+        record.ticks = completed_at;
+        push(record);
+    }
+    return result;
+}
+
+extern "C" int close(int fd) {
+    if (!real_close) real_close = resolve<close_fn>("close"); // close() may run before our constructor.
+    if (g_recorder && fd >= 0 && (unsigned)fd < FD_TABLE_SIZE) {
+        g_recorder->fd_traced[fd].store(0, std::memory_order_relaxed);
+    }
+    return real_close(fd);
+}
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+"""Plots the CSVs written by `aio-bench --scale --csv`.
+
+Draws one row of charts per engine and queue depth: throughput, scaling efficiency, CPU per request
+and p99 latency against the number of threads, with one line per context layout and batch size. Several
+CSVs, such as a null and a simulated run, or a Windows and a Linux run, go in one figure.
+
+usage: plot_scaling.py [-o OUT.png] SCALE.csv...
+"""
+
+import argparse
+import csv
+import sys
+from collections import defaultdict
+
+CHARTS = [
+    ("iops", "IOPS", False),
+    ("efficiency", "IOPS per thread vs. fewest threads", False),
+    ("cpu_us_per_op", "CPU us per request", True),
+    ("p99_us", "p99 latency us", True),
+]
+
+
+def load(paths):
+    rows = []
+    for path in paths:
+        with open(path, newline="") as f:
+            reader = csv.DictReader(f)
+            if "threads" not in (reader.fieldnames or []):
+                sys.exit(f"plot_scaling: {path} was not written by aio-bench --scale --csv")
+            rows.extend(reader)
+    return rows
+
+
+def number(row, column):
+    value = row.get(column, "")
+    return float(value) if value else None
+
+
+def panel_title(platform, backend, sim_latency, qd):
+    engine = f"{platform}/{backend}"
+    if sim_latency:
+        engine += f" ({sim_latency} us)"
+    return f"{engine}, qd {qd} per thread"
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Plot aio-bench --scale results.")
+    parser.add_argument("csv", nargs="+", help="CSV files written by aio-bench --scale --csv")
+    parser.add_argument("-o", "--output", default="scaling.png", help="image to write (default scaling.png)")
+    args = parser.parse_args()
+
+    # Imported late so --help works without matplotlib.
+    import matplotlib
+    matplotlib.use("Agg")
+    import matplotlib.pyplot as plt
+
+    panels = defaultdict(lambda: defaultdict(list))
+    for row in load(args.csv):
+        panel = (row["platform"], row["backend"], row["sim_latency_us"], int(row["qd"]))
+        series = (row["contexts"], int(row["batch"]))
+        panels[panel][series].append(row)
+    if not panels:
+        sys.exit("plot_scaling: no rows to plot")
+
+    figure, axes = plt.subplots(len(panels), len(CHARTS), figsize=(5 * len(CHARTS), 3.6 * len(panels)), squeeze=False)
+    for line, (panel, series_rows) in enumerate(sorted(panels.items())):
+        for column, (field, label, log_scale) in enumerate(CHARTS):
+            ax = axes[line][column]
+            for (contexts, batch), rows in sorted(series_rows.items()):
+                points = sorted((int(r["threads"]), number(r, field)) for r in rows)
+                points = [(t, v) for t, v in points if v is not None]
+                if not points:
+                    continue
+                layout = "context per thread" if contexts == "thread" else f"{contexts} context{'s' if contexts != '1' else ''}"
+                ax.plot([t for t, _ in points], [v for _, v in points], marker="o", label=f"{layout}, batch {batch}")
+            if field == "efficiency":
+                ax.axhline(1.0, color="grey", linewidth=0.8, linestyle=":")
+            ax.set_xscale("log", base=2)
+            if log_scale:
+                ax.set_yscale("log")
+            ax.set_xlabel("threads")
+            ax.set_ylabel(label)
+            ax.set_title(panel_title(*panel), fontsize=9)
+            ax.grid(True, which="both", alpha=0.3)
+        axes[line][0].legend(fontsize=7)
+
+    figure.tight_layout()
+    figure.savefig(args.output, dpi=120)
+    print(f"plot_scaling: wrote {args.output}")
+
+
+if __name__ == "__main__":
+    main()